@@ -26,7 +26,7 @@ class TrafficApp : public AppBase {
           std::make_shared<Variable>("ssd_output", ssd_output)};
     };
     auto func2 = [&](std::shared_ptr<RequestContext> ctx) {
-      auto ssd_output = ctx->GetVariable("ssd_output")->result();
+      auto ssd_output = ctx->GetVariable(ssd_output_var_)->result();
       std::vector<std::shared_ptr<QueryResult> > results;
       std::vector<RectProto> car_boxes;
       std::vector<RectProto> face_boxes;
@@ -51,7 +51,7 @@ class TrafficApp : public AppBase {
           std::make_shared<Variable>("rec_output", results)};
     };
     auto func3 = [&](std::shared_ptr<RequestContext> ctx) {
-      auto rec_output = ctx->GetVariable("rec_output");
+      auto rec_output = ctx->GetVariable(rec_output_var_);
       if (rec_output->count() > 0) {
         rec_output->result()->ToProto(ctx->reply());
       }
@@ -61,6 +61,8 @@ class TrafficApp : public AppBase {
     ExecBlock* b2 = new ExecBlock(1, func2, {"ssd_output"});
     ExecBlock* b3 = new ExecBlock(2, func3, {"rec_output"});
     qp_ = new QueryProcessor({b1, b2, b3});
+    ssd_output_var_ = qp_->plan().VariableIndex("ssd_output");
+    rec_output_var_ = qp_->plan().VariableIndex("rec_output");
   }
 
  private:
@@ -79,6 +81,8 @@ class TrafficApp : public AppBase {
   std::shared_ptr<ModelHandler> ssd_model_;
   std::shared_ptr<ModelHandler> car_model_;
   std::shared_ptr<ModelHandler> face_model_;
+  int ssd_output_var_;
+  int rec_output_var_;
 };
 
 DEFINE_string(port, "9001", "Server port");
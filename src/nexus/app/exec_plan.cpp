@@ -0,0 +1,158 @@
+#include "nexus/app/exec_plan.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "nexus/app/exec_block.h"
+
+namespace nexus {
+namespace app {
+
+ExecPlan::ExecPlan(const std::vector<ExecBlock*>& blocks) : blocks_(blocks) {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    auto deps = blocks_[i]->dependency();
+    num_dependencies_.push_back(deps.size());
+    for (const auto& name : deps) {
+      auto iter = var_index_.emplace(name, consumers_.size()).first;
+      if (iter->second == static_cast<int>(consumers_.size())) {
+        consumers_.emplace_back();
+      }
+      consumers_[iter->second].push_back(i);
+    }
+  }
+}
+
+int ExecPlan::VariableIndex(const std::string& name) const {
+  auto iter = var_index_.find(name);
+  if (iter == var_index_.end()) {
+    return -1;
+  }
+  return iter->second;
+}
+
+void ExecState::Init(const ExecPlan* plan) {
+  CHECK(plan_ == nullptr) << "Execution state is already initialized";
+  plan_ = plan;
+  num_unscheduled_blocks_.store(plan->num_blocks());
+  num_pending_deps_.reset(new std::atomic<int>[plan->num_blocks()]);
+  vars_.resize(plan->num_variables());
+  ready_blocks_.reserve(plan->num_blocks());
+  for (size_t i = 0; i < plan->num_blocks(); ++i) {
+    num_pending_deps_[i].store(plan->num_dependencies(i));
+    if (plan->num_dependencies(i) == 0) {
+      ready_blocks_.push_back(plan->block(i));
+    }
+  }
+}
+
+ExecBlock* ExecState::NextReadyBlock() {
+  if (next_ready_block_ == ready_blocks_.size()) {
+    return nullptr;
+  }
+  num_unscheduled_blocks_.fetch_sub(1);
+  return ready_blocks_[next_ready_block_++];
+}
+
+bool ExecState::AddBlockReturn(const std::vector<VariablePtr>& vars) {
+  bool any_ready = false;
+  for (const auto& var : vars) {
+    int index = plan_->VariableIndex(var->name());
+    if (index < 0) {
+      continue;
+    }
+    if (vars_[index] != nullptr) {
+      LOG(ERROR) << "Variable " << var->name() << " is returned twice";
+      continue;
+    }
+    vars_[index] = var;
+    AddPendingQueries(var, index);
+    if (var->ready()) {
+      any_ready |= SetVariableReady(index);
+    }
+  }
+  return any_ready;
+}
+
+bool ExecState::AddQueryResult(const QueryResultProto& result) {
+  uint64_t qid = result.query_id();
+  auto iter = std::find_if(
+      waiting_queries_.begin(), waiting_queries_.end(),
+      [qid](const std::pair<uint64_t, int>& q) { return q.first == qid; });
+  if (iter == waiting_queries_.end()) {
+    dangling_results_.push_back(result);
+    return false;
+  }
+  int index = iter->second;
+  waiting_queries_.erase(iter);
+  const auto& var = index < static_cast<int>(vars_.size())
+                        ? vars_[index]
+                        : continuations_[index - vars_.size()].first;
+  if (var->AddQueryResult(result)) {
+    return SetVariableReady(index);
+  }
+  return false;
+}
+
+Continuation ExecState::NextReadyContinuation() {
+  if (next_ready_continuation_ == ready_continuations_.size()) {
+    return nullptr;
+  }
+  int i = ready_continuations_[next_ready_continuation_++];
+  num_pending_continuations_.fetch_sub(1);
+  continuations_[i].first = nullptr;
+  return std::move(continuations_[i].second);
+}
+
+void ExecState::AddContinuation(VariablePtr var, Continuation continuation) {
+  int index = vars_.size() + continuations_.size();
+  continuations_.emplace_back(var, std::move(continuation));
+  num_pending_continuations_.fetch_add(1);
+  AddPendingQueries(var, index);
+  if (var->ready()) {
+    SetVariableReady(index);
+  }
+}
+
+void ExecState::AddPendingQueries(const VariablePtr& var, int index) {
+  // AddQueryResult removes the result from pending_results, so iterate
+  // backwards.
+  const auto& pending = var->pending_results();
+  for (size_t i = pending.size(); i-- > 0;) {
+    uint64_t qid = pending[i]->query_id();
+    auto iter = std::find_if(
+        dangling_results_.begin(), dangling_results_.end(),
+        [qid](const QueryResultProto& r) { return r.query_id() == qid; });
+    if (iter != dangling_results_.end()) {
+      var->AddQueryResult(*iter);
+      dangling_results_.erase(iter);
+    } else {
+      waiting_queries_.emplace_back(qid, index);
+    }
+  }
+}
+
+void ExecState::Cancel() {
+  next_ready_block_ = ready_blocks_.size();
+  num_unscheduled_blocks_.store(0);
+  next_ready_continuation_ = ready_continuations_.size();
+  num_pending_continuations_.store(0);
+}
+
+bool ExecState::SetVariableReady(int index) {
+  if (index >= static_cast<int>(vars_.size())) {
+    ready_continuations_.push_back(index - vars_.size());
+    return true;
+  }
+  bool any_ready = false;
+  for (int block_index : plan_->consumers(index)) {
+    if (num_pending_deps_[block_index].fetch_sub(1) == 1) {
+      ready_blocks_.push_back(plan_->block(block_index));
+      any_ready = true;
+    }
+  }
+  return any_ready;
+}
+
+}  // namespace app
+}  // namespace nexus
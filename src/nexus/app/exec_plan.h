@@ -0,0 +1,157 @@
+#ifndef NEXUS_APP_EXEC_PLAN_H_
+#define NEXUS_APP_EXEC_PLAN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "nexus/app/variable.h"
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+namespace app {
+
+class ExecBlock;
+class RequestContext;
+
+/*!
+ * \brief Code that runs on a frontend worker once the query results it waits
+ *   for are ready. See RequestContext::Then.
+ */
+using Continuation = std::function<void(std::shared_ptr<RequestContext>)>;
+
+/*!
+ * \brief The ExecBlocks of a QueryProcessor compiled into integer indices.
+ *   Each variable required by a block gets an index, and each block the
+ *   number of variables it waits for. It is built once when the app starts
+ *   and shared by all requests.
+ */
+class ExecPlan {
+ public:
+  explicit ExecPlan(const std::vector<ExecBlock*>& blocks);
+
+  size_t num_blocks() const { return blocks_.size(); }
+
+  size_t num_variables() const { return consumers_.size(); }
+
+  ExecBlock* block(int index) const { return blocks_[index]; }
+
+  /*! \brief Number of variables required by the block. */
+  int num_dependencies(int block_index) const {
+    return num_dependencies_[block_index];
+  }
+
+  /*! \brief Indices of the blocks that require the variable. */
+  const std::vector<int>& consumers(int var_index) const {
+    return consumers_[var_index];
+  }
+
+  /*! \brief Index of the variable, or -1 if no block requires it. */
+  int VariableIndex(const std::string& name) const;
+
+ private:
+  std::vector<ExecBlock*> blocks_;
+  std::vector<int> num_dependencies_;
+  std::vector<std::vector<int> > consumers_;
+  std::unordered_map<std::string, int> var_index_;
+};
+
+/*!
+ * \brief Execution state of one request on an ExecPlan. Variables are kept in
+ *   a fixed array indexed by the plan, and each block has an atomic counter
+ *   of the variables it still waits for. A block becomes ready when its
+ *   counter drops to zero. Continuations added by blocks wait on their own
+ *   variables, which are indexed after the ones of the plan.
+ *
+ *   Not thread-safe except finished(); RequestContext guards the rest with
+ *   its mutex, because query results and block returns arrive on different
+ *   threads.
+ */
+class ExecState {
+ public:
+  /*! \brief Start the request with the blocks that require no variable. */
+  void Init(const ExecPlan* plan);
+
+  const ExecPlan* plan() const { return plan_; }
+
+  /*!
+   * \brief Whether all blocks and continuations have been handed out by
+   *   NextReadyBlock and NextReadyContinuation.
+   */
+  bool finished() const {
+    return num_unscheduled_blocks_.load() == 0 &&
+           num_pending_continuations_.load() == 0;
+  }
+
+  /*! \return nullptr if no block is ready. */
+  ExecBlock* NextReadyBlock();
+
+  /*! \return An empty function if no continuation is ready. */
+  Continuation NextReadyContinuation();
+
+  bool HasReadyTask() const {
+    return next_ready_block_ < ready_blocks_.size() ||
+           next_ready_continuation_ < ready_continuations_.size();
+  }
+
+  /*! \return nullptr if the variable is not ready yet. */
+  VariablePtr GetVariable(int index) const {
+    const auto& var = vars_[index];
+    return var != nullptr && var->ready() ? var : nullptr;
+  }
+
+  /*!
+   * \brief Add the variables returned by a block. Variables that no block
+   *   requires are dropped.
+   * \return Whether any block became ready.
+   */
+  bool AddBlockReturn(const std::vector<VariablePtr>& vars);
+
+  /*!
+   * \brief Add the result of a query. A result that arrives before the block
+   *   that sent the query returns is kept until then.
+   * \return Whether any block became ready.
+   */
+  bool AddQueryResult(const QueryResultProto& result);
+
+  /*!
+   * \brief Add a continuation that becomes ready when all results of the
+   *   variable are ready.
+   */
+  void AddContinuation(VariablePtr var, Continuation continuation);
+
+  /*! \brief Drop all blocks and continuations that are not handed out yet. */
+  void Cancel();
+
+ private:
+  /*! \brief Wait for the results of the variable that are not ready yet. */
+  void AddPendingQueries(const VariablePtr& var, int index);
+
+  bool SetVariableReady(int index);
+
+  const ExecPlan* plan_ = nullptr;
+  std::atomic<int> num_unscheduled_blocks_{0};
+  std::unique_ptr<std::atomic<int>[]> num_pending_deps_;
+  std::vector<VariablePtr> vars_;
+  /*! \brief Each block becomes ready once, so this is only appended to. */
+  std::vector<ExecBlock*> ready_blocks_;
+  size_t next_ready_block_ = 0;
+  /*! \brief Pairs of query id and the index of the variable waiting for it. */
+  std::vector<std::pair<uint64_t, int> > waiting_queries_;
+  std::vector<QueryResultProto> dangling_results_;
+  /*! \brief Continuation i waits on variable index num_variables() + i. */
+  std::vector<std::pair<VariablePtr, Continuation> > continuations_;
+  std::atomic<int> num_pending_continuations_{0};
+  std::vector<int> ready_continuations_;
+  size_t next_ready_continuation_ = 0;
+};
+
+}  // namespace app
+}  // namespace nexus
+
+#endif  // NEXUS_APP_EXEC_PLAN_H_
@@ -2,6 +2,7 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
 #include <boost/asio.hpp>
 #include <limits>
 #include <memory>
@@ -9,10 +10,25 @@
 #include <string>
 
 #include "nexus/common/config.h"
+#include "nexus/common/model_db.h"
 #include "nexus/common/model_def.h"
 #include "nexus/proto/control.pb.h"
 
 DECLARE_int32(load_balance);
+DECLARE_string(model_root);
+DEFINE_int32(frontend_preprocess_threads, 2,
+             "Number of threads that decode, resize and stage user inputs");
+DEFINE_int32(frontend_default_image_size, 224,
+             "Image size of models whose input size is unknown to the "
+             "frontend");
+DEFINE_double(user_rate_limit, 0,
+              "Requests per second each user connection may send. Excess "
+              "requests are rejected with RATE_LIMITED. 0 means unlimited.");
+DEFINE_double(user_rate_burst, 16,
+              "Number of requests each user connection may send at once");
+DEFINE_int32(frontend_reply_threads, 4,
+             "Number of threads that deserialize and deliver query results "
+             "from backends");
 
 namespace nexus {
 namespace app {
@@ -28,7 +44,8 @@ Frontend::Frontend(ario::PollerType poller_type, std::string rdma_dev,
       large_buffers_(kLargeBufferPoolBits, kLargeBufferBlockBits),
       rdma_(rdma_dev, &executor_, &rdma_handler_, &small_buffers_),
       rdma_sender_(&small_buffers_),
-      helper_executor_(ario::PollerType::kBlocking),
+      reply_router_(FLAGS_frontend_reply_threads),
+      preprocess_executor_(ario::PollerType::kBlocking),
       rd_(),
       rand_gen_(rd_()) {
   rdma_.ExposeMemory(large_buffers_.data(), large_buffers_.pool_size());
@@ -47,8 +64,12 @@ Frontend::Frontend(ario::PollerType poller_type, std::string rdma_dev,
   rdma_.ConnectTcp(dispatcher_ip_, sch_port);
   executor_threads_.emplace_back(&ario::EpollExecutor::RunEventLoop,
                                  &executor_);
-  executor_threads_.emplace_back(&ario::EpollExecutor::RunEventLoop,
-                                 &helper_executor_);
+  reply_router_.Start(&executor_threads_);
+  CHECK_GT(FLAGS_frontend_preprocess_threads, 0);
+  for (int i = 0; i < FLAGS_frontend_preprocess_threads; ++i) {
+    executor_threads_.emplace_back(&ario::EpollExecutor::RunEventLoop,
+                                   &preprocess_executor_);
+  }
   dispatcher_conn_ = promise_dispatcher_conn_.get_future().get();
 
   // Init Node ID and register frontend to scheduler
@@ -63,15 +84,12 @@ Frontend::~Frontend() {
 
 void Frontend::Run(QueryProcessor* qp, size_t nthreads) {
   // TODO: Unify workers and executor threads
+  request_pool_.Init(nthreads);
   for (size_t i = 0; i < nthreads; ++i) {
-    std::unique_ptr<Worker> worker(new Worker(qp, request_pool_));
+    std::unique_ptr<Worker> worker(new Worker(qp, request_pool_, i));
     worker->Start();
     workers_.push_back(std::move(worker));
   }
-  for (size_t i = 1; i < nthreads; ++i) {
-    executor_threads_.emplace_back(&ario::EpollExecutor::RunEventLoop,
-                                   &helper_executor_);
-  }
 
   running_ = true;
   daemon_thread_ = std::thread(&Frontend::Daemon, this);
@@ -86,7 +104,8 @@ void Frontend::Stop() {
   Unregister();
   // Stop all accept new connections
   ServerBase::Stop();
-  helper_executor_.StopEventLoop();
+  reply_router_.Stop();
+  preprocess_executor_.StopEventLoop();
   executor_.StopEventLoop();
   rdma_.Stop();
   // Stop all frontend connections
@@ -127,27 +146,33 @@ void Frontend::RdmaHandler::OnConnected(ario::RdmaQueuePair* conn) {
 
   // from Backend
   auto key = conn->peer_ip() + ':' + std::to_string(conn->peer_tcp_port());
-  BackendInfo backend_info;
+  std::vector<BackendInfo> backend_infos;
   {
     std::lock_guard<std::mutex> lock(outer_.connecting_backends_mutex_);
     auto iter = outer_.connecting_backends_.find(key);
     if (iter == outer_.connecting_backends_.end()) {
       LOG(FATAL) << "Cannot find BackendInfo for " << key;
     }
-    backend_info = std::move(iter->second);
+    backend_infos = std::move(iter->second);
     outer_.connecting_backends_.erase(iter);
+    auto& connected = outer_.connected_backends_[key];
+    connected.conn = conn;
+    for (const auto& backend_info : backend_infos) {
+      connected.node_ids.push_back(backend_info.node_id());
+    }
+  }
+  for (const auto& backend_info : backend_infos) {
+    auto backend = std::make_shared<BackendSession>(backend_info, conn,
+                                                    outer_.rdma_sender_);
+    outer_.backend_pool_.AddBackend(backend);
+    LOG(INFO) << "Connected to backend_id=" << backend_info.node_id()
+              << " at " << key;
   }
-  auto backend =
-      std::make_shared<BackendSession>(backend_info, conn, outer_.rdma_sender_);
-  outer_.backend_pool_.AddBackend(backend);
 
   // Send TellNodeIdMessage
   ControlMessage msg;
   msg.mutable_tell_node_id()->set_node_id(outer_.node_id_);
   outer_.rdma_sender_.SendMessage(conn, msg);
-
-  LOG(INFO) << "Connected to backend_id=" << backend_info.node_id() << " at "
-            << key;
 }
 
 void Frontend::RdmaHandler::OnRemoteMemoryRegionReceived(
@@ -163,9 +188,12 @@ void Frontend::RdmaHandler::OnRdmaReadComplete(ario::RdmaQueuePair* conn,
 
 void Frontend::RdmaHandler::OnRecv(ario::RdmaQueuePair* conn,
                                    ario::OwnedMemoryBlock buf) {
-  // Use helper executor to handle messages. Prevent starving RDMA event loop.
+  // Handle messages off the RDMA event loop to prevent starving it.
+  auto view = buf.AsMessageView();
+  auto& executor =
+      outer_.reply_router_.Route(view.bytes(), view.bytes_length());
   auto pbuf = std::make_shared<ario::OwnedMemoryBlock>(std::move(buf));
-  outer_.helper_executor_.PostBigCallback(
+  executor.PostBigCallback(
       [this, conn, pbuf](ario::ErrorCode) {
         OnRecvInternal(conn, std::move(*pbuf));
       },
@@ -235,11 +263,34 @@ void Frontend::RdmaHandler::OnSent(ario::RdmaQueuePair* conn,
 
 void Frontend::RdmaHandler::OnError(ario::RdmaQueuePair* conn,
                                     ario::RdmaError error) {
-  LOG(ERROR) << "TODO: Frontend::RdmaHandler::OnError";
+  if (conn == outer_.dispatcher_conn_ || conn == outer_.model_worker_conn_) {
+    LOG(ERROR) << "TODO: Frontend::RdmaHandler::OnError";
+    return;
+  }
+
+  // from Backend. Forget the connection so that a backend server restarting
+  // at the same address gets connected again.
+  auto key = conn->peer_ip() + ':' + std::to_string(conn->peer_tcp_port());
+  std::vector<uint32_t> node_ids;
+  {
+    std::lock_guard<std::mutex> lock(outer_.connecting_backends_mutex_);
+    auto iter = outer_.connected_backends_.find(key);
+    if (iter != outer_.connected_backends_.end() && iter->second.conn == conn) {
+      node_ids = std::move(iter->second.node_ids);
+      outer_.connected_backends_.erase(iter);
+    } else {
+      outer_.connecting_backends_.erase(key);
+    }
+  }
+  LOG(ERROR) << "Lost connection to backend server at " << key;
+  for (auto node_id : node_ids) {
+    outer_.backend_pool_.RemoveBackend(node_id);
+  }
 }
 
 void Frontend::HandleAccept() {
-  auto conn = std::make_shared<UserSession>(std::move(socket_), this);
+  auto conn = std::make_shared<UserSession>(
+      std::move(socket_), this, FLAGS_user_rate_limit, FLAGS_user_rate_burst);
   connection_pool_.insert(conn);
   conn->Start();
 }
@@ -271,11 +322,32 @@ void Frontend::HandleMessage(std::shared_ptr<Connection> conn,
         LOG(ERROR) << "UserRequest message comes from non-user connection";
         break;
       }
+      if (!user_sess->rate_limit().TryAcquire()) {
+        // Reject before spending any buffer or dispatch on the request.
+        RequestProto request;
+        ReplyProto reply;
+        message->DecodeBody(&request);
+        reply.set_user_id(request.user_id());
+        reply.set_req_id(request.req_id());
+        reply.set_status(RATE_LIMITED);
+        reply.set_error_message("Exceeded the rate limit of the user");
+        auto reply_msg =
+            std::make_shared<Message>(kUserReply, reply.ByteSizeLong());
+        reply_msg->EncodeBody(reply);
+        user_sess->Write(reply_msg);
+        break;
+      }
       auto req =
           std::make_shared<RequestContext>(user_sess, message, request_pool_);
-      helper_executor_.PostBigCallback(
+      preprocess_executor_.PostBigCallback(
           [this, req](ario::ErrorCode) {
-            req->PrepareImage(large_buffers_.Allocate());
+            if (!req->StageInput(large_buffers_.Allocate(), image_height_,
+                                 image_width_)) {
+              req->HandleError(INPUT_TYPE_INCORRECT,
+                               "Cannot stage the request input");
+              req->SendReply();
+              return;
+            }
             request_pool_.AddNewRequest(req);
           },
           ario::ErrorCode::kOk);
@@ -375,10 +447,36 @@ std::shared_ptr<ModelHandler> Frontend::LoadModel(LoadModelRequest req) {
     model_pool_.resize(model_index.t + 1);
   }
   model_pool_[model_index.t] = model_handler;
+  UpdateImageSize(req.model_session());
 
   return model_handler;
 }
 
+void Frontend::UpdateImageSize(const ModelSession& model_session) {
+  int height = model_session.image_height();
+  int width = model_session.image_width();
+  if (height == 0 && !FLAGS_model_root.empty()) {
+    const auto* info = ModelDatabase::Singleton().GetModelInfo(
+        ModelSessionToModelID(model_session));
+    if (info != nullptr && (*info)["image_height"]) {
+      height = (*info)["image_height"].as<int>();
+      width = (*info)["image_width"].as<int>();
+    }
+  }
+  if (height == 0) {
+    height = FLAGS_frontend_default_image_size;
+    width = FLAGS_frontend_default_image_size;
+  }
+  if ((image_height_ != 0 && image_height_ != height) ||
+      (image_width_ != 0 && image_width_ != width)) {
+    LOG(WARNING) << "Models take inputs of different sizes. Images are "
+                 << "staged at the largest size and resized by backends.";
+  }
+  image_height_ = std::max(image_height_, height);
+  image_width_ = std::max(image_width_, width);
+  LOG(INFO) << "Stage images at " << image_height_ << "x" << image_width_;
+}
+
 void Frontend::ComplexQuerySetup(const nexus::ComplexQuerySetupRequest& req) {
   LOG(FATAL) << "Frontend::ComplexQuerySetup not supported.";
 }
@@ -430,13 +528,33 @@ void Frontend::UpdateBackendList(const BackendListUpdates& request) {
   // TODO: remove this rpc when we remove TellNodeIdMessage.
   for (const auto& backend_info : request.backends()) {
     auto key = backend_info.ip() + ':' + std::to_string(backend_info.port());
+    ario::RdmaQueuePair* conn = nullptr;
+    bool connect = false;
     {
       std::lock_guard<std::mutex> lock(connecting_backends_mutex_);
-      connecting_backends_[key] = backend_info;
+      auto iter = connected_backends_.find(key);
+      if (iter != connected_backends_.end()) {
+        conn = iter->second.conn;
+        iter->second.node_ids.push_back(backend_info.node_id());
+      } else {
+        auto& pending = connecting_backends_[key];
+        connect = pending.empty();
+        pending.push_back(backend_info);
+      }
+    }
+    if (conn) {
+      // Another logical backend of a connected backend server.
+      backend_pool_.AddBackend(
+          std::make_shared<BackendSession>(backend_info, conn, rdma_sender_));
+      LOG(INFO) << "Connected to backend_id=" << backend_info.node_id()
+                << " at " << key << " over an existing connection";
+      continue;
+    }
+    if (connect) {
+      LOG(INFO) << "Connecting to backend_id=" << backend_info.node_id()
+                << " at " << key;
+      rdma_.ConnectTcp(backend_info.ip(), backend_info.port());
     }
-    LOG(INFO) << "Connecting to backend_id=" << backend_info.node_id() << " at "
-              << key;
-    rdma_.ConnectTcp(backend_info.ip(), backend_info.port());
   }
 }
 
@@ -7,12 +7,15 @@
 #include <memory>
 #include <mutex>
 #include <random>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "ario/ario.h"
 #include "nexus/app/model_handler.h"
 #include "nexus/app/query_processor.h"
+#include "nexus/app/reply_router.h"
 #include "nexus/app/request_context.h"
 #include "nexus/app/user_session.h"
 #include "nexus/app/worker.h"
@@ -110,6 +113,9 @@ class Frontend : public ServerBase, public MessageHandler {
  private:
   std::shared_ptr<ModelHandler> GetModel(ModelIndex model_index) const;
 
+  /*! \brief Grow the staged image size to fit the input of the model. */
+  void UpdateImageSize(const ModelSession& model_session);
+
   std::string dispatcher_ip_;
   uint16_t rdma_tcp_server_port_;
 
@@ -130,11 +136,17 @@ class Frontend : public ServerBase, public MessageHandler {
   std::promise<LoadModelReply> promise_add_model_reply_;
   std::promise<ario::RdmaQueuePair*> promise_model_worker_conn_;
 
-  // Helper workers that handles replies from Dispatcher and Backend.
-  // Also preprocess the client inputs.
-  // TODO: unify with the pre-existing Worker threads
-  ario::EpollExecutor helper_executor_;
+  /*! \brief Handles the messages from Dispatcher and backends. */
+  ReplyRouter reply_router_;
+  /*! \brief Decodes, resizes and stages the inputs of user requests. */
+  ario::EpollExecutor preprocess_executor_;
   std::vector<std::thread> executor_threads_;
+  /*!
+   * \brief Size that images are resized to before staging. The largest input
+   *   size among the loaded models. Backends resize again for smaller models.
+   */
+  int image_height_ = 0;
+  int image_width_ = 0;
 
   /*! \brief Indicator whether backend is running */
   std::atomic_bool running_;
@@ -155,9 +167,18 @@ class Frontend : public ServerBase, public MessageHandler {
   /*! \brief Map from ModelIndex to model handler. */
   std::vector<std::shared_ptr<ModelHandler>> model_pool_;
 
-  // for UpdateBackendList
+  // for UpdateBackendList. A backend server may host several logical
+  // backends on the same address, which share one connection.
   std::mutex connecting_backends_mutex_;
-  std::unordered_map<std::string, BackendInfo> connecting_backends_;
+  std::unordered_map<std::string, std::vector<BackendInfo>>
+      connecting_backends_ /* GUARDED_BY(connecting_backends_mutex_) */;
+  struct ConnectedBackend {
+    ario::RdmaQueuePair* conn;
+    /*! \brief Logical backends that share the connection. */
+    std::vector<uint32_t> node_ids;
+  };
+  std::unordered_map<std::string, ConnectedBackend>
+      connected_backends_ /* GUARDED_BY(connecting_backends_mutex_) */;
 
   std::thread daemon_thread_;
   /*! \brief Mutex for connection_pool_ and user_sessions_ */
@@ -13,6 +13,22 @@
 #include "nexus/proto/control.pb.h"
 
 DEFINE_int32(count_interval, 1, "Interval to count number of requests in sec");
+DEFINE_int32(result_cache_mb, 0,
+             "Memory bound of the result cache of each model session in MB. "
+             "0 disables the cache.");
+DEFINE_int32(result_cache_ttl_ms, 1000, "Time to live of cached results");
+DEFINE_double(model_rate_limit, 0,
+              "Queries per second each model session may dispatch. Excess "
+              "queries fail with RATE_LIMITED. 0 means unlimited.");
+DEFINE_double(model_rate_burst, 64,
+              "Number of queries each model session may dispatch at once");
+DEFINE_bool(adaptive_rate_limit, false,
+            "Cut the rate limit of a model session when the dispatcher drops "
+            "its queries, and raise it back when drops stop");
+DEFINE_int32(adaptive_rate_limit_window_ms, 1000,
+             "Interval at which adaptive rate limits change");
+DEFINE_double(adaptive_rate_limit_drop_ratio, 0.05,
+              "Ratio of dropped queries above which the rate limit is cut");
 
 namespace nexus {
 namespace app {
@@ -90,10 +106,20 @@ ModelHandler::ModelHandler(ModelSession model_session, ModelIndex model_index,
       rdma_sender_(rdma_sender),
       input_memory_allocator_(input_memory_allocator),
       total_throughput_(0.),
+      rate_limiter_(
+          FLAGS_model_rate_limit, FLAGS_model_rate_burst,
+          FLAGS_adaptive_rate_limit,
+          std::chrono::milliseconds(FLAGS_adaptive_rate_limit_window_ms),
+          FLAGS_adaptive_rate_limit_drop_ratio),
       rd_(),
       rand_gen_(rd_()) {
   counter_ =
       MetricRegistry::Singleton().CreateIntervalCounter(FLAGS_count_interval);
+  if (FLAGS_result_cache_mb > 0) {
+    result_cache_ = std::make_unique<ResultCache>(
+        size_t(FLAGS_result_cache_mb) << 20,
+        std::chrono::milliseconds(FLAGS_result_cache_ttl_ms));
+  }
   LOG(INFO) << "Created ModelHandler " << model_session_id_ << " ModelIndex "
             << model_index.t;
 }
@@ -107,9 +133,48 @@ std::shared_ptr<QueryResult> ModelHandler::Execute(
     uint32_t topk, std::vector<RectProto> windows) {
   uint64_t qid = global_query_id_.fetch_add(1, std::memory_order_relaxed);
   counter_->Increase(1);
-  {
-    std::lock_guard<std::mutex> lock(query_ctx_mu_);
-    query_ctx_.emplace(qid, ctx);
+  auto reply = std::make_shared<QueryResult>(qid);
+  PendingQuery pending{ctx, false, 0};
+  if (result_cache_ != nullptr) {
+    // Fail the queries coalesced into ones that never got a reply.
+    for (uint64_t waiter : result_cache_->ExpireInflight()) {
+      auto lost = query_ctx_.Take(QueryId(waiter));
+      if (!lost.has_value()) {
+        continue;
+      }
+      QueryResultProto result;
+      result.set_query_id(waiter);
+      result.set_model_index(model_index_.t);
+      result.set_status(TIMEOUT);
+      result.set_error_message("The identical query in flight got no reply");
+      lost->ctx->HandleQueryResult(result, model_session_);
+    }
+    pending.cache_key = ResultCache::Key(ctx->input_hash(), output_fields,
+                                         topk, windows);
+    QueryResultProto cached;
+    switch (result_cache_->Lookup(pending.cache_key, qid, &cached)) {
+      case ResultCache::kHit:
+        cached.set_query_id(qid);
+        ctx->HandleQueryResult(cached, model_session_);
+        return reply;
+      case ResultCache::kCoalesced:
+        query_ctx_.Insert(QueryId(qid), std::move(pending));
+        return reply;
+      case ResultCache::kMiss:
+        pending.cache_leader = true;
+        break;
+    }
+  }
+  query_ctx_.Insert(QueryId(qid), std::move(pending));
+  if (!rate_limiter_.TryAcquire()) {
+    // Fail the query, and the ones coalesced into it, without dispatching.
+    QueryResultProto result;
+    result.set_query_id(qid);
+    result.set_model_index(model_index_.t);
+    result.set_status(RATE_LIMITED);
+    result.set_error_message("Exceeded the rate limit of the model");
+    HandleBackendReply(result);
+    return reply;
   }
 
   // Build the query proto
@@ -156,26 +221,38 @@ std::shared_ptr<QueryResult> ModelHandler::Execute(
   request->set_rdma_read_length(ctx->rdma_read_length());
   rdma_sender_.SendMessage(model_worker_conn_, msg);
 
-  auto reply = std::make_shared<QueryResult>(qid);
   return reply;
 }
 
 void ModelHandler::HandleBackendReply(const QueryResultProto& result) {
-  std::shared_ptr<RequestContext> ctx;
-  {
-    std::lock_guard<std::mutex> lock(query_ctx_mu_);
-    auto qid = QueryId(result.query_id());
-    auto iter = query_ctx_.find(qid);
-    if (iter == query_ctx_.end()) {
-      // FIXME why this happens? lower from FATAL to ERROR temporarily
-      LOG(ERROR) << model_session_id_ << " cannot find query context for query "
-                 << qid.t;
-      return;
+  auto qid = QueryId(result.query_id());
+  auto pending = query_ctx_.Take(qid);
+  if (!pending.has_value()) {
+    // FIXME why this happens? lower from FATAL to ERROR temporarily
+    LOG(ERROR) << model_session_id_ << " cannot find query context for query "
+               << qid.t;
+    return;
+  }
+  if (result.status() != RATE_LIMITED) {
+    rate_limiter_.OnReply(result.status() == CTRL_DISPATCHER_DROPPED_QUERY);
+  }
+  pending->ctx->HandleQueryResult(result, model_session_);
+  if (!pending->cache_leader) {
+    return;
+  }
+  // Queries coalesced into this one get a copy of its result.
+  auto waiters = result_cache_->Complete(pending->cache_key, result);
+  if (waiters.empty()) {
+    return;
+  }
+  QueryResultProto copy = result;
+  for (uint64_t waiter : waiters) {
+    copy.set_query_id(waiter);
+    auto ctx = query_ctx_.Take(QueryId(waiter));
+    if (ctx.has_value()) {
+      ctx->ctx->HandleQueryResult(copy, model_session_);
     }
-    ctx = iter->second;
-    query_ctx_.erase(iter);
   }
-  ctx->HandleQueryResult(result, model_session_);
 }
 
 void ModelHandler::HandleDispatcherReply(const DispatchReply& reply) {
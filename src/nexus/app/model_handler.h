@@ -10,10 +10,13 @@
 #include <unordered_map>
 
 #include "ario/ario.h"
+#include "nexus/app/rate_limiter.h"
+#include "nexus/app/result_cache.h"
 #include "nexus/common/backend_pool.h"
 #include "nexus/common/data_type.h"
 #include "nexus/common/metric.h"
 #include "nexus/common/rdma_sender.h"
+#include "nexus/common/sharded_map.h"
 #include "nexus/common/typedef.h"
 #include "nexus/proto/nnquery.pb.h"
 
@@ -87,6 +90,9 @@ class ModelHandler {
 
   std::shared_ptr<IntervalCounter> counter() const { return counter_; }
 
+  /*! \brief nullptr unless --result_cache_mb is set. */
+  const ResultCache* result_cache() const { return result_cache_.get(); }
+
   std::shared_ptr<QueryResult> Execute(
       std::shared_ptr<RequestContext> ctx,
       std::vector<std::string> output_fields = {}, uint32_t topk = 1,
@@ -102,6 +108,14 @@ class ModelHandler {
   std::vector<uint32_t> BackendList();
 
  private:
+  /*! \brief A query waiting for its result. */
+  struct PendingQuery {
+    std::shared_ptr<RequestContext> ctx;
+    /*! \brief Whether the query fills the result cache entry of cache_key. */
+    bool cache_leader;
+    uint64_t cache_key;
+  };
+
   std::shared_ptr<BackendSession> GetBackendWeightedRoundRobin();
 
   std::shared_ptr<BackendSession> GetBackendDeficitRoundRobin();
@@ -129,14 +143,20 @@ class ModelHandler {
   double quantum_to_rate_ratio_ = 0;
   size_t current_drr_index_ = 0;
   float total_throughput_;
+  ModelRateLimiter rate_limiter_;
   /*! \brief Interval counter to count number of requests within each
    *  interval.
    */
   std::shared_ptr<IntervalCounter> counter_;
 
-  std::unordered_map<QueryId, std::shared_ptr<RequestContext>> query_ctx_;
+  /*!
+   * \brief Contexts of queries waiting for results. Sharded by query id, so
+   *   that worker threads executing queries and the reply path do not
+   *   contend on one mutex.
+   */
+  ShardedMap<QueryId, PendingQuery> query_ctx_;
+  std::unique_ptr<ResultCache> result_cache_;
   std::mutex route_mu_;
-  std::mutex query_ctx_mu_;
   /*! \brief random number generator */
   std::random_device rd_;
   std::mt19937 rand_gen_;
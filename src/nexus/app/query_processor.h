@@ -4,6 +4,7 @@
 #include <glog/logging.h>
 
 #include "nexus/app/exec_block.h"
+#include "nexus/app/exec_plan.h"
 #include "nexus/app/request_context.h"
 
 namespace nexus {
@@ -11,7 +12,8 @@ namespace app {
 
 class QueryProcessor {
  public:
-  QueryProcessor(std::vector<ExecBlock*> blocks) : blocks_(blocks) {
+  QueryProcessor(std::vector<ExecBlock*> blocks)
+      : blocks_(blocks), plan_(blocks) {
     std::unordered_set<int> block_ids;
     for (auto block : blocks) {
       if (block_ids.count(block->id()) > 0) {
@@ -21,25 +23,42 @@ class QueryProcessor {
     }
   }
 
+  /*! \brief Compiled blocks, e.g. to look up the index of a variable. */
+  const ExecPlan& plan() const { return plan_; }
+
   void Process(std::shared_ptr<RequestContext> ctx) {
     if (ctx->state() == kUninitialized) {
       // LOG(INFO) << "Init req " << ctx->const_request().user_id() << ":" <<
       //     ctx->const_request().req_id();
-      ctx->SetExecBlocks(blocks_);
+      ctx->SetExecPlan(&plan_);
     }
     while (!ctx->finished()) {
       auto block = ctx->NextReadyBlock();
-      if (block == nullptr) {
-        ctx->SetState(kBlocking);
-        return;
+      if (block != nullptr) {
+        // LOG(INFO) << "Exec req " << ctx->const_request().user_id() << ":"
+        //     << ctx->const_request().req_id() << ", block " << block->id();
+        auto ret = block->Run(ctx);
+        if (ctx->state() == kError) {
+          break;
+        }
+        ctx->AddBlockReturn(ret);
+        continue;
+      }
+      auto continuation = ctx->NextReadyContinuation();
+      if (continuation) {
+        continuation(ctx);
+        if (ctx->state() == kError) {
+          break;
+        }
+        continue;
       }
-      // LOG(INFO) << "Exec req " << ctx->const_request().user_id() << ":" <<
-      //     ctx->const_request().req_id() << ", block " << block->id();
-      auto ret = block->Run(ctx);
-      if (ctx->state() == kError) {
-        break;
+      ctx->SetState(kBlocking);
+      // A result that arrived since the checks above could not resume the
+      // request, because it was still running.
+      if (ctx->HasReadyTask()) {
+        ctx->SetState(kRunning);
       }
-      ctx->AddBlockReturn(ret);
+      return;
     }
     // LOG(INFO) << "Reply req " << ctx->const_request().user_id() << ":" <<
     //     ctx->const_request().req_id();
@@ -48,6 +67,7 @@ class QueryProcessor {
 
  private:
   std::vector<ExecBlock*> blocks_;
+  ExecPlan plan_;
 };
 
 }  // namespace app
@@ -0,0 +1,85 @@
+#include "nexus/app/rate_limiter.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace nexus {
+namespace app {
+
+namespace {
+
+constexpr double kDecreaseFactor = 0.8;
+constexpr double kIncreaseFactor = 1.1;
+
+}  // namespace
+
+ModelRateLimiter::ModelRateLimiter(double rate, double burst, bool adaptive,
+                                   std::chrono::milliseconds window,
+                                   double drop_ratio)
+    : bucket_(rate, burst),
+      max_rate_(std::max(rate, 0.)),
+      adaptive_(adaptive),
+      window_ns_(std::chrono::nanoseconds(window).count()),
+      drop_ratio_(drop_ratio),
+      window_start_ns_(Clock::now().time_since_epoch().count()) {}
+
+bool ModelRateLimiter::TryAcquire(TimePoint now) {
+  if (!adaptive_) {
+    return bucket_.TryAcquire(now);
+  }
+  MaybeAdapt(now);
+  if (!bucket_.TryAcquire(now)) {
+    return false;
+  }
+  num_admitted_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void ModelRateLimiter::OnReply(bool dropped, TimePoint now) {
+  if (!adaptive_) {
+    return;
+  }
+  num_replies_.fetch_add(1, std::memory_order_relaxed);
+  if (dropped) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  MaybeAdapt(now);
+}
+
+void ModelRateLimiter::MaybeAdapt(TimePoint now) {
+  int64_t now_ns = now.time_since_epoch().count();
+  int64_t start_ns = window_start_ns_.load(std::memory_order_relaxed);
+  if (now_ns - start_ns < window_ns_) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(adapt_mu_, std::try_to_lock);
+  if (!lock.owns_lock() ||
+      !window_start_ns_.compare_exchange_strong(start_ns, now_ns)) {
+    return;
+  }
+  double elapsed_sec = (now_ns - start_ns) / 1e9;
+  double admitted_rate = num_admitted_.exchange(0) / elapsed_sec;
+  uint64_t replies = num_replies_.exchange(0);
+  uint64_t dropped = num_dropped_.exchange(0);
+
+  double rate = bucket_.rate();
+  if (dropped > 0 && dropped > drop_ratio_ * replies) {
+    double base = rate > 0 ? std::min(rate, admitted_rate) : admitted_rate;
+    double new_rate = std::max(1., base * kDecreaseFactor);
+    LOG(INFO) << "Drop ratio " << dropped << "/" << replies
+              << ", cut the rate limit to " << new_rate;
+    bucket_.SetRate(new_rate);
+  } else if (rate > 0 && (max_rate_ == 0 || rate < max_rate_ * 0.999)) {
+    double new_rate = rate * kIncreaseFactor;
+    if (max_rate_ > 0) {
+      new_rate = std::min(new_rate, max_rate_);
+    } else if (new_rate > 2 * admitted_rate) {
+      new_rate = 0;
+    }
+    bucket_.SetRate(new_rate);
+  }
+}
+
+}  // namespace app
+}  // namespace nexus
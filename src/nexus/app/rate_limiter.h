@@ -0,0 +1,66 @@
+#ifndef NEXUS_APP_RATE_LIMITER_H_
+#define NEXUS_APP_RATE_LIMITER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "nexus/common/time_util.h"
+#include "nexus/common/token_bucket.h"
+
+namespace nexus {
+namespace app {
+
+/*!
+ * \brief Rate limit of the queries that a frontend dispatches for one model
+ *   session.
+ *
+ *   In adaptive mode the limit follows the drop replies of the dispatcher.
+ *   After each window in which more than drop_ratio of the replies are
+ *   drops, the limit is cut to 80% of the rate admitted in that window.
+ *   After each window under the ratio, it grows by 10% until it reaches the
+ *   configured rate, or, without one, until it is twice the admitted rate
+ *   and the model is unlimited again.
+ */
+class ModelRateLimiter {
+ public:
+  /*!
+   * \param rate Queries per second. Non-positive means unlimited.
+   * \param burst Number of queries admitted at once.
+   * \param adaptive Whether to adapt the limit to the drop replies.
+   * \param window Interval at which the limit adapts.
+   * \param drop_ratio Ratio of drop replies above which the limit is cut.
+   */
+  ModelRateLimiter(double rate, double burst, bool adaptive,
+                   std::chrono::milliseconds window, double drop_ratio);
+
+  /*! \return Whether the query can be dispatched. */
+  bool TryAcquire(TimePoint now = Clock::now());
+
+  /*! \brief Count the reply to a dispatched query. */
+  void OnReply(bool dropped, TimePoint now = Clock::now());
+
+  /*! \brief Current limit in queries per second, or 0 if unlimited. */
+  double rate() const { return bucket_.rate(); }
+
+ private:
+  void MaybeAdapt(TimePoint now);
+
+  TokenBucket bucket_;
+  const double max_rate_;
+  const bool adaptive_;
+  const int64_t window_ns_;
+  const double drop_ratio_;
+  std::atomic<int64_t> window_start_ns_;
+  std::atomic<uint64_t> num_admitted_{0};
+  std::atomic<uint64_t> num_replies_{0};
+  std::atomic<uint64_t> num_dropped_{0};
+  /*! \brief Held by the thread that adapts the limit at the end of a window. */
+  std::mutex adapt_mu_;
+};
+
+}  // namespace app
+}  // namespace nexus
+
+#endif  // NEXUS_APP_RATE_LIMITER_H_
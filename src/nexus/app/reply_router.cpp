@@ -0,0 +1,82 @@
+#include "nexus/app/reply_router.h"
+
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace app {
+
+namespace {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+}  // namespace
+
+bool PeekQueryResultId(const void* data, size_t size, uint64_t* query_id) {
+  CodedInputStream input(static_cast<const uint8_t*>(data), size);
+  // Only the oneof message is set, so the result is the first field.
+  uint32_t tag = input.ReadTag();
+  if (WireFormatLite::GetTagFieldNumber(tag) !=
+          ControlMessage::kQueryResultFieldNumber ||
+      WireFormatLite::GetTagWireType(tag) !=
+          WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    return false;
+  }
+  uint32_t length;
+  if (!input.ReadVarint32(&length)) {
+    return false;
+  }
+  // Fields are serialized in order, so query_id comes first unless it is 0
+  // and omitted.
+  *query_id = 0;
+  auto limit = input.PushLimit(length);
+  tag = input.ReadTag();
+  if (WireFormatLite::GetTagFieldNumber(tag) ==
+          QueryResultProto::kQueryIdFieldNumber &&
+      WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_VARINT) {
+    if (!input.ReadVarint64(query_id)) {
+      return false;
+    }
+  }
+  input.PopLimit(limit);
+  return true;
+}
+
+ReplyRouter::ReplyRouter(size_t num_result_executors)
+    : control_executor_(ario::PollerType::kBlocking) {
+  CHECK_GT(num_result_executors, 0);
+  for (size_t i = 0; i < num_result_executors; ++i) {
+    result_executors_.emplace_back(
+        new ario::EpollExecutor(ario::PollerType::kBlocking));
+  }
+}
+
+void ReplyRouter::Start(std::vector<std::thread>* threads) {
+  threads->emplace_back(&ario::EpollExecutor::RunEventLoop,
+                        &control_executor_);
+  for (auto& executor : result_executors_) {
+    threads->emplace_back(&ario::EpollExecutor::RunEventLoop, executor.get());
+  }
+}
+
+void ReplyRouter::Stop() {
+  control_executor_.StopEventLoop();
+  for (auto& executor : result_executors_) {
+    executor->StopEventLoop();
+  }
+}
+
+ario::EpollExecutor& ReplyRouter::Route(const void* data, size_t size) {
+  uint64_t query_id;
+  if (!PeekQueryResultId(data, size, &query_id)) {
+    return control_executor_;
+  }
+  return *result_executors_[query_id % result_executors_.size()];
+}
+
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,56 @@
+#ifndef NEXUS_APP_REPLY_ROUTER_H_
+#define NEXUS_APP_REPLY_ROUTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ario/ario.h"
+
+namespace nexus {
+namespace app {
+
+/*!
+ * \brief Read the query ID of a serialized ControlMessage without parsing
+ *   the whole message.
+ * \return Whether the message is a query result.
+ */
+bool PeekQueryResultId(const void* data, size_t size, uint64_t* query_id);
+
+/*!
+ * \brief Executors that handle the control messages a frontend receives.
+ *
+ *   Query results from backends are hashed by query ID over several
+ *   executors with one thread each, so the results of one query are handled
+ *   in the order they arrive while different queries are deserialized and
+ *   delivered in parallel. Every other message, such as dispatch replies and
+ *   backend list updates, goes to a separate control executor, so that it
+ *   does not queue behind a burst of results.
+ */
+class ReplyRouter {
+ public:
+  explicit ReplyRouter(size_t num_result_executors);
+
+  /*! \brief Start one thread on each executor and append it to threads. */
+  void Start(std::vector<std::thread>* threads);
+
+  void Stop();
+
+  /*! \brief The executor that handles the serialized ControlMessage. */
+  ario::EpollExecutor& Route(const void* data, size_t size);
+
+  ario::EpollExecutor& control_executor() { return control_executor_; }
+
+  size_t num_result_executors() const { return result_executors_.size(); }
+
+ private:
+  ario::EpollExecutor control_executor_;
+  std::vector<std::unique_ptr<ario::EpollExecutor>> result_executors_;
+};
+
+}  // namespace app
+}  // namespace nexus
+
+#endif  // NEXUS_APP_REPLY_ROUTER_H_
@@ -1,12 +1,25 @@
 #include "nexus/app/request_context.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <cstring>
 #include <opencv2/opencv.hpp>
 
 #include "nexus/app/exec_block.h"
+#include "nexus/app/result_cache.h"
+#include "nexus/common/data_type.h"
 #include "nexus/common/image.h"
 #include "nexus/common/model_def.h"
+#include "nexus/common/staged_input.h"
+
+DECLARE_int32(result_cache_mb);
+DEFINE_bool(frontend_decode_image, true,
+            "Decode and resize images on the frontend. Otherwise backends "
+            "read the encoded image bytes and decode them.");
+DEFINE_bool(frontend_scaled_decode, true,
+            "Decode JPEG images at a reduced scale that is still larger than "
+            "the model input before resizing them on the frontend.");
 
 namespace nexus {
 namespace app {
@@ -25,10 +38,7 @@ RequestContext::RequestContext(std::shared_ptr<UserSession> user_sess,
   msg->DecodeBody(&request_);
 }
 
-bool RequestContext::finished() {
-  std::lock_guard<std::mutex> lock(mu_);
-  return (pending_blocks_.empty() && ready_blocks_.empty());
-}
+bool RequestContext::finished() { return exec_state_.finished(); }
 
 void RequestContext::SetState(RequestState state) {
   if (state_ == kError) {
@@ -42,78 +52,87 @@ void RequestContext::SetState(RequestState state) {
     if (state == kRunning || state == kError) {
       req_pool_.MoveToReady(shared_from_this());
     }
-  } else if (prev_state == kRunning) {
-    if (state == kBlocking) {
-      req_pool_.AddBlockRequest(shared_from_this());
-    }
   }
 }
 
-void RequestContext::SetExecBlocks(std::vector<ExecBlock*> blocks) {
+void RequestContext::SetExecPlan(const ExecPlan* plan) {
   CHECK_EQ(state_, kUninitialized) << "Request context is alrealdy initialized";
-  for (auto block : blocks) {
-    auto deps = block->dependency();
-    if (deps.empty()) {
-      ready_blocks_.push_back(block);
-    } else {
-      pending_blocks_.emplace(block->id(), block);
-      block_deps_.emplace(block->id(), block->dependency());
-    }
-  }
+  std::lock_guard<std::mutex> lock(mu_);
+  exec_state_.Init(plan);
   state_.store(kRunning);
 }
 
-void RequestContext::SetBackendQueryProto(
-    QueryProto query_proto, ario::OwnedMemoryBlock&& exposed_memory_block) {
+bool RequestContext::StageInput(ario::OwnedMemoryBlock&& exposed_memory_block,
+                                int image_height, int image_width) {
   exposed_memory_block_ = std::move(exposed_memory_block);
-  const auto& input = query_proto.input();
-  // TODO: avoid the serialization
-  bool ok = input.SerializeToArray(exposed_memory_block_.data(),
-                                   exposed_memory_block_.size());
-  CHECK(ok) << "Failed to copy the input image to exposed_memory_block_";
-  rdma_read_offset_ =
-      exposed_memory_block_.data() - exposed_memory_block_.allocator()->data();
-  rdma_read_length_ = input.ByteSizeLong();
+  const auto& input = request_.input();
+  if (FLAGS_result_cache_mb > 0) {
+    input_hash_ = HashInput(input);
+  }
+  switch (input.data_type()) {
+    case DT_IMAGE:
+      if (FLAGS_frontend_decode_image || input.image().data().empty()) {
+        return PrepareImage(image_height, image_width);
+      }
+      return StageEncodedImage();
+    case DT_TENSOR:
+      return StageTensor();
+    default:
+      return false;
+  }
 }
 
 ExecBlock* RequestContext::NextReadyBlock() {
   std::lock_guard<std::mutex> lock(mu_);
-  if (ready_blocks_.empty()) {
-    return nullptr;
-  }
-  auto block = ready_blocks_.front();
-  ready_blocks_.pop_front();
-  // LOG(INFO) << "Ready blocks: " << ready_blocks_.size() <<
-  //     ", pending blocks: " << pending_blocks_.size();
-  return block;
+  return exec_state_.NextReadyBlock();
+}
+
+Continuation RequestContext::NextReadyContinuation() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return exec_state_.NextReadyContinuation();
+}
+
+bool RequestContext::HasReadyTask() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return exec_state_.HasReadyTask();
+}
+
+void RequestContext::Then(std::shared_ptr<QueryResult> result,
+                          Continuation continuation) {
+  Then(std::vector<std::shared_ptr<QueryResult> >{std::move(result)},
+       std::move(continuation));
+}
+
+void RequestContext::Then(std::vector<std::shared_ptr<QueryResult> > results,
+                          Continuation continuation) {
+  auto var = std::make_shared<Variable>("", std::move(results));
+  std::lock_guard<std::mutex> lock(mu_);
+  exec_state_.AddContinuation(std::move(var), std::move(continuation));
+}
+
+VariablePtr RequestContext::GetVariable(int var_index) {
+  std::lock_guard<std::mutex> lock(mu_);
+  CHECK_GE(var_index, 0) << "No block requires the variable";
+  CHECK_LT(static_cast<size_t>(var_index),
+           exec_state_.plan()->num_variables());
+  auto var = exec_state_.GetVariable(var_index);
+  CHECK(var != nullptr) << "Variable " << var_index << " is not ready";
+  return var;
 }
 
 VariablePtr RequestContext::GetVariable(const std::string& var_name) {
   std::lock_guard<std::mutex> lock(mu_);
-  auto itr = vars_.find(var_name);
-  CHECK(itr != vars_.end()) << "Variable " << var_name << " doesn't exist "
-                            << " or is not ready";
-  return itr->second;
+  int var_index = exec_state_.plan()->VariableIndex(var_name);
+  auto var = var_index < 0 ? nullptr : exec_state_.GetVariable(var_index);
+  CHECK(var != nullptr) << "Variable " << var_name << " doesn't exist "
+                        << " or is not ready";
+  return var;
 }
 
 void RequestContext::AddBlockReturn(std::vector<VariablePtr> vars) {
   std::lock_guard<std::mutex> lock(mu_);
-  for (auto var : vars) {
-    auto var_name = var->name();
-    for (auto qid : var->query_ids()) {
-      auto itr = dangling_results_.find(qid);
-      if (itr != dangling_results_.end()) {
-        var->AddQueryResult(itr->second);
-        dangling_results_.erase(itr);
-      } else {
-        qid_var_map_.emplace(qid, var_name);
-      }
-    }
-    if (var->ready()) {
-      AddReadyVariable(var);
-    } else {
-      waiting_vars_.emplace(var_name, var);
-    }
+  if (exec_state_.AddBlockReturn(vars)) {
+    SetState(kRunning);
   }
 }
 
@@ -155,18 +174,8 @@ void RequestContext::HandleQueryResult(const QueryResultProto& result,
     return;
   }
 
-  auto qid_itr = qid_var_map_.find(qid);
-  if (qid_itr == qid_var_map_.end()) {
-    dangling_results_.emplace(qid, result);
-    return;
-  }
-  std::string var_name = qid_itr->second;
-  qid_var_map_.erase(qid_itr);
-
-  auto var = waiting_vars_.at(var_name);
-  if (var->AddQueryResult(result)) {
-    waiting_vars_.erase(var_name);
-    AddReadyVariable(var);
+  if (exec_state_.AddQueryResult(result)) {
+    SetState(kRunning);
   }
 }
 
@@ -188,50 +197,93 @@ void RequestContext::SendReply() {
   user_session_->Write(std::move(reply_msg));
 }
 
-void RequestContext::AddReadyVariable(std::shared_ptr<Variable> var) {
-  vars_.emplace(var->name(), var);
-  std::vector<int> ready_blocks;
-  for (auto& block_itr : block_deps_) {
-    block_itr.second.erase(var->name());
-    if (block_itr.second.empty()) {
-      ready_blocks.push_back(block_itr.first);
-    }
-  }
-  for (auto block_id : ready_blocks) {
-    auto block = pending_blocks_.at(block_id);
-    pending_blocks_.erase(block_id);
-    block_deps_.erase(block_id);
-    ready_blocks_.push_back(block);
-  }
-  if (!ready_blocks_.empty()) {
-    SetState(kRunning);
-  }
-}
-
 void RequestContext::HandleErrorLocked(uint32_t status,
                                        const std::string& error_msg) {
   reply_.set_status(status);
   reply_.set_error_message(error_msg);
-  ready_blocks_.clear();
-  pending_blocks_.clear();
+  exec_state_.Cancel();
   SetState(kError);
 }
 
-void RequestContext::PrepareImage(
-    ario::OwnedMemoryBlock&& exposed_memory_block) {
-  exposed_memory_block_ = std::move(exposed_memory_block);
+bool RequestContext::PrepareImage(int height, int width) {
+  if (height <= 0 || width <= 0) {
+    return false;
+  }
+  auto* payload = StageTensorHeader(
+      exposed_memory_buffer(), exposed_memory_block_.size(), DT_UINT8,
+      {static_cast<uint32_t>(height), static_cast<uint32_t>(width), 3});
+  CHECK(payload != nullptr) << "Exposed memory block is too small";
+  const auto& image_proto = request_.input().image();
+  cv::Mat image = FLAGS_frontend_scaled_decode
+                      ? DecodeImageScaled(image_proto, height, width, CO_RGB)
+                      : DecodeImage(image_proto, CO_RGB);
+  if (!image.data) {
+    return false;
+  }
+  cv::Mat resized(height, width, CV_8UC3, payload);
+  cv::resize(image, resized, cv::Size(width, height));
+  SetRdmaReadRange(payload - exposed_memory_buffer() +
+                   resized.total() * resized.elemSize());
+  return true;
+}
 
-  // TODO: use model input size instead of const number.
-  constexpr int kSize = 224;
+bool RequestContext::StageEncodedImage() {
+  const auto& image = request_.input().image();
+  auto* payload = StageEncodedImageHeader(exposed_memory_buffer(),
+                                          exposed_memory_block_.size(),
+                                          image.format(), image.data().size());
+  if (payload == nullptr) {
+    LOG(ERROR) << "Image of " << image.data().size()
+               << " bytes does not fit in the exposed memory block";
+    return false;
+  }
+  std::memcpy(payload, image.data().data(), image.data().size());
+  SetRdmaReadRange(payload - exposed_memory_buffer() +
+                   image.data().size());
+  return true;
+}
 
-  cv::Mat image = DecodeImage(request_.input().image(), CO_RGB);
-  cv::Mat resized(kSize, kSize, CV_8UC3, exposed_memory_block_.data());
-  CHECK_GT(exposed_memory_block_.size(), resized.total() * resized.elemSize());
-  cv::resize(image, resized, cv::Size(kSize, kSize));
+bool RequestContext::StageTensor() {
+  const auto& tensor = request_.input().tensor();
+  std::vector<uint32_t> dims(tensor.shape().begin(), tensor.shape().end());
+  const void* data;
+  size_t nbytes;
+  switch (tensor.data_type()) {
+    case DT_INT32:
+      data = tensor.ints().data();
+      nbytes = tensor.ints_size() * sizeof(int32_t);
+      break;
+    case DT_FLOAT:
+      data = tensor.floats().data();
+      nbytes = tensor.floats_size() * sizeof(float);
+      break;
+    case DT_DOUBLE:
+      data = tensor.doubles().data();
+      nbytes = tensor.doubles_size() * sizeof(double);
+      break;
+    default:
+      return false;
+  }
+  auto expected_nbytes =
+      TensorPayloadBytes(tensor.data_type(), dims.data(), dims.size());
+  if (!expected_nbytes.has_value() || *expected_nbytes != nbytes) {
+    return false;
+  }
+  auto* payload =
+      StageTensorHeader(exposed_memory_buffer(),
+                        exposed_memory_block_.size(), tensor.data_type(), dims);
+  if (payload == nullptr) {
+    return false;
+  }
+  std::memcpy(payload, data, nbytes);
+  SetRdmaReadRange(payload - exposed_memory_buffer() + nbytes);
+  return true;
+}
 
+void RequestContext::SetRdmaReadRange(size_t nbytes) {
   rdma_read_offset_ =
       exposed_memory_block_.data() - exposed_memory_block_.allocator()->data();
-  rdma_read_length_ = resized.total() * resized.elemSize();
+  rdma_read_length_ = nbytes;
 }
 
 }  // namespace app
@@ -1,80 +1,27 @@
 #ifndef NEXUS_APP_REQUEST_CONTEXT_H_
 #define NEXUS_APP_REQUEST_CONTEXT_H_
 
+#include <glog/logging.h>
+
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "ario/ario.h"
+#include "nexus/app/exec_plan.h"
 #include "nexus/app/model_handler.h"
 #include "nexus/app/user_session.h"
+#include "nexus/app/variable.h"
 #include "nexus/common/block_queue.h"
 #include "nexus/common/time_util.h"
+#include "nexus/common/work_stealing_queue.h"
 #include "nexus/proto/control.pb.h"
 #include "nexus/proto/nnquery.pb.h"
 
 namespace nexus {
 namespace app {
 
-class Variable {
- public:
-  Variable(std::string name, std::shared_ptr<QueryResult> result)
-      : name_(name), data_{result} {
-    if (!result->ready()) {
-      pending_results_.emplace(result->query_id(), result);
-    }
-  }
-
-  Variable(std::string name, std::vector<std::shared_ptr<QueryResult> > results)
-      : name_(name), data_(results) {
-    for (auto& r : results) {
-      if (!r->ready()) {
-        pending_results_.emplace(r->query_id(), r);
-      }
-    }
-  }
-
-  bool ready() const { return pending_results_.empty(); }
-
-  std::string name() const { return name_; }
-
-  size_t count() const { return data_.size(); }
-
-  std::shared_ptr<QueryResult> result() const {
-    if (data_.empty()) {
-      return nullptr;
-    }
-    return data_.at(0);
-  }
-
-  std::shared_ptr<QueryResult> operator[](int idx) const {
-    return data_.at(idx);
-  }
-
-  std::vector<uint64_t> query_ids() const {
-    std::vector<uint64_t> qids;
-    for (auto itr : pending_results_) {
-      qids.push_back(itr.first);
-    }
-    return qids;
-  }
-
-  bool AddQueryResult(const QueryResultProto& result) {
-    auto reply = pending_results_.at(result.query_id());
-    reply->SetResult(result);
-    pending_results_.erase(result.query_id());
-    return pending_results_.empty();
-  }
-
- private:
-  std::string name_;
-  std::vector<std::shared_ptr<QueryResult> > data_;
-  std::unordered_map<uint64_t, std::shared_ptr<QueryResult> > pending_results_;
-};
-
-using VariablePtr = std::shared_ptr<Variable>;
-
 enum RequestState {
   kUninitialized = 0,
   kRunning = 1,
@@ -107,20 +54,59 @@ class RequestContext : public DeadlineItem,
 
   const TimePoint& frontend_recv_time() const { return frontend_recv_time_; }
 
+  /*! \brief Index of the worker that last ran the request, or -1. */
+  int last_worker() const { return last_worker_.load(); }
+
+  void set_last_worker(int worker) { last_worker_.store(worker); }
+
+  /*!
+   * \brief Hash of the request input for the result cache. Only set by
+   *   StageInput when --result_cache_mb is set.
+   */
+  uint64_t input_hash() const { return input_hash_; }
+
   uint64_t rdma_read_offset() const { return rdma_read_offset_; }
   uint64_t rdma_read_length() const { return rdma_read_length_; }
 
   void SetState(RequestState state);
 
-  void SetExecBlocks(std::vector<ExecBlock*> blocks);
-
-  void SetBackendQueryProto(QueryProto query_proto,
-                            ario::OwnedMemoryBlock&& exposed_memory_block);
+  void SetExecPlan(const ExecPlan* plan);
 
-  void PrepareImage(ario::OwnedMemoryBlock&& exposed_memory_block);
+  /*!
+   * \brief Stage the request input in the exposed memory block for backends
+   *   to read, as a raw tensor or as the encoded image bytes. See
+   *   StagedInputHeader. Images are decoded and resized to
+   *   image_height x image_width here only if --frontend_decode_image is set
+   *   or they have no encoded bytes.
+   * \return false if the input cannot be staged.
+   */
+  bool StageInput(ario::OwnedMemoryBlock&& exposed_memory_block,
+                  int image_height, int image_width);
 
   ExecBlock* NextReadyBlock();
 
+  /*! \return An empty function if no continuation is ready. */
+  Continuation NextReadyContinuation();
+
+  /*! \brief Whether a block or a continuation is ready to run. */
+  bool HasReadyTask();
+
+  /*!
+   * \brief Run the continuation on a frontend worker once the result is
+   *   ready. The request occupies no worker while it waits, and is replied
+   *   after all of its continuations have run. Must be called from a block
+   *   or a continuation of this request.
+   */
+  void Then(std::shared_ptr<QueryResult> result, Continuation continuation);
+
+  /*! \brief Run the continuation once all the results are ready. */
+  void Then(std::vector<std::shared_ptr<QueryResult> > results,
+            Continuation continuation);
+
+  /*! \brief Get a ready variable by the index from ExecPlan::VariableIndex. */
+  VariablePtr GetVariable(int var_index);
+
+  /*! \brief Get a ready variable by name. Slower than by index. */
   VariablePtr GetVariable(const std::string& var_name);
 
   void AddBlockReturn(std::vector<VariablePtr> vars);
@@ -133,10 +119,21 @@ class RequestContext : public DeadlineItem,
   void SendReply();
 
  private:
-  void AddReadyVariable(std::shared_ptr<Variable> var);
-
   void HandleErrorLocked(uint32_t status, const std::string& error_msg);
 
+  /*! \brief Decode and resize the image into a uint8 HWC tensor. */
+  bool PrepareImage(int height, int width);
+
+  bool StageEncodedImage();
+
+  bool StageTensor();
+
+  void SetRdmaReadRange(size_t nbytes);
+
+  char* exposed_memory_buffer() {
+    return reinterpret_cast<char*>(exposed_memory_block_.data());
+  }
+
  protected:
   std::shared_ptr<UserSession> user_session_;
   RequestPool& req_pool_;
@@ -146,48 +143,54 @@ class RequestContext : public DeadlineItem,
   double slack_ms_;
   bool has_backend_query_sent_ = false;
   TimePoint frontend_recv_time_;
+  std::atomic<int> last_worker_{-1};
+  uint64_t input_hash_ = 0;
 
   ario::OwnedMemoryBlock exposed_memory_block_;
   uint64_t rdma_read_offset_ = 0;
   uint64_t rdma_read_length_ = 0;
 
-  std::deque<ExecBlock*> ready_blocks_;
-  std::unordered_map<int, ExecBlock*> pending_blocks_;
-  std::unordered_map<int, std::unordered_set<std::string> > block_deps_;
-
-  std::unordered_map<std::string, VariablePtr> vars_;
-  std::unordered_map<std::string, VariablePtr> waiting_vars_;
-  std::unordered_map<uint64_t, std::string> qid_var_map_;
-  std::unordered_map<uint64_t, QueryResultProto> dangling_results_;
+  /*! \brief Guarded by mu_, except for ExecState::finished(). */
+  ExecState exec_state_;
   std::mutex mu_;
 };
 
+/*!
+ * \brief Ready requests of the frontend workers. A request that resumes
+ *   after waiting on model replies goes back to the worker that last ran it.
+ *   Idle workers steal requests from the others, earliest deadline first.
+ *   Blocked requests are kept alive by the model handlers that wait for
+ *   their query results, so they are not tracked here.
+ */
 class RequestPool {
  public:
-  void AddNewRequest(std::shared_ptr<RequestContext> req) {
-    ready_requests_.push(req);
+  /*! \brief Must be called before any request is added. */
+  void Init(size_t num_workers) {
+    CHECK(!ready_requests_) << "RequestPool is already initialized";
+    ready_requests_ =
+        std::make_unique<WorkStealingQueue<RequestContext>>(num_workers);
   }
 
-  void AddBlockRequest(std::shared_ptr<RequestContext> req) {
-    std::lock_guard<std::mutex> lock(mu_);
-    block_requests_.insert(req);
+  void AddNewRequest(std::shared_ptr<RequestContext> req) {
+    ready_requests_->Push(std::move(req), -1);
   }
 
   void MoveToReady(std::shared_ptr<RequestContext> req) {
-    ready_requests_.push(req);
-    std::lock_guard<std::mutex> lock(mu_);
-    block_requests_.erase(req);
+    int worker = req->last_worker();
+    ready_requests_->Push(std::move(req), worker);
   }
 
   std::shared_ptr<RequestContext> GetRequest(
-      std::chrono::milliseconds timeout) {
-    return ready_requests_.pop(timeout);
+      size_t worker, std::chrono::milliseconds timeout) {
+    auto req = ready_requests_->Pop(worker, timeout);
+    if (req) {
+      req->set_last_worker(static_cast<int>(worker));
+    }
+    return req;
   }
 
  private:
-  BlockPriorityQueue<RequestContext> ready_requests_;
-  std::unordered_set<std::shared_ptr<RequestContext> > block_requests_;
-  std::mutex mu_;
+  std::unique_ptr<WorkStealingQueue<RequestContext>> ready_requests_;
 };
 
 }  // namespace app
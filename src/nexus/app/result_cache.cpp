@@ -0,0 +1,181 @@
+#include "nexus/app/result_cache.h"
+
+#include <boost/functional/hash.hpp>
+#include <functional>
+#include <string_view>
+
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace app {
+
+namespace {
+
+size_t HashBytes(const void* data, size_t size) {
+  return std::hash<std::string_view>{}(
+      std::string_view(static_cast<const char*>(data), size));
+}
+
+}  // namespace
+
+uint64_t HashInput(const ValueProto& input) {
+  size_t h = 0;
+  boost::hash_combine(h, static_cast<int>(input.data_type()));
+  if (input.data_type() == DT_IMAGE) {
+    const auto& image = input.image();
+    boost::hash_combine(h, std::hash<std::string>{}(image.data()));
+    boost::hash_combine(h, image.hack_filename());
+    boost::hash_combine(h, static_cast<int>(image.format()));
+    boost::hash_combine(h, image.color());
+  } else if (input.data_type() == DT_TENSOR &&
+             input.tensor().data_type() == DT_FLOAT) {
+    const auto& tensor = input.tensor();
+    for (auto dim : tensor.shape()) {
+      boost::hash_combine(h, dim);
+    }
+    boost::hash_combine(h, HashBytes(tensor.floats().data(),
+                                     tensor.floats_size() * sizeof(float)));
+  } else {
+    boost::hash_combine(h, input.SerializeAsString());
+  }
+  return h;
+}
+
+ResultCache::ResultCache(size_t capacity_bytes, std::chrono::milliseconds ttl)
+    : shard_capacity_(capacity_bytes / kNumShards), ttl_(ttl) {}
+
+uint64_t ResultCache::Key(uint64_t input_hash,
+                          const std::vector<std::string>& output_fields,
+                          uint32_t topk,
+                          const std::vector<RectProto>& windows) {
+  size_t h = input_hash;
+  for (const auto& field : output_fields) {
+    boost::hash_combine(h, field);
+  }
+  boost::hash_combine(h, topk);
+  for (const auto& rect : windows) {
+    boost::hash_combine(h, rect.left());
+    boost::hash_combine(h, rect.top());
+    boost::hash_combine(h, rect.right());
+    boost::hash_combine(h, rect.bottom());
+  }
+  return h;
+}
+
+ResultCache::LookupStatus ResultCache::Lookup(uint64_t key, uint64_t qid,
+                                              QueryResultProto* result) {
+  auto now = Clock::now();
+  auto& shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto iter = shard.entries.find(key);
+  if (iter != shard.entries.end()) {
+    if (iter->second->expire_time > now) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+      *result = iter->second->result;
+      num_hits_.fetch_add(1, std::memory_order_relaxed);
+      return kHit;
+    }
+    Erase(shard, iter->second);
+  }
+  auto inflight = shard.inflight.find(key);
+  if (inflight != shard.inflight.end() && inflight->second.deadline > now) {
+    inflight->second.waiters.push_back(qid);
+    num_coalesced_.fetch_add(1, std::memory_order_relaxed);
+    return kCoalesced;
+  }
+  if (inflight == shard.inflight.end()) {
+    shard.inflight.emplace(key, Inflight{qid, now + ttl_, {}});
+  } else {
+    // The query in flight got no result in time. Dispatch this one instead,
+    // and give its result to the queries waiting on the lost one.
+    inflight->second.leader = qid;
+    inflight->second.deadline = now + ttl_;
+  }
+  num_misses_.fetch_add(1, std::memory_order_relaxed);
+  return kMiss;
+}
+
+std::vector<uint64_t> ResultCache::Complete(uint64_t key,
+                                            const QueryResultProto& result) {
+  auto& shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::vector<uint64_t> waiters;
+  auto inflight = shard.inflight.find(key);
+  if (inflight != shard.inflight.end() &&
+      inflight->second.leader == result.query_id()) {
+    waiters = std::move(inflight->second.waiters);
+    shard.inflight.erase(inflight);
+  }
+  if (result.status() != CTRL_OK) {
+    return waiters;
+  }
+
+  auto iter = shard.entries.find(key);
+  if (iter != shard.entries.end()) {
+    Erase(shard, iter->second);
+  }
+  Entry entry;
+  entry.key = key;
+  entry.result.set_model_index(result.model_index());
+  entry.result.set_status(result.status());
+  *entry.result.mutable_output() = result.output();
+  entry.expire_time = Clock::now() + ttl_;
+  entry.bytes = sizeof(Entry) + entry.result.SpaceUsedLong();
+  if (entry.bytes > shard_capacity_) {
+    return waiters;
+  }
+  shard.bytes += entry.bytes;
+  shard.lru.push_front(std::move(entry));
+  shard.entries.emplace(key, shard.lru.begin());
+  while (shard.bytes > shard_capacity_) {
+    Erase(shard, std::prev(shard.lru.end()));
+  }
+  return waiters;
+}
+
+std::vector<uint64_t> ResultCache::ExpireInflight() {
+  auto now = Clock::now();
+  int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       now.time_since_epoch())
+                       .count();
+  int64_t ttl_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(ttl_).count();
+  // Only one caller scans the shards per TTL.
+  int64_t next_ns = next_expire_ns_.load(std::memory_order_relaxed);
+  if (now_ns < next_ns ||
+      !next_expire_ns_.compare_exchange_strong(next_ns, now_ns + ttl_ns)) {
+    return {};
+  }
+  std::vector<uint64_t> waiters;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto iter = shard.inflight.begin(); iter != shard.inflight.end();) {
+      if (iter->second.deadline > now) {
+        ++iter;
+        continue;
+      }
+      waiters.insert(waiters.end(), iter->second.waiters.begin(),
+                     iter->second.waiters.end());
+      iter = shard.inflight.erase(iter);
+    }
+  }
+  return waiters;
+}
+
+size_t ResultCache::size_bytes() const {
+  size_t bytes = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bytes += shard.bytes;
+  }
+  return bytes;
+}
+
+void ResultCache::Erase(Shard& shard, std::list<Entry>::iterator iter) {
+  shard.bytes -= iter->bytes;
+  shard.entries.erase(iter->key);
+  shard.lru.erase(iter);
+}
+
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,142 @@
+#ifndef NEXUS_APP_RESULT_CACHE_H_
+#define NEXUS_APP_RESULT_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/common/time_util.h"
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+namespace app {
+
+/*!
+ * \brief Hash of the bytes of a request input. Images are hashed by their
+ *   encoded bytes, so identical frames hash the same before any decoding.
+ */
+uint64_t HashInput(const ValueProto& input);
+
+/*!
+ * \brief Query results of one model session, keyed by the input and the
+ *   requested outputs of the query.
+ *
+ *   Identical queries that miss at the same time are coalesced: only the
+ *   first one is dispatched, and the rest get its result from Complete. A
+ *   query in flight that gets no result within the TTL is given up on, so
+ *   that a lost reply does not hold its waiters forever.
+ *   Entries expire after a TTL, and the least recently used ones are evicted
+ *   to stay within the memory bound. The cache is sharded by key, so that
+ *   lookups of different inputs rarely contend on a mutex.
+ *
+ *   Keys are 64-bit hashes. Two different inputs may collide, which is
+ *   unlikely with the few entries a frontend keeps.
+ */
+class ResultCache {
+ public:
+  enum LookupStatus {
+    /*! \brief The result is cached. */
+    kHit = 0,
+    /*! \brief The caller must dispatch the query, then call Complete. */
+    kMiss = 1,
+    /*!
+     * \brief An identical query is in flight. Complete or ExpireInflight
+     *   returns this query.
+     */
+    kCoalesced = 2,
+  };
+
+  static constexpr size_t kNumShards = 16;
+
+  ResultCache(size_t capacity_bytes, std::chrono::milliseconds ttl);
+
+  /*! \brief Key of a query on the input with the hash from HashInput. */
+  static uint64_t Key(uint64_t input_hash,
+                      const std::vector<std::string>& output_fields,
+                      uint32_t topk, const std::vector<RectProto>& windows);
+
+  /*!
+   * \brief Look up the result of a query.
+   * \param key Key of the query.
+   * \param qid Query id, used to deliver the result of a coalesced query.
+   * \param result Filled with the cached result on kHit. Its query id,
+   *   latency and clock are not set.
+   */
+  LookupStatus Lookup(uint64_t key, uint64_t qid, QueryResultProto* result);
+
+  /*!
+   * \brief Finish the query dispatched after kMiss. Successful results are
+   *   cached; errors are passed on to the coalesced queries only.
+   * \param result Result of the query, with its query id.
+   * \return Ids of the queries coalesced into it. Empty if the query was
+   *   given up on.
+   */
+  std::vector<uint64_t> Complete(uint64_t key, const QueryResultProto& result);
+
+  /*!
+   * \brief Give up on the queries in flight for longer than the TTL. Later
+   *   identical queries are dispatched again. Scans all shards at most once
+   *   per TTL, so it is cheap to call on every query.
+   * \return Ids of the queries coalesced into the ones given up on. They
+   *   get no result from Complete.
+   */
+  std::vector<uint64_t> ExpireInflight();
+
+  /*! \brief Memory used by cached entries. */
+  size_t size_bytes() const;
+
+  uint64_t num_hits() const { return num_hits_.load(); }
+
+  uint64_t num_misses() const { return num_misses_.load(); }
+
+  uint64_t num_coalesced() const { return num_coalesced_.load(); }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    QueryResultProto result;
+    TimePoint expire_time;
+    size_t bytes;
+  };
+
+  /*! \brief A dispatched query and the ones coalesced into it. */
+  struct Inflight {
+    uint64_t leader;
+    TimePoint deadline;
+    std::vector<uint64_t> waiters;
+  };
+
+  // Keep each shard on its own cache lines.
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    /*! \brief Most recently used first. */
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+    std::unordered_map<uint64_t, Inflight> inflight;
+    size_t bytes = 0;
+  };
+
+  Shard& GetShard(uint64_t key) { return shards_[key % kNumShards]; }
+
+  void Erase(Shard& shard, std::list<Entry>::iterator iter);
+
+  size_t shard_capacity_;
+  std::chrono::milliseconds ttl_;
+  std::array<Shard, kNumShards> shards_;
+  /*! \brief When ExpireInflight scans the shards next, in ns since epoch. */
+  std::atomic<int64_t> next_expire_ns_{0};
+  std::atomic<uint64_t> num_hits_{0};
+  std::atomic<uint64_t> num_misses_{0};
+  std::atomic<uint64_t> num_coalesced_{0};
+};
+
+}  // namespace app
+}  // namespace nexus
+
+#endif  // NEXUS_APP_RESULT_CACHE_H_
@@ -2,21 +2,33 @@
 #define NEXUS_APP_USER_SESSION_H_
 
 #include "nexus/common/connection.h"
+#include "nexus/common/token_bucket.h"
 
 namespace nexus {
 namespace app {
 
 class UserSession : public Connection {
  public:
-  UserSession(boost::asio::ip::tcp::socket socket, MessageHandler* handler)
-      : Connection(std::move(socket), handler), user_id_(0) {}
+  /*!
+   * \param rate_limit Requests per second the user may send. Non-positive
+   *   means unlimited.
+   * \param rate_burst Number of requests the user may send at once.
+   */
+  UserSession(boost::asio::ip::tcp::socket socket, MessageHandler* handler,
+              double rate_limit = 0, double rate_burst = 1)
+      : Connection(std::move(socket), handler),
+        user_id_(0),
+        rate_limit_(rate_limit, rate_burst) {}
 
   uint32_t user_id() const { return user_id_; }
 
   void set_user_id(uint32_t user_id) { user_id_ = user_id; }
 
+  TokenBucket& rate_limit() { return rate_limit_; }
+
  private:
   uint32_t user_id_;
+  TokenBucket rate_limit_;
 };
 
 }  // namespace app
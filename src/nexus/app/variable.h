@@ -0,0 +1,87 @@
+#ifndef NEXUS_APP_VARIABLE_H_
+#define NEXUS_APP_VARIABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nexus/app/model_handler.h"
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+namespace app {
+
+class Variable {
+ public:
+  Variable(std::string name, std::shared_ptr<QueryResult> result)
+      : name_(std::move(name)), data_{result} {
+    if (!result->ready()) {
+      pending_results_.push_back(result);
+    }
+  }
+
+  Variable(std::string name, std::vector<std::shared_ptr<QueryResult> > results)
+      : name_(std::move(name)), data_(std::move(results)) {
+    for (auto& r : data_) {
+      if (!r->ready()) {
+        pending_results_.push_back(r);
+      }
+    }
+  }
+
+  bool ready() const { return pending_results_.empty(); }
+
+  const std::string& name() const { return name_; }
+
+  size_t count() const { return data_.size(); }
+
+  std::shared_ptr<QueryResult> result() const {
+    if (data_.empty()) {
+      return nullptr;
+    }
+    return data_.at(0);
+  }
+
+  std::shared_ptr<QueryResult> operator[](int idx) const {
+    return data_.at(idx);
+  }
+
+  /*! \brief Results that are not ready yet. */
+  const std::vector<std::shared_ptr<QueryResult> >& pending_results() const {
+    return pending_results_;
+  }
+
+  std::vector<uint64_t> query_ids() const {
+    std::vector<uint64_t> qids;
+    for (auto& r : pending_results_) {
+      qids.push_back(r->query_id());
+    }
+    return qids;
+  }
+
+  bool AddQueryResult(const QueryResultProto& result) {
+    for (auto iter = pending_results_.begin(); iter != pending_results_.end();
+         ++iter) {
+      if ((*iter)->query_id() == result.query_id()) {
+        (*iter)->SetResult(result);
+        pending_results_.erase(iter);
+        break;
+      }
+    }
+    return pending_results_.empty();
+  }
+
+ private:
+  std::string name_;
+  std::vector<std::shared_ptr<QueryResult> > data_;
+  /*! \brief A variable waits for a few queries, so a vector is enough. */
+  std::vector<std::shared_ptr<QueryResult> > pending_results_;
+};
+
+using VariablePtr = std::shared_ptr<Variable>;
+
+}  // namespace app
+}  // namespace nexus
+
+#endif  // NEXUS_APP_VARIABLE_H_
@@ -5,8 +5,8 @@
 namespace nexus {
 namespace app {
 
-Worker::Worker(QueryProcessor* qp, RequestPool& req_pool)
-    : qp_(qp), req_pool_(req_pool), running_(false) {}
+Worker::Worker(QueryProcessor* qp, RequestPool& req_pool, size_t index)
+    : qp_(qp), req_pool_(req_pool), index_(index), running_(false) {}
 
 void Worker::Start() {
   running_ = true;
@@ -24,7 +24,7 @@ void Worker::Join() {
 void Worker::Run() {
   auto timeout = std::chrono::milliseconds(50);
   while (running_) {
-    auto req = req_pool_.GetRequest(timeout);
+    auto req = req_pool_.GetRequest(index_, timeout);
     if (req == nullptr) {
       continue;
     }
@@ -14,7 +14,7 @@ class Frontend;
 
 class Worker {
  public:
-  Worker(QueryProcessor* qp, RequestPool& req_pool);
+  Worker(QueryProcessor* qp, RequestPool& req_pool, size_t index);
 
   void Start();
 
@@ -27,6 +27,8 @@ class Worker {
  private:
   QueryProcessor* qp_;
   RequestPool& req_pool_;
+  /*! \brief Index of the worker in the RequestPool. */
+  size_t index_;
   volatile std::atomic_bool running_;
   std::thread thread_;
 };
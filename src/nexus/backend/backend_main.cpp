@@ -25,10 +25,14 @@ DEFINE_string(sch_addr, "127.0.0.1",
               "scheduler IP address "
               "(use default port 10001 if no port specified)");
 DEFINE_int32(gpu, 0, "gpu device ID (default: 0)");
+DEFINE_string(gpus, "",
+              "Host a logical backend on each of the GPUs, e.g., \"0-3\". "
+              "Without GPU support, each entry emulates a device on the CPU. "
+              "Overrides --gpu.");
 DEFINE_uint64(num_workers, 0, "number of workers (default: 0)");
 DEFINE_string(cores, "", "Specify cores to use, e.g., \"0-4\", or \"0-3,5\"");
 
-std::vector<int> ParseCores(std::string s) {
+std::vector<int> ParseIdList(std::string s) {
   std::vector<int> cores;
   std::vector<std::string> segs;
   SplitString(s, ',', &segs);
@@ -38,7 +42,7 @@ std::vector<int> ParseCores(std::string s) {
     } else {
       std::vector<std::string> range;
       SplitString(seg, '-', &range);
-      CHECK_EQ(range.size(), 2) << "Wrong format of cores";
+      CHECK_EQ(range.size(), 2) << "Wrong format of id list " << s;
       int beg = std::stoi(range[0]);
       int end = std::stoi(range[1]);
       for (int i = beg; i <= end; ++i) {
@@ -84,9 +88,15 @@ int main(int argc, char **argv) {
   }
 
   // Decide server IP address
+  std::vector<int> gpus;
+  if (FLAGS_gpus.empty()) {
+    gpus.push_back(FLAGS_gpu);
+  } else {
+    gpus = ParseIdList(FLAGS_gpus);
+  }
   LOG(INFO) << "Backend server: rdma_dev " << FLAGS_rdma_dev << ", port "
-            << FLAGS_port << ", workers " << FLAGS_num_workers << ", gpu "
-            << FLAGS_gpu;
+            << FLAGS_port << ", workers " << FLAGS_num_workers << ", gpus "
+            << (FLAGS_gpus.empty() ? std::to_string(FLAGS_gpu) : FLAGS_gpus);
   // Initialize _Hack_Images
   {
     ImageProto image;
@@ -94,9 +104,9 @@ int main(int argc, char **argv) {
     (void)_Hack_DecodeImageByFilename(image, ChannelOrder::CO_BGR);
   }
   // Create the backend server
-  std::vector<int> cores = ParseCores(FLAGS_cores);
+  std::vector<int> cores = ParseIdList(FLAGS_cores);
   BackendServer server(poller_type, FLAGS_rdma_dev, FLAGS_port, FLAGS_sch_addr,
-                       FLAGS_gpu, FLAGS_num_workers, cores);
+                       gpus, FLAGS_num_workers, cores);
   server_ptr = &server;
   server.Run();
   return 0;
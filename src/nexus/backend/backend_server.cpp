@@ -4,16 +4,21 @@
 #include <glog/logging.h>
 #include <pthread.h>
 
+#include <algorithm>
 #include <chrono>
+#include <fstream>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include <string>
 #include <unordered_set>
 
 #include "nexus/backend/gpu_executor.h"
 #include "nexus/backend/share_prefix_model.h"
 #include "nexus/backend/tf_share_model.h"
+#include "nexus/backend/utils.h"
 #include "nexus/common/config.h"
 #include "nexus/common/device.h"
 #include "nexus/common/model_db.h"
@@ -24,16 +29,69 @@
 #include "nexus/proto/nnquery.pb.h"
 
 DEFINE_int32(occupancy_valid, 10, "Backup backend occupancy valid time in ms");
+DEFINE_int32(model_load_parallelism, 2,
+             "Number of models that can be loaded concurrently");
+DEFINE_int32(backend_stats_log_interval_sec, 60,
+             "Interval to log execution statistics of each model in sec. "
+             "0 to disable.");
+DEFINE_bool(model_warmup, true,
+            "Warm up a model with representative batch sizes before reporting "
+            "it ready to the dispatcher");
 
 namespace nexus {
 namespace backend {
 
+namespace {
+
+/*! \brief Read a "<key>: <value> kB"-style field of /proc/self/status. */
+long ReadProcStatus(const std::string& key) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() &&
+        line[key.size()] == ':') {
+      return std::stol(line.substr(key.size() + 1));
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+BackendServer::LogicalBackend::LogicalBackend(int gpu_id,
+                                              ario::PollerType poller_type)
+    : node_id(0), gpu_id(gpu_id) {
+#ifdef USE_GPU
+  auto* gpu = DeviceManager::Singleton().GetGPUDevice(gpu_id);
+  gpu_name = gpu->device_name();
+  gpu_uuid = gpu->uuid();
+  gpu_memory = gpu->FreeMemory();
+#else
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  gpu_name = cpu->name();
+  gpu_uuid = "GenericCPU";
+  gpu_memory = 0;
+#endif
+
+  gpu_executor.reset(new GpuExecutorPlanFollower(gpu_id, poller_type));
+}
+
+ModelExecutorPtr BackendServer::LogicalBackend::GetModel(
+    uint32_t model_index) {
+  std::lock_guard<std::mutex> lock(model_table_mu);
+  if (model_index >= model_table.size()) {
+    return nullptr;
+  }
+  return model_table[model_index];
+}
+
 BackendServer::BackendServer(ario::PollerType poller_type, std::string rdma_dev,
-                             uint16_t port, std::string sch_addr, int gpu_id,
-                             size_t num_workers, std::vector<int> cores)
-    : gpu_id_(gpu_id),
-      rdma_dev_(std::move(rdma_dev)),
+                             uint16_t port, std::string sch_addr,
+                             std::vector<int> gpu_ids, size_t num_workers,
+                             std::vector<int> cores)
+    : rdma_dev_(std::move(rdma_dev)),
       rdma_port_(port),
+      start_time_(Clock::now()),
       executor_(poller_type),
       rdma_handler_(*this),
       small_buffers_(kSmallBufferPoolBits, kSmallBufferBlockBits),
@@ -42,18 +100,7 @@ BackendServer::BackendServer(ario::PollerType poller_type, std::string rdma_dev,
       rdma_sender_(&small_buffers_),
       running_(false),
       rand_gen_(rd_()) {
-#ifdef USE_GPU
-  auto* gpu = DeviceManager::Singleton().GetGPUDevice(gpu_id_);
-  gpu_name_ = gpu->device_name();
-  gpu_uuid_ = gpu->uuid();
-  gpu_memory_ = gpu->FreeMemory();
-#else
-  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
-  gpu_name_ = cpu->name();
-  gpu_uuid_ = "GenericCPU";
-  gpu_memory_ = 0;
-#endif
-
+  CHECK(!gpu_ids.empty()) << "At least one GPU is required";
   rdma_.RegisterLocalMemory(&large_buffers_);
   rdma_.ListenTcp(port);
 
@@ -70,26 +117,29 @@ BackendServer::BackendServer(ario::PollerType poller_type, std::string rdma_dev,
   rdma_ev_thread_ = std::thread(&ario::EpollExecutor::RunEventLoop, &executor_);
   dispatcher_conn_ = promise_dispatcher_conn_.get_future().get();
 
-  // Init GPU executor
+  // Init GPU executors, one per logical backend
   LOG(INFO) << "Using PlanFollower as GpuExecutor";
-  gpu_executor_.reset(new GpuExecutorPlanFollower(gpu_id, poller_type));
-  if (cores.empty()) {
-    gpu_executor_->Start();
-  } else {
-    gpu_executor_->Start(cores.back());
-    cores.pop_back();
-    // Pin IO thread to core
-    // cpu_set_t cpuset;
-    // CPU_ZERO(&cpuset);
-    // int io_core = cores.back();
-    // CPU_SET(io_core, &cpuset);
-    // int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
-    // &cpuset); if (rc != 0) {
-    //   LOG(ERROR) << "Error calling pthread_setaffinity_np: " << rc << "\n";
-    // }
-    // LOG(INFO) << "IO thread is pinned on CPU " << io_core;
-    // cores.pop_back();
+  for (int gpu_id : gpu_ids) {
+    auto backend = std::make_unique<LogicalBackend>(gpu_id, poller_type);
+    if (cores.empty()) {
+      backend->gpu_executor->Start();
+    } else {
+      backend->gpu_executor->Start(cores.back());
+      cores.pop_back();
+    }
+    backends_.push_back(std::move(backend));
   }
+  // Pin IO thread to core
+  // cpu_set_t cpuset;
+  // CPU_ZERO(&cpuset);
+  // int io_core = cores.back();
+  // CPU_SET(io_core, &cpuset);
+  // int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+  // &cpuset); if (rc != 0) {
+  //   LOG(ERROR) << "Error calling pthread_setaffinity_np: " << rc << "\n";
+  // }
+  // LOG(INFO) << "IO thread is pinned on CPU " << io_core;
+  // cores.pop_back();
 
   // Init workers
   if (num_workers == 0) {
@@ -122,10 +172,21 @@ void BackendServer::Run() {
   // Init node id and register backend to global scheduler
   Register();
   // Start the daemon thread
-  model_table_thread_ = std::thread(&BackendServer::ModelTableDaemon, this);
+  CHECK_GT(FLAGS_model_load_parallelism, 0);
+  for (int i = 0; i < FLAGS_model_load_parallelism; ++i) {
+    model_table_threads_.emplace_back(&BackendServer::ModelTableDaemon, this);
+  }
   daemon_thread_ = std::thread(&BackendServer::Daemon, this);
-  LOG(INFO) << "Backend server (id: " << node_id_ << ") is listening on "
-            << "port " << rdma_port_;
+  std::unordered_set<ario::RdmaQueuePair*> connections;
+  {
+    std::lock_guard<std::mutex> lock(mu_connections_);
+    connections = all_connections_;
+  }
+  LOG(INFO) << "Backend server with " << backends_.size()
+            << " logical backends is listening on port " << rdma_port_
+            << ". threads=" << ReadProcStatus("Threads")
+            << ", rss=" << ReadProcStatus("VmRSS") / 1024 << "MB"
+            << ", frontend_connections=" << connections.size();
 
   // Block forever
   rdma_ev_thread_.join();
@@ -146,7 +207,9 @@ void BackendServer::Stop() {
   node_connections_.clear();
   map_connection_nodeid_.clear();
 
-  gpu_executor_->Stop();
+  for (auto& backend : backends_) {
+    backend->gpu_executor->Stop();
+  }
   // Stop workers
   for (auto& worker : workers_) {
     worker->Stop();
@@ -156,9 +219,12 @@ void BackendServer::Stop() {
   if (daemon_thread_.joinable()) {
     daemon_thread_.join();
   }
-  if (model_table_thread_.joinable()) {
-    model_table_thread_.join();
+  for (auto& thread : model_table_threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
   }
+  model_table_threads_.clear();
   rdma_ev_thread_.join();
 
   LOG(INFO) << "Backend server stopped";
@@ -227,21 +293,31 @@ void BackendServer::RdmaHandler::OnRecv(ario::RdmaQueuePair* conn,
       // from Dispatcher
       auto& msg = *req.mutable_enqueue_query();
 
+      ControlMessage resp;
+      auto* reply = resp.mutable_enqueue_query_reply();
+      auto* backend = outer_.GetLogicalBackend(msg.backend_id());
+      if (!backend) {
+        reply->set_status(CtrlStatus::CTRL_SERVER_NOT_REGISTERED);
+        outer_.rdma_sender_.SendMessage(conn, resp);
+        break;
+      }
       auto model_index = msg.query_without_input().model_index();
-      CHECK_GT(outer_.model_table_.size(), model_index);
-      auto model_executor = outer_.model_table_[model_index];
-      CHECK(model_executor != nullptr);
-
+      auto model_executor = backend->GetModel(model_index);
+      if (model_executor == nullptr) {
+        LOG(ERROR) << "EnqueueQuery: model not loaded. model_index="
+                   << model_index;
+        reply->set_status(CtrlStatus::MODEL_SESSION_NOT_LOADED);
+        outer_.rdma_sender_.SendMessage(conn, resp);
+        break;
+      }
       auto task = std::make_shared<Task>(nullptr, model_executor);
       task->SetQuery(std::move(*msg.mutable_query_without_input()),
                      msg.rdma_read_offset(), msg.rdma_read_length());
       bool ok = outer_.EnqueueQuery(task);
-
-      ControlMessage resp;
-      auto* reply = resp.mutable_enqueue_query_reply();
       reply->set_status(ok ? CtrlStatus::CTRL_OK
                            : CtrlStatus(task->result.status()));
       outer_.rdma_sender_.SendMessage(conn, resp);
+      break;
     }
     case ControlMessage::MessageCase::kEnqueueBatchplan: {
       // from Dispatcher
@@ -308,17 +384,21 @@ void BackendServer::HandleFetchImageReply(ario::WorkRequestID wrid,
   }
   auto global_id = task->query.global_id();
 
-  // TODO: refactor preprocessing
-  constexpr int kSize = 224;
+  // The frontend stages the input with a StagedInputHeader. Convert the
+  // payload in place without decoding any protobuf.
   auto view = buf.AsMessageView();
-  auto* beg = reinterpret_cast<unsigned char*>(view.bytes());
-  auto len = view.bytes_length() / sizeof(*beg);
-  CHECK_EQ(len, kSize * kSize * 3);
-  auto* cpu_device = DeviceManager::Singleton().GetCPUDevice();
-  auto in_arr = std::make_shared<Array>(DT_FLOAT, len, cpu_device);
-  cv::Mat img(kSize, kSize, CV_8UC3, beg);
-  cv::Mat fimg(kSize, kSize, CV_32FC3, in_arr->Data<void>());
-  img.convertTo(fimg, CV_32FC3);
+  auto* model = task->model->model();
+  auto in_arr = StagedInputToModelInput(
+      reinterpret_cast<const char*>(view.bytes()), view.bytes_length(),
+      model->InputShape(), model->InputChannelsFirst());
+  if (in_arr == nullptr) {
+    LOG(ERROR) << "Cannot convert the staged input. global_id=" << global_id
+               << ", bytes=" << view.bytes_length();
+    task->result.set_status(INPUT_TYPE_INCORRECT);
+    task->result.set_error_message("Cannot convert the staged input");
+    MarkBatchPlanQueryFailed(std::move(task));
+    return;
+  }
   task->AppendInput(in_arr);
 
   task->query.mutable_clock()->set_backend_got_image_ns(backend_got_image_ns);
@@ -333,6 +413,11 @@ void BackendServer::HandleFetchImageReply(ario::WorkRequestID wrid,
   // task_queue_.push(std::move(task));
 
   task->stage = Stage::kForward;
+  auto ready_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now().time_since_epoch())
+                      .count();
+  task->model->stats().fetch_to_ready_us.Record(
+      (ready_ns - task->query.clock().backend_fetch_image_ns()) / 1000);
   MarkBatchPlanQueryPreprocessed(task);
 }
 
@@ -345,20 +430,33 @@ void BackendServer::LoadModelEnqueue(const BackendLoadModelCommand& request) {
 }
 
 void BackendServer::LoadModel(const BackendLoadModelCommand& request) {
-  // Start to update model table
-  std::lock_guard<std::mutex> lock(model_table_mu_);
   auto model_sess_id = ModelSessionToString(request.model_session());
-  VLOG(1) << "LoadModel: model_session=" << model_sess_id;
-  if (model_table_.size() <= request.model_index()) {
-    model_table_.resize(request.model_index() + 1);
-  }
-  if (model_table_[request.model_index()]) {
-    CHECK_EQ(model_table_[request.model_index()]->model()->model_session_id(),
-             model_sess_id);
-    LOG(INFO) << "Skip loading model session " << model_sess_id
-              << " because already loaded.";
+  auto model_index = request.model_index();
+  VLOG(1) << "LoadModel: model_session=" << model_sess_id
+          << ", backend_id=" << request.backend_id();
+  auto* backend = GetLogicalBackend(request.backend_id());
+  if (!backend) {
     return;
   }
+  auto& model_table = backend->model_table;
+  {
+    std::lock_guard<std::mutex> lock(backend->model_table_mu);
+    if (model_table.size() <= model_index) {
+      model_table.resize(model_index + 1);
+    }
+    if (model_table[model_index]) {
+      CHECK_EQ(model_table[model_index]->model()->model_session_id(),
+               model_sess_id);
+      LOG(INFO) << "Skip loading model session " << model_sess_id
+                << " because already loaded.";
+      return;
+    }
+    if (!backend->loading_models.insert(model_index).second) {
+      LOG(INFO) << "Skip loading model session " << model_sess_id
+                << " because it is being loaded.";
+      return;
+    }
+  }
 
   // Temporary adaptor to use existing ModelExecutor constructor.
   ModelInstanceConfig config;
@@ -368,18 +466,67 @@ void BackendServer::LoadModel(const BackendLoadModelCommand& request) {
 
   auto profile_id = ModelSessionToProfileID(request.model_session());
   auto* profile = ModelDatabase::Singleton().GetModelProfile(
-      gpu_name_, gpu_uuid_, profile_id);
-  if (!profile) return;
+      backend->gpu_name, backend->gpu_uuid, profile_id);
+  if (!profile) {
+    LOG(ERROR) << "Cannot find profile for model session " << model_sess_id;
+    {
+      std::lock_guard<std::mutex> lock(backend->model_table_mu);
+      backend->loading_models.erase(model_index);
+    }
+    NotifyModelReady(*backend, model_index,
+                     CtrlStatus::CTRL_INVALID_LOAD_MODEL_REQUEST);
+    return;
+  }
   auto memory_usage = profile->GetMemoryUsage(request.max_batch());
   config.set_memory_usage(memory_usage);
 
-  // Load new model instance
+  // Load new model instance. This is the slow part, so it runs outside of
+  // model_table_mu and other models can be loaded at the same time.
+  auto load_start = Clock::now();
   auto model = std::make_shared<ModelExecutor>(
-      gpu_id_, config, ModelIndex(request.model_index()), task_queue_);
-  model_table_[request.model_index()] = model;
-  gpu_executor_->AddModel(model);
-  LOG(INFO) << "Load model instance " << model_sess_id
-            << ", max_batch: " << config.max_batch();
+      backend->gpu_id, config, ModelIndex(model_index), task_queue_);
+  auto warmup_start = Clock::now();
+  if (FLAGS_model_warmup) {
+    model->Warmup(WarmupBatchSizes(request.max_batch()));
+  }
+  auto ready_time = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(backend->model_table_mu);
+    model_table[model_index] = model;
+    backend->loading_models.erase(model_index);
+  }
+  backend->gpu_executor->AddModel(model);
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  LOG(INFO) << "Load model instance " << model_sess_id << " on backend "
+            << backend->node_id << ", max_batch: " << config.max_batch()
+            << ", load: "
+            << duration_cast<milliseconds>(warmup_start - load_start).count()
+            << "ms, warmup: "
+            << duration_cast<milliseconds>(ready_time - warmup_start).count()
+            << "ms";
+  NotifyModelReady(*backend, model_index, CtrlStatus::CTRL_OK);
+}
+
+BackendServer::LogicalBackend* BackendServer::GetLogicalBackend(
+    uint32_t backend_id) {
+  for (auto& backend : backends_) {
+    if (backend->node_id == backend_id) {
+      return backend.get();
+    }
+  }
+  LOG(ERROR) << "Backend " << backend_id << " is not hosted by this server";
+  return nullptr;
+}
+
+void BackendServer::NotifyModelReady(const LogicalBackend& backend,
+                                     uint32_t model_index, CtrlStatus status) {
+  ControlMessage msg;
+  auto* ready = msg.mutable_backend_model_ready();
+  ready->set_node_id(backend.node_id);
+  ready->set_model_index(model_index);
+  ready->set_status(status);
+  rdma_sender_.SendMessage(dispatcher_conn_, msg);
 }
 
 bool BackendServer::EnqueueQuery(std::shared_ptr<Task> task) {
@@ -425,6 +572,21 @@ void BackendServer::HandleEnqueueBatchPlan(BatchPlanProto&& req,
                              Clock::now().time_since_epoch())
                              .count();
 
+  auto* backend = GetLogicalBackend(req.backend_id());
+  if (!backend) {
+    reply->set_status(CtrlStatus::CTRL_SERVER_NOT_REGISTERED);
+    return;
+  }
+  // Find the model of the plan
+  auto plan_model_index = req.model_index();
+  auto model_executor = backend->GetModel(plan_model_index);
+  if (model_executor == nullptr) {
+    LOG(ERROR) << "HandleEnqueueBatchPlan: model not loaded. model_index="
+               << plan_model_index << ", plan_id=" << req.plan_id();
+    reply->set_status(CtrlStatus::MODEL_SESSION_NOT_LOADED);
+    return;
+  }
+
   // Add batchplan
   auto plan = std::make_shared<BatchPlanContext>(std::move(req));
   {
@@ -434,22 +596,36 @@ void BackendServer::HandleEnqueueBatchPlan(BatchPlanProto&& req,
                  << plan->proto().plan_id();
       return;
     }
-    pending_plans_[plan->plan_id()] = plan;
+    pending_plans_[plan->plan_id()] = PendingPlan{plan, backend};
   }
 
   // Acquire input array
-  CHECK_GT(model_table_.size(), req.model_index());
-  auto model_executor = model_table_[req.model_index()];
-  CHECK(model_executor != nullptr);
   plan->SetInputArray(model_executor->AcquireInputArray());
 
   // Enqueue queries
   reply->set_status(CtrlStatus::CTRL_OK);
   for (const auto& query : plan->proto().queries()) {
-    auto task = std::make_shared<Task>(nullptr, model_executor);
+    // Queries of other models in the prefix group of the plan model keep
+    // their own model index. The dispatcher clears the rest.
+    auto model_index = query.query_without_input().model_index();
+    auto query_executor = model_executor;
+    if (model_index != 0 && model_index != plan_model_index) {
+      query_executor = backend->GetModel(model_index);
+      if (query_executor == nullptr) {
+        LOG(ERROR) << "Prefix group member not loaded. model_index="
+                   << model_index << ", plan_id=" << plan->plan_id().t;
+        plan->MarkQueryDropped(
+            GlobalId(query.query_without_input().global_id()));
+        reply->set_status(CtrlStatus::MODEL_SESSION_NOT_LOADED);
+        continue;
+      }
+    } else {
+      model_index = plan_model_index;
+    }
+    auto task = std::make_shared<Task>(nullptr, query_executor);
     task->SetQuery(query.query_without_input(), query.rdma_read_offset(),
                    query.rdma_read_length());
-    task->query.set_model_index(plan->proto().model_index());
+    task->query.set_model_index(model_index);
     task->SetPlanId(plan->plan_id());
     task->query.mutable_clock()->set_backend_recv_ns(backend_recv_ns);
     bool ok = EnqueueQuery(task);
@@ -461,9 +637,21 @@ void BackendServer::HandleEnqueueBatchPlan(BatchPlanProto&& req,
 }
 
 void BackendServer::MarkBatchPlanQueryPreprocessed(std::shared_ptr<Task> task) {
+  UpdatePendingPlan(std::move(task), false);
+}
+
+void BackendServer::MarkBatchPlanQueryFailed(std::shared_ptr<Task> task) {
+  UpdatePendingPlan(task, true);
+  task->stage = Stage::kPostprocess;
+  task->enqueue_time = Clock::now();
+  task_queue_.push(std::move(task));
+}
+
+void BackendServer::UpdatePendingPlan(std::shared_ptr<Task> task,
+                                      bool dropped) {
   CHECK(task->plan_id.has_value());
   auto plan_id = task->plan_id.value();
-  std::shared_ptr<BatchPlanContext> ready_plan;
+  std::optional<PendingPlan> ready_plan;
   {
     std::lock_guard<std::mutex> lock(mu_pending_plans_);
     auto iter = pending_plans_.find(plan_id);
@@ -472,28 +660,69 @@ void BackendServer::MarkBatchPlanQueryPreprocessed(std::shared_ptr<Task> task) {
                  << ", global_id=" << task->query.global_id();
       return;
     }
-    auto plan = iter->second;
-    plan->AddPreprocessedTask(task);
+    auto& plan = iter->second.plan;
+    if (dropped) {
+      plan->MarkQueryDropped(GlobalId(task->query.global_id()));
+    } else {
+      plan->AddPreprocessedTask(task);
+    }
     if (plan->IsReadyToRun()) {
-      ready_plan = plan;
+      ready_plan = std::move(iter->second);
       pending_plans_.erase(iter);
     }
   }
-  if (ready_plan) {
-    gpu_executor_->AddBatchPlan(ready_plan);
+  if (ready_plan.has_value()) {
+    ready_plan->backend->gpu_executor->AddBatchPlan(
+        std::move(ready_plan->plan));
   }
 }
 
+std::vector<ModelExecStatsSnapshot> BackendServer::GetExecStats() {
+  std::vector<ModelExecStatsSnapshot> snapshots;
+  for (auto& backend : backends_) {
+    std::vector<ModelExecutorPtr> model_table;
+    {
+      std::lock_guard<std::mutex> lock(backend->model_table_mu);
+      model_table = backend->model_table;
+    }
+    for (const auto& m : model_table) {
+      if (!m) {
+        continue;
+      }
+      auto name = m->model()->model_session_id();
+      if (backends_.size() > 1) {
+        name += "@" + std::to_string(backend->node_id);
+      }
+      snapshots.push_back(m->stats().Snapshot(name));
+    }
+  }
+  return snapshots;
+}
+
 void BackendServer::Daemon() {
+  auto next_stats_log_time =
+      Clock::now() + std::chrono::seconds(FLAGS_backend_stats_log_interval_sec);
   while (running_) {
     auto next_time = Clock::now() + std::chrono::seconds(beacon_interval_sec_);
     KeepAlive();
+    if (FLAGS_backend_stats_log_interval_sec > 0 &&
+        Clock::now() >= next_stats_log_time) {
+      next_stats_log_time +=
+          std::chrono::seconds(FLAGS_backend_stats_log_interval_sec);
+      for (const auto& snapshot : GetExecStats()) {
+        LOG(INFO) << "Execution stats of " << snapshot.ToString();
+      }
+    }
     std::vector<ModelExecutorPtr> model_table;
-    {
-      std::lock_guard<std::mutex> lock(model_table_mu_);
-      model_table = model_table_;
+    for (auto& backend : backends_) {
+      std::lock_guard<std::mutex> lock(backend->model_table_mu);
+      model_table.insert(model_table.end(), backend->model_table.begin(),
+                         backend->model_table.end());
     }
     for (const auto& m : model_table) {
+      if (!m) {
+        continue;
+      }
       double rps = m->GetRequestRate();
       double drop_rate = m->GetDropRate();
       if (rps > 0.1) {
@@ -526,52 +755,72 @@ void BackendServer::ModelTableDaemon() {
 }
 
 void BackendServer::Register() {
-  // Init node id
   std::uniform_int_distribution<uint32_t> dis(
       1, std::numeric_limits<uint32_t>::max());
-  node_id_ = dis(rand_gen_);
-
-  // Prepare request
-  ControlMessage msg;
-  auto& request = *msg.mutable_register_request();
-  request.set_node_type(BACKEND_NODE);
-  request.set_node_id(node_id_);
-  request.set_port(rdma_port_);
-  request.set_gpu_device_name(gpu_name_);
-  request.set_gpu_uuid(gpu_uuid_);
-  request.set_gpu_available_memory(gpu_memory_);
-
-  rdma_sender_.SendMessage(dispatcher_conn_, msg);
-  auto reply = std::move(promise_register_reply_.get_future().get());
-  if (reply.status() == CtrlStatus::CTRL_OK) {
-    beacon_interval_sec_ = reply.beacon_interval_sec();
-    VLOG(1) << "Register done.";
-  } else {
-    LOG(FATAL) << "Failed to register frontend to dispatcher: "
-               << CtrlStatus_Name(reply.status());
+  // The dispatcher replies in order on the shared connection, so logical
+  // backends register one at a time.
+  for (auto& backend : backends_) {
+    // Init node id
+    do {
+      backend->node_id = dis(rand_gen_);
+    } while (std::count_if(backends_.begin(), backends_.end(),
+                           [&backend](const auto& other) {
+                             return other->node_id == backend->node_id;
+                           }) > 1);
+
+    // Prepare request
+    ControlMessage msg;
+    auto& request = *msg.mutable_register_request();
+    request.set_node_type(BACKEND_NODE);
+    request.set_node_id(backend->node_id);
+    request.set_port(rdma_port_);
+    request.set_gpu_device_name(backend->gpu_name);
+    request.set_gpu_uuid(backend->gpu_uuid);
+    request.set_gpu_available_memory(backend->gpu_memory);
+
+    promise_register_reply_ = std::promise<RegisterReply>();
+    rdma_sender_.SendMessage(dispatcher_conn_, msg);
+    auto reply = std::move(promise_register_reply_.get_future().get());
+    if (reply.status() == CtrlStatus::CTRL_OK) {
+      beacon_interval_sec_ = reply.beacon_interval_sec();
+      auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+          Clock::now() - start_time_);
+      LOG(INFO) << "Registered backend " << backend->node_id << " on GPU "
+                << backend->gpu_id << ". start_delay=" << delay.count()
+                << "ms";
+    } else {
+      LOG(FATAL) << "Failed to register backend to dispatcher: "
+                 << CtrlStatus_Name(reply.status());
+    }
   }
 }
 
 void BackendServer::Unregister() {
-  ControlMessage msg;
-  auto& request = *msg.mutable_unregister_request();
-  request.set_node_type(BACKEND_NODE);
-  request.set_node_id(node_id_);
-
-  rdma_sender_.SendMessage(dispatcher_conn_, msg);
-  auto reply = std::move(promise_unregister_reply_.get_future().get());
-  CtrlStatus ret = reply.status();
-  if (ret != CTRL_OK) {
-    LOG(ERROR) << "Unregister error: " << CtrlStatus_Name(ret);
+  for (auto& backend : backends_) {
+    ControlMessage msg;
+    auto& request = *msg.mutable_unregister_request();
+    request.set_node_type(BACKEND_NODE);
+    request.set_node_id(backend->node_id);
+
+    promise_unregister_reply_ = std::promise<RpcReply>();
+    rdma_sender_.SendMessage(dispatcher_conn_, msg);
+    auto reply = std::move(promise_unregister_reply_.get_future().get());
+    CtrlStatus ret = reply.status();
+    if (ret != CTRL_OK) {
+      LOG(ERROR) << "Unregister error: " << CtrlStatus_Name(ret)
+                 << ". backend_id=" << backend->node_id;
+    }
   }
 }
 
 void BackendServer::KeepAlive() {
-  ControlMessage resp;
-  auto* reply = resp.mutable_inform_alive();
-  reply->set_node_type(NodeType::BACKEND_NODE);
-  reply->set_node_id(node_id_);
-  rdma_sender_.SendMessage(dispatcher_conn_, resp);
+  for (auto& backend : backends_) {
+    ControlMessage resp;
+    auto* reply = resp.mutable_inform_alive();
+    reply->set_node_type(NodeType::BACKEND_NODE);
+    reply->set_node_id(backend->node_id);
+    rdma_sender_.SendMessage(dispatcher_conn_, resp);
+  }
 }
 
 }  // namespace backend
@@ -14,6 +14,7 @@
 
 #include "ario/ario.h"
 #include "nexus/backend/batch_plan_context.h"
+#include "nexus/backend/exec_stats.h"
 #include "nexus/backend/gpu_executor.h"
 #include "nexus/backend/model_exec.h"
 #include "nexus/backend/task.h"
@@ -23,6 +24,7 @@
 #include "nexus/common/model_def.h"
 #include "nexus/common/rdma_sender.h"
 #include "nexus/common/spinlock.h"
+#include "nexus/common/time_util.h"
 #include "nexus/common/typedef.h"
 #include "nexus/proto/control.pb.h"
 
@@ -30,28 +32,30 @@ namespace nexus {
 namespace backend {
 
 /*!
- * \brief Backend server runs on top of a GPU, handles queries from frontends,
- *   and executes model instances on GPU.
+ * \brief Backend server runs on top of one or more GPUs, handles queries from
+ *   frontends, and executes model instances on GPU. Each GPU is registered to
+ *   the dispatcher as a logical backend with its own node id and plan
+ *   follower. Logical backends share the RDMA transport, the connections to
+ *   the dispatcher and frontends, and the worker pool.
  */
 class BackendServer {
  public:
   /*!
    * \brief Constructs a backend server
    * \param port Port number for receiving requests
-   * \param rpc_port Port number for RPC server and control messages
    * \param sch_addr Scheduler IP address, if no port specified, use default
-   * port 10001 \param num_workers Number of worker threads \param gpu_id GPU
-   * device ID \param model_db_root Model database root directory path
+   *   port 10001
+   * \param gpu_ids GPU device IDs, one logical backend per entry. Without GPU
+   *   support, each entry is an emulated device on the CPU.
+   * \param num_workers Number of worker threads
    */
   BackendServer(ario::PollerType poller_type, std::string rdma_dev,
-                uint16_t port, std::string sch_addr, int gpu_id,
+                uint16_t port, std::string sch_addr, std::vector<int> gpu_ids,
                 size_t num_workers = 0, std::vector<int> cores = {});
   /*! \brief Deconstructs backend server */
   ~BackendServer();
-  /*! \brief Get backend node ID */
-  uint32_t node_id() const { return node_id_; }
-  /*! \brief Get GPU device ID */
-  int gpu_id() const { return gpu_id_; }
+  /*! \brief Get the number of logical backends */
+  size_t num_backends() const { return backends_.size(); }
   /*! \brief Starts the backend server */
   void Run();
   /*! \brief Stops the backend server */
@@ -61,25 +65,77 @@ class BackendServer {
   void LoadModel(const BackendLoadModelCommand& req);
   void HandleEnqueueBatchPlan(BatchPlanProto&& req, RpcReply* reply);
   void MarkBatchPlanQueryPreprocessed(std::shared_ptr<Task> task);
+  /*! \brief Snapshot of the execution statistics of all loaded models. */
+  std::vector<ModelExecStatsSnapshot> GetExecStats();
 
  private:
   /*! \brief Daemon thread that sends stats to scheduler periodically. */
   void Daemon();
 
+  /*! \brief Loader thread that loads models requested by the dispatcher. */
   void ModelTableDaemon();
-  /*! \brief Register this backend server to global scheduler. */
-  void Register();
-  /*! \brief Unregister this backend server to global scheduler. */
-  void Unregister();
   /*!
-   * \brief Send model workload history to global scheduler.
-   * \param request Workload history protobuf.
+   * \brief A device registered to the dispatcher as a backend of its own.
+   */
+  struct LogicalBackend {
+    LogicalBackend(int gpu_id, ario::PollerType poller_type);
+
+    /*!
+     * \brief Get the model at a ModelIndex.
+     * \return nullptr if the model is not loaded yet.
+     */
+    ModelExecutorPtr GetModel(uint32_t model_index);
+
+    /*! \brief Backend node id */
+    uint32_t node_id;
+    /*! \brief GPU device index */
+    int gpu_id;
+    std::string gpu_name;
+    std::string gpu_uuid;
+    size_t gpu_memory;
+    /*! \brief GPU executor */
+    std::unique_ptr<GpuExecutorPlanFollower> gpu_executor;
+    /*!
+     * \brief Mapping from ModelIndex to model instance.
+     * Guarded by model_table_mu.
+     */
+    std::vector<ModelExecutorPtr> model_table;
+    /*! \brief ModelIndex of models being loaded. Guarded by model_table_mu. */
+    std::unordered_set<uint32_t> loading_models;
+    /*! \brief Mutex for accessing model_table */
+    std::mutex model_table_mu;
+  };
+
+  struct PendingPlan {
+    std::shared_ptr<BatchPlanContext> plan;
+    LogicalBackend* backend;
+  };
+
+  /*!
+   * \brief Find the logical backend that a dispatcher message is sent to.
+   * \return nullptr if the backend is not hosted by this server.
    */
+  LogicalBackend* GetLogicalBackend(uint32_t backend_id);
+  /*! \brief Tell the dispatcher that a model is ready to execute plans. */
+  void NotifyModelReady(const LogicalBackend& backend, uint32_t model_index,
+                        CtrlStatus status);
+  /*! \brief Register all logical backends to global scheduler. */
+  void Register();
+  /*! \brief Unregister all logical backends from global scheduler. */
+  void Unregister();
+  /*! \brief Tell global scheduler that all logical backends are alive. */
   void KeepAlive();
 
   bool EnqueueQuery(std::shared_ptr<Task> task);
   void HandleFetchImageReply(ario::WorkRequestID wrid,
                              ario::OwnedMemoryBlock buf);
+  /*!
+   * \brief Drop the query from its batch plan and reply the error of the
+   *   task to the frontend.
+   */
+  void MarkBatchPlanQueryFailed(std::shared_ptr<Task> task);
+  /*! \brief Add the query to its pending plan, or drop it from the plan. */
+  void UpdatePendingPlan(std::shared_ptr<Task> task, bool dropped);
 
   class RdmaHandler : public ario::RdmaEventHandler {
    public:
@@ -99,13 +155,10 @@ class BackendServer {
   };
 
  private:
-  /*! \brief GPU device index */
-  int gpu_id_;
   std::string rdma_dev_;
   uint16_t rdma_port_;
-  std::string gpu_name_;
-  std::string gpu_uuid_;
-  size_t gpu_memory_;
+  /*! \brief Time when the server is constructed. */
+  TimePoint start_time_;
 
   ario::EpollExecutor executor_;
   RdmaHandler rdma_handler_;
@@ -125,8 +178,6 @@ class BackendServer {
   uint32_t beacon_interval_sec_;
   /*! \brief Flag for whether backend and daemon thread is running */
   std::atomic_bool running_;
-  /*! \brief Backend node id */
-  uint32_t node_id_;
   /*! \brief Daemon thread */
   std::thread daemon_thread_;
 
@@ -141,18 +192,11 @@ class BackendServer {
   BlockPriorityQueue<Task> task_queue_;
   /*! \brief Worker thread pool */
   std::vector<std::unique_ptr<Worker>> workers_;
-  /*! \brief GPU executor */
-  std::unique_ptr<GpuExecutorPlanFollower> gpu_executor_;
-  /*!
-   * \brief Mapping from ModelIndex to model instance.
-   * Guarded by model_table_mu_.p
-   */
-  std::vector<ModelExecutorPtr> model_table_;
-  std::thread model_table_thread_;
+  /*! \brief Logical backends hosted by this server. */
+  std::vector<std::unique_ptr<LogicalBackend>> backends_;
+  std::vector<std::thread> model_table_threads_;
 
   BlockQueue<BackendLoadModelCommand> model_table_requests_;
-  /*! \brief Mutex for accessing model_table_ */
-  std::mutex model_table_mu_;
   /*! \brief Random number genertor */
   std::random_device rd_;
   std::mt19937 rand_gen_;
@@ -164,7 +208,7 @@ class BackendServer {
 
   // Batch plans waiting for image and not added to gpu_executor_ yet.
   std::mutex mu_pending_plans_;
-  std::unordered_map<PlanId, std::shared_ptr<BatchPlanContext>> pending_plans_;
+  std::unordered_map<PlanId, PendingPlan> pending_plans_;
 };
 
 }  // namespace backend
@@ -2,6 +2,8 @@
 
 #include <glog/logging.h>
 
+#include <chrono>
+
 #include "nexus/backend/task.h"
 
 namespace nexus {
@@ -9,16 +11,33 @@ namespace backend {
 
 BatchPlanContext::BatchPlanContext(BatchPlanProto proto)
     : proto_(std::move(proto)), plan_id_(proto_.plan_id()) {
-  for (const auto& query : proto_.queries()) {
+  uint32_t plan_size = proto_.queries_size();
+
+  // Keep the load factor of the GlobalId table at most 1/2.
+  slot_bits_ = 3;
+  while ((size_t(1) << slot_bits_) < size_t(plan_size) * 2) {
+    ++slot_bits_;
+  }
+  slot_keys_.resize(size_t(1) << slot_bits_);
+  slot_indexes_.resize(size_t(1) << slot_bits_, kEmptySlot);
+  pending_bitmap_.resize((plan_size + 63) / 64);
+  dropped_bitmap_.resize((plan_size + 63) / 64);
+
+  for (uint32_t i = 0; i < plan_size; ++i) {
+    const auto& query = proto_.queries(i);
     auto global_id = GlobalId(query.query_without_input().global_id());
-    auto pair = global_ids_.insert(global_id);
-    if (!pair.second) {
+    if (FindQueryIndex(global_id) != kEmptySlot) {
       LOG(ERROR) << "Duplicated query in BatchPlan. global_id=" << global_id.t
                  << ", plan_id=" << plan_id_.t;
+      continue;
     }
+    InsertQueryIndex(global_id, i);
+    SetBit(pending_bitmap_, i);
+    ++num_queries_;
   }
-  pending_queries_ = global_ids_;
-  batch_task_ = std::make_shared<BatchTask>(proto_.queries_size());
+  num_pending_ = num_queries_;
+  preprocessed_task_.reserve(num_queries_);
+  batch_task_ = std::make_shared<BatchTask>(plan_size);
 }
 
 BatchPlanContext::~BatchPlanContext() {
@@ -37,47 +56,104 @@ std::shared_ptr<Array> BatchPlanContext::ReleaseInputArray() {
   return ret;
 }
 
-bool BatchPlanContext::MarkQueryProcessed(GlobalId global_id) {
-  if (!global_ids_.count(global_id)) {
-    LOG(ERROR)
-        << "MarkQueryProcessed: Query not belong to BatchPlan. global_id="
-        << global_id.t << ", plan_id=" << plan_id_.t;
-    return false;
+size_t BatchPlanContext::SlotOf(GlobalId global_id) const {
+  // Fibonacci hashing. GlobalIds are sequential, so the high bits of the
+  // product spread them well over the table.
+  return (global_id.t * 0x9E3779B97F4A7C15ULL) >> (64 - slot_bits_);
+}
+
+void BatchPlanContext::InsertQueryIndex(GlobalId global_id, uint32_t index) {
+  size_t mask = slot_indexes_.size() - 1;
+  size_t slot = SlotOf(global_id);
+  while (slot_indexes_[slot] != kEmptySlot) {
+    slot = (slot + 1) & mask;
   }
-  auto iter = pending_queries_.find(global_id);
-  if (iter == pending_queries_.end()) {
-    LOG(ERROR)
-        << "MarkQueryProcessed: Query is not in pending state. global_id="
-        << global_id.t << ", plan_id=" << plan_id_.t;
-    return false;
+  slot_keys_[slot] = global_id.t;
+  slot_indexes_[slot] = index;
+}
+
+uint32_t BatchPlanContext::FindQueryIndex(GlobalId global_id) const {
+  size_t mask = slot_indexes_.size() - 1;
+  size_t slot = SlotOf(global_id);
+  while (slot_indexes_[slot] != kEmptySlot) {
+    if (slot_keys_[slot] == global_id.t) {
+      return slot_indexes_[slot];
+    }
+    slot = (slot + 1) & mask;
   }
-  pending_queries_.erase(iter);
-  return true;
+  return kEmptySlot;
+}
+
+BatchPlanContext::QueryState BatchPlanContext::GetQueryState(
+    GlobalId global_id) const {
+  auto index = FindQueryIndex(global_id);
+  if (index == kEmptySlot) {
+    return QueryState::kNotFound;
+  }
+  if (TestBit(pending_bitmap_, index)) {
+    return QueryState::kPending;
+  }
+  if (TestBit(dropped_bitmap_, index)) {
+    return QueryState::kDropped;
+  }
+  return QueryState::kPreprocessed;
+}
+
+TimePoint BatchPlanContext::GetQueryDeadline(GlobalId global_id) const {
+  auto index = FindQueryIndex(global_id);
+  if (index == kEmptySlot) {
+    return TimePoint::max();
+  }
+  auto deadline_ns = proto_.queries(index).deadline_ns();
+  if (deadline_ns == 0) {
+    return TimePoint::max();
+  }
+  return TimePoint(std::chrono::nanoseconds(deadline_ns));
 }
 
-void BatchPlanContext::MarkQueryDropped(GlobalId global_id) {
-  if (!MarkQueryProcessed(global_id)) {
-    return;
+uint32_t BatchPlanContext::MarkQueryProcessed(GlobalId global_id,
+                                              const char* caller) {
+  auto index = FindQueryIndex(global_id);
+  if (index == kEmptySlot) {
+    LOG(ERROR) << caller << ": Query not belong to BatchPlan. global_id="
+               << global_id.t << ", plan_id=" << plan_id_.t;
+    return kEmptySlot;
   }
-  dropped_queries_.insert(global_id);
+  if (!TestBit(pending_bitmap_, index)) {
+    LOG(ERROR) << caller << ": Query is not in pending state. global_id="
+               << global_id.t << ", plan_id=" << plan_id_.t;
+    return kEmptySlot;
+  }
+  ClearBit(pending_bitmap_, index);
+  --num_pending_;
+  return index;
 }
 
-void BatchPlanContext::AddPreprocessedTask(std::shared_ptr<Task> task) {
+bool BatchPlanContext::MarkQueryDropped(GlobalId global_id) {
+  auto index = MarkQueryProcessed(global_id, "MarkQueryDropped");
+  if (index == kEmptySlot) {
+    return false;
+  }
+  SetBit(dropped_bitmap_, index);
+  ++num_dropped_;
+  return true;
+}
+
+bool BatchPlanContext::AddPreprocessedTask(std::shared_ptr<Task> task) {
   auto global_id = GlobalId(task->query.global_id());
-  if (!MarkQueryProcessed(global_id)) {
-    return;
+  if (MarkQueryProcessed(global_id, "AddPreprocessedTask") == kEmptySlot) {
+    return false;
   }
-  preprocessed_task_.push_back(task);
 
   // Memory copy
   CHECK(input_array_ != nullptr) << "input_array_ was not set";
   for (auto& input : task->inputs) {
     batch_task_->AppendInput(input, task);
   }
+  preprocessed_task_.push_back(std::move(task));
+  return true;
 }
 
-bool BatchPlanContext::IsReadyToRun() const { return pending_queries_.empty(); }
-
 std::vector<std::shared_ptr<Task>> BatchPlanContext::PopPreprocessedTasks() {
   CHECK_EQ(has_populated_, false)
       << "BatchPlan populated before. plan_id=" << plan_id_.t;
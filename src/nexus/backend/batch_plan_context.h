@@ -1,8 +1,8 @@
 #ifndef NEXUS_BACKEND_BATCH_PLAN_CONTEXT_H_
 #define NEXUS_BACKEND_BATCH_PLAN_CONTEXT_H_
 
+#include <cstdint>
 #include <memory>
-#include <unordered_set>
 #include <vector>
 
 #include "nexus/backend/batch_task.h"
@@ -15,8 +15,23 @@ namespace backend {
 
 class Task;
 
+/*!
+ * \brief BatchPlanContext tracks the queries of a BatchPlan on the backend
+ *   until all of them are either preprocessed or dropped.
+ *
+ * Queries are identified by their index in the plan. GlobalIds are mapped to
+ * indexes once at construction with a small open-addressing table, and the
+ * per-query state is kept in bitmaps.
+ */
 class BatchPlanContext {
  public:
+  enum class QueryState {
+    kPending,
+    kPreprocessed,
+    kDropped,
+    kNotFound,
+  };
+
   explicit BatchPlanContext(BatchPlanProto proto);
   ~BatchPlanContext();
   const BatchPlanProto& proto() const { return proto_; }
@@ -29,19 +44,67 @@ class BatchPlanContext {
 
   void SetInputArray(std::shared_ptr<Array> input_array);
   std::shared_ptr<Array> ReleaseInputArray();
-  void MarkQueryDropped(GlobalId global_id);
-  void AddPreprocessedTask(std::shared_ptr<Task> task);
-  bool IsReadyToRun() const;
+  /*!
+   * \brief Mark a pending query as dropped.
+   * \return false if the query is not in the plan or not pending.
+   */
+  bool MarkQueryDropped(GlobalId global_id);
+  /*!
+   * \brief Mark a pending query as preprocessed and copy its inputs to the
+   *   batch input array.
+   * \return false if the query is not in the plan or not pending.
+   */
+  bool AddPreprocessedTask(std::shared_ptr<Task> task);
+  bool IsReadyToRun() const { return num_pending_ == 0; }
   std::vector<std::shared_ptr<Task>> PopPreprocessedTasks();
 
+  QueryState GetQueryState(GlobalId global_id) const;
+  /*!
+   * \brief Latest time that the query should finish execution.
+   * \return TimePoint::max() if the query is not in the plan or the plan does
+   *   not carry its deadline.
+   */
+  TimePoint GetQueryDeadline(GlobalId global_id) const;
+  uint32_t num_queries() const { return num_queries_; }
+  uint32_t num_pending() const { return num_pending_; }
+  uint32_t num_dropped() const { return num_dropped_; }
+  uint32_t num_preprocessed() const {
+    return num_queries_ - num_pending_ - num_dropped_;
+  }
+
  private:
-  bool MarkQueryProcessed(GlobalId global_id);
+  static constexpr uint32_t kEmptySlot = UINT32_MAX;
+
+  void InsertQueryIndex(GlobalId global_id, uint32_t index);
+  uint32_t FindQueryIndex(GlobalId global_id) const;
+  size_t SlotOf(GlobalId global_id) const;
+  /*! \brief Returns the query index, or kEmptySlot if not pending. */
+  uint32_t MarkQueryProcessed(GlobalId global_id, const char* caller);
+
+  static bool TestBit(const std::vector<uint64_t>& bitmap, uint32_t index) {
+    return (bitmap[index >> 6] >> (index & 63)) & 1;
+  }
+  static void SetBit(std::vector<uint64_t>& bitmap, uint32_t index) {
+    bitmap[index >> 6] |= uint64_t(1) << (index & 63);
+  }
+  static void ClearBit(std::vector<uint64_t>& bitmap, uint32_t index) {
+    bitmap[index >> 6] &= ~(uint64_t(1) << (index & 63));
+  }
 
   BatchPlanProto proto_;
   PlanId plan_id_;
-  std::unordered_set<GlobalId> global_ids_;
-  std::unordered_set<GlobalId> pending_queries_;
-  std::unordered_set<GlobalId> dropped_queries_;
+  /*! \brief Number of distinct queries in the plan. */
+  uint32_t num_queries_ = 0;
+  uint32_t num_pending_ = 0;
+  uint32_t num_dropped_ = 0;
+  /*! \brief log2 of the number of slots in the GlobalId table. */
+  int slot_bits_;
+  std::vector<uint64_t> slot_keys_;
+  std::vector<uint32_t> slot_indexes_;
+  /*! \brief Bit i is set if query i in the plan is pending. */
+  std::vector<uint64_t> pending_bitmap_;
+  /*! \brief Bit i is set if query i in the plan is dropped. */
+  std::vector<uint64_t> dropped_bitmap_;
   std::vector<std::shared_ptr<Task>> preprocessed_task_;
   std::shared_ptr<Array> input_array_;
   std::shared_ptr<BatchTask> batch_task_;
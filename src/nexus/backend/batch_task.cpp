@@ -28,10 +28,19 @@ void BatchTask::CreateInputArray(DataType data_type,
 void BatchTask::SetOutputArrays(
     const std::unordered_map<std::string, ArrayPtr>& arrays) {
   output_arrays_ = arrays;
+  batch_output_ = nullptr;
+}
+
+void BatchTask::SetBatchOutput(std::shared_ptr<BatchOutput> batch_output) {
+  CHECK_LE(inputs_.size(), batch_output->pool().max_batch())
+      << "Batch output is smaller than the batch";
+  batch_output_ = std::move(batch_output);
+  output_arrays_.clear();
 }
 
 void BatchTask::CreateOutputArrays(
     const std::unordered_map<std::string, size_t>& sizes, Device* device) {
+  batch_output_ = nullptr;
   uint32_t batch = max_batch_;
   if (inputs_.size() > 0) {
     batch = inputs_.size();
@@ -43,6 +52,11 @@ void BatchTask::CreateOutputArrays(
 }
 
 ArrayPtr BatchTask::GetOutputArray(const std::string& name) const {
+  if (batch_output_) {
+    int output_index = batch_output_->pool().GetOutputIndex(name);
+    CHECK_GE(output_index, 0) << "Output array " << name << " doesn't exist";
+    return batch_output_->array(output_index);
+  }
   CHECK_GT(output_arrays_.count(name), 0)
       << "Output array " << name << " doesn't exist";
   return output_arrays_.at(name);
@@ -66,9 +80,87 @@ void BatchTask::AppendInput(std::shared_ptr<Input> input,
   input_write_pt_ += nbytes;
 }
 
+void BatchTask::AppendInputNoCopy(std::shared_ptr<Input> input,
+                                  std::shared_ptr<Task> task) {
+  CHECK_LT(inputs_.size(), max_batch_) << "Exceed max batch size";
+  inputs_.push_back(std::move(input));
+  tasks_.push_back(std::move(task));
+}
+
+std::vector<std::shared_ptr<Input>> BatchTask::RemoveInputs(
+    const std::vector<bool>& keep,
+    std::vector<std::shared_ptr<Task>>* removed_tasks) {
+  CHECK(outputs_.empty()) << "Batch output is already sliced";
+  CHECK_EQ(keep.size(), inputs_.size());
+  std::vector<std::shared_ptr<Input>> removed_inputs;
+  size_t type_nbytes = type_size(input_array_->data_type());
+  char* read_pt = input_array_->Data<char>();
+  char* write_pt = read_pt;
+  size_t num_kept = 0;
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    size_t nbytes = inputs_[i]->array->num_elements() * type_nbytes;
+    if (keep[i]) {
+      if (write_pt != read_pt) {
+        // Inputs of a model have the same size, so the moved input never
+        // overlaps with its new location.
+        CHECK_GE(size_t(read_pt - write_pt), nbytes)
+            << "Overlapping inputs in the batch";
+        Memcpy(write_pt, input_array_->device(), read_pt,
+               input_array_->device(), nbytes);
+      }
+      write_pt += nbytes;
+      if (num_kept != i) {
+        inputs_[num_kept] = std::move(inputs_[i]);
+        tasks_[num_kept] = std::move(tasks_[i]);
+      }
+      ++num_kept;
+    } else {
+      removed_inputs.push_back(std::move(inputs_[i]));
+      removed_tasks->push_back(std::move(tasks_[i]));
+    }
+    read_pt += nbytes;
+  }
+  inputs_.resize(num_kept);
+  tasks_.resize(num_kept);
+  input_write_pt_ = write_pt;
+  return removed_inputs;
+}
+
+std::shared_ptr<Output> BatchTask::ResetPooledOutput(uint32_t i) {
+  Output* output = batch_output_->output(i);
+  output->task_id = inputs_[i]->task_id;
+  output->index = inputs_[i]->index;
+  output->arrays.clear();
+  // Aliasing constructor: no allocation, and the output keeps the whole batch
+  // output from going back to the pool.
+  return std::shared_ptr<Output>(batch_output_, output);
+}
+
 void BatchTask::SliceOutputBatch(
     const std::unordered_map<std::string, Slice>& slices) {
   CHECK(outputs_.empty()) << "Batch output is already sliced";
+  if (batch_output_) {
+    const auto& pool = batch_output_->pool();
+    CHECK_EQ(pool.num_outputs(), slices.size())
+        << "Number of outputs must match the number of slices";
+    outputs_.reserve(inputs_.size());
+    for (uint i = 0; i < inputs_.size(); ++i) {
+      auto output = ResetPooledOutput(i);
+      for (int j = 0; j < pool.num_outputs(); ++j) {
+        const auto& name = pool.output_name(j);
+        const auto& slice = slices.at(name);
+        const auto& arr = batch_output_->array(j);
+        auto& view = output->views[j];
+        view.data = arr->Data<float>() + slice.offset(i);
+        view.num_elements = slice.num_elements(i);
+        // Models still reading outputs by name get array slices as well.
+        output->arrays.emplace(
+            name, arr->Slice(slice.offset(i), slice.num_elements(i)));
+      }
+      outputs_.push_back(std::move(output));
+    }
+    return;
+  }
   CHECK_EQ(output_arrays_.size(), slices.size())
       << "Number of outputs must "
          "match the number of slices";
@@ -86,6 +178,23 @@ void BatchTask::SliceOutputBatch(
   }
 }
 
+void BatchTask::SliceOutputBatch() {
+  CHECK(outputs_.empty()) << "Batch output is already sliced";
+  CHECK(batch_output_ != nullptr) << "Batch output is not pooled";
+  const auto& pool = batch_output_->pool();
+  outputs_.reserve(inputs_.size());
+  for (uint i = 0; i < inputs_.size(); ++i) {
+    auto output = ResetPooledOutput(i);
+    for (int j = 0; j < pool.num_outputs(); ++j) {
+      size_t size = pool.output_size(j);
+      auto& view = output->views[j];
+      view.data = batch_output_->array(j)->Data<float>() + i * size;
+      view.num_elements = size;
+    }
+    outputs_.push_back(std::move(output));
+  }
+}
+
 void BatchTask::set_outputs(
     const std::vector<std::shared_ptr<Output>>& outputs) {
   CHECK_EQ(outputs.size(), inputs_.size()) << "Number of outputs must match "
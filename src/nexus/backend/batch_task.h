@@ -3,6 +3,7 @@
 
 #include <memory>
 
+#include "nexus/backend/output_pool.h"
 #include "nexus/backend/slice.h"
 #include "nexus/backend/task.h"
 
@@ -56,6 +57,17 @@ class BatchTask {
    */
   void CreateOutputArrays(const std::unordered_map<std::string, size_t>& sizes,
                           Device* device);
+  /*!
+   * \brief Use pooled output arrays for holding the batch output results.
+   *   Outputs sliced from them are views that keep the batch output alive
+   *   instead of separately allocated arrays.
+   * \param batch_output Batch output acquired from an OutputArrayPool.
+   */
+  void SetBatchOutput(std::shared_ptr<BatchOutput> batch_output);
+  /*! \brief Return pooled batch output, or nullptr if not used */
+  inline const std::shared_ptr<BatchOutput>& batch_output() const {
+    return batch_output_;
+  }
   /*! \brief Return input batch array */
   inline ArrayPtr GetInputArray() const { return input_array_; }
   /*!
@@ -69,11 +81,35 @@ class BatchTask {
    * \param input A single input.
    */
   void AppendInput(std::shared_ptr<Input> input, std::shared_ptr<Task> task);
+  /*!
+   * \brief Append a new input without copying its data into the batch input
+   *   array. Used for sub-batches whose input is produced by a previous
+   *   stage, e.g. the suffix batches after a shared prefix.
+   * \param input A single input.
+   */
+  void AppendInputNoCopy(std::shared_ptr<Input> input,
+                         std::shared_ptr<Task> task);
+  /*!
+   * \brief Remove inputs from the batch and compact the batch input array.
+   *   Must be called before the batch is forwarded.
+   * \param keep Whether to keep each input, in the order of the batch.
+   * \param removed_tasks Tasks of the removed inputs, one per removed input.
+   * \return Removed inputs.
+   */
+  std::vector<std::shared_ptr<Input> > RemoveInputs(
+      const std::vector<bool>& keep,
+      std::vector<std::shared_ptr<Task> >* removed_tasks);
   /*!
    * \brief Slice the batch output into individual outputs.
    * \param slices Slices for all arrays.
    */
   void SliceOutputBatch(const std::unordered_map<std::string, Slice>& slices);
+  /*!
+   * \brief Slice the pooled batch output evenly into individual outputs.
+   *   Each input gets output_size(i) floats of output i. Does not allocate
+   *   once the batch output has been used before.
+   */
+  void SliceOutputBatch();
   /*! \brief Get all individual inputs in the batch. */
   inline const std::vector<std::shared_ptr<Input> >& inputs() const {
     return inputs_;
@@ -90,6 +126,12 @@ class BatchTask {
   }
 
  private:
+  /*!
+   * \brief Reset the pooled output slot of the i-th input.
+   * \return Output that shares ownership with the pooled batch output.
+   */
+  std::shared_ptr<Output> ResetPooledOutput(uint32_t i);
+
   /*! \brief Batch ID. */
   uint64_t batch_id_;
   /*! \brief Max batch size. */
@@ -102,6 +144,8 @@ class BatchTask {
   size_t input_elements_;
   /*! \brief Map from name to array. */
   std::unordered_map<std::string, ArrayPtr> output_arrays_;
+  /*! \brief Pooled output arrays. Takes precedence over output_arrays_. */
+  std::shared_ptr<BatchOutput> batch_output_;
   /*! \brief Tasks in the batch */
   std::vector<std::shared_ptr<Task> > tasks_;
   /*! \brief Individual inputs in the batch */
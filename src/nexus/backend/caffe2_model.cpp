@@ -210,17 +210,17 @@ void Caffe2Model::Preprocess(std::shared_ptr<Task> task) {
   const auto& input_data = query.input();
   switch (input_data.data_type()) {
     case DT_IMAGE: {
-      cv::Mat cv_img_bgr = DecodeImage(input_data.image(), CO_BGR);
-      if (query.window_size() > 0) {
-        for (int i = 0; i < query.window_size(); ++i) {
-          const auto& rect = query.window(i);
-          cv::Mat crop_img = cv_img_bgr(cv::Rect(rect.left(), rect.top(),
-                                                 rect.right() - rect.left(),
-                                                 rect.bottom() - rect.top()));
-          prepare_image(crop_img);
-        }
-      } else {
-        prepare_image(cv_img_bgr);
+      cv::Size image_size;
+      auto images =
+          DecodeImageWindows(input_data.image(), query.window(), image_height_,
+                             image_width_, CO_BGR, &image_size);
+      if (images.empty()) {
+        task->result.set_status(INPUT_TYPE_INCORRECT);
+        task->result.set_error_message("Cannot decode image or its windows");
+        break;
+      }
+      for (auto& img : images) {
+        prepare_image(img);
       }
       break;
     }
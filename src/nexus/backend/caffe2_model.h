@@ -15,6 +15,8 @@ class Caffe2Model : public ModelInstance {
 
   Shape InputShape() final;
 
+  bool InputChannelsFirst() const final { return true; }
+
   std::unordered_map<std::string, Shape> OutputShapes() final;
 
   ArrayPtr CreateInputGpuArray() final;
@@ -24,6 +24,8 @@ class CaffeDenseCapModel : public ModelInstance {
 
   Shape InputShape() final;
 
+  bool InputChannelsFirst() const final { return true; }
+
   std::unordered_map<std::string, Shape> OutputShapes() final;
 
   ArrayPtr CreateInputGpuArray() final;
@@ -27,6 +27,8 @@ class CaffeModel : public ModelInstance {
 
   Shape InputShape() final;
 
+  bool InputChannelsFirst() const final { return true; }
+
   std::unordered_map<std::string, Shape> OutputShapes() final;
 
   ArrayPtr CreateInputGpuArray() final;
@@ -140,15 +140,17 @@ void DarknetModel::Preprocess(std::shared_ptr<Task> task) {
     auto buf = std::make_shared<Buffer>(
         resized.data, nfloats * sizeof(float), cpu_device_, true);
     free_image(img);
+    auto in_arr = std::make_shared<Array>(DT_FLOAT, nfloats, buf);
 #else
     cv::Mat resized_image;
     cv::resize(cv_img, resized_image, cv::Size(net_->w, net_->h));
     image input = cvmat_to_image(resized_image);
     size_t nfloats = net_->w * net_->h * 3;
-    auto buf = std::make_shared<Buffer>(input.data, nfloats * sizeof(float),
-                                        cpu_device_, true);
+    // darknet mallocs the image, which the CPU device cannot free.
+    auto in_arr = std::make_shared<Array>(DT_FLOAT, nfloats, cpu_device_);
+    memcpy(in_arr->Data<float>(), input.data, nfloats * sizeof(float));
+    free_image(input);
 #endif
-    auto in_arr = std::make_shared<Array>(DT_FLOAT, nfloats, buf);
     task->AppendInput(in_arr);
   };
 
@@ -156,19 +158,18 @@ void DarknetModel::Preprocess(std::shared_ptr<Task> task) {
   const auto& input_data = query.input();
   switch (input_data.data_type()) {
     case DT_IMAGE: {
-      cv::Mat cv_img_rgb = DecodeImage(input_data.image(), CO_RGB);
-      task->attrs["im_height"] = cv_img_rgb.rows;
-      task->attrs["im_width"] = cv_img_rgb.cols;
-      if (query.window_size() > 0) {
-        for (int i = 0; i < query.window_size(); ++i) {
-          auto rect = query.window(i);
-          cv::Mat crop_img = cv_img_rgb(cv::Rect(rect.left(), rect.top(),
-                                                 rect.right() - rect.left(),
-                                                 rect.bottom() - rect.top()));
-          prepare_image(crop_img);
-        }
-      } else {
-        prepare_image(cv_img_rgb);
+      cv::Size image_size;
+      auto images = DecodeImageWindows(input_data.image(), query.window(),
+                                       net_->h, net_->w, CO_RGB, &image_size);
+      if (images.empty()) {
+        task->result.set_status(INPUT_TYPE_INCORRECT);
+        task->result.set_error_message("Cannot decode image or its windows");
+        break;
+      }
+      task->attrs["im_height"] = image_size.height;
+      task->attrs["im_width"] = image_size.width;
+      for (auto& img : images) {
+        prepare_image(img);
       }
       break;
     }
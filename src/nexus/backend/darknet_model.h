@@ -21,6 +21,8 @@ class DarknetModel : public ModelInstance {
 
   Shape InputShape() final;
 
+  bool InputChannelsFirst() const final { return true; }
+
   std::unordered_map<std::string, Shape> OutputShapes() final;
 
   ArrayPtr CreateInputGpuArray() final;
@@ -0,0 +1,32 @@
+#include "nexus/backend/exec_stats.h"
+
+#include <sstream>
+
+namespace nexus {
+namespace backend {
+
+std::string ModelExecStatsSnapshot::ToString() const {
+  std::ostringstream ss;
+  ss << model_session_id << "\n"
+     << "  start_delay_us:       " << start_delay_us.ToString() << "\n"
+     << "  exec_lateness_us:     " << exec_lateness_us.ToString() << "\n"
+     << "  fetch_to_ready_us:    " << fetch_to_ready_us.ToString() << "\n"
+     << "  postprocess_queue_us: " << postprocess_queue_us.ToString() << "\n"
+     << "  batch_size:           " << batch_size.ToString();
+  return ss.str();
+}
+
+ModelExecStatsSnapshot ModelExecStats::Snapshot(
+    std::string model_session_id) const {
+  ModelExecStatsSnapshot snapshot;
+  snapshot.model_session_id = std::move(model_session_id);
+  snapshot.start_delay_us = start_delay_us.Snapshot();
+  snapshot.exec_lateness_us = exec_lateness_us.Snapshot();
+  snapshot.fetch_to_ready_us = fetch_to_ready_us.Snapshot();
+  snapshot.postprocess_queue_us = postprocess_queue_us.Snapshot();
+  snapshot.batch_size = batch_size.Snapshot();
+  return snapshot;
+}
+
+}  // namespace backend
+}  // namespace nexus
@@ -0,0 +1,44 @@
+#ifndef NEXUS_BACKEND_EXEC_STATS_H_
+#define NEXUS_BACKEND_EXEC_STATS_H_
+
+#include <string>
+
+#include "nexus/common/metric.h"
+
+namespace nexus {
+namespace backend {
+
+struct ModelExecStatsSnapshot {
+  std::string model_session_id;
+  HistogramSnapshot start_delay_us;
+  HistogramSnapshot exec_lateness_us;
+  HistogramSnapshot fetch_to_ready_us;
+  HistogramSnapshot postprocess_queue_us;
+  HistogramSnapshot batch_size;
+
+  std::string ToString() const;
+};
+
+/*!
+ * \brief Per-model statistics of how the backend follows the batch plans.
+ *   All values are in microseconds except batch_size. Recording is lock-free.
+ */
+struct ModelExecStats {
+  /*! \brief Actual minus planned start time of each batch plan. */
+  Histogram start_delay_us;
+  /*! \brief Actual minus profiled forward latency of each batch. */
+  Histogram exec_lateness_us;
+  /*! \brief From issuing the input fetch to the query being ready. */
+  Histogram fetch_to_ready_us;
+  /*! \brief Time a task waits in the task queue before postprocessing. */
+  Histogram postprocess_queue_us;
+  /*! \brief Batch size actually forwarded. */
+  Histogram batch_size;
+
+  ModelExecStatsSnapshot Snapshot(std::string model_session_id) const;
+};
+
+}  // namespace backend
+}  // namespace nexus
+
+#endif  // NEXUS_BACKEND_EXEC_STATS_H_
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <memory>
 #include <thread>
+#include <utility>
 
 #include "nexus/backend/backend_server.h"
 #include "nexus/common/device.h"
@@ -31,6 +32,9 @@ bool OrderBatchPlanProtoByExecTimeDesc(
 namespace nexus {
 namespace backend {
 
+// Defined in the backend namespace by model_exec.cpp.
+DECLARE_int32(backend_max_inflight_plans);
+
 GpuExecutorPlanFollower::GpuExecutorPlanFollower(int gpu_id,
                                                  ario::PollerType poller_type)
     : gpu_id_(gpu_id), executor_(poller_type), next_timer_(executor_) {}
@@ -50,11 +54,21 @@ void GpuExecutorPlanFollower::Start(int core) {
     pthread_setname_np(pthread_self(), "GpuExecutor");
     executor_.RunEventLoop();
   });
+  output_thread_ = std::thread([this] {
+    pthread_setname_np(pthread_self(), "GpuExecOutput");
+    OutputLoop();
+  });
 }
 
 void GpuExecutorPlanFollower::Stop() {
   executor_.StopEventLoop();
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    stop_output_ = true;
+  }
+  inflight_cv_.notify_all();
   thread_.join();
+  output_thread_.join();
 }
 
 void GpuExecutorPlanFollower::AddModel(std::shared_ptr<ModelExecutor> model) {
@@ -87,13 +101,18 @@ void GpuExecutorPlanFollower::AddBatchPlan(
   UpdateTimer();
 }
 
-void GpuExecutorPlanFollower::UpdateTimer() {
+int GpuExecutorPlanFollower::num_inflight() {
+  std::lock_guard<std::mutex> lock(inflight_mutex_);
+  return num_inflight_;
+}
+
+void GpuExecutorPlanFollower::UpdateTimer(bool rearm) {
   if (plans_.empty()) {
     return;
   }
   const auto& plan = plans_[0];
   TimePoint exec_time(std::chrono::nanoseconds(plan->proto().exec_time_ns()));
-  if (exec_time != next_timer_.timeout()) {
+  if (rearm || exec_time != next_timer_.timeout()) {
     next_timer_.SetTimeout(exec_time);
     next_timer_.AsyncWait([this](ario::ErrorCode error) { OnTimer(error); });
   }
@@ -104,6 +123,19 @@ void GpuExecutorPlanFollower::OnTimer(ario::ErrorCode error) {
   if (error != ario::ErrorCode::kOk) {
     return;
   }
+  {
+    // Bound the number of plans whose forward is issued but whose outputs are
+    // not handled yet. This also bounds the input arrays in use. Only this
+    // thread adds to num_inflight_, so the slot is still free below.
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    if (stop_output_) {
+      return;
+    }
+    if (num_inflight_ >= FLAGS_backend_max_inflight_plans) {
+      waiting_for_slot_ = true;
+      return;
+    }
+  }
   auto start_time = Clock::now();
   std::shared_ptr<BatchPlanContext> plan;
   std::shared_ptr<ModelExecutor> model;
@@ -134,6 +166,7 @@ void GpuExecutorPlanFollower::OnTimer(ario::ErrorCode error) {
     model = models_[model_index];
   }
   const auto& model_name = model->model()->model_session().model_name();
+  model->stats().start_delay_us.Record(start_delay_us);
   if (start_delay_us > 1000) {
     LOG(WARNING) << "Huge start  delay. " << model_name
                  << ". plan_id=" << plan->proto().plan_id()
@@ -141,44 +174,91 @@ void GpuExecutorPlanFollower::OnTimer(ario::ErrorCode error) {
                  << ", start_delay=" << start_delay_us << "us";
   }
 
-  if (start_delay_us > 20000) {
-    LOG(ERROR) << "Intolerable start delay: " << start_delay_us
-               << "us. Drop current batch plan_id=" << plan->plan_id();
-    model->DropBatchPlan(plan);
-    UpdateTimer();
-    return;
-  }
+  // Late plans are not dropped as a whole here. ModelExecutor trims the
+  // queries that can no longer meet their deadlines right before Forward.
 
   VLOG(1) << "Executing BatchPlan: plan_id=" << plan->proto().plan_id()
           << ", model_name=" << model_name
           << ", batch_size=" << plan->proto().queries_size()
           << ", start_delay=" << start_delay_us << "us";
-  bool is_executing = is_executing_.test_and_set();
-  CHECK(!is_executing)
-      << "BUG: the backend has not finished the previous batch.";
-  model->ExecuteBatchPlan(plan);
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    ++num_inflight_;
+  }
+  auto inflight = model->StartBatchPlan(plan, device_free_at_);
+  if (inflight) {
+    device_free_at_ = inflight->expected_finish;
+  }
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    if (inflight) {
+      inflight_plans_.push_back(InflightPlan{model, std::move(inflight),
+                                             start_time, start_delay_us,
+                                             queue_delay_us});
+    } else {
+      --num_inflight_;
+    }
+  }
+  inflight_cv_.notify_all();
+  std::lock_guard<std::mutex> lock(mutex_);
+  UpdateTimer();
+}
+
+void GpuExecutorPlanFollower::OutputLoop() {
+  for (;;) {
+    InflightPlan plan;
+    {
+      std::unique_lock<std::mutex> lock(inflight_mutex_);
+      inflight_cv_.wait(
+          lock, [this] { return stop_output_ || !inflight_plans_.empty(); });
+      if (inflight_plans_.empty()) {
+        return;
+      }
+      plan = std::move(inflight_plans_.front());
+      inflight_plans_.pop_front();
+    }
+    FinishPlan(std::move(plan));
+    bool wake_timer;
+    {
+      std::lock_guard<std::mutex> lock(inflight_mutex_);
+      --num_inflight_;
+      wake_timer = std::exchange(waiting_for_slot_, false);
+    }
+    if (wake_timer) {
+      executor_.PostOk([this](ario::ErrorCode) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        UpdateTimer(true);
+      });
+    }
+  }
+}
+
+void GpuExecutorPlanFollower::FinishPlan(InflightPlan plan) {
+  using namespace std::chrono;
+  const auto& model_name = plan.model->model()->model_session().model_name();
+  auto plan_id = plan.inflight->plan->proto().plan_id();
+  auto batch_size = plan.inflight->plan->proto().queries_size();
+  auto expected_finish_time_ns =
+      plan.inflight->plan->proto().expected_finish_time_ns();
+  plan.model->FinishBatchPlan(std::move(plan.inflight));
   auto finish_time = Clock::now();
   auto elapse_us =
-      duration_cast<microseconds>(finish_time - start_time).count();
+      duration_cast<microseconds>(finish_time - plan.start_time).count();
   auto finish_time_ns =
       duration_cast<nanoseconds>(finish_time.time_since_epoch()).count();
-  auto finish_delay_us =
-      (finish_time_ns - plan->proto().expected_finish_time_ns()) / 1000;
-  VLOG(1) << "BatchPlan finished. plan_id=" << plan->proto().plan_id()
-          << ", model_name=" << model_name
-          << ", batch_size=" << plan->proto().queries_size()
-          << ", start_delay=" << start_delay_us << "us"
+  auto finish_delay_us = (finish_time_ns - expected_finish_time_ns) / 1000;
+  VLOG(1) << "BatchPlan finished. plan_id=" << plan_id
+          << ", model_name=" << model_name << ", batch_size=" << batch_size
+          << ", start_delay=" << plan.start_delay_us << "us"
           << ", elapse=" << elapse_us << "us"
           << ", finish_delay=" << finish_delay_us << "us";
   if (finish_delay_us > 100) {
     LOG(WARNING) << "Huge finish delay. " << model_name
-                 << ". plan_id=" << plan->proto().plan_id()
-                 << ", queue_delay=" << queue_delay_us << "us"
-                 << ", start_delay=" << start_delay_us << "us"
+                 << ". plan_id=" << plan_id
+                 << ", queue_delay=" << plan.queue_delay_us << "us"
+                 << ", start_delay=" << plan.start_delay_us << "us"
                  << ", finish_delay=" << finish_delay_us << "us";
   }
-  UpdateTimer();
-  is_executing_.clear();
 }
 
 }  // namespace backend
@@ -1,8 +1,10 @@
 #ifndef NEXUS_BACKEND_BASE_GPU_EXECUTOR_H_
 #define NEXUS_BACKEND_BASE_GPU_EXECUTOR_H_
 
-#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -26,22 +28,61 @@ class GpuExecutorPlanFollower {
   void AddModel(std::shared_ptr<ModelExecutor> model);
   void RemoveModel(std::shared_ptr<ModelExecutor> model);
   void AddBatchPlan(std::shared_ptr<BatchPlanContext> plan);
+  /*! \brief Number of plans whose outputs are not handled yet. */
+  int num_inflight();
 
  private:
-  void UpdateTimer() /* REQUIRES(mutex_) */;
+  struct InflightPlan {
+    std::shared_ptr<ModelExecutor> model;
+    std::unique_ptr<InflightBatchPlan> inflight;
+    TimePoint start_time;
+    int64_t start_delay_us;
+    int64_t queue_delay_us;
+  };
+
+  /*!
+   * \brief Arm the timer for the earliest plan.
+   * \param rearm Arm the timer even if it is set to that plan already.
+   */
+  void UpdateTimer(bool rearm = false) /* REQUIRES(mutex_) */;
+  /*!
+   * \brief Start the earliest plan. When FLAGS_backend_max_inflight_plans
+   *   plans are in flight, leave it queued instead. OutputLoop re-arms the
+   *   timer when a plan is done, so the event loop is never blocked.
+   */
   void OnTimer(ario::ErrorCode error);
+  /*!
+   * \brief Waits for the outputs of in-flight plans in the order they were
+   *   issued, so that the executor thread can issue the next plan meanwhile.
+   */
+  void OutputLoop();
+  void FinishPlan(InflightPlan plan);
 
   int gpu_id_;
   std::thread thread_;
+  std::thread output_thread_;
 
   ario::EpollExecutor executor_;
 
-  std::atomic_flag is_executing_ = ATOMIC_FLAG_INIT;
+  std::mutex inflight_mutex_;
+  std::condition_variable inflight_cv_;
+  std::deque<InflightPlan> inflight_plans_ /* GUARDED_BY(inflight_mutex_) */;
+  /*! \brief Number of issued plans whose outputs are not handled yet. */
+  int num_inflight_ /* GUARDED_BY(inflight_mutex_) */ = 0;
+  /*! \brief Whether a due plan waits for num_inflight_ to drop. */
+  bool waiting_for_slot_ /* GUARDED_BY(inflight_mutex_) */ = false;
+  bool stop_output_ /* GUARDED_BY(inflight_mutex_) */ = false;
+
   std::mutex mutex_;
   std::vector<std::shared_ptr<BatchPlanContext>>
       plans_ /* GUARDED_BY(mutex_) */;
   std::vector<std::shared_ptr<ModelExecutor>> models_ /* GUARDED_BY(mutex_) */;
   ario::Timer next_timer_ /* GUARDED_BY(mutex_) */;
+  /*!
+   * \brief Time when the device is expected to finish the plans in flight.
+   *   Only used by the event loop thread.
+   */
+  TimePoint device_free_at_;
 };
 
 }  // namespace backend
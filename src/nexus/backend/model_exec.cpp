@@ -3,8 +3,12 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <sstream>
+#include <utility>
 
 #include "nexus/backend/batch_plan_context.h"
 #include "nexus/backend/model_ins.h"
@@ -23,6 +27,9 @@ DEFINE_int32(backend_count_interval, 1,
              "Interval to count number of requests in sec");
 DEFINE_int32(backend_avg_interval, 5, "Moving average interval in sec");
 DEFINE_int32(backend_batch_policy, 0, "0: Sliding window; 1: Earliest first;");
+DEFINE_int32(backend_max_inflight_plans, 2,
+             "Max number of batch plans whose forward has been issued but "
+             "whose outputs have not been handled yet");
 
 ModelExecutor::ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
                              ModelIndex model_index,
@@ -56,10 +63,10 @@ ModelExecutor::ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
     backup_backends_.push_back(info.node_id());
   }
 
-  // Create multiple input arrays. When one is used by forwarding, memcpy can
-  // still happen to another.
+  // Create multiple input arrays. When some are used by in-flight forwarding,
+  // memcpy can still happen to another.
   LOG(INFO) << "Warming up input array for " << model_->model_session_id();
-  for (int i = 0; i < 2; ++i) {
+  for (int i = 0; i < FLAGS_backend_max_inflight_plans + 1; ++i) {
     auto input_array = model_->CreateInputGpuArray();
     // model_->WarmupInputArray(input_array);  // Not effective
     input_arrays_.insert(input_array);
@@ -67,6 +74,16 @@ ModelExecutor::ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
   LOG(INFO) << "Finish warming up input array for "
             << model_->model_session_id();
   idle_input_arrays_ = input_arrays_;
+
+  // Output layers are resolved to indexes once here. Output arrays are then
+  // recycled across batches instead of allocated for every batch.
+  std::unordered_map<std::string, size_t> output_sizes;
+  for (const auto& iter : model_->OutputShapes()) {
+    output_sizes.emplace(iter.first, iter.second.NumElements(1));
+  }
+  output_pool_ = std::make_unique<OutputArrayPool>(
+      output_sizes, model_->max_batch(),
+      DeviceManager::Singleton().GetCPUDevice());
 }
 
 ModelExecutor::~ModelExecutor() {
@@ -75,6 +92,7 @@ ModelExecutor::~ModelExecutor() {
 }
 
 std::shared_ptr<Array> ModelExecutor::AcquireInputArray() {
+  std::lock_guard<std::mutex> lock(input_array_mu_);
   LOG_IF(FATAL, idle_input_arrays_.empty()) << "No more idle input arrays";
   auto iter = idle_input_arrays_.begin();
   auto ret = *iter;
@@ -83,6 +101,7 @@ std::shared_ptr<Array> ModelExecutor::AcquireInputArray() {
 }
 
 void ModelExecutor::ReleaseInputArray(std::shared_ptr<Array> array) {
+  std::lock_guard<std::mutex> lock(input_array_mu_);
   CHECK(input_arrays_.count(array) > 0) << "Invalid array";
   CHECK(idle_input_arrays_.count(array) == 0) << "Already idle";
   idle_input_arrays_.insert(std::move(array));
@@ -221,30 +240,101 @@ void ModelExecutor::DecreaseOpenRequests(int cnt) {
   // CHECK_GE(prev, cnt) << "Negative value in open requests";
 }
 
+void ModelExecutor::Warmup(const std::vector<uint32_t>& batch_sizes) {
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  auto input_array = AcquireInputArray();
+  auto task = std::make_shared<Task>();
+  task->AppendInput(std::make_shared<Array>(
+      input_array->data_type(), model_->InputShape().NumElements(1), cpu));
+  for (auto batch : batch_sizes) {
+    auto start_time = Clock::now();
+    auto batch_task = std::make_shared<BatchTask>(batch);
+    batch_task->SetInputArray(input_array);
+    for (uint32_t i = 0; i < batch; ++i) {
+      batch_task->AppendInput(task->inputs[0], task);
+    }
+    batch_task->SetBatchOutput(output_pool_->Acquire());
+    model_->Forward(batch_task);
+    auto elapse_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         Clock::now() - start_time)
+                         .count();
+    LOG(INFO) << "Warmup " << model_->model_session_id() << " batch=" << batch
+              << " elapse=" << elapse_us << "us";
+  }
+  ReleaseInputArray(input_array);
+}
+
 void ModelExecutor::ExecuteBatchPlan(std::shared_ptr<BatchPlanContext> plan) {
+  auto inflight = StartBatchPlan(std::move(plan));
+  if (inflight) {
+    FinishBatchPlan(std::move(inflight));
+  }
+}
+
+std::unique_ptr<InflightBatchPlan> ModelExecutor::StartBatchPlan(
+    std::shared_ptr<BatchPlanContext> plan, TimePoint device_free_at) {
   auto batch_task = GetBatchTaskByBatchPlan(plan);
   int dequeue_cnt = plan->proto().queries_size();
+  auto start = std::max(Clock::now(), device_free_at);
+  TrimExpiredQueries(*plan, batch_task.get(), start);
   drop_counter_->Increase(dequeue_cnt - batch_task->batch_size());
   if (batch_task->batch_size() == 0) {
-    std::lock_guard<std::mutex> lock(time_mu_);
-    DecreaseOpenRequests(dequeue_cnt);
-    last_exec_finish_ = Clock::now();
+    {
+      std::lock_guard<std::mutex> lock(time_mu_);
+      DecreaseOpenRequests(dequeue_cnt);
+      last_exec_finish_ = Clock::now();
+    }
+    ReleaseInputArray(plan->ReleaseInputArray());
     VLOG(1) << "ExecuteBatchPlan return early. batch_size=0, plan_id="
             << plan->proto().plan_id();
-    return;
+    return nullptr;
   }
 
-  // Each time recompute output sizes because it might change for prefix model
-  std::unordered_map<std::string, size_t> output_sizes;
-  for (auto iter : model_->OutputShapes()) {
-    output_sizes.emplace(iter.first, iter.second.NumElements(1));
+  auto inflight = std::make_unique<InflightBatchPlan>();
+  inflight->forward_start = Clock::now();
+  inflight->expected_finish = start;
+  if (profile_ != nullptr) {
+    inflight->expected_finish += std::chrono::microseconds(static_cast<int64_t>(
+        profile_->GetForwardLatency(batch_task->batch_size())));
+  }
+  inflight->plan = std::move(plan);
+  inflight->batch_task = std::move(batch_task);
+  if (IsPrefixGroupBatch(*inflight->batch_task)) {
+    ForwardPrefixGroupAsync(inflight.get());
+  } else {
+    inflight->batch_task->SetBatchOutput(output_pool_->Acquire());
+    model_->ForwardAsync(inflight->batch_task);
+  }
+  return inflight;
+}
+
+void ModelExecutor::FinishBatchPlan(
+    std::unique_ptr<InflightBatchPlan> inflight) {
+  auto& plan = inflight->plan;
+  auto& batch_task = inflight->batch_task;
+  int dequeue_cnt = plan->proto().queries_size();
+  if (inflight->suffix_batches.empty()) {
+    model_->WaitOutput(batch_task);
+  } else {
+    WaitPrefixGroupOutput(inflight.get());
   }
-  batch_task->CreateOutputArrays(output_sizes,
-                                 DeviceManager::Singleton().GetCPUDevice());
-  model_->Forward(batch_task);
+  auto forward_finish = Clock::now();
+  TimePoint forward_start;
   {
     std::lock_guard<std::mutex> lock(time_mu_);
-    last_exec_finish_ = Clock::now();
+    // The device runs one batch at a time, so a pipelined batch starts
+    // running when the previous one finishes.
+    forward_start = std::max(inflight->forward_start, last_exec_finish_);
+    last_exec_finish_ = forward_finish;
+  }
+  stats_.batch_size.Record(batch_task->batch_size());
+  if (profile_ != nullptr) {
+    auto forward_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          forward_finish - forward_start)
+                          .count();
+    auto profiled_us = static_cast<int64_t>(
+        profile_->GetForwardLatency(batch_task->batch_size()));
+    stats_.exec_lateness_us.Record(forward_us - profiled_us);
   }
   DecreaseOpenRequests(dequeue_cnt);
 
@@ -258,7 +348,9 @@ void ModelExecutor::ExecuteBatchPlan(std::shared_ptr<BatchPlanContext> plan) {
     auto task = tasks[i];
     if (task->AddOutput(output)) {
       completed_tasks.push_back(task);
+      task->timer.Record(kTaskExec, forward_start);
       task->stage = kPostprocess;
+      task->enqueue_time = forward_finish;
     }
   }
   // task_queue_.push is expensive. So batch push here.
@@ -274,37 +366,202 @@ void ModelExecutor::ExecuteBatchPlan(std::shared_ptr<BatchPlanContext> plan) {
   }
 }
 
+bool ModelExecutor::IsPrefixGroupBatch(const BatchTask& batch_task) const {
+  for (const auto& task : batch_task.tasks()) {
+    if (task->model.get() != this) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ModelExecutor::ForwardPrefixGroupAsync(InflightBatchPlan* inflight) {
+  CHECK(model_->SupportsPrefixBatching())
+      << "Got a prefix group batch plan for " << model_->model_session_id()
+      << ", which does not support prefix batching";
+  const auto& batch_task = inflight->batch_task;
+  model_->ForwardPrefixAsync(batch_task);
+
+  // Split the batch by suffix model. Groups are small, so a linear scan is
+  // cheaper than a map.
+  const auto& inputs = batch_task->inputs();
+  const auto& tasks = batch_task->tasks();
+  auto& suffix_batches = inflight->suffix_batches;
+  auto& positions = inflight->suffix_positions;
+  positions.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    auto* suffix_model = tasks[i]->model.get();
+    auto iter = std::find_if(suffix_batches.begin(), suffix_batches.end(),
+                             [suffix_model](const auto& batch) {
+                               return batch.first == suffix_model;
+                             });
+    size_t k = iter - suffix_batches.begin();
+    if (iter == suffix_batches.end()) {
+      CHECK(suffix_model->model_->SupportsPrefixBatching())
+          << suffix_model->model_->model_session_id()
+          << " does not support prefix batching";
+      auto suffix_batch =
+          std::make_shared<BatchTask>(suffix_model->model_->max_batch());
+      suffix_batch->set_batch_id(batch_task->batch_id());
+      suffix_batches.emplace_back(suffix_model, std::move(suffix_batch));
+    }
+    auto& suffix_batch = suffix_batches[k].second;
+    positions.emplace_back(k, suffix_batch->batch_size());
+    suffix_batch->AppendInputNoCopy(inputs[i], tasks[i]);
+  }
+
+  for (auto& [suffix_model, suffix_batch] : suffix_batches) {
+    suffix_batch->SetBatchOutput(suffix_model->output_pool_->Acquire());
+    suffix_model->model_->ForwardSuffixAsync(suffix_batch);
+  }
+}
+
+void ModelExecutor::WaitPrefixGroupOutput(InflightBatchPlan* inflight) {
+  // Suffix batches were issued in order, so they finish in order too.
+  for (auto& [suffix_model, suffix_batch] : inflight->suffix_batches) {
+    suffix_model->model_->WaitOutput(suffix_batch);
+  }
+  std::vector<std::shared_ptr<Output>> outputs;
+  outputs.reserve(inflight->suffix_positions.size());
+  for (const auto& pos : inflight->suffix_positions) {
+    outputs.push_back(
+        inflight->suffix_batches[pos.first].second->outputs().at(pos.second));
+  }
+  inflight->batch_task->set_outputs(outputs);
+}
+
 void ModelExecutor::DropBatchPlan(std::shared_ptr<BatchPlanContext> plan) {
   auto batch_task = GetBatchTaskByBatchPlan(plan);
   int dequeue_cnt = plan->proto().queries_size();
   drop_counter_->Increase(dequeue_cnt);
   DecreaseOpenRequests(dequeue_cnt);
 
-  const auto& inputs = batch_task->inputs();
   auto& tasks = batch_task->tasks();
+  ReplyDroppedInputs(batch_task->inputs(), tasks);
+
+  ReleaseInputArray(plan->ReleaseInputArray());
+
+  auto backend_finish_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               Clock::now().time_since_epoch())
+                               .count();
+  for (auto& task : tasks) {
+    task->query.mutable_clock()->set_backend_finish_ns(backend_finish_ns);
+  }
+}
+
+std::vector<uint32_t> WarmupBatchSizes(uint32_t max_batch) {
+  std::vector<uint32_t> batch_sizes = {1};
+  if (max_batch / 2 > 1) {
+    batch_sizes.push_back(max_batch / 2);
+  }
+  if (max_batch > 1) {
+    batch_sizes.push_back(max_batch);
+  }
+  return batch_sizes;
+}
+
+uint32_t SelectQueriesInTime(const std::vector<TimePoint>& deadlines,
+                             TimePoint start, const ModelProfile& profile,
+                             std::vector<bool>* keep) {
+  using namespace std::chrono;
+  uint32_t batch_size = deadlines.size();
+  keep->assign(batch_size, true);
+  if (batch_size == 0) {
+    return 0;
+  }
+  auto finish_time = [&profile, start](uint32_t batch) {
+    return start + microseconds(
+                       static_cast<int64_t>(profile.GetForwardLatency(batch)));
+  };
+  if (*std::min_element(deadlines.begin(), deadlines.end()) >=
+      finish_time(batch_size)) {
+    return batch_size;
+  }
+
+  // Keep the largest batch such that every query in it can still finish in
+  // time. With deadlines sorted in descending order, a batch of size b is
+  // viable iff the b-th deadline is no earlier than the finish time of b.
+  std::vector<TimePoint> sorted = deadlines;
+  std::sort(sorted.begin(), sorted.end(), std::greater<TimePoint>());
+  uint32_t new_batch = batch_size;
+  while (new_batch > 0 && sorted[new_batch - 1] < finish_time(new_batch)) {
+    --new_batch;
+  }
+
+  keep->assign(batch_size, false);
+  if (new_batch > 0) {
+    auto cutoff = sorted[new_batch - 1];
+    // Ties at the cutoff are kept in batch order until the batch is full.
+    uint32_t num_above = std::count_if(
+        deadlines.begin(), deadlines.end(),
+        [cutoff](TimePoint deadline) { return deadline > cutoff; });
+    uint32_t num_ties = new_batch - num_above;
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      if (deadlines[i] > cutoff) {
+        (*keep)[i] = true;
+      } else if (deadlines[i] == cutoff && num_ties > 0) {
+        (*keep)[i] = true;
+        --num_ties;
+      }
+    }
+  }
+  return new_batch;
+}
+
+void ModelExecutor::TrimExpiredQueries(const BatchPlanContext& plan,
+                                       BatchTask* batch_task,
+                                       TimePoint start) {
+  using namespace std::chrono;
+  uint32_t batch_size = batch_task->batch_size();
+  if (batch_size == 0 || profile_ == nullptr) {
+    return;
+  }
+  const auto& tasks = batch_task->tasks();
+  std::vector<TimePoint> deadlines;
+  deadlines.reserve(batch_size);
+  for (const auto& task : tasks) {
+    auto global_id = GlobalId(task->query.global_id());
+    deadlines.push_back(plan.GetQueryDeadline(global_id));
+  }
+  std::vector<bool> keep;
+  uint32_t new_batch =
+      SelectQueriesInTime(deadlines, start, *profile_, &keep);
+  if (new_batch == batch_size) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<Task>> removed_tasks;
+  auto removed_inputs = batch_task->RemoveInputs(keep, &removed_tasks);
+  VLOG(1) << "Trimmed expired queries. plan_id=" << plan.plan_id().t
+          << ", model=" << model_->model_session_id()
+          << ", batch_size=" << batch_size << ", new_batch_size=" << new_batch;
+  ReplyDroppedInputs(removed_inputs, removed_tasks);
+  auto backend_finish_ns =
+      duration_cast<nanoseconds>(Clock::now().time_since_epoch()).count();
+  for (auto& task : removed_tasks) {
+    task->query.mutable_clock()->set_backend_finish_ns(backend_finish_ns);
+  }
+}
+
+void ModelExecutor::ReplyDroppedInputs(
+    const std::vector<std::shared_ptr<Input>>& inputs,
+    const std::vector<std::shared_ptr<Task>>& tasks) {
   std::vector<std::shared_ptr<Task>> completed_tasks;
   completed_tasks.reserve(inputs.size());
+  auto now = Clock::now();
   // Add output to corresponding tasks, and remove tasks that get all outputs
-  for (int i = 0; i < inputs.size(); ++i) {
-    auto input = inputs[i];
-    auto task = tasks[i];
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const auto& input = inputs[i];
+    const auto& task = tasks[i];
     if (task->AddVirtualOutput(input->index)) {
       completed_tasks.push_back(task);
       task->stage = kPostprocess;
+      task->enqueue_time = now;
       processing_tasks_.erase(task->task_id);
     }
   }
   // task_queue_.push is expensive. So batch push here.
   task_queue_.batch_push(completed_tasks);
-
-  ReleaseInputArray(plan->ReleaseInputArray());
-
-  auto backend_finish_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                               Clock::now().time_since_epoch())
-                               .count();
-  for (auto& task : tasks) {
-    task->query.mutable_clock()->set_backend_finish_ns(backend_finish_ns);
-  }
 }
 
 std::shared_ptr<BatchTask> ModelExecutor::GetBatchTaskByBatchPlan(
@@ -5,9 +5,13 @@
 #include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "nexus/backend/batch_plan_context.h"
+#include "nexus/backend/exec_stats.h"
 #include "nexus/backend/model_ins.h"
+#include "nexus/backend/output_pool.h"
 #include "nexus/common/block_queue.h"
 #include "nexus/common/metric.h"
 #include "nexus/common/model_db.h"
@@ -15,6 +19,51 @@
 namespace nexus {
 namespace backend {
 
+class ModelExecutor;
+
+/*! \brief A batch plan whose forward is issued but not finished yet. */
+struct InflightBatchPlan {
+  std::shared_ptr<BatchPlanContext> plan;
+  std::shared_ptr<BatchTask> batch_task;
+  /*! \brief Time when the forward was issued. */
+  TimePoint forward_start;
+  /*!
+   * \brief Time when the forward is expected to finish, by the profile,
+   *   after the batches in flight before it.
+   */
+  TimePoint expected_finish;
+  /*!
+   * \brief Batches of the suffix models when the batch mixes models of a
+   *   prefix group, otherwise empty.
+   */
+  std::vector<std::pair<ModelExecutor*, std::shared_ptr<BatchTask>>>
+      suffix_batches;
+  /*!
+   * \brief Index in suffix_batches and position in that batch of each input
+   *   of batch_task.
+   */
+  std::vector<std::pair<size_t, size_t>> suffix_positions;
+};
+
+/*!
+ * \brief Choose the queries of a batch that all finish before their deadlines
+ *   when the batch starts at start. A smaller batch is forwarded faster, so
+ *   the largest batch whose queries all meet their deadlines is chosen. Ties
+ *   at its earliest deadline are kept in batch order.
+ * \param deadlines Deadlines of the queries in batch order.
+ * \param keep Set to whether each query is kept, in batch order.
+ * \return Size of the chosen batch, 0 if every query has expired.
+ */
+uint32_t SelectQueriesInTime(const std::vector<TimePoint>& deadlines,
+                             TimePoint start, const ModelProfile& profile,
+                             std::vector<bool>* keep);
+
+/*!
+ * \brief Batch sizes that ModelExecutor::Warmup runs after a model is loaded:
+ *   1, half of max_batch and max_batch.
+ */
+std::vector<uint32_t> WarmupBatchSizes(uint32_t max_batch);
+
 class ModelExecutor {
  public:
   ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
@@ -30,6 +79,10 @@ class ModelExecutor {
 
   const ModelProfile* profile() const { return profile_; }
 
+  ModelExecStats& stats() { return stats_; }
+
+  const ModelExecStats& stats() const { return stats_; }
+
   void SetBatch(uint32_t batch) { model_->set_batch(batch); }
 
   double GetRequestRate();
@@ -54,7 +107,31 @@ class ModelExecutor {
 
   void Postprocess(std::shared_ptr<Task> task);
 
+  /*!
+   * \brief Forward dummy batches through the model so that the first real
+   *   batches do not pay for lazy initialization in the framework.
+   * \param batch_sizes Batch sizes to run, in order.
+   */
+  void Warmup(const std::vector<uint32_t>& batch_sizes);
+
+  /*! \brief Forward a batch plan and wait for its outputs. */
   void ExecuteBatchPlan(std::shared_ptr<BatchPlanContext> plan);
+  /*!
+   * \brief Issue the forward of a batch plan without waiting for outputs.
+   * \param device_free_at Time when the device is expected to finish the
+   *   batches in flight. The batch starts after them, so queries that would
+   *   then miss their deadlines are dropped.
+   * \return nullptr if no query is left to forward.
+   */
+  std::unique_ptr<InflightBatchPlan> StartBatchPlan(
+      std::shared_ptr<BatchPlanContext> plan,
+      TimePoint device_free_at = TimePoint());
+  /*!
+   * \brief Wait for the outputs of a started batch plan and queue its tasks
+   *   for postprocessing. Batch plans must be finished in the order they are
+   *   started.
+   */
+  void FinishBatchPlan(std::unique_ptr<InflightBatchPlan> inflight);
   void DropBatchPlan(std::shared_ptr<BatchPlanContext> plan);
 
   TimePoint LastExecuteFinishTime();
@@ -69,6 +146,38 @@ class ModelExecutor {
   std::shared_ptr<BatchTask> GetBatchTaskByBatchPlan(
       std::shared_ptr<BatchPlanContext> plan);
 
+  /*!
+   * \brief Remove queries that cannot finish before their deadlines from the
+   *   batch, and reply them as dropped. The smaller batch is forwarded faster,
+   *   so the largest batch whose queries all meet their deadlines is kept.
+   * \param start Time when the forward of the batch is expected to start.
+   */
+  void TrimExpiredQueries(const BatchPlanContext& plan, BatchTask* batch_task,
+                          TimePoint start);
+
+  /*!
+   * \brief Whether the batch holds queries of other models in the prefix
+   *   group of this model. The dispatcher schedules a prefix group as one
+   *   model, so its batch plans may mix the suffix models of the group.
+   */
+  bool IsPrefixGroupBatch(const BatchTask& batch_task) const;
+
+  /*!
+   * \brief Issue the forward of the shared prefix once over the whole batch,
+   *   then of each suffix model over its own inputs.
+   */
+  void ForwardPrefixGroupAsync(InflightBatchPlan* inflight);
+
+  /*!
+   * \brief Wait for the suffix batches of a prefix group batch and set the
+   *   outputs of the batch in its order.
+   */
+  void WaitPrefixGroupOutput(InflightBatchPlan* inflight);
+
+  /*! \brief Fill dropped inputs with virtual outputs and reply the tasks. */
+  void ReplyDroppedInputs(const std::vector<std::shared_ptr<Input>>& inputs,
+                          const std::vector<std::shared_ptr<Task>>& tasks);
+
   bool IncreaseOpenRequests(int cnt, bool limit_max_batch);
 
   void DecreaseOpenRequests(int cnt);
@@ -89,6 +198,10 @@ class ModelExecutor {
   /*! \brief Input array allocated in GPU memory to hold batch inputs. */
   std::unordered_set<std::shared_ptr<Array>> input_arrays_;
   std::unordered_set<std::shared_ptr<Array>> idle_input_arrays_;
+  /*! \brief Mutex to protect idle_input_arrays_. */
+  std::mutex input_array_mu_;
+  /*! \brief Output arrays recycled across batches. */
+  std::unique_ptr<OutputArrayPool> output_pool_;
   /*! \brief Batch index. */
   std::atomic<uint64_t> batch_id_;
   /*! \brief Number of open requests. */
@@ -97,6 +210,7 @@ class ModelExecutor {
    */
   std::shared_ptr<IntervalCounter> req_counter_;
   std::shared_ptr<IntervalCounter> drop_counter_;
+  ModelExecStats stats_;
 
   EWMA req_rate_;
   EWMA drop_rate_;
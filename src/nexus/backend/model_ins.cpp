@@ -72,7 +72,7 @@ void CreateModelInstance(int gpu_id, const ModelInstanceConfig& config,
       if (!profile.has_value()) {
         LOG(FATAL) << "Failed to parse SleepProfile.";
       }
-      model->reset(new SleepModel(*profile, config, model_index));
+      model->reset(new SleepModel(*profile, gpu_id, config, model_index));
     } else {
       LOG(FATAL) << "Unknown framework " << framework;
     }
@@ -122,11 +122,16 @@ void ModelInstance::RemoveInputGpuArray(ArrayPtr arr) {
   LOG(WARNING) << "Don't support remove input gpu array";
 }
 void ModelInstance::ForwardAsync(std::shared_ptr<BatchTask> batch_task) {
-  LOG(WARNING) << "Don't support async forward";
+  // Models without async support finish the forward here, so WaitOutput has
+  // nothing to wait for.
   Forward(batch_task);
 }
-void ModelInstance::WaitOutput(std::shared_ptr<BatchTask> batch_task) {
-  LOG(WARNING) << "Don't support async forward";
+void ModelInstance::WaitOutput(std::shared_ptr<BatchTask> batch_task) {}
+void ModelInstance::ForwardPrefixAsync(std::shared_ptr<BatchTask> batch_task) {
+  LOG(FATAL) << "ForwardPrefixAsync not implemented for " << model_session_id_;
+}
+void ModelInstance::ForwardSuffixAsync(std::shared_ptr<BatchTask> batch_task) {
+  LOG(FATAL) << "ForwardSuffixAsync not implemented for " << model_session_id_;
 }
 uint64_t ModelInstance::GetPeakBytesInUse() {
   LOG(FATAL) << "GetPeakBytesInUse not implemented";
@@ -65,6 +65,11 @@ class ModelInstance {
    * \return Input shape.
    */
   virtual Shape InputShape() = 0;
+  /*!
+   * \brief Whether the input is laid out as {batch, channels, height, width}
+   *   rather than {batch, height, width, channels}.
+   */
+  virtual bool InputChannelsFirst() const { return false; }
   /*!
    * \brief Get output shapes of the model.
    * \return Mapping from output blob name to its shape.
@@ -118,6 +123,24 @@ class ModelInstance {
   virtual void ForwardAsync(std::shared_ptr<BatchTask> batch_task);
 
   virtual void WaitOutput(std::shared_ptr<BatchTask> batch_task);
+  /*!
+   * \brief Whether the model can run as a member of a prefix group, i.e.
+   *   ForwardPrefixAsync and ForwardSuffixAsync are implemented.
+   */
+  virtual bool SupportsPrefixBatching() const { return false; }
+  /*!
+   * \brief Issue the forward of the prefix shared by a prefix group over the
+   *   whole batch. Called on the model instance of the group leader.
+   * \param batch_task Batch of inputs of all models in the group.
+   */
+  virtual void ForwardPrefixAsync(std::shared_ptr<BatchTask> batch_task);
+  /*!
+   * \brief Issue the forward of the model-specific suffix over the inputs of
+   *   this model, after the prefix issued on the whole batch. WaitOutput
+   *   waits for it and slices the outputs.
+   * \param batch_task Sub-batch of the inputs that belong to this model.
+   */
+  virtual void ForwardSuffixAsync(std::shared_ptr<BatchTask> batch_task);
   /*!
    * \brief Postprocess the query in the task.
    * \param task Pointer to task.
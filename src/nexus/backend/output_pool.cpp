@@ -0,0 +1,71 @@
+#include "nexus/backend/output_pool.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace nexus {
+namespace backend {
+
+BatchOutput::BatchOutput(const OutputArrayPool& pool)
+    : pool_(pool), outputs_(pool.max_batch()) {
+  arrays_.reserve(pool.num_outputs());
+  for (int i = 0; i < pool.num_outputs(); ++i) {
+    arrays_.push_back(std::make_shared<Array>(
+        DT_FLOAT, pool.max_batch() * pool.output_size(i), pool.device_));
+  }
+  for (auto& output : outputs_) {
+    output.views.resize(pool.num_outputs());
+  }
+}
+
+OutputArrayPool::OutputArrayPool(
+    const std::unordered_map<std::string, size_t>& output_sizes,
+    uint32_t max_batch, Device* device)
+    : max_batch_(max_batch), device_(device) {
+  CHECK_GT(max_batch, 0) << "Max batch must be positive";
+  for (const auto& iter : output_sizes) {
+    names_.push_back(iter.first);
+  }
+  std::sort(names_.begin(), names_.end());
+  for (const auto& name : names_) {
+    sizes_.push_back(output_sizes.at(name));
+  }
+}
+
+int OutputArrayPool::GetOutputIndex(const std::string& name) const {
+  for (size_t i = 0; i < names_.size(); ++i) {
+    if (names_[i] == name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+std::shared_ptr<BatchOutput> OutputArrayPool::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t n = batch_outputs_.size();
+  for (size_t k = 0; k < n; ++k) {
+    size_t i = (next_ + k) % n;
+    // Only the pool holds a reference, so nobody else can take a new one.
+    if (batch_outputs_[i].use_count() == 1) {
+      // Pairs with the release when the last user dropped its reference.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      next_ = (i + 1) % n;
+      return batch_outputs_[i];
+    }
+  }
+  batch_outputs_.push_back(std::make_shared<BatchOutput>(*this));
+  VLOG(1) << "OutputArrayPool grows to " << batch_outputs_.size()
+          << " batch outputs";
+  return batch_outputs_.back();
+}
+
+size_t OutputArrayPool::num_allocated() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return batch_outputs_.size();
+}
+
+}  // namespace backend
+}  // namespace nexus
@@ -0,0 +1,118 @@
+#ifndef NEXUS_BACKEND_OUTPUT_POOL_H_
+#define NEXUS_BACKEND_OUTPUT_POOL_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+
+namespace nexus {
+namespace backend {
+
+class OutputArrayPool;
+
+/*!
+ * \brief BatchOutput holds the output arrays of a batch and the per-query
+ *   outputs sliced from them. It is owned by an OutputArrayPool and reused
+ *   once the batch task and all of its sliced outputs are released.
+ */
+class BatchOutput {
+ public:
+  explicit BatchOutput(const OutputArrayPool& pool);
+  BatchOutput(const BatchOutput& other) = delete;
+  BatchOutput& operator=(const BatchOutput& other) = delete;
+
+  /*! \brief Pool that the batch output belongs to. */
+  const OutputArrayPool& pool() const { return pool_; }
+  /*!
+   * \brief Get the batch array of an output. The array is sized for the max
+   *   batch of the pool.
+   * \param output_index Index of the output in the pool.
+   */
+  const ArrayPtr& array(int output_index) const {
+    return arrays_[output_index];
+  }
+  /*!
+   * \brief Get the reusable output slot of the i-th query in the batch.
+   * \param i Index of the query in the batch.
+   */
+  Output* output(uint32_t i) { return &outputs_[i]; }
+
+ private:
+  const OutputArrayPool& pool_;
+  /*! \brief Batch arrays, indexed by output index. */
+  std::vector<ArrayPtr> arrays_;
+  /*! \brief Per-query outputs. Never resized, so pointers stay valid. */
+  std::vector<Output> outputs_;
+};
+
+/*!
+ * \brief OutputArrayPool recycles the output arrays of a model across batches.
+ *
+ * Output layers are resolved to integer indexes once when the pool is created.
+ * Outputs are indexed in the order of their names. A BatchOutput handed out by
+ * Acquire() goes back to the pool when the last reference to it is dropped,
+ * which includes the per-query outputs sliced from it.
+ */
+class OutputArrayPool {
+ public:
+  /*!
+   * \brief Construct an output array pool.
+   * \param output_sizes Map from output name to number of floats of a single
+   *   input.
+   * \param max_batch Max batch size.
+   * \param device Device for allocation of output arrays.
+   */
+  OutputArrayPool(const std::unordered_map<std::string, size_t>& output_sizes,
+                  uint32_t max_batch, Device* device);
+  /*! \brief Return max batch size */
+  uint32_t max_batch() const { return max_batch_; }
+  /*! \brief Return number of outputs */
+  int num_outputs() const { return static_cast<int>(names_.size()); }
+  /*! \brief Return name of the output at index */
+  const std::string& output_name(int output_index) const {
+    return names_[output_index];
+  }
+  /*! \brief Return number of floats of a single input in the output */
+  size_t output_size(int output_index) const {
+    return sizes_[output_index];
+  }
+  /*!
+   * \brief Get the index of an output.
+   * \param name Name of the output.
+   * \return Index of the output, or -1 if not found.
+   */
+  int GetOutputIndex(const std::string& name) const;
+  /*!
+   * \brief Get an idle batch output. A new one is allocated if all batch
+   *   outputs are in use.
+   */
+  std::shared_ptr<BatchOutput> Acquire();
+  /*! \brief Return number of batch outputs allocated by the pool. */
+  size_t num_allocated() const;
+
+ private:
+  uint32_t max_batch_;
+  Device* device_;
+  std::vector<std::string> names_;
+  std::vector<size_t> sizes_;
+
+  friend class BatchOutput;
+
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<BatchOutput>> batch_outputs_
+      /* GUARDED_BY(mutex_) */;
+  /*! \brief Where Acquire() starts to look for an idle batch output. */
+  size_t next_ /* GUARDED_BY(mutex_) */ = 0;
+};
+
+}  // namespace backend
+}  // namespace nexus
+
+#endif  // NEXUS_BACKEND_OUTPUT_POOL_H_
@@ -16,6 +16,10 @@ class SharePrefixModel : public ModelInstance {
 
   Shape InputShape() final;
 
+  bool InputChannelsFirst() const final {
+    return prefix_model_->InputChannelsFirst();
+  }
+
   std::unordered_map<std::string, Shape> OutputShapes() final;
 
   ArrayPtr CreateInputGpuArray() final;
@@ -1,15 +1,27 @@
 #include "nexus/backend/sleep_model.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <immintrin.h>
 
+#include <algorithm>
 #include <chrono>
+#include <memory>
+#include <random>
 #include <stdexcept>
 #include <thread>
+#include <unordered_map>
 
 #include "nexus/backend/model_ins.h"
 #include "nexus/common/time_util.h"
 
+DEFINE_int32(sleep_model_jitter_us, 0,
+             "Add a uniformly random delay of up to this value to each "
+             "SleepModel forward. Used to emulate jittery backends.");
+DEFINE_int32(sleep_model_load_ms, 0,
+             "Time that constructing a SleepModel takes. Used to emulate slow "
+             "model loading.");
+
 namespace nexus {
 namespace backend {
 
@@ -33,11 +45,34 @@ inline void SleepFor(const std::chrono::duration<Rep, Period>& duration) {
   BlockSleepFor(duration);
 }
 
+int ForwardJitterUs() {
+  if (FLAGS_sleep_model_jitter_us <= 0) {
+    return 0;
+  }
+  thread_local std::mt19937 gen(std::random_device{}());
+  std::uniform_int_distribution<int> dist(0, FLAGS_sleep_model_jitter_us);
+  return dist(gen);
+}
+
+EmulatedDevice* GetEmulatedDevice(int gpu_id) {
+  static std::mutex mutex;
+  static std::unordered_map<int, std::unique_ptr<EmulatedDevice>> devices;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& device = devices[gpu_id];
+  if (!device) {
+    device = std::make_unique<EmulatedDevice>();
+  }
+  return device.get();
+}
+
 }  // namespace
 
-SleepModel::SleepModel(SleepProfile profile, const ModelInstanceConfig& config,
+SleepModel::SleepModel(SleepProfile profile, int gpu_id,
+                       const ModelInstanceConfig& config,
                        ModelIndex model_index)
-    : ModelInstance(-1, config, model_index), profile_(std::move(profile)) {
+    : ModelInstance(-1, config, model_index),
+      profile_(std::move(profile)),
+      device_(GetEmulatedDevice(gpu_id)) {
   LOG(INFO) << "Construct SleepModel."
             << "slope_us=" << profile.slope_us()
             << ", intercept_us=" << profile.intercept_us()
@@ -73,6 +108,9 @@ SleepModel::SleepModel(SleepProfile profile, const ModelInstanceConfig& config,
     output_sizes_[name] = n;
     output_shapes_[name] = Shape{1, n};
   }
+  if (FLAGS_sleep_model_load_ms > 0) {
+    SleepFor(std::chrono::milliseconds(FLAGS_sleep_model_load_ms));
+  }
 }
 
 Shape SleepModel::InputShape() { return input_shape_; }
@@ -137,7 +175,70 @@ void SleepModel::Preprocess(std::shared_ptr<Task> task) {
 
 void SleepModel::Forward(std::shared_ptr<BatchTask> batch_task) {
   size_t batch_size = batch_task->batch_size();
-  SleepFor(std::chrono::microseconds(profile_.forward_us(batch_size)));
+  RunOnDevice(std::chrono::microseconds(profile_.forward_us(batch_size) +
+                                        ForwardJitterUs()));
+  SliceOutputs(batch_task.get());
+}
+
+void SleepModel::ForwardAsync(std::shared_ptr<BatchTask> batch_task) {
+  auto forward_time = std::chrono::microseconds(
+      profile_.forward_us(batch_task->batch_size()) + ForwardJitterUs());
+  AddInflightBatch(batch_task.get(), ReserveDevice(forward_time));
+}
+
+void SleepModel::WaitOutput(std::shared_ptr<BatchTask> batch_task) {
+  TimePoint finish_time;
+  {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    auto iter = async_finish_time_.find(batch_task.get());
+    CHECK(iter != async_finish_time_.end()) << "BatchTask is not in flight";
+    finish_time = iter->second;
+    async_finish_time_.erase(iter);
+  }
+  auto now = Clock::now();
+  if (finish_time > now) {
+    SleepFor(finish_time - now);
+  }
+  SliceOutputs(batch_task.get());
+}
+
+void SleepModel::ForwardPrefixAsync(std::shared_ptr<BatchTask> batch_task) {
+  ReserveDevice(std::chrono::microseconds(
+      profile_.prefix_forward_us(batch_task->batch_size()) +
+      ForwardJitterUs()));
+}
+
+void SleepModel::ForwardSuffixAsync(std::shared_ptr<BatchTask> batch_task) {
+  auto forward_time = std::chrono::microseconds(
+      profile_.suffix_forward_us(batch_task->batch_size()));
+  AddInflightBatch(batch_task.get(), ReserveDevice(forward_time));
+}
+
+TimePoint SleepModel::ReserveDevice(std::chrono::microseconds forward_time) {
+  std::lock_guard<std::mutex> lock(device_->mutex);
+  auto start_time = std::max(Clock::now(), device_->free_at);
+  device_->free_at = start_time + forward_time;
+  return device_->free_at;
+}
+
+void SleepModel::RunOnDevice(std::chrono::microseconds forward_time) {
+  auto finish_time = ReserveDevice(forward_time);
+  SleepFor(finish_time - Clock::now());
+}
+
+void SleepModel::AddInflightBatch(BatchTask* batch_task,
+                                  TimePoint finish_time) {
+  std::lock_guard<std::mutex> lock(async_mutex_);
+  bool inserted = async_finish_time_.emplace(batch_task, finish_time).second;
+  CHECK(inserted) << "BatchTask is already in flight";
+}
+
+void SleepModel::SliceOutputs(BatchTask* batch_task) {
+  if (batch_task->batch_output()) {
+    batch_task->SliceOutputBatch();
+    return;
+  }
+  size_t batch_size = batch_task->batch_size();
   std::unordered_map<std::string, Slice> slices;
   for (uint i = 0; i < output_layers_.size(); ++i) {
     const auto& name = output_layers_[i];
@@ -150,11 +251,8 @@ void SleepModel::Postprocess(std::shared_ptr<Task> task) {
   const QueryProto& query = task->query;
   QueryResultProto* result = &task->result;
   result->set_status(CTRL_OK);
-  for (auto output : task->outputs) {
-    auto out_arr = output->arrays.at(output_layers_[0]);
-    size_t count = out_arr->num_elements();
-    size_t output_size = output_sizes_.at(output_layers_[0]);
-    auto* record = result->add_output();
+  for (size_t i = 0; i < task->outputs.size(); ++i) {
+    result->add_output();
   }
 
   SleepFor(std::chrono::microseconds(profile_.postprocess_us()));
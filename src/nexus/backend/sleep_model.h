@@ -1,18 +1,33 @@
 #ifndef NEXUS_BACKEND_SLEEP_MODEL_H_
 #define NEXUS_BACKEND_SLEEP_MODEL_H_
 
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "nexus/backend/model_ins.h"
 #include "nexus/common/sleep_profile.h"
+#include "nexus/common/time_util.h"
 
 namespace nexus {
 namespace backend {
 
+/*! \brief Time when an emulated device finishes all batches issued to it. */
+struct EmulatedDevice {
+  std::mutex mutex;
+  TimePoint free_at /* GUARDED_BY(mutex) */;
+};
+
 class SleepModel : public ModelInstance {
  public:
-  SleepModel(SleepProfile profile, const ModelInstanceConfig& config,
-             ModelIndex model_index);
+  /*!
+   * \brief Construct a model that sleeps instead of running on a device.
+   * \param gpu_id The emulated device. Models of the same gpu_id run their
+   *   batches one at a time.
+   */
+  SleepModel(SleepProfile profile, int gpu_id,
+             const ModelInstanceConfig& config, ModelIndex model_index);
 
   Shape InputShape() override;
   std::unordered_map<std::string, Shape> OutputShapes() override;
@@ -21,11 +36,36 @@ class SleepModel : public ModelInstance {
   std::unordered_map<std::string, ArrayPtr> GetOutputGpuArrays() override;
   void Preprocess(std::shared_ptr<Task> task) override;
   void Forward(std::shared_ptr<BatchTask> batch_task) override;
+  /*!
+   * \brief Emulate a device that runs one batch at a time. The batch is
+   *   queued behind the ones in flight on the device, of any model, and
+   *   WaitOutput sleeps until it is done.
+   */
+  void ForwardAsync(std::shared_ptr<BatchTask> batch_task) override;
+  void WaitOutput(std::shared_ptr<BatchTask> batch_task) override;
+  bool SupportsPrefixBatching() const override {
+    return profile_.prefix_percent() > 0;
+  }
+  /*! \brief Queue the prefix share of the forward time of the batch. */
+  void ForwardPrefixAsync(std::shared_ptr<BatchTask> batch_task) override;
+  /*! \brief Queue the suffix share of the forward time of the batch. */
+  void ForwardSuffixAsync(std::shared_ptr<BatchTask> batch_task) override;
   void Postprocess(std::shared_ptr<Task> task) override;
   uint64_t GetPeakBytesInUse() override;
   uint64_t GetBytesInUse() override;
 
  private:
+  void SliceOutputs(BatchTask* batch_task);
+  /*!
+   * \brief Queue the given time on the emulated device.
+   * \return Time when the device finishes it.
+   */
+  TimePoint ReserveDevice(std::chrono::microseconds forward_time);
+  /*! \brief Run for the given time once the emulated device is free. */
+  void RunOnDevice(std::chrono::microseconds forward_time);
+  /*! \brief Let WaitOutput wait for the batch until finish_time. */
+  void AddInflightBatch(BatchTask* batch_task, TimePoint finish_time);
+
   SleepProfile profile_;
 
   int image_height_;
@@ -37,6 +77,12 @@ class SleepModel : public ModelInstance {
   std::vector<std::string> output_layers_;
   std::unordered_map<std::string, Shape> output_shapes_;
   std::unordered_map<std::string, size_t> output_sizes_;
+
+  /*! \brief Emulated device shared by the models of the same gpu_id. */
+  EmulatedDevice* device_;
+  std::mutex async_mutex_;
+  std::unordered_map<BatchTask*, TimePoint>
+      async_finish_time_ /* GUARDED_BY(async_mutex_) */;
 };
 
 }  // namespace backend
@@ -27,7 +27,7 @@ Task::Task(ario::RdmaQueuePair* conn, std::shared_ptr<ModelExecutor> model)
       stage(Stage::kFetchImage),
       filled_outputs(0) {
   task_id = global_task_id_.fetch_add(1, std::memory_order_relaxed);
-  timer.Record("begin");
+  timer.Record(kTaskBegin);
 }
 
 void Task::SetConnection(ario::RdmaQueuePair* conn) { connection = conn; }
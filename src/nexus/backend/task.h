@@ -7,11 +7,15 @@
 #include <chrono>
 #include <memory>
 #include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "ario/ario.h"
 #include "nexus/common/block_queue.h"
 #include "nexus/common/data_type.h"
 #include "nexus/common/message.h"
+#include "nexus/common/time_util.h"
 #include "nexus/common/typedef.h"
 #include "nexus/proto/control.pb.h"
 #include "nexus/proto/nnquery.pb.h"
@@ -46,11 +50,18 @@ class Input : public DeadlineItem {
   std::shared_ptr<Array> array;
 };
 
+/*! \brief OutputView refers to a slice of a batch output array. */
+struct OutputView {
+  float* data = nullptr;
+  size_t num_elements = 0;
+};
+
 /*!
  * \brief Output contains the data of a single output.
  */
 class Output {
  public:
+  Output() = default;
   /*!
    * \brief Construct an Output.
    * \param tid Task id of corresponding task
@@ -60,12 +71,28 @@ class Output {
   Output(uint64_t tid, int idx,
          const std::unordered_map<std::string, ArrayPtr>& arrs);
 
+  /*!
+   * \brief Get the data of an output. Only available when the output is
+   *   sliced from pooled batch output arrays.
+   * \param output_index Index of the output in the OutputArrayPool.
+   */
+  float* Data(int output_index) const { return views[output_index].data; }
+  /*! \brief Return number of elements of an output. */
+  size_t NumElements(int output_index) const {
+    return views[output_index].num_elements;
+  }
+
   /*! \brief Task id */
-  uint64_t task_id;
+  uint64_t task_id = 0;
   /*! \brief Index in the output vector of task. */
-  int index;
+  int index = 0;
   /*! \brief Map from array name to array. */
   std::unordered_map<std::string, ArrayPtr> arrays;
+  /*!
+   * \brief Views into pooled batch output arrays, indexed by output index.
+   *   They stay valid as long as the Output is alive.
+   */
+  std::vector<OutputView> views;
 };
 
 /*! \brief Stage indicates the context processing stage */
@@ -80,6 +107,17 @@ enum Stage {
   kPostprocess,
 };
 
+/*! \brief Time points that Task::timer records. */
+enum TaskTimePoint {
+  /* !\brief Task is created */
+  kTaskBegin = 0,
+  /* !\brief Batch of the task starts forwarding */
+  kTaskExec,
+  /* !\brief Reply is sent */
+  kTaskEnd,
+  kNumTaskTimePoints,
+};
+
 class Task : public DeadlineItem, public std::enable_shared_from_this<Task> {
  public:
   /*! \brief Construct a task without connection. */
@@ -147,7 +185,9 @@ class Task : public DeadlineItem, public std::enable_shared_from_this<Task> {
   /*! \brief Attributes that needs to be kept during the task */
   YAML::Node attrs;
   /*! \brief Timer that counts the time spent in each stage */
-  Timer timer;
+  StageTimer<TaskTimePoint, kNumTaskTimePoints> timer;
+  /*! \brief Time when the task was last pushed to the task queue. */
+  TimePoint enqueue_time;
 
  private:
   /*! \brief Global task ID */
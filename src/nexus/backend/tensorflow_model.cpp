@@ -239,18 +239,18 @@ void TensorflowModel::Preprocess(std::shared_ptr<Task> task) {
   const auto& input_data = query.input();
   switch (input_data.data_type()) {
     case DT_IMAGE: {
-      cv::Mat img = DecodeImage(input_data.image(), CO_RGB);
-      task->attrs["im_height"] = img.rows;
-      task->attrs["im_width"] = img.cols;
-      if (query.window_size() > 0) {
-        for (int i = 0; i < query.window_size(); ++i) {
-          const auto& rect = query.window(i);
-          cv::Mat crop_img =
-              img(cv::Rect(rect.left(), rect.top(), rect.right() - rect.left(),
-                           rect.bottom() - rect.top()));
-          prepare_image(crop_img);
-        }
-      } else {
+      cv::Size image_size;
+      auto images =
+          DecodeImageWindows(input_data.image(), query.window(), image_height_,
+                             image_width_, CO_RGB, &image_size);
+      if (images.empty()) {
+        task->result.set_status(INPUT_TYPE_INCORRECT);
+        task->result.set_error_message("Cannot decode image or its windows");
+        break;
+      }
+      task->attrs["im_height"] = image_size.height;
+      task->attrs["im_width"] = image_size.width;
+      for (auto& img : images) {
         prepare_image(img);
       }
       break;
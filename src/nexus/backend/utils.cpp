@@ -3,9 +3,15 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <fstream>
-#include <unordered_set>
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "nexus/common/device.h"
+#include "nexus/common/staged_input.h"
 #include "nexus/common/util.h"
 
 DEFINE_bool(hack_reply_omit_output, false,
@@ -33,61 +39,195 @@ void LoadClassnames(const std::string &filepath,
   infile.close();
 }
 
+ClassificationOptions ParseClassificationOptions(const QueryProto &query) {
+  ClassificationOptions options;
+  if (query.output_field_size() > 0) {
+    options.fields = 0;
+    for (const auto &field : query.output_field()) {
+      if (field == "class_id") {
+        options.fields |= kClassId;
+      } else if (field == "class_prob") {
+        options.fields |= kClassProb;
+      } else if (field == "class_name") {
+        options.fields |= kClassName;
+      }
+    }
+  }
+  if (query.topk() > 0) {
+    options.topk = query.topk();
+  }
+  for (const auto &filter : query.filter()) {
+    if (filter.name() != "class_prob") {
+      continue;
+    }
+    if (filter.data_type() == DT_DOUBLE) {
+      options.threshold = static_cast<float>(filter.d());
+    } else {
+      options.threshold = filter.f();
+    }
+  }
+  return options;
+}
+
+namespace {
+
+// Whether lhs ranks before rhs: higher probability first, then lower class id.
+inline bool RanksBefore(const std::pair<float, uint32_t> &lhs,
+                        const std::pair<float, uint32_t> &rhs) {
+  return lhs.first > rhs.first ||
+         (lhs.first == rhs.first && lhs.second < rhs.second);
+}
+
+// Keeps the best k entries in a heap whose front is the worst kept entry.
+class TopKHeap {
+ public:
+  TopKHeap(uint32_t k, float threshold,
+           std::vector<std::pair<float, uint32_t>> *heap)
+      : k_(k), heap_(*heap), bar_(threshold) {}
+
+  // Entries at or below the bar can never be selected. Entries are visited in
+  // increasing class id, so an entry equal to the worst kept one loses.
+  float bar() const { return bar_; }
+
+  void Push(float p, uint32_t idx) {
+    if (!(p > bar_)) {
+      return;
+    }
+    if (heap_.size() == k_) {
+      std::pop_heap(heap_.begin(), heap_.end(), RanksBefore);
+      heap_.back() = {p, idx};
+    } else {
+      heap_.emplace_back(p, idx);
+    }
+    std::push_heap(heap_.begin(), heap_.end(), RanksBefore);
+    if (heap_.size() == k_) {
+      bar_ = heap_.front().first;
+    }
+  }
+
+ private:
+  uint32_t k_;
+  std::vector<std::pair<float, uint32_t>> &heap_;
+  float bar_;
+};
+
+}  // namespace
+
+void SelectTopK(const float *prob, size_t nprobs, uint32_t k, float threshold,
+                std::vector<std::pair<float, uint32_t>> *top) {
+  top->clear();
+  // k comes from the query, so never reserve more than the number of classes.
+  k = static_cast<uint32_t>(std::min<size_t>(k, nprobs));
+  if (k == 0) {
+    return;
+  }
+  top->reserve(k);
+  TopKHeap heap(k, threshold, top);
+  size_t i = 0;
+#ifdef __SSE2__
+  // Most classes fall below the bar once the heap is full, so compare 16
+  // probabilities at a time and only visit the ones above the bar.
+  __m128 bar = _mm_set1_ps(heap.bar());
+  for (; i + 16 <= nprobs; i += 16) {
+    __m128 gt0 = _mm_cmpgt_ps(_mm_loadu_ps(prob + i), bar);
+    __m128 gt1 = _mm_cmpgt_ps(_mm_loadu_ps(prob + i + 4), bar);
+    __m128 gt2 = _mm_cmpgt_ps(_mm_loadu_ps(prob + i + 8), bar);
+    __m128 gt3 = _mm_cmpgt_ps(_mm_loadu_ps(prob + i + 12), bar);
+    __m128 any = _mm_or_ps(_mm_or_ps(gt0, gt1), _mm_or_ps(gt2, gt3));
+    if (_mm_movemask_ps(any) == 0) {
+      continue;
+    }
+    uint32_t mask = _mm_movemask_ps(gt0) | (_mm_movemask_ps(gt1) << 4) |
+                    (_mm_movemask_ps(gt2) << 8) | (_mm_movemask_ps(gt3) << 12);
+    while (mask) {
+      uint32_t j = __builtin_ctz(mask);
+      mask &= mask - 1;
+      heap.Push(prob[i + j], static_cast<uint32_t>(i + j));
+    }
+    bar = _mm_set1_ps(heap.bar());
+  }
+#endif
+  for (; i < nprobs; ++i) {
+    heap.Push(prob[i], static_cast<uint32_t>(i));
+  }
+  std::sort(top->begin(), top->end(), RanksBefore);
+}
+
 void PostprocessClassification(
     const QueryProto &query, const float *prob, size_t nprobs,
     QueryResultProto *result,
     const std::unordered_map<int, std::string> *classnames) {
-  // TODO: handle top k and threshold in the query
+  PostprocessClassification(ParseClassificationOptions(query), prob, nprobs,
+                            result, classnames);
+}
+
+void PostprocessClassification(
+    const ClassificationOptions &options, const float *prob, size_t nprobs,
+    QueryResultProto *result,
+    const std::unordered_map<int, std::string> *classnames) {
   if (classnames != nullptr) {
     CHECK_EQ(classnames->size(), nprobs) << "Mismatch between number of "
                                          << "class names and number of outputs";
   }
-  std::unordered_set<std::string> output_fields(query.output_field().begin(),
-                                                query.output_field().end());
-  if (output_fields.empty()) {
-    output_fields.insert("class_id");
-    output_fields.insert("class_prob");
-    output_fields.insert("class_name");
-  }
-  float max_prob = 0.;
-  int max_idx = -1;
-  for (int i = 0; i < (int)nprobs; ++i) {
-    float p = prob[i];
-    if (p > max_prob) {
-      max_prob = p;
-      max_idx = i;
-    }
-  }
-  if (max_idx > -1) {
+  thread_local std::vector<std::pair<float, uint32_t>> top;
+  SelectTopK(prob, nprobs, options.topk, options.threshold, &top);
+  for (const auto &entry : top) {
     auto record = result->add_output();
-    if (FLAGS_hack_reply_omit_output) return;
-    for (auto field : output_fields) {
-      if (field == "class_id") {
-        auto value = record->add_named_value();
-        value->set_name("class_id");
-        value->set_data_type(DT_INT32);
-        value->set_i(max_idx);
-      } else if (field == "class_prob") {
-        auto value = record->add_named_value();
-        value->set_name("class_prob");
-        value->set_data_type(DT_FLOAT);
-        value->set_f(max_prob);
-      } else if (field == "class_name") {
-        auto value = record->add_named_value();
-        value->set_name("class_name");
-        value->set_data_type(DT_STRING);
-        if (classnames != nullptr) {
-          auto iter = classnames->find(max_idx);
-          if (iter == classnames->end()) {
-            LOG(ERROR) << "Cannot find class name for class id " << max_idx;
-          } else {
-            value->set_s(iter->second);
-          }
+    if (FLAGS_hack_reply_omit_output) continue;
+    int class_id = static_cast<int>(entry.second);
+    if (options.fields & kClassId) {
+      auto value = record->add_named_value();
+      value->set_name("class_id");
+      value->set_data_type(DT_INT32);
+      value->set_i(class_id);
+    }
+    if (options.fields & kClassProb) {
+      auto value = record->add_named_value();
+      value->set_name("class_prob");
+      value->set_data_type(DT_FLOAT);
+      value->set_f(entry.first);
+    }
+    if (options.fields & kClassName) {
+      auto value = record->add_named_value();
+      value->set_name("class_name");
+      value->set_data_type(DT_STRING);
+      if (classnames != nullptr) {
+        auto iter = classnames->find(class_id);
+        if (iter == classnames->end()) {
+          LOG(ERROR) << "Cannot find class name for class id " << class_id;
+        } else {
+          value->set_s(iter->second);
         }
       }
     }
   }
 }
 
+ArrayPtr StagedInputToModelInput(const char* buf, size_t len,
+                                 const Shape& input_shape,
+                                 bool channels_first) {
+  if (input_shape.ndims() != 4) {
+    return nullptr;
+  }
+  int height = input_shape.dim(channels_first ? 2 : 1);
+  int width = input_shape.dim(channels_first ? 3 : 2);
+  int channels = input_shape.dim(channels_first ? 1 : 3);
+  if (channels != 3 || height <= 0 || width <= 0) {
+    return nullptr;
+  }
+  auto staged = ParseStagedInput(buf, len);
+  if (!staged.has_value()) {
+    return nullptr;
+  }
+  auto* cpu_device = DeviceManager::Singleton().GetCPUDevice();
+  auto in_arr = std::make_shared<Array>(
+      DT_FLOAT, static_cast<size_t>(height) * width * 3, cpu_device);
+  if (!StagedInputToFloatImage(*staged, height, width, in_arr->Data<float>(),
+                               channels_first)) {
+    return nullptr;
+  }
+  return in_arr;
+}
+
 }  // namespace backend
 }  // namespace nexus
@@ -1,21 +1,78 @@
 #ifndef NEXUS_BACKEND_UTILS_H_
 #define NEXUS_BACKEND_UTILS_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "nexus/common/data_type.h"
 #include "nexus/proto/nnquery.pb.h"
 
 namespace nexus {
 namespace backend {
 
+/*! \brief Fields of a classification record, as bits of a mask. */
+enum ClassificationField : uint32_t {
+  kClassId = 1u << 0,
+  kClassProb = 1u << 1,
+  kClassName = 1u << 2,
+  kAllClassificationFields = kClassId | kClassProb | kClassName,
+};
+
+/*! \brief Classification postprocessing options requested by a query. */
+struct ClassificationOptions {
+  /*! \brief Bitmask of ClassificationField to fill in each record. */
+  uint32_t fields = kAllClassificationFields;
+  /*! \brief Max number of classes to return. */
+  uint32_t topk = 1;
+  /*! \brief Only classes with probability above threshold are returned. */
+  float threshold = 0.f;
+};
+
 void LoadClassnames(const std::string& filepath,
                     std::unordered_map<int, std::string>* classnames);
 
+/*!
+ * \brief Parse the output fields, topk and the "class_prob" filter of a
+ *   query. Unknown output fields are ignored.
+ */
+ClassificationOptions ParseClassificationOptions(const QueryProto& query);
+
+/*!
+ * \brief Select the k largest probabilities that are above threshold.
+ * \param prob Probabilities of all classes.
+ * \param nprobs Number of classes.
+ * \param k Max number of classes to select.
+ * \param threshold Only probabilities above it are selected.
+ * \param top Output of (probability, class id), in descending order of
+ *   probability. Ties are ordered by class id.
+ */
+void SelectTopK(const float* prob, size_t nprobs, uint32_t k, float threshold,
+                std::vector<std::pair<float, uint32_t>>* top);
+
 void PostprocessClassification(
     const QueryProto& query, const float* prob, size_t nprobs,
     QueryResultProto* result,
     const std::unordered_map<int, std::string>* classnames = nullptr);
 
+void PostprocessClassification(
+    const ClassificationOptions& options, const float* prob, size_t nprobs,
+    QueryResultProto* result,
+    const std::unordered_map<int, std::string>* classnames = nullptr);
+
+/*!
+ * \brief Convert an input staged by a frontend to the image input of a model.
+ * \param input_shape Input shape of the model, including the batch.
+ * \param channels_first Whether input_shape is NCHW rather than NHWC.
+ * \return Float array of one image, or nullptr if the input cannot be
+ *   converted.
+ */
+ArrayPtr StagedInputToModelInput(const char* buf, size_t len,
+                                 const Shape& input_shape,
+                                 bool channels_first);
+
 }  // namespace backend
 }  // namespace nexus
 
@@ -43,6 +43,19 @@ void Worker::Stop() {
   }
 }
 
+void Worker::RecordQueueTime(const Task& task) {
+  if (task.model == nullptr ||
+      task.enqueue_time.time_since_epoch().count() == 0) {
+    return;
+  }
+  auto queue_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      Clock::now() - task.enqueue_time)
+                      .count();
+  if (task.stage == kPostprocess) {
+    task.model->stats().postprocess_queue_us.Record(queue_us);
+  }
+}
+
 void Worker::Run() {
   std::this_thread::sleep_for(std::chrono::milliseconds(20));
   LOG(INFO) << "Worker " << index_ << " starts";
@@ -58,6 +71,7 @@ void Worker::Run() {
 }
 
 void Worker::Process(std::shared_ptr<Task> task) {
+  RecordQueueTime(*task);
   switch (task->stage) {
     case kPreprocess: {
       if (task->model == nullptr) {
@@ -97,11 +111,13 @@ void Worker::Process(std::shared_ptr<Task> task) {
 }
 
 void Worker::SendReply(std::shared_ptr<Task> task) {
-  task->timer.Record("end");
+  task->timer.Record(kTaskEnd);
   task->result.set_query_id(task->query.query_id());
   task->result.set_model_index(task->query.model_index());
-  task->result.set_latency_us(task->timer.GetLatencyMicros("begin", "end"));
-  task->result.set_queuing_us(task->timer.GetLatencyMicros("begin", "exec"));
+  task->result.set_latency_us(
+      task->timer.GetLatencyMicros(kTaskBegin, kTaskEnd));
+  task->result.set_queuing_us(
+      task->timer.GetLatencyMicros(kTaskBegin, kTaskExec));
   if (task->model != nullptr && task->model->backup()) {
     task->result.set_use_backup(true);
   } else {
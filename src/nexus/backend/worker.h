@@ -28,6 +28,8 @@ class Worker {
  private:
   void Process(std::shared_ptr<Task> task);
 
+  void RecordQueueTime(const Task& task);
+
   void SendReply(std::shared_ptr<Task> task);
 
  private:
@@ -26,6 +26,10 @@ class Buffer : public std::enable_shared_from_this<Buffer> {
     //     ", own data " << own_data_;
   }
 
+  /*!
+   * \brief Wrap data. If own_data, data must come from device->Allocate,
+   *   which frees it.
+   */
   explicit Buffer(void* data, size_t nbytes, Device* device,
                   bool own_data = false)
       : data_(data),
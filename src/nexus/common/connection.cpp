@@ -2,8 +2,34 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace nexus {
 
+namespace {
+
+/*!
+ * \brief Buffer sequence over an array of buffers. Unlike a vector, asio
+ *   copies it into the write operation without allocating.
+ */
+class BufferSpan {
+ public:
+  using value_type = boost::asio::const_buffer;
+  using const_iterator = const boost::asio::const_buffer*;
+
+  BufferSpan(const_iterator begin, const_iterator end)
+      : begin_(begin), end_(end) {}
+  const_iterator begin() const { return begin_; }
+  const_iterator end() const { return end_; }
+
+ private:
+  const_iterator begin_;
+  const_iterator end_;
+};
+
+}  // namespace
+
 Connection::Connection(boost::asio::ip::tcp::socket socket,
                        MessageHandler* handler)
     : socket_(std::move(socket)), handler_(handler), wrong_header_(false) {
@@ -15,7 +41,7 @@ Connection::Connection(boost::asio::io_context& io_context,
                        MessageHandler* handler)
     : socket_(io_context), handler_(handler), wrong_header_(false) {}
 
-void Connection::Start() { DoReadHeader(); }
+void Connection::Start() { DoRead(); }
 
 void Connection::Stop() {
   LOG(INFO) << "Connection Stop";
@@ -25,18 +51,18 @@ void Connection::Stop() {
 
 void Connection::Write(std::shared_ptr<Message> msg) {
   std::lock_guard<std::mutex> lock(write_queue_mutex_);
-  bool write_in_progress = !write_queue_.empty();
   write_queue_.push_back(std::move(msg));
-  if (!write_in_progress) {
+  if (num_writing_ == 0) {
     DoWrite();
   }
 }
 
-void Connection::DoReadHeader() {
+void Connection::DoRead() {
   auto self(shared_from_this());
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
-  boost::asio::async_read(
-      socket_, boost::asio::buffer(msg_header_buffer_, MESSAGE_HEADER_SIZE),
+  socket_.async_read_some(
+      boost::asio::buffer(recv_buffer_ + recv_end_,
+                          kReceiveBufferSize - recv_end_),
       [this, self](boost::system::error_code ec, size_t nbytes) {
         if (ec) {
           if (ec != boost::asio::error::operation_aborted) {
@@ -44,48 +70,77 @@ void Connection::DoReadHeader() {
           }
           return;
         }
-        MessageHeader msg_header;
-        if (!DecodeHeader(msg_header_buffer_, &msg_header)) {
-          if (!wrong_header_) {
-            LOG(ERROR) << "Wrong header detected";
-            wrong_header_ = true;
-          }
-          DoReadHeader();
-        } else {
-          wrong_header_ = false;
-          auto msg = std::make_shared<Message>(msg_header);
-          // LOG(INFO) << "msg type: " << msg->type() << ", body length: " <<
-          //     msg->body_length();
-          DoReadBody(std::move(msg));
-        }
+        recv_end_ += nbytes;
+        HandleReceived();
       });
 }
 
-void Connection::DoReadBody(std::shared_ptr<Message> msg) {
+void Connection::HandleReceived() {
+  while (recv_end_ - recv_begin_ >= MESSAGE_HEADER_SIZE) {
+    const char* begin = recv_buffer_ + recv_begin_;
+    MessageHeader msg_header;
+    if (!DecodeHeader(begin, &msg_header)) {
+      if (!wrong_header_) {
+        LOG(ERROR) << "Wrong header detected";
+        wrong_header_ = true;
+      }
+      recv_begin_ += MESSAGE_HEADER_SIZE;
+      continue;
+    }
+    wrong_header_ = false;
+    auto msg = std::make_shared<Message>(msg_header);
+    // The header is already written by the constructor of Message.
+    size_t nbytes = std::min(recv_end_ - recv_begin_, msg->length());
+    std::memcpy(msg->body(), begin + MESSAGE_HEADER_SIZE,
+                nbytes - MESSAGE_HEADER_SIZE);
+    if (nbytes < msg->length()) {
+      // All received bytes belong to this message. Receive the rest of it
+      // into the message directly.
+      recv_begin_ = recv_end_ = 0;
+      DoReadBody(std::move(msg), nbytes);
+      return;
+    }
+    recv_begin_ += nbytes;
+    handler_->HandleMessage(shared_from_this(), std::move(msg));
+  }
+  // Move the partial header to the front of the buffer.
+  size_t remain = recv_end_ - recv_begin_;
+  std::memmove(recv_buffer_, recv_buffer_ + recv_begin_, remain);
+  recv_begin_ = 0;
+  recv_end_ = remain;
+  DoRead();
+}
+
+void Connection::DoReadBody(std::shared_ptr<Message> msg, size_t offset) {
   auto self(shared_from_this());
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
-  boost::asio::async_read(socket_,
-                          boost::asio::buffer(msg->body(), msg->body_length()),
-                          [this, self, msg](boost::system::error_code ec,
-                                            size_t /* bytes_transferred */) {
-                            if (ec) {
-                              if (ec != boost::asio::error::operation_aborted) {
-                                handler_->HandleError(self, ec);
-                              }
-                            } else {
-                              handler_->HandleMessage(self, std::move(msg));
-                              DoReadHeader();
-                            }
-                          });
+  boost::asio::async_read(
+      socket_,
+      boost::asio::buffer(msg->data() + offset, msg->length() - offset),
+      [this, self, msg](boost::system::error_code ec,
+                        size_t /* bytes_transferred */) {
+        if (ec) {
+          if (ec != boost::asio::error::operation_aborted) {
+            handler_->HandleError(self, ec);
+          }
+        } else {
+          handler_->HandleMessage(self, std::move(msg));
+          DoRead();
+        }
+      });
 }
 
 void Connection::DoWrite() {
+  // write_queue_mutex_ is held by the caller.
+  num_writing_ = std::min(write_queue_.size(), kMaxWriteBatch);
+  for (size_t i = 0; i < num_writing_; ++i) {
+    write_buffers_[i] = boost::asio::buffer(write_queue_[i]->data(),
+                                            write_queue_[i]->length());
+  }
   auto self(shared_from_this());
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
   boost::asio::async_write(
-      socket_,
-      boost::asio::buffer(write_queue_.front()->data(),
-                          write_queue_.front()->length()),
+      socket_, BufferSpan(write_buffers_, write_buffers_ + num_writing_),
       [this, self](boost::system::error_code ec, size_t) {
         std::lock_guard<std::mutex> lock(write_queue_mutex_);
         if (ec) {
@@ -93,7 +148,9 @@ void Connection::DoWrite() {
             handler_->HandleError(self, ec);
           }
         } else {
-          write_queue_.pop_front();
+          write_queue_.erase(write_queue_.begin(),
+                             write_queue_.begin() + num_writing_);
+          num_writing_ = 0;
           if (!write_queue_.empty()) {
             DoWrite();
           }
@@ -2,6 +2,7 @@
 #define NEXUS_COMMON_CONNECTION_H_
 
 #include <boost/asio.hpp>
+#include <cstddef>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -52,11 +53,16 @@ class Connection : public std::enable_shared_from_this<Connection> {
 
  protected:
   Connection(boost::asio::io_context& io_context, MessageHandler* handler);
-  /*! \brief reads the header from the connection */
-  void DoReadHeader();
-  /*! \brief reads the body of message and invoke the handler */
-  void DoReadBody(std::shared_ptr<Message> msg);
-  /*! \brief sends the message to the peer */
+  /*! \brief receives more bytes into the receive buffer */
+  void DoRead();
+  /*!
+   * \brief invokes the handler on the messages in the receive buffer, and
+   *   continues receiving
+   */
+  void HandleReceived();
+  /*! \brief reads the rest of a message that the receive buffer cannot hold */
+  void DoReadBody(std::shared_ptr<Message> msg, size_t offset);
+  /*! \brief sends all queued messages to the peer with one gathered write */
   void DoWrite();
 
  protected:
@@ -67,12 +73,26 @@ class Connection : public std::enable_shared_from_this<Connection> {
   MessageHandler* handler_;
   /*! \brief Wrong header indicator */
   bool wrong_header_;
-  /*! \brief Receiving message */
-  // std::shared_ptr<Message> recv_message_;
-  char msg_header_buffer_[MESSAGE_HEADER_SIZE];
-  /*! \brief Queue for outbound messages */
+  /*!
+   * \brief Size of the receive buffer. Small messages are received many at a
+   *   time, and the body of a larger one is received into the message itself.
+   */
+  static constexpr size_t kReceiveBufferSize = 8192;
+  /*! \brief Max number of messages sent by one gathered write */
+  static constexpr size_t kMaxWriteBatch = 64;
+  /*! \brief Receive buffer */
+  char recv_buffer_[kReceiveBufferSize];
+  /*! \brief Offset of the first unparsed byte in recv_buffer_ */
+  size_t recv_begin_ = 0;
+  /*! \brief Offset past the last received byte in recv_buffer_ */
+  size_t recv_end_ = 0;
+  /*! \brief Queue for outbound messages, starting with the ones being sent */
   std::deque<std::shared_ptr<Message> > write_queue_;
-  /*! \brief Mutex for write_queue_ */
+  /*! \brief Buffers of the messages being sent */
+  boost::asio::const_buffer write_buffers_[kMaxWriteBatch];
+  /*! \brief Number of messages being sent */
+  size_t num_writing_ = 0;
+  /*! \brief Mutex for write_queue_, write_buffers_ and num_writing_ */
   std::mutex write_queue_mutex_;
 };
 
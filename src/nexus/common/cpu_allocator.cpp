@@ -0,0 +1,166 @@
+#include "nexus/common/cpu_allocator.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace nexus {
+
+namespace {
+
+/*! \brief Bytes of a class that a thread keeps before sharing them. */
+constexpr size_t kThreadCacheBytesPerClass = 4 << 20;
+constexpr size_t kMaxThreadBlocksPerClass = 64;
+/*! \brief Bytes of a class kept free for all threads. */
+constexpr size_t kMaxSharedBytesPerClass = 64 << 20;
+
+/*! \brief Set when the cache of the thread is destroyed at thread exit. */
+thread_local bool thread_cache_destroyed = false;
+
+uint32_t& HeaderOf(void* ptr) {
+  return *reinterpret_cast<uint32_t*>(static_cast<char*>(ptr) -
+                                      CPUAllocator::kAlignment);
+}
+
+}  // namespace
+
+thread_local CPUAllocator::ThreadCache CPUAllocator::thread_cache_;
+
+CPUAllocator::ThreadCache::~ThreadCache() {
+  thread_cache_destroyed = true;
+  auto& allocator = CPUAllocator::Singleton();
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    for (void* ptr : blocks[i]) {
+      allocator.FreeShared(ptr, i);
+    }
+  }
+}
+
+std::string CPUAllocator::Stats::ToString() const {
+  std::ostringstream ss;
+  ss << "thread_cache_hits=" << thread_cache_hits
+     << " shared_hits=" << shared_hits
+     << " system_allocations=" << system_allocations
+     << " oversized_allocations=" << oversized_allocations
+     << " system_frees=" << system_frees;
+  return ss.str();
+}
+
+CPUAllocator& CPUAllocator::Singleton() {
+  // Never destroyed, so that arrays can be freed during exit.
+  static auto* allocator = new CPUAllocator;
+  return *allocator;
+}
+
+size_t CPUAllocator::SizeClass(size_t size) {
+  if (size <= (size_t{1} << kMinSizeBits)) {
+    return 0;
+  }
+  // 2^bits < size <= 2^(bits+1)
+  size_t bits = 63 - __builtin_clzll(size - 1);
+  if (bits >= kMaxSizeBits) {
+    return kNumClasses;
+  }
+  size_t step_bits = bits - kStepsBits;
+  size_t step = (size - (size_t{1} << bits) + (size_t{1} << step_bits) - 1) >>
+                step_bits;
+  return ((bits - kMinSizeBits) << kStepsBits) + step;
+}
+
+size_t CPUAllocator::MaxThreadBlocks(size_t size_class) {
+  return std::min(kMaxThreadBlocksPerClass,
+                  std::max<size_t>(2, kThreadCacheBytesPerClass /
+                                          ClassSize(size_class)));
+}
+
+size_t CPUAllocator::MaxSharedBlocks(size_t size_class) {
+  return std::max<size_t>(4, kMaxSharedBytesPerClass / ClassSize(size_class));
+}
+
+void* CPUAllocator::SystemAllocate(size_t nbytes, uint32_t size_class) {
+  // aligned_alloc wants a multiple of the alignment.
+  size_t total = (kAlignment + nbytes + kAlignment - 1) & ~(kAlignment - 1);
+  char* base = static_cast<char*>(std::aligned_alloc(kAlignment, total));
+  CHECK(base != nullptr) << "Failed to allocate " << nbytes << " bytes";
+  void* ptr = base + kAlignment;
+  HeaderOf(ptr) = size_class;
+  return ptr;
+}
+
+void* CPUAllocator::Allocate(size_t nbytes) {
+  size_t size_class = SizeClass(nbytes);
+  if (size_class >= kNumClasses) {
+    oversized_allocations_.Increase();
+    return SystemAllocate(nbytes, kNumClasses);
+  }
+  if (!thread_cache_destroyed) {
+    auto& blocks = thread_cache_.blocks[size_class];
+    if (!blocks.empty()) {
+      void* ptr = blocks.back();
+      blocks.pop_back();
+      thread_cache_hits_.Increase();
+      return ptr;
+    }
+  }
+  {
+    auto& free_list = free_lists_[size_class];
+    std::lock_guard<std::mutex> lock(free_list.mutex);
+    if (!free_list.blocks.empty()) {
+      void* ptr = free_list.blocks.back();
+      free_list.blocks.pop_back();
+      shared_hits_.Increase();
+      return ptr;
+    }
+  }
+  system_allocations_.Increase();
+  return SystemAllocate(ClassSize(size_class), size_class);
+}
+
+void CPUAllocator::Free(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  size_t size_class = HeaderOf(ptr);
+  if (size_class >= kNumClasses) {
+    std::free(static_cast<char*>(ptr) - kAlignment);
+    return;
+  }
+  if (!thread_cache_destroyed) {
+    auto& blocks = thread_cache_.blocks[size_class];
+    if (blocks.size() < MaxThreadBlocks(size_class)) {
+      if (blocks.capacity() == 0) {
+        blocks.reserve(MaxThreadBlocks(size_class));
+      }
+      blocks.push_back(ptr);
+      return;
+    }
+  }
+  FreeShared(ptr, size_class);
+}
+
+void CPUAllocator::FreeShared(void* ptr, size_t size_class) {
+  {
+    auto& free_list = free_lists_[size_class];
+    std::lock_guard<std::mutex> lock(free_list.mutex);
+    if (free_list.blocks.size() < MaxSharedBlocks(size_class)) {
+      free_list.blocks.push_back(ptr);
+      return;
+    }
+  }
+  system_frees_.Increase();
+  std::free(static_cast<char*>(ptr) - kAlignment);
+}
+
+CPUAllocator::Stats CPUAllocator::stats() const {
+  Stats stats;
+  stats.thread_cache_hits = thread_cache_hits_.value();
+  stats.shared_hits = shared_hits_.value();
+  stats.system_allocations = system_allocations_.value();
+  stats.oversized_allocations = oversized_allocations_.value();
+  stats.system_frees = system_frees_.value();
+  return stats;
+}
+
+}  // namespace nexus
@@ -0,0 +1,109 @@
+#ifndef NEXUS_COMMON_CPU_ALLOCATOR_H_
+#define NEXUS_COMMON_CPU_ALLOCATOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nexus/common/metric.h"
+
+namespace nexus {
+
+/*!
+ * \brief Allocator of the CPU buffers of arrays.
+ *
+ *   Blocks are 64-byte aligned and come in size classes of four steps per
+ *   power of two, from 256 B to 16 MB, so a block wastes at most a quarter
+ *   of its size. Freed blocks go to a small cache of the freeing thread
+ *   first, then to a free list of the class shared by all threads. Larger
+ *   sizes are allocated and freed by the system allocator.
+ *
+ *   Every block starts after a 64-byte header that holds its size class, so
+ *   Free does not need the size. Free only takes blocks from Allocate.
+ */
+class CPUAllocator {
+ public:
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kMinSizeBits = 8;
+  static constexpr size_t kMaxSizeBits = 24;
+  /*! \brief Number of size classes in each power of two. */
+  static constexpr size_t kStepsBits = 2;
+  static constexpr size_t kNumClasses =
+      ((kMaxSizeBits - kMinSizeBits) << kStepsBits) + 1;
+
+  struct Stats {
+    /*! \brief Blocks taken from the cache of the calling thread. */
+    uint64_t thread_cache_hits;
+    /*! \brief Blocks taken from the shared free lists. */
+    uint64_t shared_hits;
+    /*! \brief Blocks of a size class allocated from the system. */
+    uint64_t system_allocations;
+    /*! \brief Blocks larger than every size class. */
+    uint64_t oversized_allocations;
+    /*! \brief Blocks returned to the system because the caches are full. */
+    uint64_t system_frees;
+
+    std::string ToString() const;
+  };
+
+  /*! \brief Get the allocator shared by all CPU devices of the process. */
+  static CPUAllocator& Singleton();
+
+  /*! \brief Get a 64-byte aligned block of at least nbytes. */
+  void* Allocate(size_t nbytes);
+
+  /*! \brief Return a block from Allocate. */
+  void Free(void* ptr);
+
+  Stats stats() const;
+
+  /*! \brief Index of the smallest class that fits size, or kNumClasses. */
+  static size_t SizeClass(size_t size);
+
+  /*! \brief Size of the blocks of a class. */
+  static size_t ClassSize(size_t index) {
+    size_t steps = size_t{1} << kStepsBits;
+    return (steps + index % steps)
+           << (kMinSizeBits - kStepsBits + index / steps);
+  }
+
+ private:
+  /*! \brief Blocks a thread keeps of each class. */
+  struct ThreadCache {
+    std::array<std::vector<void*>, kNumClasses> blocks;
+    /*! \brief Return the blocks to the shared free lists. */
+    ~ThreadCache();
+  };
+
+  struct alignas(64) FreeList {
+    std::mutex mutex;
+    std::vector<void*> blocks /* GUARDED_BY(mutex) */;
+  };
+
+  CPUAllocator() = default;
+
+  /*! \brief Allocate a block and its header from the system. */
+  static void* SystemAllocate(size_t nbytes, uint32_t size_class);
+
+  /*! \brief Return a block to the shared free list or to the system. */
+  void FreeShared(void* ptr, size_t size_class);
+
+  static size_t MaxThreadBlocks(size_t size_class);
+  static size_t MaxSharedBlocks(size_t size_class);
+
+  static thread_local ThreadCache thread_cache_;
+
+  FreeList free_lists_[kNumClasses];
+  ShardedCounter thread_cache_hits_;
+  ShardedCounter shared_hits_;
+  ShardedCounter system_allocations_;
+  ShardedCounter oversized_allocations_;
+  ShardedCounter system_frees_;
+};
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_CPU_ALLOCATOR_H_
@@ -10,6 +10,8 @@
 #include <cuda_runtime.h>
 #endif
 
+#include "nexus/common/cpu_allocator.h"
+
 namespace nexus {
 
 enum DeviceType {
@@ -44,11 +46,11 @@ class Device {
 class CPUDevice : public Device {
  public:
   void* Allocate(size_t nbytes) final {
-    void* buf = malloc(nbytes);
-    return buf;
+    return CPUAllocator::Singleton().Allocate(nbytes);
   }
 
-  void Free(void* buf) final { free(buf); }
+  /*! \brief Free a buffer from Allocate, not one from malloc. */
+  void Free(void* buf) final { CPUAllocator::Singleton().Free(buf); }
 
   std::string name() const override { return cpu_model_; }
 
@@ -3,8 +3,12 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <jpeglib.h>
+
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <csetjmp>
 #include <fstream>
 #include <iterator>
 #include <opencv2/opencv.hpp>
@@ -13,6 +17,10 @@
 #include <vector>
 
 DEFINE_string(hack_image_root, "", "HACK: path to directory of images");
+DEFINE_bool(roi_decode, true,
+            "Decode JPEG inputs only where their windows are, at a reduced "
+            "scale that is still larger than the model input. Otherwise "
+            "fully decode them and crop the windows.");
 
 class _Hack_Images {
  public:
@@ -56,10 +64,133 @@ class _Hack_Images {
 
 namespace nexus {
 
-cv::Mat DecodeImageImpl(const std::vector<char> &vec_data, bool color,
+namespace {
+
+int ImreadFlag(bool color, int scale_denom) {
+  switch (scale_denom) {
+    case 2:
+      return color ? cv::IMREAD_REDUCED_COLOR_2
+                   : cv::IMREAD_REDUCED_GRAYSCALE_2;
+    case 4:
+      return color ? cv::IMREAD_REDUCED_COLOR_4
+                   : cv::IMREAD_REDUCED_GRAYSCALE_4;
+    case 8:
+      return color ? cv::IMREAD_REDUCED_COLOR_8
+                   : cv::IMREAD_REDUCED_GRAYSCALE_8;
+    default:
+      return color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+  }
+}
+
+const std::vector<char> &_Hack_ImageData(const ImageProto &image) {
+  static _Hack_Images *_images = new _Hack_Images(FLAGS_hack_image_root);
+  const auto &vec_data = _images->get(image.hack_filename());
+  if (vec_data.empty() && image.hack_filename() != "__init_Hack_Images") {
+    LOG(ERROR) << "Cannot find image by filename: " << image.hack_filename();
+  }
+  return vec_data;
+}
+
+/*!
+ * \brief Encoded bytes of an image, from the proto or the hack images.
+ * \return nullptr if a hack image is not found.
+ */
+const std::vector<char> *ImageData(const ImageProto &image,
+                                   std::vector<char> *owned_data) {
+  if (image.hack_filename().empty()) {
+    const std::string &data = image.data();
+    owned_data->assign(data.c_str(), data.c_str() + data.size());
+    return owned_data;
+  }
+  const auto &vec_data = _Hack_ImageData(image);
+  return vec_data.empty() ? nullptr : &vec_data;
+}
+
+cv::Rect WindowRect(const RectProto &rect) {
+  return cv::Rect(rect.left(), rect.top(), rect.right() - rect.left(),
+                  rect.bottom() - rect.top());
+}
+
+bool WindowsInImage(
+    const google::protobuf::RepeatedPtrField<RectProto> &windows,
+    int height, int width) {
+  for (const auto &rect : windows) {
+    if (rect.left() >= rect.right() || rect.top() >= rect.bottom() ||
+        rect.right() > static_cast<uint32_t>(width) ||
+        rect.bottom() > static_cast<uint32_t>(height)) {
+      LOG(ERROR) << "Window (" << rect.left() << ", " << rect.top() << ", "
+                 << rect.right() << ", " << rect.bottom()
+                 << ") is not inside the " << width << "x" << height
+                 << " image";
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+ * \brief Decode the windows with JpegRegionDecoder.
+ * \return false if libjpeg-turbo cannot decode the image.
+ */
+bool DecodeJpegWindows(
+    const std::vector<char> &data,
+    const google::protobuf::RepeatedPtrField<RectProto> &windows, int height,
+    int width, int src_height, int src_width, bool color, ChannelOrder order,
+    std::vector<cv::Mat> *crops) {
+  std::vector<cv::Rect> rects;
+  for (const auto &rect : windows) {
+    rects.push_back(WindowRect(rect));
+  }
+  if (rects.empty()) {
+    rects.emplace_back(0, 0, src_width, src_height);
+  }
+  int denom = 1;
+  if (height > 0 && width > 0) {
+    denom = 8;
+    for (const auto &rect : rects) {
+      denom = std::min(denom, JpegScaleDenominator(rect.height, rect.width,
+                                                   height, width));
+    }
+  }
+  // Windows in the scaled image, and the region that spans them.
+  int left = src_width, top = src_height, right = 0, bottom = 0;
+  for (auto &rect : rects) {
+    int x0 = rect.x / denom;
+    int y0 = rect.y / denom;
+    int x1 = (rect.x + rect.width + denom - 1) / denom;
+    int y1 = (rect.y + rect.height + denom - 1) / denom;
+    rect = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+    left = std::min(left, x0);
+    top = std::min(top, y0);
+    right = std::max(right, x1);
+    bottom = std::max(bottom, y1);
+  }
+  JpegRegionDecoder decoder;
+  if (!decoder.Start(data.data(), data.size(), denom, color, order)) {
+    return false;
+  }
+  cv::Rect region(left, top, right - left, bottom - top);
+  if (!decoder.Crop(&region)) {
+    return false;
+  }
+  cv::Mat decoded(region.height, region.width, color ? CV_8UC3 : CV_8UC1);
+  if (!decoder.Read(decoded.data, decoded.cols * decoded.elemSize())) {
+    return false;
+  }
+  crops->clear();
+  for (const auto &rect : rects) {
+    // libjpeg rounds the scaled size up like the windows, so they fit.
+    crops->push_back(decoded(cv::Rect(rect.x - region.x, rect.y - region.y,
+                                      rect.width, rect.height)));
+  }
+  return true;
+}
+
+}  // namespace
+
+cv::Mat DecodeImageImpl(const std::vector<char> &vec_data, int cv_read_flag,
                         ChannelOrder order) {
   cv::Mat img_bgr;
-  int cv_read_flag = color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
   img_bgr = cv::imdecode(vec_data, cv_read_flag);
   if (!img_bgr.data) {
     LOG(ERROR) << "Could not decode image";
@@ -74,24 +205,253 @@ cv::Mat DecodeImageImpl(const std::vector<char> &vec_data, bool color,
 
 cv::Mat _Hack_DecodeImageByFilename(const ImageProto &image,
                                     ChannelOrder order) {
-  static _Hack_Images *_images = new _Hack_Images(FLAGS_hack_image_root);
-  const auto &vec_data = _images->get(image.hack_filename());
+  const auto &vec_data = _Hack_ImageData(image);
   if (vec_data.empty()) {
-    if (image.hack_filename() != "__init_Hack_Images")
-      LOG(ERROR) << "Cannot find image by filename: " << image.hack_filename();
     return {};
   }
-  return DecodeImageImpl(vec_data, image.color(), order);
+  return DecodeImageImpl(vec_data, ImreadFlag(image.color(), 1), order);
 }
 
 cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order) {
   if (image.hack_filename().empty()) {
     const std::string &data = image.data();
     std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-    return DecodeImageImpl(vec_data, image.color(), order);
+    return DecodeImageImpl(vec_data, ImreadFlag(image.color(), 1), order);
   } else {
     return _Hack_DecodeImageByFilename(image, order);
   }
 }
 
+bool GetJpegSize(const char *data, size_t size, int *height, int *width) {
+  const auto *p = reinterpret_cast<const uint8_t *>(data);
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (p[pos] != 0xFF) {
+      return false;
+    }
+    uint8_t marker = p[pos + 1];
+    if (marker == 0xFF) {
+      // Fill byte
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      // Markers without a segment
+      pos += 2;
+      continue;
+    }
+    if (marker == 0xD9 || marker == 0xDA) {
+      // End of image or start of scan before any frame header
+      return false;
+    }
+    size_t len = (p[pos + 2] << 8) | p[pos + 3];
+    bool is_sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                  marker != 0xC8 && marker != 0xCC;
+    if (is_sof) {
+      if (len < 7 || pos + 9 > size) {
+        return false;
+      }
+      *height = (p[pos + 5] << 8) | p[pos + 6];
+      *width = (p[pos + 7] << 8) | p[pos + 8];
+      return *height > 0 && *width > 0;
+    }
+    pos += 2 + len;
+  }
+  return false;
+}
+
+int JpegScaleDenominator(int src_height, int src_width, int height,
+                         int width) {
+  for (int denom = 8; denom > 1; denom /= 2) {
+    // libjpeg rounds the scaled size up.
+    int scaled_height = (src_height + denom - 1) / denom;
+    int scaled_width = (src_width + denom - 1) / denom;
+    if (scaled_height >= height && scaled_width >= width) {
+      return denom;
+    }
+  }
+  return 1;
+}
+
+cv::Mat DecodeImageScaled(const ImageProto &image, int height, int width,
+                          ChannelOrder order) {
+  std::vector<char> owned_data;
+  const std::vector<char> *vec_data = ImageData(image, &owned_data);
+  if (vec_data == nullptr) {
+    return {};
+  }
+  int denom = 1;
+  int src_height, src_width;
+  if (image.format() == ImageProto::JPEG &&
+      GetJpegSize(vec_data->data(), vec_data->size(), &src_height,
+                  &src_width)) {
+    denom = JpegScaleDenominator(src_height, src_width, height, width);
+  }
+  return DecodeImageImpl(*vec_data, ImreadFlag(image.color(), denom), order);
+}
+
+std::vector<cv::Mat> DecodeImageWindows(
+    const ImageProto &image,
+    const google::protobuf::RepeatedPtrField<RectProto> &windows, int height,
+    int width, ChannelOrder order, cv::Size *image_size) {
+  std::vector<char> owned_data;
+  const std::vector<char> *vec_data = ImageData(image, &owned_data);
+  if (vec_data == nullptr) {
+    return {};
+  }
+  int src_height, src_width;
+  if (FLAGS_roi_decode && image.format() == ImageProto::JPEG &&
+      GetJpegSize(vec_data->data(), vec_data->size(), &src_height,
+                  &src_width)) {
+    if (!WindowsInImage(windows, src_height, src_width)) {
+      return {};
+    }
+    std::vector<cv::Mat> crops;
+    if (DecodeJpegWindows(*vec_data, windows, height, width, src_height,
+                          src_width, image.color(), order, &crops)) {
+      *image_size = cv::Size(src_width, src_height);
+      return crops;
+    }
+  }
+  cv::Mat img = DecodeImageImpl(*vec_data, ImreadFlag(image.color(), 1), order);
+  if (!img.data || !WindowsInImage(windows, img.rows, img.cols)) {
+    return {};
+  }
+  *image_size = img.size();
+  if (windows.empty()) {
+    return {img};
+  }
+  std::vector<cv::Mat> crops;
+  for (const auto &rect : windows) {
+    crops.push_back(img(WindowRect(rect)));
+  }
+  return crops;
+}
+
+namespace {
+
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  std::jmp_buf jump;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  auto *err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+  char message[JMSG_LENGTH_MAX];
+  err->pub.format_message(cinfo, message);
+  VLOG(1) << "libjpeg: " << message;
+  std::longjmp(err->jump, 1);
+}
+
+void JpegOutputMessage(j_common_ptr cinfo) {
+  char message[JMSG_LENGTH_MAX];
+  cinfo->err->format_message(cinfo, message);
+  VLOG(1) << "libjpeg: " << message;
+}
+
+}  // namespace
+
+struct JpegRegionDecoder::Impl {
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager err;
+  bool started = false;
+  /*! \brief Rows of the region in the scaled image. */
+  int top = 0;
+  int bottom = 0;
+};
+
+JpegRegionDecoder::JpegRegionDecoder() : impl_(new Impl) {
+  impl_->cinfo.err = jpeg_std_error(&impl_->err.pub);
+  impl_->err.pub.error_exit = JpegErrorExit;
+  impl_->err.pub.output_message = JpegOutputMessage;
+  jpeg_create_decompress(&impl_->cinfo);
+}
+
+JpegRegionDecoder::~JpegRegionDecoder() {
+  jpeg_destroy_decompress(&impl_->cinfo);
+}
+
+bool JpegRegionDecoder::Start(const char *data, size_t size, int scale_denom,
+                              bool color, ChannelOrder order) {
+  CHECK(!impl_->started) << "Decoder already started";
+  auto *cinfo = &impl_->cinfo;
+  if (setjmp(impl_->err.jump)) {
+    jpeg_abort_decompress(cinfo);
+    return false;
+  }
+  jpeg_mem_src(cinfo,
+               reinterpret_cast<unsigned char *>(const_cast<char *>(data)),
+               size);
+  jpeg_read_header(cinfo, TRUE);
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = scale_denom;
+  if (color) {
+    cinfo->out_color_space = order == CO_BGR ? JCS_EXT_BGR : JCS_EXT_RGB;
+  } else {
+    cinfo->out_color_space = JCS_GRAYSCALE;
+  }
+  jpeg_start_decompress(cinfo);
+  impl_->started = true;
+  impl_->top = 0;
+  impl_->bottom = cinfo->output_height;
+  return true;
+}
+
+int JpegRegionDecoder::height() const { return impl_->cinfo.output_height; }
+
+int JpegRegionDecoder::width() const { return impl_->cinfo.output_width; }
+
+int JpegRegionDecoder::channels() const {
+  return impl_->cinfo.output_components;
+}
+
+bool JpegRegionDecoder::Crop(cv::Rect *region) {
+  CHECK(impl_->started) << "Decoder not started";
+  auto *cinfo = &impl_->cinfo;
+  int x0 = std::max(region->x, 0);
+  int y0 = std::max(region->y, 0);
+  int x1 = std::min<int>(region->x + region->width, cinfo->output_width);
+  int y1 = std::min<int>(region->y + region->height, cinfo->output_height);
+  if (x0 >= x1 || y0 >= y1) {
+    return false;
+  }
+  if (setjmp(impl_->err.jump)) {
+    return false;
+  }
+  // Fancy upsampling of subsampled chroma has no neighbor at the edges of
+  // a cropped scanline, so keep a column of margin on each side.
+  x0 = std::max(x0 - 1, 0);
+  x1 = std::min<int>(x1 + 1, cinfo->output_width);
+  JDIMENSION xoffset = x0;
+  JDIMENSION crop_width = x1 - x0;
+  if (crop_width != cinfo->output_width) {
+    jpeg_crop_scanline(cinfo, &xoffset, &crop_width);
+  }
+  *region = cv::Rect(xoffset, y0, crop_width, y1 - y0);
+  impl_->top = y0;
+  impl_->bottom = y1;
+  return true;
+}
+
+bool JpegRegionDecoder::Read(uint8_t *buffer, size_t step) {
+  CHECK(impl_->started) << "Decoder not started";
+  auto *cinfo = &impl_->cinfo;
+  if (setjmp(impl_->err.jump)) {
+    return false;
+  }
+  if (impl_->top > 0) {
+    jpeg_skip_scanlines(cinfo, impl_->top);
+  }
+  while (cinfo->output_scanline < static_cast<JDIMENSION>(impl_->bottom)) {
+    JSAMPROW row = buffer + (cinfo->output_scanline - impl_->top) * step;
+    jpeg_read_scanlines(cinfo, &row, 1);
+  }
+  // The rows below the region are never decoded.
+  jpeg_abort_decompress(cinfo);
+  return true;
+}
+
 }  // namespace nexus
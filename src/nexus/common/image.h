@@ -1,7 +1,11 @@
 #ifndef NEXUS_COMMON_IMAGE_H_
 #define NEXUS_COMMON_IMAGE_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <opencv2/core/core.hpp>
+#include <vector>
 
 #include "nexus/proto/nnquery.pb.h"
 
@@ -17,6 +21,94 @@ cv::Mat _Hack_DecodeImageByFilename(const ImageProto &image,
 
 cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order);
 
+/*!
+ * \brief Read the size of a JPEG image from its frame header.
+ * \return false if data is not a JPEG image or the header is truncated.
+ */
+bool GetJpegSize(const char *data, size_t size, int *height, int *width);
+
+/*!
+ * \brief Largest JPEG DCT scaling denominator (1, 2, 4 or 8) that still
+ *   decodes a src_height x src_width image to at least height x width.
+ */
+int JpegScaleDenominator(int src_height, int src_width, int height, int width);
+
+/*!
+ * \brief Decode an image that is going to be resized to height x width.
+ *   JPEG images are decoded at the smallest DCT-domain scale that is still
+ *   at least that large, which skips most of the IDCT and color conversion
+ *   work for large images. Other formats are fully decoded.
+ */
+cv::Mat DecodeImageScaled(const ImageProto &image, int height, int width,
+                          ChannelOrder order);
+
+/*!
+ * \brief Decode the windows of an image that are each going to be resized
+ *   to height x width. JPEG images are decoded at the smallest DCT-domain
+ *   scale that keeps every window at least that large, and only the rows and
+ *   iMCU columns that the windows span are decoded. Other formats, and JPEG
+ *   images libjpeg-turbo cannot decode this way, are fully decoded.
+ * \param windows Windows in the coordinates of the full image. If there are
+ *   none, the whole image is decoded.
+ * \param height, width Size the windows are resized to, or 0 to decode them
+ *   at full scale.
+ * \param image_size Set to the size of the full image.
+ * \return One image for each window, or the whole image if there is no
+ *   window. Empty if the image cannot be decoded or a window is not inside
+ *   the image.
+ */
+std::vector<cv::Mat> DecodeImageWindows(
+    const ImageProto &image,
+    const google::protobuf::RepeatedPtrField<RectProto> &windows, int height,
+    int width, ChannelOrder order, cv::Size *image_size);
+
+/*!
+ * \brief Decoder of a region of a JPEG image with libjpeg-turbo. The image
+ *   can be scaled by 1/2, 1/4 or 1/8 in the DCT domain. Rows above and below
+ *   the region are skipped without IDCT and color conversion, and iMCU
+ *   columns left and right of it are not decoded at all.
+ */
+class JpegRegionDecoder {
+ public:
+  JpegRegionDecoder();
+  ~JpegRegionDecoder();
+
+  JpegRegionDecoder(const JpegRegionDecoder &) = delete;
+  JpegRegionDecoder &operator=(const JpegRegionDecoder &) = delete;
+
+  /*!
+   * \brief Read the header and start decoding at 1/scale_denom. data must
+   *   outlive the decoder.
+   * \return false if data is not a JPEG image libjpeg-turbo can decode.
+   */
+  bool Start(const char *data, size_t size, int scale_denom, bool color,
+             ChannelOrder order);
+
+  /*! \brief Height of the scaled image. */
+  int height() const;
+  /*! \brief Width of the scaled image, or of the region after Crop. */
+  int width() const;
+  int channels() const;
+
+  /*!
+   * \brief Decode only a region of the scaled image. region is clamped to
+   *   the image and grows by a column on each side, then its left edge moves
+   *   left to an iMCU boundary.
+   * \return false if the region is empty.
+   */
+  bool Crop(cv::Rect *region);
+
+  /*!
+   * \brief Decode the region into rows that are step bytes apart. Can be
+   *   called once.
+   */
+  bool Read(uint8_t *buffer, size_t step);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
 }  // namespace nexus
 
 #endif  // NEXUS_COMMON_IMAGE_H_
@@ -28,24 +28,67 @@ bool DecodeHeader(const char* buffer, MessageHeader* header) {
   return true;
 }
 
-Message::Message(const MessageHeader& header) {
-  type_ = static_cast<MessageType>(header.msg_type);
-  body_length_ = header.body_length;
-  data_ = new char[MESSAGE_HEADER_SIZE + body_length_];
-  *((uint32_t*)data_) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
-  *((uint32_t*)(data_ + 4)) = htonl((uint32_t)type_);
-  *((uint32_t*)(data_ + 8)) = htonl(body_length_);
+MessageBufferPool& MessageBufferPool::Singleton() {
+  // Never destroyed, so that messages can be freed during exit.
+  static auto* pool = new MessageBufferPool;
+  return *pool;
 }
 
+size_t MessageBufferPool::SizeClass(size_t size) {
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    if (size <= (size_t{1} << (kMinSizeBits + i))) {
+      return i;
+    }
+  }
+  return kNumClasses;
+}
+
+char* MessageBufferPool::Allocate(size_t size) {
+  auto cls = SizeClass(size);
+  if (cls == kNumClasses) {
+    num_allocated_.fetch_add(1, std::memory_order_relaxed);
+    return new char[size];
+  }
+  auto& list = free_lists_[cls];
+  {
+    std::lock_guard<std::mutex> lock(list.mutex);
+    if (!list.buffers.empty()) {
+      char* buffer = list.buffers.back();
+      list.buffers.pop_back();
+      num_reused_.fetch_add(1, std::memory_order_relaxed);
+      return buffer;
+    }
+  }
+  num_allocated_.fetch_add(1, std::memory_order_relaxed);
+  return new char[size_t{1} << (kMinSizeBits + cls)];
+}
+
+void MessageBufferPool::Free(char* buffer, size_t size) {
+  auto cls = SizeClass(size);
+  if (cls < kNumClasses) {
+    size_t max_buffers = kMaxFreeBytesPerClass >> (kMinSizeBits + cls);
+    auto& list = free_lists_[cls];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    if (list.buffers.size() < max_buffers) {
+      list.buffers.push_back(buffer);
+      return;
+    }
+  }
+  delete[] buffer;
+}
+
+Message::Message(const MessageHeader& header)
+    : Message(static_cast<MessageType>(header.msg_type), header.body_length) {}
+
 Message::Message(MessageType type, size_t body_length)
     : type_(type), body_length_(body_length) {
-  data_ = new char[MESSAGE_HEADER_SIZE + body_length];
+  data_ = MessageBufferPool::Singleton().Allocate(length());
   *((uint32_t*)data_) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
   *((uint32_t*)(data_ + 4)) = htonl((uint32_t)type);
   *((uint32_t*)(data_ + 8)) = htonl(body_length_);
 }
 
-Message::~Message() { delete[] data_; }
+Message::~Message() { MessageBufferPool::Singleton().Free(data_, length()); }
 
 void Message::set_type(MessageType type) {
   type_ = type;
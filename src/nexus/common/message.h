@@ -4,7 +4,12 @@
 #include <arpa/inet.h>
 #include <google/protobuf/message.h>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace nexus {
 
@@ -51,6 +56,50 @@ struct MessageHeader {
 
 bool DecodeHeader(const char* buffer, MessageHeader* header);
 
+/*!
+ * \brief Free lists of message buffers, one for each power-of-two size from
+ *   256 B to 1 MB. Every Message takes its buffer from here, so that steady
+ *   traffic on user connections does not call malloc. Larger buffers are
+ *   allocated and freed directly.
+ */
+class MessageBufferPool {
+ public:
+  /*! \brief Get the pool shared by all messages of the process. */
+  static MessageBufferPool& Singleton();
+  /*! \brief Get a buffer of at least size bytes. */
+  char* Allocate(size_t size);
+  /*!
+   * \brief Return a buffer to the pool.
+   * \param buffer Buffer from Allocate
+   * \param size The size passed to Allocate
+   */
+  void Free(char* buffer, size_t size);
+  /*! \brief Number of buffers allocated from the heap. */
+  uint64_t num_allocated() const { return num_allocated_.load(); }
+  /*! \brief Number of buffers reused from the free lists. */
+  uint64_t num_reused() const { return num_reused_.load(); }
+
+ private:
+  static constexpr size_t kMinSizeBits = 8;
+  static constexpr size_t kMaxSizeBits = 20;
+  static constexpr size_t kNumClasses = kMaxSizeBits - kMinSizeBits + 1;
+  /*! \brief Bytes each free list keeps at most. */
+  static constexpr size_t kMaxFreeBytesPerClass = 16 << 20;
+
+  MessageBufferPool() = default;
+  /*! \brief Index of the smallest class that fits size, or kNumClasses. */
+  static size_t SizeClass(size_t size);
+
+  struct alignas(64) FreeList {
+    std::mutex mutex;
+    std::vector<char*> buffers /* GUARDED_BY(mutex) */;
+  };
+
+  FreeList free_lists_[kNumClasses];
+  std::atomic<uint64_t> num_allocated_{0};
+  std::atomic<uint64_t> num_reused_{0};
+};
+
 /*!
  * \brief Message is used to hold the packets that are communicated between
  * client and frontend server, and between frontend server and backend server.
@@ -58,24 +107,28 @@ bool DecodeHeader(const char* buffer, MessageHeader* header);
 class Message {
  public:
   /*!
-   * \brief Construct a nessage.
+   * \brief Construct a nessage from a decoded header.
    *
-   * It allocates the data buffer with maximal size. This constructor is mainly
-   * used to hold an inbound packet when the message size is unknown.
+   * It takes the data buffer from MessageBufferPool and writes the header.
+   * This constructor is mainly used to hold an inbound packet, whose body is
+   * then received into body().
    */
   // Message();
   Message(const MessageHeader& header);
   /*!
    * \brief Construct a nessage with explicit body length.
    *
-   * It allocates the data buffer with body length plus header size. This
-   * constructor is mainly used to hold an outbound packet when the message
-   * size is known
+   * It takes a data buffer of body length plus header size from
+   * MessageBufferPool. This constructor is mainly used to hold an outbound
+   * packet when the message size is known
    *
    * \param body_length Length of payload in bytes
    */
   Message(MessageType type, size_t body_length);
-  /*! \brief Destruct a message. */
+  // disable copy
+  Message(const Message&) = delete;
+  Message& operator=(const Message&) = delete;
+  /*! \brief Destruct a message and return its buffer to the pool. */
   ~Message();
   /*! \brief Get the data pointer */
   char* data() { return data_; }
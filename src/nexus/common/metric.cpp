@@ -1,6 +1,10 @@
 #include "nexus/common/metric.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <limits>
+#include <sstream>
 
 namespace nexus {
 
@@ -38,6 +42,264 @@ void IntervalCounter::TickImpl() {
   history_.push_back(count);
 }
 
+double HistogramSnapshot::Mean() const {
+  return count ? static_cast<double>(sum) / count : 0.;
+}
+
+int64_t HistogramSnapshot::Percentile(double p) const {
+  if (count == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(std::ceil(p / 100. * count));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  int64_t value = max;
+  bool found = false;
+  // Negative values from the largest magnitude to the smallest.
+  for (size_t i = negative_buckets.size(); i-- > 0 && !found;) {
+    seen += negative_buckets[i];
+    if (seen >= rank) {
+      // Bucket i never holds magnitude 0, so the lower bound is the previous
+      // bucket's upper bound plus one.
+      uint64_t lower = i ? Histogram::BucketUpperBound(i - 1) + 1 : 1;
+      value = -static_cast<int64_t>(lower - 1) - 1;
+      found = true;
+    }
+  }
+  for (size_t i = 0; i < positive_buckets.size() && !found; ++i) {
+    seen += positive_buckets[i];
+    if (seen >= rank) {
+      auto upper = Histogram::BucketUpperBound(i);
+      value = upper > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())
+                  ? std::numeric_limits<int64_t>::max()
+                  : static_cast<int64_t>(upper);
+      found = true;
+    }
+  }
+  return std::min(std::max(value, min), max);
+}
+
+std::string HistogramSnapshot::ToString() const {
+  std::ostringstream ss;
+  ss << "n=" << count;
+  if (count) {
+    ss << " mean=" << static_cast<int64_t>(Mean()) << " p50=" << Percentile(50)
+       << " p90=" << Percentile(90) << " p99=" << Percentile(99)
+       << " min=" << min << " max=" << max;
+  }
+  return ss.str();
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot& other) {
+  if (other.count == 0) {
+    return;
+  }
+  negative_buckets.resize(
+      std::max(negative_buckets.size(), other.negative_buckets.size()));
+  positive_buckets.resize(
+      std::max(positive_buckets.size(), other.positive_buckets.size()));
+  for (size_t i = 0; i < other.negative_buckets.size(); ++i) {
+    negative_buckets[i] += other.negative_buckets[i];
+  }
+  for (size_t i = 0; i < other.positive_buckets.size(); ++i) {
+    positive_buckets[i] += other.positive_buckets[i];
+  }
+  min = count ? std::min(min, other.min) : other.min;
+  max = count ? std::max(max, other.max) : other.max;
+  count += other.count;
+  sum += other.sum;
+}
+
+Histogram::Histogram() { Reset(); }
+
+size_t Histogram::BucketIndex(uint64_t magnitude) {
+  constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  if (magnitude < kSubBuckets) {
+    return magnitude;
+  }
+  int exponent = 63 - __builtin_clzll(magnitude) - kSubBucketBits;
+  uint64_t mantissa = magnitude >> exponent;
+  return kSubBuckets + (exponent << kSubBucketBits) + (mantissa - kSubBuckets);
+}
+
+uint64_t Histogram::BucketUpperBound(size_t index) {
+  constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  if (index < kSubBuckets) {
+    return index;
+  }
+  int exponent = (index - kSubBuckets) >> kSubBucketBits;
+  uint64_t mantissa = kSubBuckets + ((index - kSubBuckets) & (kSubBuckets - 1));
+  return ((mantissa + 1) << exponent) - 1;
+}
+
+void Histogram::Record(int64_t value) {
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  int64_t cur = min_.load(std::memory_order_relaxed);
+  while (value < cur &&
+         !min_.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+  }
+  cur = max_.load(std::memory_order_relaxed);
+  while (value > cur &&
+         !max_.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+  }
+  if (value < 0) {
+    auto magnitude = static_cast<uint64_t>(-(value + 1)) + 1;
+    negative_buckets_[BucketIndex(magnitude)].fetch_add(
+        1, std::memory_order_relaxed);
+  } else {
+    positive_buckets_[BucketIndex(value)].fetch_add(1,
+                                                    std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Reset() {
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+  max_.store(std::numeric_limits<int64_t>::min(), std::memory_order_relaxed);
+  for (auto& bucket : negative_buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  for (auto& bucket : positive_buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+HistogramSnapshot Histogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.negative_buckets.resize(kNumBuckets);
+  snapshot.positive_buckets.resize(kNumBuckets);
+  // Buckets are read one by one while writers may be running, so the sum of
+  // buckets is used as the count to keep percentiles consistent.
+  uint64_t count = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    snapshot.negative_buckets[i] =
+        negative_buckets_[i].load(std::memory_order_relaxed);
+    snapshot.positive_buckets[i] =
+        positive_buckets_[i].load(std::memory_order_relaxed);
+    count += snapshot.negative_buckets[i] + snapshot.positive_buckets[i];
+  }
+  snapshot.count = count;
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  snapshot.min = count ? min_.load(std::memory_order_relaxed) : 0;
+  snapshot.max = count ? max_.load(std::memory_order_relaxed) : 0;
+  return snapshot;
+}
+
+uint64_t ShardedCounter::value() const {
+  uint64_t sum = 0;
+  for (const auto& shard : shards_) {
+    sum += shard.count.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+void ShardedCounter::Reset() {
+  for (auto& shard : shards_) {
+    shard.count.store(0, std::memory_order_relaxed);
+  }
+}
+
+void ShardedHistogram::Reset() {
+  for (auto& shard : shards_) {
+    shard.histogram.Reset();
+  }
+}
+
+HistogramSnapshot ShardedHistogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  for (const auto& shard : shards_) {
+    snapshot.Merge(shard.histogram.Snapshot());
+  }
+  return snapshot;
+}
+
+namespace {
+
+std::string EscapeLabelValue(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    switch (c) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += c;
+    }
+  }
+  return escaped;
+}
+
+}  // namespace
+
+void PrometheusWriter::AddHeader(const std::string& name,
+                                 const std::string& help, const char* type) {
+  if (name == last_name_) {
+    return;
+  }
+  last_name_ = name;
+  text_ += "# HELP " + name + " " + help + "\n";
+  text_ += "# TYPE " + name + " " + type + "\n";
+}
+
+void PrometheusWriter::AddSample(const std::string& name,
+                                 const MetricLabels& labels,
+                                 const std::string& value) {
+  text_ += name;
+  if (!labels.empty()) {
+    text_ += "{";
+    for (size_t i = 0; i < labels.size(); ++i) {
+      if (i) {
+        text_ += ",";
+      }
+      text_ += labels[i].first + "=\"" + EscapeLabelValue(labels[i].second) +
+               "\"";
+    }
+    text_ += "}";
+  }
+  text_ += " " + value + "\n";
+}
+
+void PrometheusWriter::AddCounter(const std::string& name,
+                                  const std::string& help,
+                                  const MetricLabels& labels, uint64_t value) {
+  AddHeader(name, help, "counter");
+  AddSample(name, labels, std::to_string(value));
+}
+
+void PrometheusWriter::AddGauge(const std::string& name,
+                                const std::string& help,
+                                const MetricLabels& labels, double value) {
+  AddHeader(name, help, "gauge");
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  AddSample(name, labels, buf);
+}
+
+void PrometheusWriter::AddHistogram(const std::string& name,
+                                    const std::string& help,
+                                    const MetricLabels& labels,
+                                    const HistogramSnapshot& snapshot) {
+  AddHeader(name, help, "summary");
+  static const std::pair<const char*, double> kQuantiles[] = {
+      {"0.5", 50}, {"0.9", 90}, {"0.99", 99}, {"0.999", 99.9}};
+  for (const auto& quantile : kQuantiles) {
+    auto quantile_labels = labels;
+    quantile_labels.emplace_back("quantile", quantile.first);
+    AddSample(name, quantile_labels,
+              std::to_string(snapshot.Percentile(quantile.second)));
+  }
+  AddSample(name + "_sum", labels, std::to_string(snapshot.sum));
+  AddSample(name + "_count", labels, std::to_string(snapshot.count));
+}
+
 EWMA::EWMA(uint32_t sample_interval_sec, uint32_t avg_interval_sec)
     : sample_interval_sec_(sample_interval_sec),
       avg_interval_sec_(avg_interval_sec),
@@ -97,4 +359,58 @@ void MetricRegistry::RemoveMetric(std::shared_ptr<IntervalCounter> metric) {
   metrics_.erase(metric);
 }
 
+std::shared_ptr<ShardedCounter> MetricRegistry::CreateShardedCounter(
+    const std::string& name, const std::string& help, MetricLabels labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto metric = std::make_shared<ShardedCounter>();
+  metrics_.insert(metric);
+  exported_.push_back({name, help, std::move(labels), metric, nullptr});
+  return metric;
+}
+
+std::shared_ptr<ShardedHistogram> MetricRegistry::CreateShardedHistogram(
+    const std::string& name, const std::string& help, MetricLabels labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto metric = std::make_shared<ShardedHistogram>();
+  metrics_.insert(metric);
+  exported_.push_back({name, help, std::move(labels), nullptr, metric});
+  return metric;
+}
+
+void MetricRegistry::RemoveMetric(std::shared_ptr<Metric> metric) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  metrics_.erase(metric);
+  exported_.erase(
+      std::remove_if(exported_.begin(), exported_.end(),
+                     [&metric](const ExportedMetric& exported) {
+                       return exported.counter == metric ||
+                              exported.histogram == metric;
+                     }),
+      exported_.end());
+}
+
+std::string MetricRegistry::ExportText() {
+  std::vector<ExportedMetric> exported;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exported = exported_;
+  }
+  // Samples of one metric name must be contiguous.
+  std::stable_sort(exported.begin(), exported.end(),
+                   [](const ExportedMetric& a, const ExportedMetric& b) {
+                     return a.name < b.name;
+                   });
+  PrometheusWriter writer;
+  for (const auto& metric : exported) {
+    if (metric.counter) {
+      writer.AddCounter(metric.name, metric.help, metric.labels,
+                        metric.counter->value());
+    } else {
+      writer.AddHistogram(metric.name, metric.help, metric.labels,
+                          metric.histogram->Snapshot());
+    }
+  }
+  return writer.str();
+}
+
 }  // namespace nexus
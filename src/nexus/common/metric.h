@@ -1,10 +1,14 @@
 #ifndef NEXUS_COMMON_METRIC_H_
 #define NEXUS_COMMON_METRIC_H_
 
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "nexus/common/time_util.h"
@@ -52,6 +56,164 @@ class IntervalCounter : public Metric, public Tickable {
   std::atomic_bool running_;
 };
 
+/*!
+ * \brief Point-in-time copy of a Histogram.
+ */
+struct HistogramSnapshot {
+  uint64_t count = 0;
+  int64_t sum = 0;
+  int64_t min = 0;
+  int64_t max = 0;
+  /*! \brief Bucket counts of negative values, indexed by magnitude. */
+  std::vector<uint64_t> negative_buckets;
+  /*! \brief Bucket counts of non-negative values. */
+  std::vector<uint64_t> positive_buckets;
+
+  double Mean() const;
+  /*!
+   * \brief Estimate the value at the given percentile.
+   * \param p Percentile in [0, 100].
+   * \return Upper bound of the bucket that contains the percentile, clamped
+   *   to [min, max]. Relative error is at most 1/8.
+   */
+  int64_t Percentile(double p) const;
+  /*! \brief One-line summary: count, mean, p50, p90, p99, min, max. */
+  std::string ToString() const;
+  /*!
+   * \brief Add the values of another snapshot. Buckets are the same in all
+   *   histograms, so the merged percentiles are as accurate as if all values
+   *   were recorded into one histogram.
+   */
+  void Merge(const HistogramSnapshot& other);
+};
+
+/*!
+ * \brief Histogram of int64 values with log-linear buckets.
+ *
+ * Record() only uses relaxed atomic operations and is safe to call from any
+ * thread without taking locks.
+ */
+class Histogram : public Metric {
+ public:
+  /*! \brief Number of linear sub-buckets in each power of two. */
+  static constexpr int kSubBucketBits = 3;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1)
+                                        << kSubBucketBits;
+
+  Histogram();
+
+  void Record(int64_t value);
+
+  void Reset() final;
+
+  HistogramSnapshot Snapshot() const;
+
+  static size_t BucketIndex(uint64_t magnitude);
+  /*! \brief Largest magnitude that falls into the bucket. */
+  static uint64_t BucketUpperBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> count_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+  std::array<std::atomic<uint64_t>, kNumBuckets> negative_buckets_;
+  std::array<std::atomic<uint64_t>, kNumBuckets> positive_buckets_;
+};
+
+/*! \brief Number of shards of ShardedCounter and ShardedHistogram. */
+constexpr size_t kMetricShards = 16;
+
+/*!
+ * \brief Shard of the calling thread. Threads are assigned shards round
+ *   robin when they first update a sharded metric.
+ */
+inline size_t MetricShardIndex() {
+  static std::atomic<size_t> next_index{0};
+  thread_local size_t index =
+      next_index.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+  return index;
+}
+
+/*!
+ * \brief Counter that threads update on shards of their own, so that they
+ *   do not contend on one cache line. Shards are summed at read time.
+ */
+class ShardedCounter : public Metric {
+ public:
+  void Increase(uint64_t value = 1) {
+    shards_[MetricShardIndex()].count.fetch_add(value,
+                                                std::memory_order_relaxed);
+  }
+
+  uint64_t value() const;
+
+  void Reset() final;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> count{0};
+  };
+  std::array<Shard, kMetricShards> shards_;
+};
+
+/*!
+ * \brief Histogram that threads record into on shards of their own. Record()
+ *   is lock-free and only touches the shard of the calling thread. Shards
+ *   are merged at read time.
+ */
+class ShardedHistogram : public Metric {
+ public:
+  void Record(int64_t value) {
+    shards_[MetricShardIndex()].histogram.Record(value);
+  }
+
+  void Reset() final;
+
+  HistogramSnapshot Snapshot() const;
+
+ private:
+  struct alignas(64) Shard {
+    Histogram histogram;
+  };
+  std::array<Shard, kMetricShards> shards_;
+};
+
+/*! \brief Label names and values of a metric. */
+using MetricLabels = std::vector<std::pair<std::string, std::string> >;
+
+/*!
+ * \brief Writes metrics in the Prometheus text exposition format. Samples
+ *   of the same metric name must be added one after another.
+ */
+class PrometheusWriter {
+ public:
+  void AddCounter(const std::string& name, const std::string& help,
+                  const MetricLabels& labels, uint64_t value);
+
+  void AddGauge(const std::string& name, const std::string& help,
+                const MetricLabels& labels, double value);
+
+  /*!
+   * \brief Add a histogram as a summary with the 0.5, 0.9, 0.99 and 0.999
+   *   quantiles, the sum and the count.
+   */
+  void AddHistogram(const std::string& name, const std::string& help,
+                    const MetricLabels& labels,
+                    const HistogramSnapshot& snapshot);
+
+  const std::string& str() const { return text_; }
+
+ private:
+  void AddHeader(const std::string& name, const std::string& help,
+                 const char* type);
+  void AddSample(const std::string& name, const MetricLabels& labels,
+                 const std::string& value);
+
+  std::string text_;
+  std::string last_name_;
+};
+
 class EWMA {
  public:
   EWMA(uint32_t sample_interval_sec, uint32_t avg_interval_sec);
@@ -81,11 +243,35 @@ class MetricRegistry {
 
   void RemoveMetric(std::shared_ptr<IntervalCounter> metric);
 
+  /*! \brief Create a counter that ExportText exposes. */
+  std::shared_ptr<ShardedCounter> CreateShardedCounter(
+      const std::string& name, const std::string& help,
+      MetricLabels labels = {});
+
+  /*! \brief Create a histogram that ExportText exposes. */
+  std::shared_ptr<ShardedHistogram> CreateShardedHistogram(
+      const std::string& name, const std::string& help,
+      MetricLabels labels = {});
+
+  void RemoveMetric(std::shared_ptr<Metric> metric);
+
+  /*! \brief All sharded metrics in the Prometheus text exposition format. */
+  std::string ExportText();
+
  private:
+  struct ExportedMetric {
+    std::string name;
+    std::string help;
+    MetricLabels labels;
+    std::shared_ptr<ShardedCounter> counter;
+    std::shared_ptr<ShardedHistogram> histogram;
+  };
+
   MetricRegistry() {}
 
   std::mutex mutex_;
   std::unordered_set<std::shared_ptr<Metric> > metrics_;
+  std::vector<ExportedMetric> exported_;
 };
 
 }  // namespace nexus
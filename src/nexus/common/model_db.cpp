@@ -3,10 +3,12 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <cmath>
 #include <fstream>
 #include <queue>
+#include <sstream>
 
 #include "nexus/common/model_def.h"
 #include "nexus/common/sleep_profile.h"
@@ -28,6 +30,10 @@ namespace fs = boost::filesystem;
 DEFINE_string(model_root, "", "Model root dicrectory");
 DEFINE_double(profile_multiplier, 1.0,
               "Multiplier to forward latency in profile.");
+DEFINE_bool(model_profile_cache, true,
+            "Cache the parsed model profiles in profiles.cache under "
+            "model_root, so that later starts do not parse unchanged "
+            "profiles");
 
 namespace nexus {
 
@@ -92,44 +98,36 @@ void ModelProfile::MergeProfileBySlowest(const ModelProfile& rhs) {
   MergeMeanStdBySlowest(postprocess_, rhs.postprocess_);
 }
 
+ModelProfile::ModelProfile(const RawProfile& raw)
+    : profile_id_(raw.profile_id),
+      gpu_device_name_(raw.gpu_device_name),
+      gpu_uuid_(raw.gpu_uuid) {
+  auto to_entry = [](const ProfileRow& row) {
+    ProfileEntry entry;
+    entry.latency_mean = row.latency_mean * FLAGS_profile_multiplier;
+    entry.latency_std = row.latency_std * FLAGS_profile_multiplier;
+    entry.static_memory = row.static_memory;
+    entry.memory_usage = row.memory_usage;
+    entry.repeat = row.repeat;
+    return entry;
+  };
+  forward_lats_.resize(1);
+  for (const auto& row : raw.forward) {
+    forward_lats_.push_back(to_entry(row));
+  }
+  preprocess_ = to_entry(raw.preprocess);
+  postprocess_ = to_entry(raw.postprocess);
+}
+
 void ModelProfile::LoadProfile(const std::string& filepath) {
   std::ifstream fin(filepath);
   CHECK(fin.good()) << "Profile file " << filepath << " doesn't exist";
-  std::getline(fin, profile_id_);
-  std::getline(fin, gpu_device_name_);
-  std::string line;
-  std::vector<std::string> tokens;
-  std::getline(fin, gpu_uuid_);
-  std::getline(fin, line);  // Forward latency
-  // batch,latency(us),std(us),static memory(B),peak memory(B),repeat
-  std::getline(fin, line);
-  forward_lats_.resize(1);
-  while (true) {
-    std::getline(fin, line);
-    if (line.find("Preprocess latency (mean,std,repeat)") == 0) break;
-    SplitString(line, ',', &tokens);
-    CHECK_EQ(tokens.size(), 6) << filepath;
-    ProfileEntry entry;
-    uint32_t batch = stoi(tokens[0]);
-    entry.latency_mean = stof(tokens[1]) * FLAGS_profile_multiplier;
-    entry.latency_std = stof(tokens[2]) * FLAGS_profile_multiplier;
-    entry.static_memory = stoll(tokens[3]);
-    entry.memory_usage = stoll(tokens[4]);
-    entry.repeat = std::stoi(tokens[5]);
-    CHECK_EQ(forward_lats_.size(), batch);
-    forward_lats_.push_back(entry);
-  }
-  std::getline(fin, line);
-  SplitString(line, ',', &tokens);
-  preprocess_.latency_mean = stof(tokens[0]) * FLAGS_profile_multiplier;
-  preprocess_.latency_std = stof(tokens[1]) * FLAGS_profile_multiplier;
-  preprocess_.repeat = std::stoi(tokens[2]);
-  std::getline(fin, line);  // Postprocess latency (mean,std,repeat)
-  std::getline(fin, line);
-  SplitString(line, ',', &tokens);
-  postprocess_.latency_mean = stof(tokens[0]) * FLAGS_profile_multiplier;
-  postprocess_.latency_std = stof(tokens[1]) * FLAGS_profile_multiplier;
-  postprocess_.repeat = std::stoi(tokens[2]);
+  std::ostringstream text;
+  text << fin.rdbuf();
+  RawProfile raw;
+  CHECK(ParseProfileText(text.str(), &raw))
+      << "Malformed profile file " << filepath;
+  *this = ModelProfile(raw);
 }
 
 void ModelProfile::ForceMonotonicity() {
@@ -236,8 +234,8 @@ std::pair<uint32_t, double> ModelProfile::GetMaxThroughput(
 
 ModelProfile ModelProfile::FromSleepProfile(const SleepProfile& profile) {
   constexpr double kStdFactor = 0.01;
+  // The default constructor leaves the empty entry of batch 0.
   ModelProfile p;
-  p.forward_lats_.push_back({});
   for (uint32_t i = 1; i < 500; ++i) {
     double f = profile.forward_us(i);
     p.forward_lats_.push_back({f, f * kStdFactor, 0, 0, 1});
@@ -255,17 +253,27 @@ ModelDatabase& ModelDatabase::Singleton() {
   return model_db_;
 }
 
-const YAML::Node* ModelDatabase::GetModelInfo(
-    const std::string& model_id) const {
+namespace {
+
+/*!
+ * \brief Key of the model in the model DB. A sleep model takes the entries of
+ *   the TensorFlow model of its name.
+ */
+std::string ModelDBKey(const std::string& model_id) {
   ModelSession model_session;
   ParseModelID(model_id, &model_session);
-  std::string key;
-  if (SleepProfile::MatchPrefix(model_session.framework())) {
-    model_session.set_framework("tensorflow");
-    key = ModelSessionToModelID(model_session);
-  } else {
-    key = model_id;
+  if (!SleepProfile::MatchPrefix(model_session.framework())) {
+    return model_id;
   }
+  model_session.set_framework("tensorflow");
+  return ModelSessionToModelID(model_session);
+}
+
+}  // namespace
+
+const YAML::Node* ModelDatabase::GetModelInfo(
+    const std::string& model_id) const {
+  auto key = ModelDBKey(model_id);
   auto itr = model_info_table_.find(key);
   if (itr == model_info_table_.end()) {
     LOG(ERROR) << "Cannot find model info for " << model_id << " (key=\"" << key
@@ -300,6 +308,7 @@ const ModelProfile* ModelDatabase::GetModelProfile(
   if (SleepProfile::MatchPrefix(profile_id)) {
     ModelSession model_session;
     ParseModelID(profile_id, &model_session);
+    std::lock_guard<std::mutex> lock(profile_mutex_);
     auto iter = sleep_profiles_.find(model_session.framework());
     if (iter != sleep_profiles_.end()) {
       return &iter->second;
@@ -322,7 +331,7 @@ const ModelProfile* ModelDatabase::GetModelProfile(
   auto& profile_table = itr->second;
   auto key = profile_id + ":" + gpu_uuid;
   auto itr2 = profile_table.find(key);
-  if (itr2 != profile_table.end()) return &itr2->second;
+  if (itr2 != profile_table.end()) return Materialize(itr2->second);
 
   std::vector<std::string> tokens;
   SplitString(profile_id, ':', &tokens);
@@ -340,12 +349,24 @@ const ModelProfile* ModelDatabase::GetModelProfile(
   }
   auto key3 = mirror_profile_id + ':' + gpu_uuid;
   auto itr3 = profile_table.find(key3);
-  if (itr3 != profile_table.end()) return &itr3->second;
+  if (itr3 != profile_table.end()) return Materialize(itr3->second);
   LOG(ERROR) << "Cannot find model profile " << key << " or " << key3 << " on "
              << gpu_device;
   return nullptr;
 }
 
+const ModelProfile* ModelDatabase::Materialize(const LazyProfile& lazy) const {
+  std::lock_guard<std::mutex> lock(profile_mutex_);
+  if (lazy.profile == nullptr) {
+    auto iter = lazy.sources.begin();
+    lazy.profile.reset(new ModelProfile(profile_cache_->Read(*iter)));
+    for (++iter; iter != lazy.sources.end(); ++iter) {
+      lazy.profile->MergeProfile(ModelProfile(profile_cache_->Read(*iter)));
+    }
+  }
+  return lazy.profile.get();
+}
+
 std::shared_ptr<TFShareInfo> ModelDatabase::GetTFShareInfo(
     const std::string& model_name) const {
   auto iter = tf_share_models_.find(model_name);
@@ -355,15 +376,16 @@ std::shared_ptr<TFShareInfo> ModelDatabase::GetTFShareInfo(
 
 int ModelDatabase::GetSharePrefixLength(const std::string& model_id1,
                                         const std::string& model_id2) const {
-  auto iter = share_prefix_models_.find(model_id1);
+  auto iter = share_prefix_models_.find(ModelDBKey(model_id1));
   if (iter == share_prefix_models_.end()) {
     return 0;
   }
   auto const& shares = iter->second;
-  if (shares.find(model_id2) == shares.end()) {
+  auto share = shares.find(ModelDBKey(model_id2));
+  if (share == shares.end()) {
     return 0;
   }
-  return shares.at(model_id2);
+  return share->second;
 }
 
 std::vector<std::string> ModelDatabase::GetPrefixShareModels(
@@ -510,25 +532,31 @@ void ModelDatabase::LoadModelProfiles(const std::string& profile_dir) {
     }
   }
 
-  for (const auto& filepath : files) {
-    ModelProfile profile(filepath.string());
-    auto device = profile.gpu_device_name();
-    if (device_profile_table_.find(device) == device_profile_table_.end()) {
-      device_profile_table_.emplace(device, ProfileTable());
-    }
-    auto& table = device_profile_table_[device];
-
-    auto key_generic = profile.profile_id() + ":generic";
-    auto it = table.find(key_generic);
-    if (it == table.end()) {
-      table[key_generic] = profile;
-    } else {
-      it->second.MergeProfile(profile);
-    }
-
-    if (profile.gpu_uuid() != "generic") {
-      auto key = profile.profile_id() + ":" + profile.gpu_uuid();
-      table[key] = profile;
+  std::sort(files.begin(), files.end());
+  std::vector<ProfileSource> sources(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    CHECK(ProfileSource::Stat(files[i].string(), &sources[i]))
+        << "Cannot stat profile " << files[i];
+  }
+  std::string cache_path;
+  if (FLAGS_model_profile_cache) {
+    cache_path = (fs::path(db_root_dir_) / "profiles.cache").string();
+  }
+  profile_cache_ = ProfileCache::Load(sources, cache_path);
+  CHECK(profile_cache_ != nullptr)
+      << "Cannot load model profiles from " << profile_dir;
+  LOG(INFO) << "Loaded " << sources.size() << " model profiles, parsed "
+            << profile_cache_->num_parsed() << " of them";
+
+  // Profiles are merged or replaced in the order of the files, and built on
+  // the first GetModelProfile.
+  const auto& entries = profile_cache_->entries();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto& entry = entries[i];
+    auto& table = device_profile_table_[entry.gpu_device_name];
+    table[entry.profile_id + ":generic"].sources.push_back(i);
+    if (entry.gpu_uuid != "generic") {
+      table[entry.profile_id + ":" + entry.gpu_uuid].sources = {i};
     }
   }
 }
@@ -4,9 +4,11 @@
 #include <yaml-cpp/yaml.h>
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "nexus/common/profile_cache.h"
 #include "nexus/common/sleep_profile.h"
 
 namespace nexus {
@@ -26,6 +28,9 @@ class ModelProfile {
 
   ModelProfile(const std::string& file_path);
 
+  /*! \brief Profile of the parsed text, scaled by profile_multiplier. */
+  explicit ModelProfile(const RawProfile& raw);
+
   static ModelProfile FromSleepProfile(const SleepProfile& profile);
 
   void MergeProfile(const ModelProfile& rhs);
@@ -113,6 +118,10 @@ class ModelDatabase {
                                       const std::string& gpu_uuid,
                                       const std::string& profile_id) const;
 
+  /*!
+   * \brief Number of leading layers that the two models share, or 0. Sleep
+   *   models take the share_prefix entries of their TensorFlow models.
+   */
   int GetSharePrefixLength(const std::string& model_id1,
                            const std::string& model_id2) const;
 
@@ -128,7 +137,16 @@ class ModelDatabase {
   void LoadModelProfiles(const std::string& profile_dir);
 
  private:
-  using ProfileTable = std::unordered_map<std::string, ModelProfile>;
+  /*! \brief Profile that is built from its cache entries on first use. */
+  struct LazyProfile {
+    /*! \brief Indices of the profile cache entries merged in order. */
+    std::vector<size_t> sources;
+    mutable std::unique_ptr<ModelProfile> profile;
+  };
+
+  const ModelProfile* Materialize(const LazyProfile& lazy) const;
+
+  using ProfileTable = std::unordered_map<std::string, LazyProfile>;
   using PrefixMap = std::unordered_map<std::string, uint32_t>;
 
   /*! \brief Model database root directory */
@@ -137,8 +155,12 @@ class ModelDatabase {
   std::string model_store_dir_;
   /*! \brief Map from model ID to model information */
   std::unordered_map<std::string, YAML::Node> model_info_table_;
+  /*! \brief Parsed profile files */
+  std::unique_ptr<ProfileCache> profile_cache_;
   /*! \brief Map from device name to profile table */
   std::unordered_map<std::string, ProfileTable> device_profile_table_;
+  /*! \brief Guards the profiles materialized by GetModelProfile */
+  mutable std::mutex profile_mutex_;
 
   std::unordered_map<std::string, PrefixMap> share_prefix_models_;
   /*! \brief Map from model name to TFShareInfo */
@@ -0,0 +1,473 @@
+#include "nexus/common/profile_cache.h"
+
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace nexus {
+
+namespace {
+
+constexpr char kMagic[8] = {'N', 'X', 'P', 'R', 'O', 'F', 'C', '\0'};
+
+/*! \brief Header of the cache file. The payload of records follows it. */
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_records;
+  uint64_t payload_size;
+  uint64_t payload_hash;
+};
+
+/*!
+ * \brief Hash of a byte string, 8 bytes at a time. The cache is persisted,
+ *   so unlike std::hash it must not change across builds.
+ */
+uint64_t HashBytes(const char* data, size_t size) {
+  constexpr uint64_t kMul = 0x9e3779b97f4a7c15ULL;
+  uint64_t h = size * kMul;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    word *= kMul;
+    word ^= word >> 29;
+    h = (h ^ word) * kMul;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, size - i);
+  h = (h ^ (tail * kMul)) * kMul;
+  h ^= h >> 32;
+  return h;
+}
+
+class BinaryWriter {
+ public:
+  explicit BinaryWriter(std::string* out) : out_(out) {}
+
+  template <typename T>
+  void Put(T value) {
+    out_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void PutString(const std::string& value) {
+    Put<uint32_t>(value.size());
+    out_->append(value);
+  }
+
+  void PutRow(const ProfileRow& row) {
+    Put(row.latency_mean);
+    Put(row.latency_std);
+    Put(row.static_memory);
+    Put(row.memory_usage);
+    Put(row.repeat);
+  }
+
+ private:
+  std::string* out_;
+};
+
+constexpr size_t kRowSize = 2 * sizeof(double) + 2 * sizeof(uint64_t) +
+                            sizeof(int32_t);
+
+class BinaryReader {
+ public:
+  BinaryReader(const char* data, size_t size)
+      : begin_(data), pos_(data), end_(data + size) {}
+
+  template <typename T>
+  bool Get(T* value) {
+    if (end_ - pos_ < static_cast<ptrdiff_t>(sizeof(T))) {
+      return false;
+    }
+    memcpy(value, pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  bool GetString(std::string* value) {
+    uint32_t length;
+    if (!Get(&length) || end_ - pos_ < length) {
+      return false;
+    }
+    value->assign(pos_, length);
+    pos_ += length;
+    return true;
+  }
+
+  bool GetRow(ProfileRow* row) {
+    return Get(&row->latency_mean) && Get(&row->latency_std) &&
+           Get(&row->static_memory) && Get(&row->memory_usage) &&
+           Get(&row->repeat);
+  }
+
+  bool Skip(size_t size) {
+    if (static_cast<size_t>(end_ - pos_) < size) {
+      return false;
+    }
+    pos_ += size;
+    return true;
+  }
+
+  bool done() const { return pos_ == end_; }
+  size_t offset() const { return pos_ - begin_; }
+
+ private:
+  const char* begin_;
+  const char* pos_;
+  const char* end_;
+};
+
+/*!
+ * \brief Record of a cache file. The body is everything after the source
+ *   stat and hash: the parsed profile.
+ */
+struct RecordView {
+  std::string path;
+  int64_t mtime_ns;
+  uint64_t size;
+  uint64_t content_hash;
+  const char* body;
+  size_t body_size;
+};
+
+/*! \brief Walk the records of a payload. Return false if it is malformed. */
+template <typename Visit>
+bool WalkRecords(const char* payload, size_t size, uint32_t num_records,
+                 Visit visit) {
+  BinaryReader reader(payload, size);
+  std::string unused;
+  for (uint32_t i = 0; i < num_records; ++i) {
+    RecordView record;
+    if (!reader.GetString(&record.path) || !reader.Get(&record.mtime_ns) ||
+        !reader.Get(&record.size) || !reader.Get(&record.content_hash)) {
+      return false;
+    }
+    size_t body_begin = reader.offset();
+    uint32_t num_forward;
+    if (!reader.GetString(&unused) || !reader.GetString(&unused) ||
+        !reader.GetString(&unused) || !reader.Get(&num_forward) ||
+        !reader.Skip((num_forward + 2ULL) * kRowSize)) {
+      return false;
+    }
+    record.body = payload + body_begin;
+    record.body_size = reader.offset() - body_begin;
+    visit(record);
+  }
+  return reader.done();
+}
+
+void EncodeBody(const RawProfile& profile, std::string* out) {
+  BinaryWriter writer(out);
+  writer.PutString(profile.profile_id);
+  writer.PutString(profile.gpu_device_name);
+  writer.PutString(profile.gpu_uuid);
+  writer.Put<uint32_t>(profile.forward.size());
+  for (const auto& row : profile.forward) {
+    writer.PutRow(row);
+  }
+  writer.PutRow(profile.preprocess);
+  writer.PutRow(profile.postprocess);
+}
+
+bool ReadFile(const std::string& path, std::string* content) {
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin.good()) {
+    return false;
+  }
+  std::ostringstream ss;
+  ss << fin.rdbuf();
+  *content = ss.str();
+  return true;
+}
+
+/*! \brief Split a line into comma-separated fields. */
+std::vector<std::pair<const char*, const char*>> SplitFields(const char* begin,
+                                                             const char* end) {
+  std::vector<std::pair<const char*, const char*>> fields;
+  const char* field = begin;
+  for (const char* p = begin; p <= end; ++p) {
+    if (p == end || *p == ',') {
+      fields.emplace_back(field, p);
+      field = p + 1;
+    }
+  }
+  return fields;
+}
+
+// The fields are followed by ',' or '\n' within a null-terminated string, so
+// strtod and strtoll stop at the end of the field.
+
+bool ParseField(std::pair<const char*, const char*> field, double* value) {
+  char* stop;
+  *value = std::strtod(field.first, &stop);
+  return field.first != field.second && stop == field.second;
+}
+
+template <typename T>
+bool ParseField(std::pair<const char*, const char*> field, T* value) {
+  char* stop;
+  errno = 0;
+  long long parsed = std::strtoll(field.first, &stop, 10);
+  *value = static_cast<T>(parsed);
+  return field.first != field.second && stop == field.second && errno == 0;
+}
+
+bool ParseSummaryRow(const char* begin, const char* end, ProfileRow* row) {
+  auto fields = SplitFields(begin, end);
+  return fields.size() == 3 && ParseField(fields[0], &row->latency_mean) &&
+         ParseField(fields[1], &row->latency_std) &&
+         ParseField(fields[2], &row->repeat);
+}
+
+}  // namespace
+
+bool ParseProfileText(const std::string& text, RawProfile* profile) {
+  std::vector<std::pair<const char*, const char*>> lines;
+  const char* begin = text.c_str();
+  const char* end = begin + text.size();
+  for (const char* line = begin; line < end;) {
+    const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+    eol = eol ? eol : end;
+    const char* line_end = eol;
+    if (line_end > line && line_end[-1] == '\r') {
+      --line_end;
+    }
+    lines.emplace_back(line, line_end);
+    line = eol + 1;
+  }
+  // Header, batch rows, preprocess and postprocess sections.
+  if (lines.size() < 9) {
+    return false;
+  }
+  profile->profile_id.assign(lines[0].first, lines[0].second);
+  profile->gpu_device_name.assign(lines[1].first, lines[1].second);
+  profile->gpu_uuid.assign(lines[2].first, lines[2].second);
+  profile->forward.clear();
+  static const std::string kPreprocess = "Preprocess latency (mean,std,repeat)";
+  size_t i = 5;
+  for (; i < lines.size(); ++i) {
+    std::string line(lines[i].first, lines[i].second);
+    if (line.compare(0, kPreprocess.size(), kPreprocess) == 0) {
+      break;
+    }
+    // batch,latency(us),std(us),static memory(B),peak memory(B),repeat
+    auto fields = SplitFields(lines[i].first, lines[i].second);
+    ProfileRow row;
+    uint32_t batch;
+    if (fields.size() != 6 || !ParseField(fields[0], &batch) ||
+        batch != profile->forward.size() + 1 ||
+        !ParseField(fields[1], &row.latency_mean) ||
+        !ParseField(fields[2], &row.latency_std) ||
+        !ParseField(fields[3], &row.static_memory) ||
+        !ParseField(fields[4], &row.memory_usage) ||
+        !ParseField(fields[5], &row.repeat)) {
+      return false;
+    }
+    profile->forward.push_back(row);
+  }
+  // Preprocess values, postprocess title and postprocess values.
+  if (i + 3 >= lines.size()) {
+    return false;
+  }
+  return ParseSummaryRow(lines[i + 1].first, lines[i + 1].second,
+                         &profile->preprocess) &&
+         ParseSummaryRow(lines[i + 3].first, lines[i + 3].second,
+                         &profile->postprocess);
+}
+
+bool ProfileSource::Stat(const std::string& path, ProfileSource* source) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  source->path = path;
+  source->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  source->size = st.st_size;
+  return true;
+}
+
+std::unique_ptr<ProfileCache> ProfileCache::Load(
+    const std::vector<ProfileSource>& sources, const std::string& cache_path) {
+  std::unique_ptr<ProfileCache> cache(new ProfileCache);
+  std::unordered_map<std::string, RecordView> records;
+  if (!cache_path.empty() && cache->Map(cache_path)) {
+    auto* header = reinterpret_cast<const CacheHeader*>(cache->data());
+    // The cache is valid as is if it has the same sources in the same order
+    // with the same stat.
+    bool valid = header->num_records == sources.size();
+    size_t i = 0;
+    bool ok = WalkRecords(
+        cache->data() + sizeof(CacheHeader), header->payload_size,
+        header->num_records, [&](const RecordView& record) {
+          valid = valid && record.path == sources[i].path &&
+                  record.mtime_ns == sources[i].mtime_ns &&
+                  record.size == sources[i].size;
+          ++i;
+          records.emplace(record.path, record);
+        });
+    if (ok && valid && cache->Index()) {
+      return cache;
+    }
+    if (!ok) {
+      LOG(WARNING) << "Malformed profile cache " << cache_path;
+      records.clear();
+    }
+  }
+
+  std::string payload;
+  for (const auto& source : sources) {
+    std::string text;
+    if (!ReadFile(source.path, &text)) {
+      LOG(ERROR) << "Cannot read profile " << source.path;
+      return nullptr;
+    }
+    uint64_t content_hash = HashBytes(text.data(), text.size());
+    BinaryWriter writer(&payload);
+    writer.PutString(source.path);
+    writer.Put(source.mtime_ns);
+    writer.Put(source.size);
+    writer.Put(content_hash);
+    auto iter = records.find(source.path);
+    if (iter != records.end() && iter->second.content_hash == content_hash) {
+      // Touched but unchanged.
+      payload.append(iter->second.body, iter->second.body_size);
+      continue;
+    }
+    RawProfile profile;
+    if (!ParseProfileText(text, &profile)) {
+      LOG(ERROR) << "Malformed profile " << source.path;
+      return nullptr;
+    }
+    EncodeBody(profile, &payload);
+    ++cache->num_parsed_;
+  }
+  // The old records point into the mapping.
+  records.clear();
+  if (cache->mapped_data_ != nullptr) {
+    munmap(const_cast<char*>(cache->mapped_data_), cache->mapped_size_);
+    cache->mapped_data_ = nullptr;
+  }
+
+  CacheHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_records = sources.size();
+  header.payload_size = payload.size();
+  header.payload_hash = HashBytes(payload.data(), payload.size());
+  cache->buffer_.reserve(sizeof(header) + payload.size());
+  cache->buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  cache->buffer_.append(payload);
+  payload.clear();
+  CHECK(cache->Index());
+
+  if (!cache_path.empty()) {
+    // Write to a temporary file and rename it, so that concurrent readers
+    // never see a partial cache.
+    auto tmp_path = cache_path + ".tmp." + std::to_string(getpid());
+    std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+    fout.write(cache->buffer_.data(), cache->buffer_.size());
+    fout.close();
+    if (!fout.good() || rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      LOG(WARNING) << "Cannot write profile cache " << cache_path;
+      unlink(tmp_path.c_str());
+    }
+  }
+  return cache;
+}
+
+ProfileCache::~ProfileCache() {
+  if (mapped_data_ != nullptr) {
+    munmap(const_cast<char*>(mapped_data_), mapped_size_);
+  }
+}
+
+bool ProfileCache::Map(const std::string& cache_path) {
+  int fd = open(cache_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  mapped_data_ = static_cast<const char*>(addr);
+  mapped_size_ = st.st_size;
+  auto* header = reinterpret_cast<const CacheHeader*>(mapped_data_);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion ||
+      header->payload_size != mapped_size_ - sizeof(CacheHeader) ||
+      header->payload_hash != HashBytes(mapped_data_ + sizeof(CacheHeader),
+                                        header->payload_size)) {
+    LOG(INFO) << "Profile cache " << cache_path << " is invalid or outdated";
+    munmap(addr, mapped_size_);
+    mapped_data_ = nullptr;
+    mapped_size_ = 0;
+    return false;
+  }
+  return true;
+}
+
+bool ProfileCache::Index() {
+  auto* header = reinterpret_cast<const CacheHeader*>(data());
+  const char* payload = data() + sizeof(CacheHeader);
+  entries_.clear();
+  entries_.reserve(header->num_records);
+  return WalkRecords(payload, header->payload_size, header->num_records,
+                     [&](const RecordView& record) {
+                       BinaryReader reader(record.body, record.body_size);
+                       Entry entry;
+                       reader.GetString(&entry.profile_id);
+                       reader.GetString(&entry.gpu_device_name);
+                       reader.GetString(&entry.gpu_uuid);
+                       entry.rows_offset =
+                           record.body - data() + reader.offset();
+                       entries_.push_back(std::move(entry));
+                     });
+}
+
+RawProfile ProfileCache::Read(size_t index) const {
+  const auto& entry = entries_.at(index);
+  RawProfile profile;
+  profile.profile_id = entry.profile_id;
+  profile.gpu_device_name = entry.gpu_device_name;
+  profile.gpu_uuid = entry.gpu_uuid;
+  // Index has checked that the rows are within the cache.
+  BinaryReader reader(data() + entry.rows_offset, size() - entry.rows_offset);
+  uint32_t num_forward = 0;
+  reader.Get(&num_forward);
+  profile.forward.resize(num_forward);
+  for (auto& row : profile.forward) {
+    reader.GetRow(&row);
+  }
+  reader.GetRow(&profile.preprocess);
+  reader.GetRow(&profile.postprocess);
+  return profile;
+}
+
+const char* ProfileCache::data() const {
+  return mapped_data_ != nullptr ? mapped_data_ : buffer_.data();
+}
+
+size_t ProfileCache::size() const {
+  return mapped_data_ != nullptr ? mapped_size_ : buffer_.size();
+}
+
+}  // namespace nexus
@@ -0,0 +1,128 @@
+#ifndef NEXUS_COMMON_PROFILE_CACHE_H_
+#define NEXUS_COMMON_PROFILE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nexus {
+
+/*! \brief One row of a profile text file. Latencies are in us. */
+struct ProfileRow {
+  double latency_mean = 0;
+  double latency_std = 0;
+  uint64_t static_memory = 0;
+  uint64_t memory_usage = 0;
+  int32_t repeat = 0;
+};
+
+/*! \brief Profile as written in the text file, before profile_multiplier. */
+struct RawProfile {
+  std::string profile_id;
+  std::string gpu_device_name;
+  std::string gpu_uuid;
+  /*! \brief Forward latency of batch sizes 1, 2, ... */
+  std::vector<ProfileRow> forward;
+  ProfileRow preprocess;
+  ProfileRow postprocess;
+};
+
+/*!
+ * \brief Parse the text of a profile file.
+ * \return Whether the text is a well-formed profile.
+ */
+bool ParseProfileText(const std::string& text, RawProfile* profile);
+
+/*! \brief Profile file and its stat when it is listed. */
+struct ProfileSource {
+  std::string path;
+  int64_t mtime_ns = 0;
+  uint64_t size = 0;
+
+  /*! \brief Stat the file. Return false if it cannot be stat'ed. */
+  static bool Stat(const std::string& path, ProfileSource* source);
+};
+
+/*!
+ * \brief Binary cache of parsed profile files.
+ *
+ *   The cache file starts with a magic, a format version and a hash of the
+ *   rest of the file. Each record holds the path, mtime, size and content
+ *   hash of its source file, then the parsed profile. When the cache is
+ *   loaded, a source whose mtime and size match its record is not read at
+ *   all. A source whose stat changed is read and hashed, and only reparsed
+ *   if the hash changed too. The cache is rewritten whenever it was stale.
+ *
+ *   The cache file is memory-mapped. Loading it only indexes the headers of
+ *   the records. The latency rows of a profile are decoded by Read.
+ */
+class ProfileCache {
+ public:
+  static constexpr uint32_t kVersion = 1;
+
+  /*! \brief Index of a record in the cache. */
+  struct Entry {
+    std::string profile_id;
+    std::string gpu_device_name;
+    std::string gpu_uuid;
+    /*! \brief Offset of the latency rows in the cache. */
+    size_t rows_offset;
+  };
+
+  /*!
+   * \brief Load the profiles of the sources, reusing the valid records of
+   *   the cache file, and rewrite the file if it was missing or stale.
+   * \param sources Profile files in the order of their entries.
+   * \param cache_path Cache file, or empty to parse every source without
+   *   any file.
+   * \return nullptr if a source cannot be read or parsed.
+   */
+  static std::unique_ptr<ProfileCache> Load(
+      const std::vector<ProfileSource>& sources, const std::string& cache_path);
+
+  ~ProfileCache();
+
+  ProfileCache(const ProfileCache&) = delete;
+  ProfileCache& operator=(const ProfileCache&) = delete;
+
+  /*! \brief One entry for each source, in the same order. */
+  const std::vector<Entry>& entries() const { return entries_; }
+
+  /*! \brief Decode the profile of an entry. */
+  RawProfile Read(size_t index) const;
+
+  /*! \brief Number of sources parsed from text by Load. */
+  size_t num_parsed() const { return num_parsed_; }
+
+  /*! \brief Whether Load used the cache file as is, without rewriting it. */
+  bool mapped() const { return mapped_data_ != nullptr; }
+
+ private:
+  ProfileCache() = default;
+
+  /*!
+   * \brief Map the cache file and check its magic, version and hash.
+   * \return Whether the file is a valid cache.
+   */
+  bool Map(const std::string& cache_path);
+
+  /*! \brief Build entries_ from the records in data(). */
+  bool Index();
+
+  const char* data() const;
+  size_t size() const;
+
+  /*! \brief Mapped cache file. */
+  const char* mapped_data_ = nullptr;
+  size_t mapped_size_ = 0;
+  /*! \brief Cache content when it was rebuilt rather than mapped. */
+  std::string buffer_;
+  std::vector<Entry> entries_;
+  size_t num_parsed_ = 0;
+};
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_PROFILE_CACHE_H_
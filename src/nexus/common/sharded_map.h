@@ -0,0 +1,86 @@
+#ifndef NEXUS_COMMON_SHARDED_MAP_H_
+#define NEXUS_COMMON_SHARDED_MAP_H_
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace nexus {
+
+/*!
+ * \brief Hash map split into independently locked shards, so that threads
+ *   working on different keys rarely contend on the same mutex. Sequential
+ *   integer keys, such as query ids, land on consecutive shards.
+ * \tparam NumShards Number of shards. Must be a power of two.
+ */
+template <typename Key, typename Value, size_t NumShards = 64,
+          typename Hash = std::hash<Key>>
+class ShardedMap {
+  static_assert(NumShards > 0 && (NumShards & (NumShards - 1)) == 0,
+                "NumShards must be a power of two");
+
+ public:
+  /*!
+   * \brief Insert the value if the key does not exist.
+   * \return false if the key already exists.
+   */
+  bool Insert(const Key& key, Value value) {
+    auto& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.emplace(key, std::move(value)).second;
+  }
+
+  /*! \brief Remove the key and return its value, or nullopt if not found. */
+  std::optional<Value> Take(const Key& key) {
+    auto& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.map.find(key);
+    if (iter == shard.map.end()) {
+      return std::nullopt;
+    }
+    std::optional<Value> value(std::move(iter->second));
+    shard.map.erase(iter);
+    return value;
+  }
+
+  bool Contains(const Key& key) const {
+    const auto& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.count(key) > 0;
+  }
+
+  /*! \brief Number of entries. Not a snapshot under concurrent updates. */
+  size_t size() const {
+    size_t n = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      n += shard.map.size();
+    }
+    return n;
+  }
+
+ private:
+  // Keep each shard on its own cache lines.
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Value, Hash> map /* GUARDED_BY(mutex) */;
+  };
+
+  Shard& GetShard(const Key& key) {
+    return shards_[Hash{}(key) & (NumShards - 1)];
+  }
+
+  const Shard& GetShard(const Key& key) const {
+    return shards_[Hash{}(key) & (NumShards - 1)];
+  }
+
+  std::array<Shard, NumShards> shards_;
+};
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_SHARDED_MAP_H_
@@ -11,11 +11,15 @@
 namespace nexus {
 
 SleepProfile::SleepProfile(int slope_us, int intercept_us, int preprocess_us,
-                           int postprocess_us)
+                           int postprocess_us, int prefix_percent)
     : slope_us_(slope_us),
       intercept_us_(intercept_us),
       preprocess_us_(preprocess_us),
-      postprocess_us_(postprocess_us) {}
+      postprocess_us_(postprocess_us),
+      prefix_percent_(prefix_percent) {
+  CHECK_GE(prefix_percent_, 0);
+  CHECK_LE(prefix_percent_, 100);
+}
 
 std::optional<SleepProfile> SleepProfile::Parse(const std::string& framework) {
   if (MatchPrefix(framework)) {
@@ -33,16 +37,34 @@ std::optional<SleepProfile> SleepProfile::Parse(const std::string& framework) {
             << param << "\".";
       }
     }
-    if (p.size() != 4) {
+    if (p.size() != 4 && p.size() != 5) {
       LOG(ERROR) << "Bad parameter for SleepModel. Got " << p.size()
                  << " parameters. Expected format: " << kPrefix
-                 << "slope_us,intercept_us,preprocess_us,postprocess_us";
+                 << "slope_us,intercept_us,preprocess_us,postprocess_us"
+                 << "[,prefix_percent]";
+      return std::nullopt;
+    }
+    if (p.size() == 5 && (p[4] < 0 || p[4] > 100)) {
+      LOG(ERROR) << "Bad parameter for SleepModel. prefix_percent=" << p[4]
+                 << " is not in [0, 100].";
+      return std::nullopt;
     }
-    return SleepProfile(p[0], p[1], p[2], p[3]);
+    return SleepProfile(p[0], p[1], p[2], p[3], p.size() == 5 ? p[4] : 0);
   }
   return std::nullopt;
 }
 
+bool SleepProfile::SharesPrefixWith(const SleepProfile& other) const {
+  if (prefix_percent_ == 0 || other.prefix_percent_ == 0) {
+    return false;
+  }
+  // Compare the prefix cost scaled by 100 to stay in integers.
+  return slope_us_ * prefix_percent_ ==
+             other.slope_us_ * other.prefix_percent_ &&
+         intercept_us_ * prefix_percent_ ==
+             other.intercept_us_ * other.prefix_percent_;
+}
+
 bool SleepProfile::MatchPrefix(const std::string& framework) {
   return framework.rfind(kPrefix, 0) == 0;
 }
@@ -1,6 +1,7 @@
 #ifndef NEXUS_COMMON_SLEEP_PROFILE_H_
 #define NEXUS_COMMON_SLEEP_PROFILE_H_
 
+#include <cstdint>
 #include <optional>
 #include <string>
 
@@ -9,7 +10,7 @@ namespace nexus {
 class SleepProfile {
  public:
   SleepProfile(int slope_us, int intercept_us, int preprocess_us,
-               int postprocess_us);
+               int postprocess_us, int prefix_percent = 0);
   static std::optional<SleepProfile> Parse(const std::string& framework);
   static bool MatchPrefix(const std::string& framework);
 
@@ -22,12 +23,26 @@ class SleepProfile {
   int forward_us(uint32_t batch_size) const {
     return slope_us_ * batch_size + intercept_us_;
   }
+  /*! \brief Percentage of the forward time spent in the shareable prefix. */
+  int prefix_percent() const { return prefix_percent_; }
+  int prefix_forward_us(uint32_t batch_size) const {
+    return forward_us(batch_size) * prefix_percent_ / 100;
+  }
+  int suffix_forward_us(uint32_t batch_size) const {
+    return forward_us(batch_size) - prefix_forward_us(batch_size);
+  }
+  /*!
+   * \brief Whether a batch can run the prefix of this model once for the
+   *   inputs of both models. True when both have a prefix of the same cost.
+   */
+  bool SharesPrefixWith(const SleepProfile& other) const;
 
  private:
   int slope_us_;
   int intercept_us_;
   int preprocess_us_;
   int postprocess_us_;
+  int prefix_percent_;
 };
 
 }  // namespace nexus
@@ -0,0 +1,211 @@
+#include "nexus/common/staged_input.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <opencv2/opencv.hpp>
+
+#include "nexus/common/data_type.h"
+
+namespace nexus {
+
+namespace {
+
+// Whether the header and the payload fit in len bytes, without overflowing.
+bool FitsIn(const StagedInputHeader& header, size_t len) {
+  return len >= sizeof(header) &&
+         header.payload_bytes <= len - sizeof(header);
+}
+
+char* StageHeader(char* buf, size_t capacity,
+                  const StagedInputHeader& header) {
+  if (!FitsIn(header, capacity)) {
+    return nullptr;
+  }
+  std::memcpy(buf, &header, sizeof(header));
+  return buf + sizeof(header);
+}
+
+StagedInputHeader EmptyHeader(StagedInputHeader::Kind kind) {
+  StagedInputHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = StagedInputHeader::kMagic;
+  header.kind = kind;
+  return header;
+}
+
+// Interleaved HWC pixels to CHW planes.
+void HwcToChw(const float* hwc, int height, int width, float* chw) {
+  size_t plane = static_cast<size_t>(height) * width;
+  for (size_t i = 0; i < plane; ++i) {
+    for (size_t c = 0; c < 3; ++c) {
+      chw[c * plane + i] = hwc[i * 3 + c];
+    }
+  }
+}
+
+bool ToFloatImage(const StagedInput& input, int height, int width,
+                  float* out) {
+  constexpr uint64_t kMaxMatSize = std::numeric_limits<int>::max();
+  const auto& header = input.header;
+  cv::Mat fimg(height, width, CV_32FC3, out);
+  if (header.kind == StagedInputHeader::kEncodedImage) {
+    if (header.payload_bytes == 0 || header.payload_bytes > kMaxMatSize) {
+      return false;
+    }
+    cv::Mat encoded(1, static_cast<int>(header.payload_bytes), CV_8UC1,
+                    const_cast<char*>(input.payload));
+    cv::Mat bgr = cv::imdecode(encoded, cv::IMREAD_COLOR);
+    if (!bgr.data) {
+      LOG(ERROR) << "Could not decode staged image";
+      return false;
+    }
+    cv::Mat rgb;
+    cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+    if (rgb.rows != height || rgb.cols != width) {
+      cv::resize(rgb, rgb, cv::Size(width, height));
+    }
+    rgb.convertTo(fimg, CV_32FC3);
+    return true;
+  }
+
+  // Tensors must be non-empty HWC images with 3 channels.
+  if (header.num_dims != 3 || header.dims[2] != 3 || header.dims[0] == 0 ||
+      header.dims[1] == 0 || header.dims[0] > kMaxMatSize ||
+      header.dims[1] > kMaxMatSize) {
+    return false;
+  }
+  int in_height = static_cast<int>(header.dims[0]);
+  int in_width = static_cast<int>(header.dims[1]);
+  switch (header.data_type) {
+    case DT_UINT8: {
+      cv::Mat img(in_height, in_width, CV_8UC3,
+                  const_cast<char*>(input.payload));
+      if (in_height != height || in_width != width) {
+        cv::Mat resized;
+        cv::resize(img, resized, cv::Size(width, height));
+        resized.convertTo(fimg, CV_32FC3);
+      } else {
+        img.convertTo(fimg, CV_32FC3);
+      }
+      return true;
+    }
+    case DT_FLOAT:
+      if (in_height != height || in_width != width) {
+        return false;
+      }
+      std::memcpy(out, input.payload, header.payload_bytes);
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+size_t StagedInput::num_elements() const {
+  size_t n = 1;
+  for (uint8_t i = 0; i < header.num_dims; ++i) {
+    n *= header.dims[i];
+  }
+  return n;
+}
+
+std::optional<size_t> TensorPayloadBytes(DataType data_type,
+                                         const uint32_t* dims,
+                                         size_t num_dims) {
+  size_t nbytes = type_size(data_type);
+  if (nbytes == 0) {
+    return std::nullopt;
+  }
+  for (size_t i = 0; i < num_dims; ++i) {
+    if (__builtin_mul_overflow(nbytes, dims[i], &nbytes)) {
+      return std::nullopt;
+    }
+  }
+  return nbytes;
+}
+
+char* StageTensorHeader(char* buf, size_t capacity, DataType data_type,
+                        const std::vector<uint32_t>& dims) {
+  if (dims.size() > StagedInputHeader::kMaxDims) {
+    return nullptr;
+  }
+  auto nbytes = TensorPayloadBytes(data_type, dims.data(), dims.size());
+  if (!nbytes.has_value()) {
+    return nullptr;
+  }
+  auto header = EmptyHeader(StagedInputHeader::kTensor);
+  header.data_type = static_cast<uint8_t>(data_type);
+  header.num_dims = static_cast<uint8_t>(dims.size());
+  std::copy(dims.begin(), dims.end(), header.dims);
+  header.payload_bytes = *nbytes;
+  return StageHeader(buf, capacity, header);
+}
+
+char* StageEncodedImageHeader(char* buf, size_t capacity,
+                              ImageProto::ImageFormat format, size_t nbytes) {
+  auto header = EmptyHeader(StagedInputHeader::kEncodedImage);
+  header.data_type = static_cast<uint8_t>(format);
+  header.payload_bytes = nbytes;
+  return StageHeader(buf, capacity, header);
+}
+
+size_t StagedInputBytes(const StagedInputHeader& header) {
+  return sizeof(header) + header.payload_bytes;
+}
+
+std::optional<StagedInput> ParseStagedInput(const char* buf, size_t len) {
+  StagedInput input;
+  if (len < sizeof(input.header)) {
+    return std::nullopt;
+  }
+  std::memcpy(&input.header, buf, sizeof(input.header));
+  const auto& header = input.header;
+  if (header.magic != StagedInputHeader::kMagic || !FitsIn(header, len)) {
+    return std::nullopt;
+  }
+  switch (header.kind) {
+    case StagedInputHeader::kTensor: {
+      if (header.num_dims > StagedInputHeader::kMaxDims) {
+        return std::nullopt;
+      }
+      auto nbytes =
+          TensorPayloadBytes(static_cast<DataType>(header.data_type),
+                             header.dims, header.num_dims);
+      if (!nbytes.has_value() || *nbytes != header.payload_bytes) {
+        return std::nullopt;
+      }
+      break;
+    }
+    case StagedInputHeader::kEncodedImage:
+      if (!ImageProto::ImageFormat_IsValid(header.data_type)) {
+        return std::nullopt;
+      }
+      break;
+    default:
+      return std::nullopt;
+  }
+  input.payload = buf + sizeof(header);
+  return input;
+}
+
+bool StagedInputToFloatImage(const StagedInput& input, int height, int width,
+                             float* out, bool channels_first) {
+  if (height <= 0 || width <= 0) {
+    return false;
+  }
+  if (!channels_first) {
+    return ToFloatImage(input, height, width, out);
+  }
+  std::vector<float> hwc(static_cast<size_t>(height) * width * 3);
+  if (!ToFloatImage(input, height, width, hwc.data())) {
+    return false;
+  }
+  HwcToChw(hwc.data(), height, width, out);
+  return true;
+}
+
+}  // namespace nexus
@@ -0,0 +1,92 @@
+#ifndef NEXUS_COMMON_STAGED_INPUT_H_
+#define NEXUS_COMMON_STAGED_INPUT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+
+/*!
+ * \brief Header of a query input staged in RDMA-exposed memory by the
+ *   frontend. The payload follows the header right away, so that a backend
+ *   gets both with a single RDMA read and uses the payload in place instead
+ *   of parsing a serialized ValueProto.
+ */
+struct StagedInputHeader {
+  enum Kind : uint8_t {
+    /*! \brief Dense tensor of `data_type` elements in row-major order. */
+    kTensor = 1,
+    /*! \brief Encoded image bytes. `data_type` holds the ImageFormat. */
+    kEncodedImage = 2,
+  };
+  static constexpr uint32_t kMagic = 0x4953584e;  // "NXSI"
+  static constexpr size_t kMaxDims = 4;
+
+  uint32_t magic;
+  uint8_t kind;
+  uint8_t data_type;
+  uint8_t num_dims;
+  uint8_t reserved;
+  uint32_t dims[kMaxDims];
+  uint64_t payload_bytes;
+};
+static_assert(sizeof(StagedInputHeader) == 32,
+              "StagedInputHeader is part of the frontend-backend protocol");
+
+/*! \brief A staged input that points into the buffer it was parsed from. */
+struct StagedInput {
+  StagedInputHeader header;
+  const char* payload;
+
+  size_t num_elements() const;
+};
+
+/*!
+ * \brief Write the header of a tensor input at the beginning of buf.
+ * \return Where the payload goes, or nullptr if the tensor does not fit.
+ */
+char* StageTensorHeader(char* buf, size_t capacity, DataType data_type,
+                        const std::vector<uint32_t>& dims);
+
+/*!
+ * \brief Write the header of an encoded image input at the beginning of buf.
+ * \return Where the payload goes, or nullptr if the image does not fit.
+ */
+char* StageEncodedImageHeader(char* buf, size_t capacity,
+                              ImageProto::ImageFormat format, size_t nbytes);
+
+/*!
+ * \brief Number of bytes of a tensor of the given type and dims.
+ * \return nullopt if the type has no fixed size or the size overflows.
+ */
+std::optional<size_t> TensorPayloadBytes(DataType data_type,
+                                         const uint32_t* dims,
+                                         size_t num_dims);
+
+/*! \brief Number of bytes of the header and the payload. */
+size_t StagedInputBytes(const StagedInputHeader& header);
+
+/*!
+ * \brief Parse a staged input without copying the payload.
+ * \return nullopt if buf does not hold a complete and valid staged input.
+ */
+std::optional<StagedInput> ParseStagedInput(const char* buf, size_t len);
+
+/*!
+ * \brief Convert a staged input to a float RGB image of the given size.
+ *   Encoded images are decoded to RGB. Uint8 images are resized if needed.
+ *   Float tensors must already have the given size.
+ * \param channels_first Write the image as CHW planes instead of HWC.
+ * \param out Buffer of height * width * 3 floats.
+ * \return false if the input cannot be converted.
+ */
+bool StagedInputToFloatImage(const StagedInput& input, int height, int width,
+                             float* out, bool channels_first = false);
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_STAGED_INPUT_H_
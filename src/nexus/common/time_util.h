@@ -1,8 +1,11 @@
 #ifndef NEXUS_COMMON_TIME_UTIL_H_
 #define NEXUS_COMMON_TIME_UTIL_H_
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -52,6 +55,57 @@ class Timer {
   std::unordered_map<std::string, TimePoint> time_points_;
 };
 
+/*!
+ * \brief Records the time points of a fixed set of stages in slots indexed by
+ *   an enum. Unlike Timer, recording neither hashes nor allocates.
+ * \tparam Stage Enum whose values are 0 to NumStages - 1.
+ */
+template <typename Stage, size_t NumStages>
+class StageTimer {
+ public:
+  /*! \brief Records the time point of the stage, replacing an earlier one. */
+  void Record(Stage stage, TimePoint time = Clock::now()) {
+    auto index = static_cast<size_t>(stage);
+    time_points_[index] = time;
+    recorded_ |= 1u << index;
+  }
+
+  bool Recorded(Stage stage) const {
+    return recorded_ & (1u << static_cast<size_t>(stage));
+  }
+
+  /*! \brief Time point of the stage. Only valid if it is Recorded. */
+  TimePoint Get(Stage stage) const {
+    return time_points_[static_cast<size_t>(stage)];
+  }
+
+  /*!
+   * \brief Duration between two stages, or zero if either is not recorded.
+   * \tparam Duration std::chrono duration of the result
+   */
+  template <typename Duration>
+  Duration Elapsed(Stage beg, Stage end) const {
+    if (!Recorded(beg) || !Recorded(end)) {
+      return Duration::zero();
+    }
+    return std::chrono::duration_cast<Duration>(Get(end) - Get(beg));
+  }
+
+  uint64_t GetLatencyMillis(Stage beg, Stage end) const {
+    return Elapsed<std::chrono::milliseconds>(beg, end).count();
+  }
+
+  uint64_t GetLatencyMicros(Stage beg, Stage end) const {
+    return Elapsed<std::chrono::microseconds>(beg, end).count();
+  }
+
+ private:
+  static_assert(NumStages <= 32, "Too many stages");
+
+  std::array<TimePoint, NumStages> time_points_;
+  uint32_t recorded_ = 0;
+};
+
 class Tickable {
  public:
   Tickable(uint32_t tick_interval_sec);
@@ -0,0 +1,50 @@
+#include "nexus/common/token_bucket.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace nexus {
+
+namespace {
+
+int64_t RateToInterval(double rate) {
+  return rate > 0 ? std::max<int64_t>(1, static_cast<int64_t>(1e9 / rate)) : 0;
+}
+
+}  // namespace
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : burst_(burst), interval_ns_(RateToInterval(rate)) {
+  CHECK_GE(burst, 1) << "Burst of a token bucket must be at least 1";
+}
+
+bool TokenBucket::TryAcquire(TimePoint now) {
+  int64_t interval = interval_ns_.load(std::memory_order_relaxed);
+  if (interval == 0) {
+    return true;
+  }
+  int64_t now_ns = now.time_since_epoch().count();
+  auto tolerance = static_cast<int64_t>(interval * burst_);
+  int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+  int64_t new_tat;
+  do {
+    new_tat = std::max(tat, now_ns) + interval;
+    if (new_tat - now_ns > tolerance) {
+      return false;
+    }
+  } while (!tat_ns_.compare_exchange_weak(tat, new_tat,
+                                          std::memory_order_relaxed));
+  return true;
+}
+
+double TokenBucket::rate() const {
+  int64_t interval = interval_ns_.load(std::memory_order_relaxed);
+  return interval == 0 ? 0 : 1e9 / interval;
+}
+
+void TokenBucket::SetRate(double rate) {
+  interval_ns_.store(RateToInterval(rate), std::memory_order_relaxed);
+}
+
+}  // namespace nexus
@@ -0,0 +1,48 @@
+#ifndef NEXUS_COMMON_TOKEN_BUCKET_H_
+#define NEXUS_COMMON_TOKEN_BUCKET_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "nexus/common/time_util.h"
+
+namespace nexus {
+
+/*!
+ * \brief Token bucket rate limit that admits `rate` requests per second on
+ *   average and up to `burst` requests at once.
+ *
+ *   Implemented as the generic cell rate algorithm: the bucket only keeps
+ *   the theoretical arrival time of the next request, so TryAcquire is a
+ *   single compare-and-swap and safe to call from any thread.
+ */
+class TokenBucket {
+ public:
+  /*!
+   * \param rate Requests per second. Non-positive means unlimited.
+   * \param burst Number of requests admitted at once. At least 1.
+   */
+  TokenBucket(double rate, double burst);
+
+  /*! \return Whether the request is admitted. */
+  bool TryAcquire() { return TryAcquire(Clock::now()); }
+
+  bool TryAcquire(TimePoint now);
+
+  /*! \brief Requests per second, or 0 if unlimited. */
+  double rate() const;
+
+  /*! \brief Change the rate. Non-positive means unlimited. */
+  void SetRate(double rate);
+
+ private:
+  const double burst_;
+  /*! \brief Nanoseconds between requests at the rate, or 0 if unlimited. */
+  std::atomic<int64_t> interval_ns_;
+  /*! \brief Theoretical arrival time of the next request. */
+  std::atomic<int64_t> tat_ns_{0};
+};
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_TOKEN_BUCKET_H_
@@ -0,0 +1,168 @@
+#ifndef NEXUS_COMMON_WORK_STEALING_QUEUE_H_
+#define NEXUS_COMMON_WORK_STEALING_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <vector>
+
+#include "nexus/common/block_queue.h"
+#include "nexus/common/time_util.h"
+
+namespace nexus {
+
+/*!
+ * \brief Scheduler queue for a fixed set of worker threads. Each worker owns
+ *   a queue ordered by deadline. A worker pops from its own queue first and
+ *   steals the earliest-deadline item of another worker when its own queue is
+ *   empty. Producers push to the queue of the worker that should run the
+ *   item, so that items keep running on a thread with a warm cache.
+ */
+template <class T, typename = typename std::enable_if<
+                       std::is_base_of<DeadlineItem, T>::value>::type>
+class WorkStealingQueue {
+ public:
+  explicit WorkStealingQueue(size_t num_workers)
+      : num_workers_(num_workers), queues_(new LocalQueue[num_workers]) {}
+
+  size_t num_workers() const { return num_workers_; }
+
+  /*! \brief Number of items in all queues. */
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief Push the item to the queue of the worker.
+   * \param worker Index of the worker, or -1 to pick one round-robin.
+   */
+  void Push(std::shared_ptr<T> item, int worker) {
+    if (worker < 0 || static_cast<size_t>(worker) >= num_workers_) {
+      worker = next_worker_.fetch_add(1, std::memory_order_relaxed) %
+               num_workers_;
+    }
+    auto& local = queues_[worker];
+    {
+      std::lock_guard<std::mutex> lock(local.mutex);
+      local.queue.push(std::move(item));
+      local.count.store(local.queue.size(), std::memory_order_relaxed);
+    }
+    size_.fetch_add(1);
+    if (num_sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.notify_one();
+    }
+  }
+
+  /*!
+   * \brief Pop the earliest-deadline item of the worker's queue, or steal one
+   *   from another worker. Waits for an item until the timeout.
+   * \return nullptr on timeout.
+   */
+  std::shared_ptr<T> Pop(size_t worker, std::chrono::microseconds timeout) {
+    auto until = Clock::now() + timeout;
+    for (;;) {
+      auto item = TryPop(worker);
+      if (item) {
+        return item;
+      }
+      item = Steal(worker);
+      if (item) {
+        return item;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      num_sleeping_.fetch_add(1);
+      bool ready = sleep_cv_.wait_until(lock, until,
+                                        [this] { return size_.load() > 0; });
+      num_sleeping_.fetch_sub(1);
+      if (!ready) {
+        return nullptr;
+      }
+    }
+  }
+
+ private:
+  struct CompareDeadline {
+    bool operator()(const std::shared_ptr<T>& lhs,
+                    const std::shared_ptr<T>& rhs) const {
+      return lhs->deadline() > rhs->deadline();
+    }
+  };
+
+  // Keep each queue on its own cache lines.
+  struct alignas(64) LocalQueue {
+    std::mutex mutex;
+    std::priority_queue<std::shared_ptr<T>, std::vector<std::shared_ptr<T>>,
+                        CompareDeadline>
+        queue /* GUARDED_BY(mutex) */;
+    /*! \brief Size of queue, to skip empty queues without locking. */
+    std::atomic<size_t> count{0};
+  };
+
+  std::shared_ptr<T> TryPop(size_t index) {
+    auto& local = queues_[index];
+    if (local.count.load(std::memory_order_relaxed) == 0) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(local.mutex);
+    if (local.queue.empty()) {
+      return nullptr;
+    }
+    auto item = local.queue.top();
+    local.queue.pop();
+    local.count.store(local.queue.size(), std::memory_order_relaxed);
+    size_.fetch_sub(1);
+    return item;
+  }
+
+  /*!
+   * \brief Pop the item with the earliest deadline among the heads of the
+   *   other workers' queues. A victim's head may be taken by its owner
+   *   between the scan and the pop, so the scan repeats until it finds no
+   *   item.
+   */
+  std::shared_ptr<T> Steal(size_t worker) {
+    for (;;) {
+      size_t victim = num_workers_;
+      TimePoint earliest;
+      for (size_t i = 1; i < num_workers_; ++i) {
+        size_t index = (worker + i) % num_workers_;
+        auto& local = queues_[index];
+        if (local.count.load(std::memory_order_relaxed) == 0) {
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(local.mutex);
+        if (local.queue.empty()) {
+          continue;
+        }
+        auto deadline = local.queue.top()->deadline();
+        if (victim == num_workers_ || deadline < earliest) {
+          victim = index;
+          earliest = deadline;
+        }
+      }
+      if (victim == num_workers_) {
+        return nullptr;
+      }
+      auto item = TryPop(victim);
+      if (item) {
+        return item;
+      }
+    }
+  }
+
+  const size_t num_workers_;
+  std::unique_ptr<LocalQueue[]> queues_;
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> next_worker_{0};
+  std::atomic<int> num_sleeping_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+};
+
+}  // namespace nexus
+
+#endif  // NEXUS_COMMON_WORK_STEALING_QUEUE_H_
@@ -36,12 +36,14 @@ void BackendDelegateImpl::SendLoadModelCommand(
   *request->mutable_model_session() = model_session;
   request->set_max_batch(max_batch);
   request->set_model_index(model_index.t);
+  request->set_backend_id(node_id_);
   rdma_sender_.SendMessage(conn_, req);
   Tick();
 }
 
 void BackendDelegateImpl::EnqueueBatchPlan(BatchPlanProto&& request) {
   ControlMessage req;
+  request.set_backend_id(node_id_);
   *req.mutable_enqueue_batchplan() = std::move(request);
   rdma_sender_.SendMessage(conn_, req);
   Tick();
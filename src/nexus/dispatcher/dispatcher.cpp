@@ -178,6 +178,11 @@ void Dispatcher::RdmaHandler::OnRecv(ario::RdmaQueuePair* conn,
       }
       break;
     }
+    case ControlMessage::MessageCase::kBackendModelReady: {
+      // Dispatcher <- Backend
+      outer_.HandleBackendModelReady(req.backend_model_ready());
+      break;
+    }
     case ControlMessage::MessageCase::kEnqueueQueryReply: {
       // Dispatcher <- Backend
       auto status = req.enqueue_query_reply().status();
@@ -344,8 +349,12 @@ void Dispatcher::HandleLoadModel(const LoadModelRequest& request,
   }
   reply->set_status(CtrlStatus::CTRL_OK);
 
-  // Add model session for the scheduler
-  auto& model_worker = GetModelWorker(request.model_session());
+  // Add model session for the scheduler. Sessions of a prefix group are
+  // scheduled by the ModelThread of the leader, so they share its worker.
+  const auto* prefix_group_leader =
+      scheduler_.FindPrefixGroupLeader(request.model_session());
+  auto& model_worker = GetModelWorker(
+      prefix_group_leader ? *prefix_group_leader : request.model_session());
   auto entrance = scheduler_.AddModelSession(model_worker.executor(),
                                              request.model_session());
   model_worker.AddModelSession(entrance);
@@ -411,6 +420,26 @@ void Dispatcher::HandleInformAlive(const KeepAliveRequest& request) {
   }
 }
 
+void Dispatcher::HandleBackendModelReady(
+    const BackendModelReadyMessage& request) {
+  auto backend_id = NodeId(request.node_id());
+  if (request.status() != CtrlStatus::CTRL_OK) {
+    LOG(ERROR) << "Backend failed to load model. backend_id=" << backend_id.t
+               << ", model_index=" << request.model_index()
+               << ", status=" << CtrlStatus_Name(request.status());
+    return;
+  }
+  if (backends_.find(backend_id) == backends_.end()) {
+    LOG(ERROR) << "BackendModelReady: Backend not registered. backend_id="
+               << backend_id.t;
+    return;
+  }
+  VLOG(1) << "BackendModelReady: backend_id=" << backend_id.t
+          << ", model_index=" << request.model_index();
+  scheduler_.MarkBackendModelReady(backend_id,
+                                   ModelIndex(request.model_index()));
+}
+
 ModelWorker& Dispatcher::GetModelWorker(
     const ModelSession& model_session) const {
   size_t h = 0;
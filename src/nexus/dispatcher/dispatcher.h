@@ -66,6 +66,7 @@ class Dispatcher {
   void HandleUnregister(const UnregisterRequest& request, RpcReply* reply);
   void HandleLoadModel(const LoadModelRequest& request, LoadModelReply* reply);
   void HandleInformAlive(const KeepAliveRequest& request);
+  void HandleBackendModelReady(const BackendModelReadyMessage& request);
 
   ModelWorker& GetModelWorker(const ModelSession& model_session) const;
 
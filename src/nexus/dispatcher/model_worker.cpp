@@ -125,12 +125,15 @@ void ModelWorker::Join() { ev_thread_.join(); }
 
 void ModelWorker::AddModelSession(
     MultiThreadRankScheduler::RequestEntrance entrance) {
-  executor_.PostOk([this, entrance](ario::ErrorCode) {
-    if (model_session_entrance_table_.size() <= entrance.model_index().t) {
-      model_session_entrance_table_.resize(entrance.model_index().t + 1);
-    }
-    model_session_entrance_table_[entrance.model_index().t] = entrance;
-  });
+  executor_.PostBigCallback(
+      [this, entrance](ario::ErrorCode) {
+        if (model_session_entrance_table_.size() <=
+            entrance.model_index().t) {
+          model_session_entrance_table_.resize(entrance.model_index().t + 1);
+        }
+        model_session_entrance_table_[entrance.model_index().t] = entrance;
+      },
+      ario::ErrorCode::kOk);
 }
 
 void ModelWorker::HandleDispatch(DispatchRequest&& request,
@@ -3,9 +3,11 @@
 #include <glog/logging.h>
 
 #include <chrono>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <utility>
 
 #include "nexus/common/functional.h"
 #include "nexus/common/model_def.h"
@@ -104,6 +106,24 @@ void ModelThread::PostRemoveFrontend(NodeId frontend_id) {
       [this, frontend_id](ario::ErrorCode) { frontends_.erase(frontend_id); });
 }
 
+void ModelThread::PostAddPrefixGroupMember(ModelIndex model_index) {
+  executor_.PostOk([this, model_index](ario::ErrorCode) {
+    prefix_group_members_.push_back(model_index);
+  });
+}
+
+bool ModelThread::AcceptsModelIndex(ModelIndex model_index) const {
+  if (model_index.t == model_index_.t) {
+    return true;
+  }
+  for (auto member : prefix_group_members_) {
+    if (member.t == model_index.t) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void ModelThread::PostGrantedBackend(GrantedBackendMessage cmd) {
   std::lock_guard lock(rank_msg_mutex_);
   CHECK(!rank_msg_.granted_backend.has_value());
@@ -114,7 +134,7 @@ CtrlStatus ModelThread::EnqueueQuery(DispatchRequest&& request) {
   CHECK_EQ(ario::EpollExecutor::ThisThreadExecutor(), &executor_);
 
   ModelIndex model_index(request.query_without_input().model_index());
-  if (model_index.t != model_index_.t) {
+  if (!AcceptsModelIndex(model_index)) {
     LOG(ERROR) << "Wrong ModelThread. global_id="
                << request.query_without_input().global_id()
                << ", requested model_index: " << model_index.t
@@ -212,16 +232,18 @@ void ModelThread::OnDropTimer(GlobalId head) {
 
 void ModelThread::SendDroppedQueries(
     const std::vector<std::shared_ptr<QueryContext>>& drops) {
-  std::unordered_map<NodeId, DispatchReply> replies;
+  // Queries of a prefix group member are replied under their own model
+  // index, because the frontend looks up the query by it.
+  std::map<std::pair<uint32_t, uint32_t>, DispatchReply> replies;
 
   for (auto& qctx : drops) {
     const auto& proto = qctx->request.query_without_input();
     auto frontend_id = NodeId(proto.frontend_id());
 
-    auto res = replies.try_emplace(frontend_id);
+    auto res = replies.try_emplace({frontend_id.t, proto.model_index()});
     auto& reply = res.first->second;
     if (res.second) {
-      reply.set_model_index(model_index_.t);
+      reply.set_model_index(proto.model_index());
       reply.set_status(CtrlStatus::CTRL_DISPATCHER_DROPPED_QUERY);
     }
     auto* q = reply.add_query_list();
@@ -230,7 +252,7 @@ void ModelThread::SendDroppedQueries(
   }
 
   for (auto& pair : replies) {
-    auto frontend_id = NodeId(pair.first);
+    auto frontend_id = NodeId(pair.first.first);
     auto iter = frontends_.find(frontend_id);
     if (iter == frontends_.end()) {
       LOG(ERROR) << "Cannot find frontend. frontend_id=" << frontend_id.t
@@ -274,9 +296,15 @@ TimePoint ModelThread::DoGrantedBackendMessage(GrantedBackendMessage& cmd) {
   for (auto& qctx : inputs) {
     auto* query_without_input = query.mutable_query_without_input();
     query_without_input->Swap(qctx->request.mutable_query_without_input());
-    query_without_input->clear_model_index();
+    // Keep the model index of prefix group members for the backend.
+    if (query_without_input->model_index() == model_index_.t) {
+      query_without_input->clear_model_index();
+    }
     query.set_rdma_read_offset(qctx->request.rdma_read_offset());
     query.set_rdma_read_length(qctx->request.rdma_read_length());
+    query.set_deadline_ns(
+        duration_cast<nanoseconds>(qctx->deadline.time_since_epoch())
+            .count());
     qctx->request.Clear();
     *proto.add_queries() = std::move(query);
   }
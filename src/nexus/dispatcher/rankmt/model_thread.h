@@ -66,6 +66,12 @@ class ModelThread {
                        std::shared_ptr<FrontendDelegate> delegate);
   void PostRemoveBackend(NodeId backend_id);
   void PostRemoveFrontend(NodeId frontend_id);
+  /*!
+   * \brief Also accept queries of another model session that shares the
+   *   prefix of this model. Its queries are batched together with the ones
+   *   of this model and keep their model index in the batch plan.
+   */
+  void PostAddPrefixGroupMember(ModelIndex model_index);
 
  private:
   class Poller : public ario::EventPoller {
@@ -84,6 +90,7 @@ class ModelThread {
   // Command handlers
   TimePoint DoGrantedBackendMessage(GrantedBackendMessage& cmd);
 
+  bool AcceptsModelIndex(ModelIndex model_index) const;
   void UpdateTargetBatchSize(const std::optional<AvgStd>& rps);
   void UpdateCandidate(TimePoint earliest_exec_time);
   void OnDropTimer(GlobalId head);
@@ -95,6 +102,8 @@ class ModelThread {
   ModelSession model_session_;
   std::string model_session_id_;
   ModelIndex model_index_;
+  /*! \brief Other models of the prefix group led by this model. */
+  std::vector<ModelIndex> prefix_group_members_;
   // TODO: GPU performance heterogeneity
   ModelProfile profile_;
   bool stop_flag_;
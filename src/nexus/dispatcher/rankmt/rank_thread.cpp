@@ -25,7 +25,10 @@ RankThread::BackendContext::BackendContext(
       next_available_time(std::chrono::nanoseconds(0)) {}
 
 RankThread::RankThread(ario::EpollExecutor* executor)
-    : executor_(*CHECK_NOTNULL(executor)), stop_flag_(false), poller_(this) {
+    : executor_(*CHECK_NOTNULL(executor)),
+      stop_flag_(false),
+      poller_(this),
+      num_model_threads_(0) {
   constexpr size_t kMaxModels = 512;
 
   // Prevent reallocation for thread safety.
@@ -112,7 +115,7 @@ void RankThread::DoUpdateCandidate(PerModelThreadData& mdata) {
   auto cinfo = std::shared_ptr<CandidateInfo>(
       new CandidateInfo{mdata, candidate.value()});
   candidate_pool_.Upsert(mdata.model_index, cinfo);
-  CHECK_EQ(candidate_pool_.Size(), model_threads_.size());
+  CHECK_EQ(candidate_pool_.Size(), num_model_threads_);
 
   SetupActivePlan(mdata);
 }
@@ -147,6 +150,7 @@ void RankThread::PostAddModelThread(ModelIndex model_index,
                 m, model_index, m.profile(),
                 *CHECK_NOTNULL(m.rank_command_queue()), nullptr, false});
 
+        ++num_model_threads_;
         auto& mdata = *model_threads_[model_index.t];
         candidate_pool_.Upsert(model_index,
                                std::shared_ptr<CandidateInfo>(new CandidateInfo{
@@ -178,6 +182,45 @@ void RankThread::PostRemoveBackend(NodeId backend_id) {
   });
 }
 
+void RankThread::PostBackendModelReady(NodeId backend_id,
+                                       ModelIndex model_index) {
+  executor_.PostOk([this, backend_id, model_index](ario::ErrorCode) {
+    auto iter = backends_.find(backend_id);
+    if (iter == backends_.end()) {
+      LOG(ERROR) << "BackendModelReady: backend not found. backend_id="
+                 << backend_id.t << " model_index=" << model_index.t;
+      return;
+    }
+    auto& ready_models = iter->second->ready_models;
+    if (ready_models.size() <= model_index.t) {
+      ready_models.resize(model_index.t + 1, false);
+    }
+    ready_models[model_index.t] = true;
+  });
+}
+
+void RankThread::PostAddPrefixGroupMember(ModelIndex leader_index,
+                                          ModelIndex member_index) {
+  executor_.PostOk([this, leader_index, member_index](ario::ErrorCode) {
+    auto& mdata = model_threads_.at(leader_index.t);
+    CHECK(mdata);
+    mdata->prefix_group_members.push_back(member_index);
+  });
+}
+
+bool RankThread::IsModelReady(const BackendContext& bctx,
+                              const PerModelThreadData& mdata) {
+  if (!bctx.IsModelReady(mdata.model_index)) {
+    return false;
+  }
+  for (auto member : mdata.prefix_group_members) {
+    if (!bctx.IsModelReady(member)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void RankThread::SetupActivePlan(PerModelThreadData& mdata) {
   auto& cinfo = candidate_pool_.GetByKey(mdata.model_index);
   uint32_t batch_size = cinfo->candidate.batch_size;
@@ -249,16 +292,25 @@ void RankThread::OnPlanTimer(PlanId plan_id) {
   CHECK_EQ(mdata.active_plan, plan);
   mdata.active_plan = nullptr;
 
-  // Try to assign backend if possible
+  // Try to assign the earliest available backend that has the models of the
+  // plan ready.
   CHECK_EQ(backend_availability_pool_.Size(), backends_.size());
-  if (backend_availability_pool_.Size() == 0) {
-    return;
+  BackendContext* bctx = nullptr;
+  for (size_t rank = 0; rank < backend_availability_pool_.Size(); ++rank) {
+    auto candidate_id = backend_availability_pool_.GetByRank(rank).key.get();
+    auto* candidate = backends_.at(candidate_id).get();
+    if (candidate->next_available_time > plan->exec_time) {
+      break;
+    }
+    if (IsModelReady(*candidate, mdata)) {
+      bctx = candidate;
+      break;
+    }
   }
-  auto backend_id = backend_availability_pool_.GetByRank(0).key.get();
-  auto& bctx = backends_.at(backend_id);
-  if (bctx->next_available_time > plan->exec_time) {
+  if (!bctx) {
     return;
   }
+  auto backend_id = bctx->backend_id;
 
   // Let ModelThread send out the plan
   GrantedBackendMessage msg;
@@ -272,7 +324,7 @@ void RankThread::OnPlanTimer(PlanId plan_id) {
   // Mark backend unavailable.
   // Also set the candidate of this model to be invalid.
   // ModelThread will give us updates on the backend and new candidates.
-  UpdateBackend(bctx.get(), TimePoint::max());
+  UpdateBackend(bctx, TimePoint::max());
   candidate_pool_.Upsert(mdata.model_index,
                          std::shared_ptr<CandidateInfo>(new CandidateInfo{
                              mdata, ExecutionCandidate::Invalid()}));
@@ -44,6 +44,14 @@ class RankThread {
   void PostAddBackend(NodeId backend_id,
                       std::shared_ptr<BackendDelegate> delegate);
   void PostRemoveBackend(NodeId backend_id);
+  void PostBackendModelReady(NodeId backend_id, ModelIndex model_index);
+  /*!
+   * \brief The model thread of leader_index also schedules the queries of
+   *   member_index. Its plans are granted only to backends that have both
+   *   models ready.
+   */
+  void PostAddPrefixGroupMember(ModelIndex leader_index,
+                                ModelIndex member_index);
 
   // Commands from model threads
   void PostResumeCandidateUpdate(ModelIndex model_index);
@@ -94,6 +102,8 @@ class RankThread {
     moodycamel::ReaderWriterQueue<RankCommand>& rank_command_queue;
     std::shared_ptr<ActivePlan> active_plan;
     bool rejecting_candidates;
+    /*! \brief Other models of the prefix group led by this model. */
+    std::vector<ModelIndex> prefix_group_members;
 
     std::mutex model_msg_mutex;
     MessagesFromModelThread model_msg /* GUARDED_BY(model_msg_mutex) */;
@@ -103,9 +113,15 @@ class RankThread {
     BackendContext(NodeId backend_id,
                    std::shared_ptr<BackendDelegate> delegate);
 
+    bool IsModelReady(ModelIndex model_index) const {
+      return model_index.t < ready_models.size() && ready_models[model_index.t];
+    }
+
     NodeId backend_id;
     std::shared_ptr<BackendDelegate> delegate;
     TimePoint next_available_time;
+    // Models that are loaded and warmed up on the backend.
+    std::vector<bool> ready_models;
   };
 
   // Handlers for commands from model threads
@@ -115,6 +131,9 @@ class RankThread {
 
   PlanId NextPlanId();
   void SetupActivePlan(PerModelThreadData& mdata);
+  /*! \brief Whether the backend has all models of the plans of mdata ready. */
+  static bool IsModelReady(const BackendContext& bctx,
+                           const PerModelThreadData& mdata);
   void OnPlanTimer(PlanId plan_id);
   void UpdateBackend(BackendContext* bctx, TimePoint next_available_time);
 
@@ -125,7 +144,9 @@ class RankThread {
   Poller poller_;
   PlanId next_plan_id_{1};
   std::unordered_map<NodeId, std::shared_ptr<BackendContext>> backends_;
+  /*! \brief Indexed by ModelIndex. Null for prefix group members. */
   std::vector<std::unique_ptr<PerModelThreadData>> model_threads_;
+  size_t num_model_threads_;
 
   ValueRankedSplayMap<ModelIndex, std::shared_ptr<CandidateInfo>,
                       CandidateInfo::CompareKeyFn>
@@ -1,5 +1,6 @@
 #include "nexus/dispatcher/rankmt/scheduler.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include <chrono>
@@ -19,16 +20,48 @@
 #include "nexus/common/metric.h"
 #include "nexus/common/model_db.h"
 #include "nexus/common/model_def.h"
+#include "nexus/common/sleep_profile.h"
 #include "nexus/common/time_util.h"
 #include "nexus/common/typedef.h"
 #include "nexus/dispatcher/batch_policy.h"
 #include "nexus/dispatcher/dispatcher.h"
 #include "nexus/proto/control.pb.h"
 
+DEFINE_bool(dispatcher_prefix_batch, false,
+            "Schedule model sessions that share a prefix as one model, so "
+            "that a batch plan runs the prefix once for all of them. Only "
+            "sleep models can run the prefix of a group so far.");
+
 namespace nexus {
 namespace dispatcher {
 namespace rankmt {
 
+namespace {
+
+/*!
+ * \brief Whether the backend can run the prefix of `leader` for batches
+ *   that mix both sessions. The model DB must list the two models in a
+ *   share_prefix entry. Only sleep models split a shared prefix so far, and
+ *   their prefix costs must match.
+ */
+bool SharePrefix(const ModelSession& leader, const ModelSession& member) {
+  if (leader.latency_sla() != member.latency_sla() ||
+      leader.image_height() != member.image_height() ||
+      leader.image_width() != member.image_width()) {
+    return false;
+  }
+  auto leader_sleep = SleepProfile::Parse(leader.framework());
+  auto member_sleep = SleepProfile::Parse(member.framework());
+  if (!leader_sleep.has_value() || !member_sleep.has_value() ||
+      !leader_sleep->SharesPrefixWith(*member_sleep)) {
+    return false;
+  }
+  return ModelDatabase::Singleton().GetSharePrefixLength(
+             ModelSessionToModelID(leader), ModelSessionToModelID(member)) > 0;
+}
+
+}  // namespace
+
 MultiThreadRankScheduler::Builder::Builder(
     ario::EpollExecutor* scheduler_executor,
     ario::EpollExecutor* rank_thread_executor)
@@ -48,8 +81,8 @@ MultiThreadRankScheduler::MultiThreadRankScheduler(
       rank_thread_(rank_thread_executor) {}
 
 MultiThreadRankScheduler::RequestEntrance::RequestEntrance(
-    ModelThread* model_thread)
-    : model_thread_(model_thread) {}
+    ModelThread* model_thread, ModelIndex model_index)
+    : model_thread_(model_thread), model_index_(model_index) {}
 
 CtrlStatus MultiThreadRankScheduler::RequestEntrance::EnqueueQuery(
     DispatchRequest&& request) {
@@ -58,7 +91,9 @@ CtrlStatus MultiThreadRankScheduler::RequestEntrance::EnqueueQuery(
 }
 
 MultiThreadRankScheduler::~MultiThreadRankScheduler() {
-  // TODO
+  // Event loops keep polling the model threads until they are stopped, so the
+  // model threads are freed here instead of in Stop().
+  model_threads_.clear();
 }
 
 void MultiThreadRankScheduler::Stop() {
@@ -67,16 +102,19 @@ void MultiThreadRankScheduler::Stop() {
   std::mutex mutex;
   size_t cnt = 0;
   std::condition_variable cv;
+  size_t target = 1;
   for (auto& model_thread : model_threads_) {
+    if (!model_thread) {
+      continue;
+    }
     model_thread->Stop(mutex, cnt, cv);
+    ++target;
   }
   rank_thread_.Stop(mutex, cnt, cv);
   {
-    size_t target = model_threads_.size() + 1;
     std::unique_lock lock(mutex);
     cv.wait(lock, [target, &cnt] { return cnt == target; });
   }
-  model_threads_.clear();
 }
 
 MultiThreadRankScheduler::RequestEntrance
@@ -97,12 +135,39 @@ MultiThreadRankScheduler::AddModelSession(
   CHECK_EQ(model_threads_.size(), model_index_table_.size());
   ModelIndex model_index(model_index_table_.size());
   model_index_table_[model_session_id] = model_index;
+
+  if (const auto* leader = FindPrefixGroupLeader(model_session)) {
+    auto leader_index = model_index_table_.at(ModelSessionToString(*leader));
+    auto* model_thread = model_threads_.at(leader_index.t).get();
+    LOG(INFO) << "Model session " << model_session_id
+              << " joins the prefix group of "
+              << model_thread->model_session_id();
+    model_threads_.emplace_back(nullptr);
+    model_thread->PostAddPrefixGroupMember(model_index);
+    rank_thread_.PostAddPrefixGroupMember(leader_index, model_index);
+    return RequestEntrance(model_thread, model_index);
+  }
+
   model_threads_.emplace_back(std::make_unique<ModelThread>(
       model_thread_executor, model_session, model_index, &rank_thread_,
       frontends_, backends_));
   auto* model_thread = model_threads_.back().get();
   rank_thread_.PostAddModelThread(model_index, model_thread);
-  return RequestEntrance(model_thread);
+  return RequestEntrance(model_thread, model_index);
+}
+
+const ModelSession* MultiThreadRankScheduler::FindPrefixGroupLeader(
+    const ModelSession& model_session) const {
+  if (!FLAGS_dispatcher_prefix_batch) {
+    return nullptr;
+  }
+  for (const auto& model_thread : model_threads_) {
+    if (model_thread &&
+        SharePrefix(model_thread->model_session(), model_session)) {
+      return &model_thread->model_session();
+    }
+  }
+  return nullptr;
 }
 
 void MultiThreadRankScheduler::AddBackend(
@@ -140,6 +205,11 @@ void MultiThreadRankScheduler::RemoveBackend(NodeId backend_id) {
   }
 }
 
+void MultiThreadRankScheduler::MarkBackendModelReady(NodeId backend_id,
+                                                     ModelIndex model_index) {
+  rank_thread_.PostBackendModelReady(backend_id, model_index);
+}
+
 void MultiThreadRankScheduler::RemoveFrontend(NodeId frontend_id) {
   frontends_.erase(frontend_id);
   for (auto& model_thread : model_threads_) {
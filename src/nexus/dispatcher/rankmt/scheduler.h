@@ -40,7 +40,11 @@ class MultiThreadRankScheduler {
     RequestEntrance& operator=(RequestEntrance&& other) = default;
     CtrlStatus EnqueueQuery(DispatchRequest&& request);
 
-    ModelIndex model_index() const { return model_thread_->model_index(); }
+    ModelIndex model_index() const { return model_index_; }
+    /*!
+     * \brief Model session of the ModelThread that schedules the queries.
+     *   It is the leader of the prefix group if the session joined one.
+     */
     const ModelSession& model_session() const {
       return model_thread_->model_session();
     }
@@ -50,21 +54,36 @@ class MultiThreadRankScheduler {
 
    private:
     friend class MultiThreadRankScheduler;
-    explicit RequestEntrance(ModelThread* model_thread);
+    RequestEntrance(ModelThread* model_thread, ModelIndex model_index);
 
     ModelThread* model_thread_;
+    ModelIndex model_index_;
   };
 
   MultiThreadRankScheduler(ario::EpollExecutor* scheduler_executor,
                            ario::EpollExecutor* rank_thread_executor);
   ~MultiThreadRankScheduler();
   void Stop();
+  /*!
+   * \brief Schedule a new model session. A session that shares its prefix
+   *   with an existing one joins its prefix group and is scheduled by the
+   *   ModelThread of the group leader, which must then run on
+   *   model_thread_executor. See FindPrefixGroupLeader.
+   */
   [[nodiscard]] RequestEntrance AddModelSession(
       ario::EpollExecutor* model_thread_executor, ModelSession model_session);
+  /*!
+   * \brief Return the leader of the prefix group that the model session
+   *   would join, or nullptr if it would be scheduled on its own.
+   */
+  const ModelSession* FindPrefixGroupLeader(
+      const ModelSession& model_session) const;
   void AddBackend(NodeId backend_id, std::shared_ptr<BackendDelegate> delegate);
   void AddFrontend(NodeId frontend_id,
                    std::shared_ptr<FrontendDelegate> delegate);
   void RemoveBackend(NodeId backend_id);
+  /*! \brief Allow plans of the model to be granted to the backend. */
+  void MarkBackendModelReady(NodeId backend_id, ModelIndex model_index);
   void RemoveFrontend(NodeId frontend_id);
 
  private:
@@ -72,6 +91,7 @@ class MultiThreadRankScheduler {
   RankThread rank_thread_;
 
   std::unordered_map<std::string, ModelIndex> model_index_table_;
+  /*! \brief Indexed by ModelIndex. Null for prefix group members. */
   std::vector<std::unique_ptr<ModelThread>> model_threads_;
 
   std::unordered_map<NodeId, std::shared_ptr<FrontendDelegate>> frontends_;
@@ -0,0 +1,323 @@
+#include "nexus/backend/batch_plan_context.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "nexus/backend/model_exec.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+#include "nexus/common/model_db.h"
+#include "nexus/common/profile_cache.h"
+
+namespace nexus {
+namespace backend {
+namespace {
+
+using QueryState = BatchPlanContext::QueryState;
+
+constexpr size_t kInputSize = 4;
+
+BatchPlanProto MakePlan(uint64_t first_global_id, int num_queries) {
+  BatchPlanProto proto;
+  proto.set_plan_id(1);
+  for (int i = 0; i < num_queries; ++i) {
+    auto* query = proto.add_queries();
+    query->mutable_query_without_input()->set_global_id(first_global_id + i);
+  }
+  return proto;
+}
+
+std::shared_ptr<Task> MakeTask(uint64_t global_id) {
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  auto task = std::make_shared<Task>();
+  task->query.set_global_id(global_id);
+  auto arr = std::make_shared<Array>(DT_FLOAT, kInputSize, cpu);
+  auto* data = arr->Data<float>();
+  for (size_t i = 0; i < kInputSize; ++i) {
+    data[i] = static_cast<float>(global_id);
+  }
+  task->AppendInput(arr);
+  return task;
+}
+
+class BatchPlanContextTest : public ::testing::Test {
+ protected:
+  void Init(uint64_t first_global_id, int num_queries) {
+    auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+    plan_ = std::make_unique<BatchPlanContext>(
+        MakePlan(first_global_id, num_queries));
+    plan_->SetInputArray(
+        std::make_shared<Array>(DT_FLOAT, num_queries * kInputSize, cpu));
+  }
+
+  void TearDown() override {
+    if (plan_) {
+      plan_->ReleaseInputArray();
+    }
+  }
+
+  std::unique_ptr<BatchPlanContext> plan_;
+};
+
+TEST_F(BatchPlanContextTest, AllPendingAfterCreation) {
+  Init(100, 5);
+  EXPECT_EQ(plan_->num_queries(), 5);
+  EXPECT_EQ(plan_->num_pending(), 5);
+  EXPECT_FALSE(plan_->IsReadyToRun());
+  for (uint64_t gid = 100; gid < 105; ++gid) {
+    EXPECT_EQ(plan_->GetQueryState(GlobalId(gid)), QueryState::kPending);
+  }
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(99)), QueryState::kNotFound);
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(105)), QueryState::kNotFound);
+}
+
+TEST_F(BatchPlanContextTest, PendingToPreprocessed) {
+  Init(7, 3);
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(8)));
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(8)), QueryState::kPreprocessed);
+  EXPECT_EQ(plan_->num_pending(), 2);
+  EXPECT_EQ(plan_->num_preprocessed(), 1);
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(9)));
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(7)));
+  EXPECT_TRUE(plan_->IsReadyToRun());
+
+  // Inputs are copied in the order of preprocessing completion.
+  auto batch_task = plan_->batch_task();
+  ASSERT_EQ(batch_task->batch_size(), 3);
+  const float* data = batch_task->GetInputArray()->Data<float>();
+  EXPECT_EQ(data[0], 8.f);
+  EXPECT_EQ(data[kInputSize], 9.f);
+  EXPECT_EQ(data[2 * kInputSize], 7.f);
+
+  auto tasks = plan_->PopPreprocessedTasks();
+  ASSERT_EQ(tasks.size(), 3);
+  EXPECT_EQ(tasks[0]->query.global_id(), 8);
+}
+
+TEST_F(BatchPlanContextTest, PendingToDropped) {
+  Init(1, 2);
+  ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(2)));
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(2)), QueryState::kDropped);
+  EXPECT_EQ(plan_->num_dropped(), 1);
+  EXPECT_FALSE(plan_->IsReadyToRun());
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(1)));
+  EXPECT_TRUE(plan_->IsReadyToRun());
+  EXPECT_EQ(plan_->batch_task()->batch_size(), 1);
+  EXPECT_EQ(plan_->PopPreprocessedTasks().size(), 1);
+}
+
+TEST_F(BatchPlanContextTest, AllDropped) {
+  Init(1, 2);
+  ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(1)));
+  ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(2)));
+  EXPECT_TRUE(plan_->IsReadyToRun());
+  EXPECT_EQ(plan_->batch_task()->batch_size(), 0);
+  EXPECT_TRUE(plan_->PopPreprocessedTasks().empty());
+}
+
+TEST_F(BatchPlanContextTest, DropAfterFetchCompletedIsRejected) {
+  Init(10, 2);
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(10)));
+  // The input has already been copied to the batch, so it cannot be dropped.
+  EXPECT_FALSE(plan_->MarkQueryDropped(GlobalId(10)));
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(10)), QueryState::kPreprocessed);
+  EXPECT_EQ(plan_->num_dropped(), 0);
+  EXPECT_EQ(plan_->num_pending(), 1);
+}
+
+TEST_F(BatchPlanContextTest, FetchCompletedAfterDropIsRejected) {
+  Init(10, 2);
+  ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(11)));
+  EXPECT_FALSE(plan_->AddPreprocessedTask(MakeTask(11)));
+  EXPECT_EQ(plan_->GetQueryState(GlobalId(11)), QueryState::kDropped);
+  EXPECT_EQ(plan_->batch_task()->batch_size(), 0);
+}
+
+TEST_F(BatchPlanContextTest, RepeatedTransitionsAreRejected) {
+  Init(10, 2);
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(10)));
+  EXPECT_FALSE(plan_->AddPreprocessedTask(MakeTask(10)));
+  ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(11)));
+  EXPECT_FALSE(plan_->MarkQueryDropped(GlobalId(11)));
+  EXPECT_EQ(plan_->num_preprocessed(), 1);
+  EXPECT_EQ(plan_->num_dropped(), 1);
+  EXPECT_EQ(plan_->batch_task()->batch_size(), 1);
+}
+
+TEST_F(BatchPlanContextTest, UnknownQueryIsRejected) {
+  Init(10, 2);
+  EXPECT_FALSE(plan_->AddPreprocessedTask(MakeTask(12)));
+  EXPECT_FALSE(plan_->MarkQueryDropped(GlobalId(9)));
+  EXPECT_EQ(plan_->num_pending(), 2);
+}
+
+TEST_F(BatchPlanContextTest, DuplicatedQueryCountsOnce) {
+  auto proto = MakePlan(5, 2);
+  proto.add_queries()->mutable_query_without_input()->set_global_id(5);
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  plan_ = std::make_unique<BatchPlanContext>(std::move(proto));
+  plan_->SetInputArray(std::make_shared<Array>(DT_FLOAT, 3 * kInputSize, cpu));
+  EXPECT_EQ(plan_->num_queries(), 2);
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(5)));
+  ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(6)));
+  EXPECT_TRUE(plan_->IsReadyToRun());
+}
+
+TEST_F(BatchPlanContextTest, LargePlanWithSparseGlobalIds) {
+  constexpr int kNumQueries = 256;
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  BatchPlanProto proto;
+  for (int i = 0; i < kNumQueries; ++i) {
+    // Strided ids collide in the low bits.
+    proto.add_queries()->mutable_query_without_input()->set_global_id(
+        (uint64_t(i) << 20) + 3);
+  }
+  plan_ = std::make_unique<BatchPlanContext>(std::move(proto));
+  plan_->SetInputArray(
+      std::make_shared<Array>(DT_FLOAT, kNumQueries * kInputSize, cpu));
+  for (int i = kNumQueries - 1; i >= 0; --i) {
+    auto gid = (uint64_t(i) << 20) + 3;
+    if (i % 3 == 0) {
+      ASSERT_TRUE(plan_->MarkQueryDropped(GlobalId(gid)));
+    } else {
+      ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(gid)));
+    }
+  }
+  EXPECT_TRUE(plan_->IsReadyToRun());
+  EXPECT_EQ(plan_->num_dropped(), (kNumQueries + 2) / 3);
+  EXPECT_EQ(plan_->num_preprocessed(), kNumQueries - (kNumQueries + 2) / 3);
+  EXPECT_EQ(plan_->GetQueryState(GlobalId((uint64_t(3) << 20) + 3)),
+            QueryState::kDropped);
+  EXPECT_EQ(plan_->GetQueryState(GlobalId((uint64_t(4) << 20) + 3)),
+            QueryState::kPreprocessed);
+}
+
+TEST_F(BatchPlanContextTest, QueryDeadline) {
+  auto proto = MakePlan(1, 2);
+  proto.mutable_queries(0)->set_deadline_ns(123456789);
+  plan_ = std::make_unique<BatchPlanContext>(std::move(proto));
+  EXPECT_EQ(plan_->GetQueryDeadline(GlobalId(1)),
+            TimePoint(std::chrono::nanoseconds(123456789)));
+  // Deadline not carried in the plan.
+  EXPECT_EQ(plan_->GetQueryDeadline(GlobalId(2)), TimePoint::max());
+  EXPECT_EQ(plan_->GetQueryDeadline(GlobalId(3)), TimePoint::max());
+  plan_.reset();
+}
+
+TEST_F(BatchPlanContextTest, RemoveInputsCompactsBatch) {
+  Init(1, 4);
+  for (uint64_t gid = 1; gid <= 4; ++gid) {
+    ASSERT_TRUE(plan_->AddPreprocessedTask(MakeTask(gid)));
+  }
+  auto batch_task = plan_->batch_task();
+  std::vector<std::shared_ptr<Task>> removed_tasks;
+  auto removed_inputs =
+      batch_task->RemoveInputs({false, true, false, true}, &removed_tasks);
+  ASSERT_EQ(removed_inputs.size(), 2);
+  ASSERT_EQ(removed_tasks.size(), 2);
+  EXPECT_EQ(removed_tasks[0]->query.global_id(), 1);
+  EXPECT_EQ(removed_tasks[1]->query.global_id(), 3);
+
+  ASSERT_EQ(batch_task->batch_size(), 2);
+  EXPECT_EQ(batch_task->tasks()[0]->query.global_id(), 2);
+  EXPECT_EQ(batch_task->tasks()[1]->query.global_id(), 4);
+  const float* data = batch_task->GetInputArray()->Data<float>();
+  for (size_t i = 0; i < kInputSize; ++i) {
+    EXPECT_EQ(data[i], 2.f);
+    EXPECT_EQ(data[kInputSize + i], 4.f);
+  }
+}
+
+/*! \brief Profile whose forward latency of batch b is b ms. */
+ModelProfile LinearProfile(uint32_t max_batch) {
+  RawProfile raw;
+  raw.profile_id = "stub";
+  for (uint32_t batch = 1; batch <= max_batch; ++batch) {
+    ProfileRow row;
+    row.latency_mean = 1000.0 * batch;
+    raw.forward.push_back(row);
+  }
+  return ModelProfile(raw);
+}
+
+std::vector<TimePoint> Deadlines(TimePoint start,
+                                 const std::vector<double>& deadlines_ms) {
+  std::vector<TimePoint> deadlines;
+  for (double ms : deadlines_ms) {
+    deadlines.push_back(start + std::chrono::microseconds(
+                                    static_cast<int64_t>(ms * 1000)));
+  }
+  return deadlines;
+}
+
+TEST(SelectQueriesInTimeTest, AllInTime) {
+  auto profile = LinearProfile(8);
+  auto start = Clock::now();
+  std::vector<bool> keep;
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {5, 4, 9, 4}), start,
+                                profile, &keep),
+            4);
+  EXPECT_EQ(keep, std::vector<bool>(4, true));
+  std::vector<TimePoint> no_deadline(3, TimePoint::max());
+  EXPECT_EQ(SelectQueriesInTime(no_deadline, start, profile, &keep), 3);
+  EXPECT_EQ(SelectQueriesInTime({}, start, profile, &keep), 0);
+  EXPECT_TRUE(keep.empty());
+}
+
+TEST(SelectQueriesInTimeTest, KeepsLargestBatchInTime) {
+  auto profile = LinearProfile(8);
+  auto start = Clock::now();
+  std::vector<bool> keep;
+  // Batches of 4 and 3 finish at 4 ms and 3 ms, after their earliest
+  // deadlines 1.5 ms and 2.5 ms. A batch of 2 finishes at 2 ms, before the
+  // two latest deadlines.
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {5, 1.5, 3, 2.5}), start,
+                                profile, &keep),
+            2);
+  EXPECT_EQ(keep, (std::vector<bool>{true, false, true, false}));
+
+  // The same deadlines with the batch starting 1.5 ms later.
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {5, 1.5, 3, 2.5}),
+                                start + std::chrono::microseconds(1500),
+                                profile, &keep),
+            1);
+  EXPECT_EQ(keep, (std::vector<bool>{true, false, false, false}));
+}
+
+TEST(SelectQueriesInTimeTest, TiesKeptInBatchOrder) {
+  auto profile = LinearProfile(8);
+  auto start = Clock::now();
+  std::vector<bool> keep;
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {2, 2, 2, 2}), start,
+                                profile, &keep),
+            2);
+  EXPECT_EQ(keep, (std::vector<bool>{true, true, false, false}));
+
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {2, 5, 2, 2}), start,
+                                profile, &keep),
+            2);
+  EXPECT_EQ(keep, (std::vector<bool>{true, true, false, false}));
+
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {1, 3, 3, 3}), start,
+                                profile, &keep),
+            3);
+  EXPECT_EQ(keep, (std::vector<bool>{false, true, true, true}));
+}
+
+TEST(SelectQueriesInTimeTest, AllExpired) {
+  auto profile = LinearProfile(8);
+  auto start = Clock::now();
+  std::vector<bool> keep;
+  EXPECT_EQ(SelectQueriesInTime(Deadlines(start, {0.5, 0.9, -1}), start,
+                                profile, &keep),
+            0);
+  EXPECT_EQ(keep, std::vector<bool>(3, false));
+}
+
+}  // namespace
+}  // namespace backend
+}  // namespace nexus
@@ -0,0 +1,104 @@
+#include "nexus/common/connection.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "nexus/common/message.h"
+
+namespace nexus {
+namespace {
+
+TEST(MessageBufferPoolTest, ReuseBySizeClass) {
+  auto& pool = MessageBufferPool::Singleton();
+  char* buffer = pool.Allocate(300);
+  pool.Free(buffer, 300);
+  auto num_allocated = pool.num_allocated();
+  // 300 and 500 bytes are in the same class of 512 bytes.
+  EXPECT_EQ(pool.Allocate(500), buffer);
+  EXPECT_EQ(pool.num_allocated(), num_allocated);
+  pool.Free(buffer, 500);
+}
+
+std::shared_ptr<Message> MakeMessage(int index, size_t body_length) {
+  auto msg = std::make_shared<Message>(kUserRequest, body_length);
+  for (size_t i = 0; i < body_length; ++i) {
+    msg->body()[i] = static_cast<char>(index + i);
+  }
+  return msg;
+}
+
+class Receiver : public MessageHandler {
+ public:
+  explicit Receiver(std::vector<size_t> body_lengths)
+      : body_lengths_(std::move(body_lengths)) {}
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    ASSERT_LT(num_received_, body_lengths_.size());
+    auto expected = MakeMessage(num_received_, body_lengths_[num_received_]);
+    EXPECT_EQ(message->type(), kUserRequest);
+    ASSERT_EQ(message->length(), expected->length());
+    EXPECT_EQ(std::memcmp(message->data(), expected->data(), message->length()),
+              0)
+        << "message " << num_received_;
+    ++num_received_;
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {
+    ADD_FAILURE() << ec.message();
+  }
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+  size_t num_received() const { return num_received_; }
+
+ private:
+  std::vector<size_t> body_lengths_;
+  size_t num_received_ = 0;
+};
+
+TEST(ConnectionTest, BatchedMessagesOfMixedSizes) {
+  // Small messages share the receive buffer, while large ones span it.
+  std::vector<size_t> body_lengths;
+  for (int i = 0; i < 200; ++i) {
+    for (size_t len : {0, 1, 100, 8000, 8180, 20000, 300000}) {
+      body_lengths.push_back(len);
+    }
+  }
+  boost::asio::io_context io_context;
+  boost::asio::ip::tcp::acceptor acceptor(
+      io_context, boost::asio::ip::tcp::endpoint(
+                      boost::asio::ip::address_v4::loopback(), 0));
+  boost::asio::ip::tcp::socket client_socket(io_context);
+  client_socket.connect(acceptor.local_endpoint());
+  boost::asio::ip::tcp::socket server_socket(io_context);
+  acceptor.accept(server_socket);
+
+  Receiver receiver(body_lengths);
+  Receiver unused({});
+  auto server =
+      std::make_shared<Connection>(std::move(server_socket), &receiver);
+  auto client = std::make_shared<Connection>(std::move(client_socket), &unused);
+  server->Start();
+  for (size_t i = 0; i < body_lengths.size(); ++i) {
+    client->Write(MakeMessage(i, body_lengths[i]));
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (receiver.num_received() < body_lengths.size() &&
+         std::chrono::steady_clock::now() < deadline) {
+    io_context.run_one_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(receiver.num_received(), body_lengths.size());
+  client->Stop();
+  server->Stop();
+}
+
+}  // namespace
+}  // namespace nexus
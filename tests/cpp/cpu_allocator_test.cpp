@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/buffer.h"
+#include "nexus/common/cpu_allocator.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+
+namespace nexus {
+namespace {
+
+bool IsAligned(const void* ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) % CPUAllocator::kAlignment == 0;
+}
+
+TEST(CPUAllocatorTest, SizeClass) {
+  EXPECT_EQ(CPUAllocator::SizeClass(0), 0);
+  EXPECT_EQ(CPUAllocator::ClassSize(0), 256);
+  EXPECT_EQ(CPUAllocator::ClassSize(1), 320);
+  EXPECT_EQ(CPUAllocator::ClassSize(CPUAllocator::kNumClasses - 1), 16 << 20);
+  for (size_t size = 1; size <= (16 << 20); size += size / 7 + 1) {
+    size_t index = CPUAllocator::SizeClass(size);
+    ASSERT_LT(index, CPUAllocator::kNumClasses) << size;
+    EXPECT_GE(CPUAllocator::ClassSize(index), size);
+    if (index > 0) {
+      EXPECT_LT(CPUAllocator::ClassSize(index - 1), size);
+    }
+  }
+  for (size_t index = 0; index < CPUAllocator::kNumClasses; ++index) {
+    size_t size = CPUAllocator::ClassSize(index);
+    EXPECT_EQ(CPUAllocator::SizeClass(size), index);
+    EXPECT_EQ(CPUAllocator::SizeClass(size + 1), index + 1);
+  }
+  // 224x224x3 floats waste less than a quarter of the block.
+  EXPECT_EQ(CPUAllocator::ClassSize(CPUAllocator::SizeClass(602112)), 655360);
+}
+
+TEST(CPUAllocatorTest, Alignment) {
+  auto& allocator = CPUAllocator::Singleton();
+  std::vector<void*> blocks;
+  for (size_t size : {0, 1, 3, 100, 257, 4096, 150528, 602112, 16 << 20,
+                      (16 << 20) + 1, 20 << 20}) {
+    void* ptr = allocator.Allocate(size);
+    EXPECT_TRUE(IsAligned(ptr)) << size;
+    memset(ptr, 0xab, size);
+    blocks.push_back(ptr);
+  }
+  for (void* ptr : blocks) {
+    allocator.Free(ptr);
+  }
+  allocator.Free(nullptr);
+}
+
+TEST(CPUAllocatorTest, ReuseOnSameThread) {
+  auto& allocator = CPUAllocator::Singleton();
+  auto before = allocator.stats();
+  void* ptr = allocator.Allocate(150528);
+  allocator.Free(ptr);
+  // The same class, though not the same size.
+  void* again = allocator.Allocate(150000);
+  EXPECT_EQ(again, ptr);
+  allocator.Free(again);
+  auto after = allocator.stats();
+  EXPECT_GE(after.thread_cache_hits, before.thread_cache_hits + 1);
+}
+
+TEST(CPUAllocatorTest, ReuseAcrossThreads) {
+  auto& allocator = CPUAllocator::Singleton();
+  // A class no other test uses, so that its lists start empty.
+  constexpr size_t kSize = 3 << 20;
+  void* ptr = nullptr;
+  std::thread([&] {
+    ptr = allocator.Allocate(kSize);
+    allocator.Free(ptr);
+  }).join();
+  // The block left the cache of the thread when the thread exited.
+  auto before = allocator.stats();
+  void* again = allocator.Allocate(kSize);
+  EXPECT_EQ(again, ptr);
+  EXPECT_EQ(allocator.stats().shared_hits, before.shared_hits + 1);
+  allocator.Free(again);
+}
+
+TEST(CPUAllocatorTest, OversizedGoesToSystem) {
+  auto& allocator = CPUAllocator::Singleton();
+  auto before = allocator.stats();
+  void* ptr = allocator.Allocate(32 << 20);
+  EXPECT_TRUE(IsAligned(ptr));
+  allocator.Free(ptr);
+  auto after = allocator.stats();
+  EXPECT_EQ(after.oversized_allocations, before.oversized_allocations + 1);
+  EXPECT_EQ(after.thread_cache_hits, before.thread_cache_hits);
+  EXPECT_EQ(after.shared_hits, before.shared_hits);
+}
+
+TEST(CPUAllocatorTest, CachesAreBounded) {
+  auto& allocator = CPUAllocator::Singleton();
+  constexpr size_t kSize = 12 << 20;
+  auto before = allocator.stats();
+  std::vector<void*> blocks;
+  for (int i = 0; i < 16; ++i) {
+    blocks.push_back(allocator.Allocate(kSize));
+  }
+  for (void* ptr : blocks) {
+    allocator.Free(ptr);
+  }
+  // 2 blocks stay with the thread and 5 are shared, within 64 MB.
+  EXPECT_EQ(allocator.stats().system_frees, before.system_frees + 9);
+}
+
+TEST(CPUAllocatorTest, ArrayOnCPUDevice) {
+  auto* device = DeviceManager::Singleton().GetCPUDevice();
+  Array array(DT_FLOAT, 224 * 224 * 3, device);
+  EXPECT_TRUE(IsAligned(array.Data<float>()));
+  array.Data<float>()[224 * 224 * 3 - 1] = 1;
+}
+
+}  // namespace
+}  // namespace nexus
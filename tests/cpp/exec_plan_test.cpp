@@ -0,0 +1,130 @@
+#include "nexus/app/exec_plan.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "nexus/app/exec_block.h"
+
+namespace nexus {
+namespace app {
+namespace {
+
+class ExecPlanTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto stub = [](std::shared_ptr<RequestContext>) {
+      return std::vector<VariablePtr>{};
+    };
+    blocks_.emplace_back(new ExecBlock(10, stub, {}));
+    blocks_.emplace_back(new ExecBlock(11, stub, {"x"}));
+    blocks_.emplace_back(new ExecBlock(12, stub, {"x", "y"}));
+    std::vector<ExecBlock*> blocks;
+    for (auto& b : blocks_) {
+      blocks.push_back(b.get());
+    }
+    plan_ = std::make_unique<ExecPlan>(blocks);
+  }
+
+  ExecBlock* block(int index) { return blocks_[index].get(); }
+
+  static VariablePtr ReadyVariable(const std::string& name) {
+    return std::make_shared<Variable>(
+        name, std::vector<std::shared_ptr<QueryResult> >{});
+  }
+
+  static QueryResultProto Result(uint64_t qid) {
+    QueryResultProto result;
+    result.set_query_id(qid);
+    result.set_status(CTRL_OK);
+    return result;
+  }
+
+  std::vector<std::unique_ptr<ExecBlock> > blocks_;
+  std::unique_ptr<ExecPlan> plan_;
+};
+
+TEST_F(ExecPlanTest, Compile) {
+  EXPECT_EQ(plan_->num_blocks(), 3);
+  EXPECT_EQ(plan_->num_variables(), 2);
+  int x = plan_->VariableIndex("x");
+  int y = plan_->VariableIndex("y");
+  ASSERT_GE(x, 0);
+  ASSERT_GE(y, 0);
+  EXPECT_NE(x, y);
+  EXPECT_EQ(plan_->VariableIndex("z"), -1);
+  EXPECT_EQ(plan_->num_dependencies(0), 0);
+  EXPECT_EQ(plan_->num_dependencies(2), 2);
+  EXPECT_EQ(plan_->consumers(x), (std::vector<int>{1, 2}));
+  EXPECT_EQ(plan_->consumers(y), (std::vector<int>{2}));
+}
+
+TEST_F(ExecPlanTest, BlocksBecomeReadyWithTheirVariables) {
+  ExecState state;
+  state.Init(plan_.get());
+  EXPECT_FALSE(state.finished());
+  EXPECT_EQ(state.NextReadyBlock(), block(0));
+  EXPECT_EQ(state.NextReadyBlock(), nullptr);
+
+  // Variables that no block requires are dropped.
+  EXPECT_TRUE(state.AddBlockReturn({ReadyVariable("x"), ReadyVariable("z")}));
+  EXPECT_NE(state.GetVariable(plan_->VariableIndex("x")), nullptr);
+  EXPECT_EQ(state.NextReadyBlock(), block(1));
+  EXPECT_EQ(state.NextReadyBlock(), nullptr);
+
+  // The result of the first query arrives before the block returns.
+  EXPECT_FALSE(state.AddQueryResult(Result(1)));
+  auto y = std::make_shared<Variable>(
+      "y", std::vector<std::shared_ptr<QueryResult> >{
+               std::make_shared<QueryResult>(1),
+               std::make_shared<QueryResult>(2)});
+  EXPECT_FALSE(state.AddBlockReturn({y}));
+  EXPECT_EQ(state.GetVariable(plan_->VariableIndex("y")), nullptr);
+  EXPECT_TRUE(state.AddQueryResult(Result(2)));
+  EXPECT_TRUE(y->ready());
+  EXPECT_EQ(state.NextReadyBlock(), block(2));
+  EXPECT_TRUE(state.finished());
+}
+
+TEST_F(ExecPlanTest, ContinuationsBecomeReadyWithTheirResults) {
+  ExecState state;
+  state.Init(plan_.get());
+  EXPECT_EQ(state.NextReadyBlock(), block(0));
+  int num_runs = 0;
+  auto run = [&num_runs](std::shared_ptr<RequestContext>) { ++num_runs; };
+
+  // A result that arrives before the continuation is added.
+  EXPECT_FALSE(state.AddQueryResult(Result(1)));
+  state.AddContinuation(
+      std::make_shared<Variable>("", std::make_shared<QueryResult>(1)), run);
+  state.AddContinuation(
+      std::make_shared<Variable>("", std::make_shared<QueryResult>(2)), run);
+  EXPECT_FALSE(state.finished());
+  EXPECT_TRUE(state.HasReadyTask());
+  auto first = state.NextReadyContinuation();
+  ASSERT_TRUE(first);
+  first(nullptr);
+  EXPECT_EQ(num_runs, 1);
+  EXPECT_FALSE(state.HasReadyTask());
+  EXPECT_FALSE(state.NextReadyContinuation());
+
+  EXPECT_TRUE(state.AddQueryResult(Result(2)));
+  auto second = state.NextReadyContinuation();
+  ASSERT_TRUE(second);
+  EXPECT_FALSE(state.finished());
+  second(nullptr);
+  EXPECT_EQ(num_runs, 2);
+}
+
+TEST_F(ExecPlanTest, Cancel) {
+  ExecState state;
+  state.Init(plan_.get());
+  state.Cancel();
+  EXPECT_TRUE(state.finished());
+  EXPECT_EQ(state.NextReadyBlock(), nullptr);
+}
+
+}  // namespace
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/metric.h"
+
+namespace nexus {
+namespace {
+
+TEST(HistogramTest, Empty) {
+  Histogram h;
+  auto s = h.Snapshot();
+  EXPECT_EQ(s.count, 0);
+  EXPECT_EQ(s.Percentile(50), 0);
+  EXPECT_EQ(s.ToString(), "n=0");
+}
+
+TEST(HistogramTest, BucketBoundsAreContiguous) {
+  for (size_t i = 1; i < Histogram::kNumBuckets; ++i) {
+    auto lower = Histogram::BucketUpperBound(i - 1) + 1;
+    EXPECT_EQ(Histogram::BucketIndex(lower), i);
+    EXPECT_EQ(Histogram::BucketIndex(Histogram::BucketUpperBound(i)), i);
+  }
+  EXPECT_EQ(Histogram::BucketIndex(std::numeric_limits<uint64_t>::max()),
+            Histogram::kNumBuckets - 1);
+}
+
+TEST(HistogramTest, SmallValuesAreExact) {
+  Histogram h;
+  for (int v = 1; v <= 5; ++v) {
+    h.Record(v);
+  }
+  auto s = h.Snapshot();
+  EXPECT_EQ(s.count, 5);
+  EXPECT_EQ(s.sum, 15);
+  EXPECT_EQ(s.min, 1);
+  EXPECT_EQ(s.max, 5);
+  EXPECT_DOUBLE_EQ(s.Mean(), 3.0);
+  EXPECT_EQ(s.Percentile(0), 1);
+  EXPECT_EQ(s.Percentile(50), 3);
+  EXPECT_EQ(s.Percentile(100), 5);
+}
+
+TEST(HistogramTest, NegativeValues) {
+  Histogram h;
+  h.Record(-1000);
+  h.Record(-3);
+  h.Record(0);
+  h.Record(7);
+  auto s = h.Snapshot();
+  EXPECT_EQ(s.min, -1000);
+  EXPECT_EQ(s.max, 7);
+  // -1000 falls into the bucket of magnitudes [960, 1023].
+  EXPECT_EQ(s.Percentile(25), -960);
+  EXPECT_EQ(s.Percentile(50), -3);
+  EXPECT_EQ(s.Percentile(75), 0);
+  EXPECT_EQ(s.Percentile(100), 7);
+  h.Record(std::numeric_limits<int64_t>::min());
+  EXPECT_EQ(h.Snapshot().Percentile(0), std::numeric_limits<int64_t>::min());
+}
+
+TEST(HistogramTest, PercentileRelativeError) {
+  std::mt19937 gen(123);
+  std::lognormal_distribution<double> dist(8, 2);
+  std::vector<int64_t> values;
+  Histogram h;
+  for (int i = 0; i < 100000; ++i) {
+    auto v = static_cast<int64_t>(dist(gen));
+    values.push_back(v);
+    h.Record(v);
+  }
+  std::sort(values.begin(), values.end());
+  auto s = h.Snapshot();
+  for (double p : {10., 50., 90., 99., 99.9}) {
+    auto exact = values[static_cast<size_t>(p / 100 * values.size()) - 1];
+    auto estimate = s.Percentile(p);
+    EXPECT_GE(estimate, exact) << "p" << p;
+    EXPECT_LE(estimate, exact + exact / 8 + 1) << "p" << p;
+  }
+}
+
+TEST(HistogramTest, ConcurrentRecord) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 100000;
+  Histogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&h, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        h.Record(t * kPerThread + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto s = h.Snapshot();
+  EXPECT_EQ(s.count, kThreads * kPerThread);
+  EXPECT_EQ(s.min, 0);
+  EXPECT_EQ(s.max, kThreads * kPerThread - 1);
+  int64_t n = kThreads * kPerThread;
+  EXPECT_EQ(s.sum, n * (n - 1) / 2);
+}
+
+TEST(HistogramTest, MergeMatchesOneHistogram) {
+  std::mt19937 gen(456);
+  std::lognormal_distribution<double> dist(6, 3);
+  Histogram all;
+  std::vector<Histogram> parts(5);
+  for (int i = 0; i < 50000; ++i) {
+    auto v = static_cast<int64_t>(dist(gen)) - 100;
+    all.Record(v);
+    parts[i % parts.size()].Record(v);
+  }
+  HistogramSnapshot merged;
+  for (const auto& part : parts) {
+    merged.Merge(part.Snapshot());
+  }
+  merged.Merge(Histogram().Snapshot());
+  auto s = all.Snapshot();
+  EXPECT_EQ(merged.count, s.count);
+  EXPECT_EQ(merged.sum, s.sum);
+  EXPECT_EQ(merged.min, s.min);
+  EXPECT_EQ(merged.max, s.max);
+  EXPECT_EQ(merged.negative_buckets, s.negative_buckets);
+  EXPECT_EQ(merged.positive_buckets, s.positive_buckets);
+  for (double p : {0., 1., 10., 50., 90., 99., 99.9, 100.}) {
+    EXPECT_EQ(merged.Percentile(p), s.Percentile(p)) << "p" << p;
+  }
+}
+
+TEST(HistogramTest, ShardedRecord) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 100000;
+  ShardedHistogram sharded;
+  Histogram single;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        sharded.Record(t * kPerThread + i);
+        single.Record(t * kPerThread + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto s = sharded.Snapshot();
+  auto expected = single.Snapshot();
+  EXPECT_EQ(s.count, kThreads * kPerThread);
+  EXPECT_EQ(s.sum, expected.sum);
+  EXPECT_EQ(s.min, 0);
+  EXPECT_EQ(s.max, kThreads * kPerThread - 1);
+  for (double p : {10., 50., 90., 99.}) {
+    EXPECT_EQ(s.Percentile(p), expected.Percentile(p)) << "p" << p;
+  }
+  sharded.Reset();
+  EXPECT_EQ(sharded.Snapshot().count, 0);
+}
+
+TEST(HistogramTest, Reset) {
+  Histogram h;
+  h.Record(42);
+  h.Reset();
+  auto s = h.Snapshot();
+  EXPECT_EQ(s.count, 0);
+  EXPECT_EQ(s.sum, 0);
+}
+
+}  // namespace
+}  // namespace nexus
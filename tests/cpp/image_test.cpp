@@ -0,0 +1,344 @@
+#include "nexus/common/image.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+DECLARE_bool(roi_decode);
+
+namespace nexus {
+namespace {
+
+/*! \brief JPEG header with an APP0 segment and a baseline frame header. */
+std::vector<char> JpegHeader(int height, int width) {
+  std::vector<unsigned char> bytes = {
+      0xFF, 0xD8,                                // SOI
+      0xFF, 0xE0, 0x00, 0x06, 'J', 'F', 'I', 0,  // APP0
+      0xFF, 0xFF,                                // Fill byte
+      0xFF, 0xC0, 0x00, 0x11, 0x08,              // SOF0
+      static_cast<unsigned char>(height >> 8),
+      static_cast<unsigned char>(height & 0xFF),
+      static_cast<unsigned char>(width >> 8),
+      static_cast<unsigned char>(width & 0xFF),
+      0x03};
+  return std::vector<char>(bytes.begin(), bytes.end());
+}
+
+TEST(ImageTest, GetJpegSize) {
+  auto header = JpegHeader(1080, 1920);
+  int height = 0, width = 0;
+  ASSERT_TRUE(GetJpegSize(header.data(), header.size(), &height, &width));
+  EXPECT_EQ(height, 1080);
+  EXPECT_EQ(width, 1920);
+
+  EXPECT_FALSE(GetJpegSize(header.data(), header.size() - 3, &height, &width));
+  std::vector<char> png = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+  EXPECT_FALSE(GetJpegSize(png.data(), png.size(), &height, &width));
+}
+
+TEST(ImageTest, JpegScaleDenominator) {
+  EXPECT_EQ(JpegScaleDenominator(224, 224, 224, 224), 1);
+  EXPECT_EQ(JpegScaleDenominator(446, 446, 224, 224), 1);
+  EXPECT_EQ(JpegScaleDenominator(447, 447, 224, 224), 2);
+  // libjpeg rounds up, so 1/4 of 893 is 224.
+  EXPECT_EQ(JpegScaleDenominator(893, 893, 224, 224), 4);
+  EXPECT_EQ(JpegScaleDenominator(1080, 1920, 224, 224), 4);
+  EXPECT_EQ(JpegScaleDenominator(3024, 4032, 224, 224), 8);
+  EXPECT_EQ(JpegScaleDenominator(4032, 3024, 299, 299), 8);
+  EXPECT_EQ(JpegScaleDenominator(100, 100, 224, 224), 1);
+}
+
+/*! \brief Encode a textured RGB image, with 4:2:0 chroma if subsampled. */
+std::vector<char> EncodeJpeg(int height, int width, bool subsampled) {
+  std::vector<unsigned char> pixels(height * width * 3);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      auto* p = &pixels[(y * width + x) * 3];
+      p[0] = x * 255 / width;
+      p[1] = y * 255 / height;
+      p[2] = (x * 7 + y * 13) % 256;
+    }
+  }
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  unsigned char* out = nullptr;
+  unsigned long out_size = 0;
+  jpeg_mem_dest(&cinfo, &out, &out_size);
+  cinfo.image_height = height;
+  cinfo.image_width = width;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  if (!subsampled) {
+    cinfo.comp_info[0].h_samp_factor = 1;
+    cinfo.comp_info[0].v_samp_factor = 1;
+  }
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = &pixels[cinfo.next_scanline * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  std::vector<char> data(out, out + out_size);
+  free(out);
+  return data;
+}
+
+/*! \brief Decode a region, or the whole image if region is empty. */
+std::vector<uint8_t> DecodeRegion(const std::vector<char>& data, int denom,
+                                  ChannelOrder order, cv::Rect* region) {
+  JpegRegionDecoder decoder;
+  EXPECT_TRUE(decoder.Start(data.data(), data.size(), denom, true, order));
+  if (region->area() > 0) {
+    EXPECT_TRUE(decoder.Crop(region));
+  } else {
+    *region = cv::Rect(0, 0, decoder.width(), decoder.height());
+  }
+  EXPECT_EQ(decoder.width(), region->width);
+  std::vector<uint8_t> pixels(region->height * region->width * 3);
+  EXPECT_TRUE(decoder.Read(pixels.data(), region->width * 3));
+  return pixels;
+}
+
+TEST(ImageTest, JpegRegionDecoderScales) {
+  auto data = EncodeJpeg(1080, 1920, true);
+  for (int denom : {1, 2, 4, 8}) {
+    JpegRegionDecoder decoder;
+    ASSERT_TRUE(decoder.Start(data.data(), data.size(), denom, true, CO_RGB));
+    EXPECT_EQ(decoder.height(), (1080 + denom - 1) / denom);
+    EXPECT_EQ(decoder.width(), (1920 + denom - 1) / denom);
+    EXPECT_EQ(decoder.channels(), 3);
+  }
+}
+
+TEST(ImageTest, JpegRegionMatchesFullDecode) {
+  for (bool subsampled : {false, true}) {
+    auto data = EncodeJpeg(480, 640, subsampled);
+    for (int denom : {1, 4}) {
+      cv::Rect full;
+      auto full_pixels = DecodeRegion(data, denom, CO_RGB, &full);
+      cv::Rect region(150 / denom, 100 / denom, 200 / denom, 120 / denom);
+      cv::Rect requested = region;
+      auto pixels = DecodeRegion(data, denom, CO_RGB, &region);
+      // Aligned left to an iMCU, without losing requested columns.
+      EXPECT_LE(region.x, requested.x);
+      EXPECT_GE(region.x + region.width, requested.x + requested.width);
+      EXPECT_EQ(region.y, requested.y);
+      EXPECT_EQ(region.height, requested.height);
+      int max_diff = 0;
+      for (int y = requested.y; y < requested.y + requested.height; ++y) {
+        for (int x = requested.x; x < requested.x + requested.width; ++x) {
+          for (int c = 0; c < 3; ++c) {
+            int a = pixels[((y - region.y) * region.width + x - region.x) * 3 +
+                           c];
+            int b = full_pixels[(y * full.width + x) * 3 + c];
+            max_diff = std::max(max_diff, std::abs(a - b));
+          }
+        }
+      }
+      EXPECT_LE(max_diff, 1) << "subsampled=" << subsampled
+                             << " denom=" << denom;
+    }
+  }
+}
+
+TEST(ImageTest, JpegRegionChannelOrder) {
+  auto data = EncodeJpeg(64, 64, false);
+  cv::Rect rgb_region, bgr_region;
+  auto rgb = DecodeRegion(data, 1, CO_RGB, &rgb_region);
+  auto bgr = DecodeRegion(data, 1, CO_BGR, &bgr_region);
+  ASSERT_EQ(rgb.size(), bgr.size());
+  for (size_t i = 0; i < rgb.size(); i += 3) {
+    EXPECT_EQ(rgb[i], bgr[i + 2]);
+    EXPECT_EQ(rgb[i + 2], bgr[i]);
+  }
+  // Red grows to the right and green grows down.
+  EXPECT_LT(rgb[0], rgb[63 * 3]);
+  EXPECT_LT(rgb[1], rgb[63 * 64 * 3 + 1]);
+}
+
+TEST(ImageTest, JpegRegionDecoderRejects) {
+  auto data = EncodeJpeg(64, 64, true);
+  JpegRegionDecoder truncated;
+  EXPECT_FALSE(truncated.Start(data.data(), 100, 1, true, CO_RGB));
+  std::vector<char> png = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+  JpegRegionDecoder not_jpeg;
+  EXPECT_FALSE(not_jpeg.Start(png.data(), png.size(), 1, true, CO_RGB));
+
+  JpegRegionDecoder decoder;
+  ASSERT_TRUE(decoder.Start(data.data(), data.size(), 1, true, CO_RGB));
+  cv::Rect outside(64, 0, 10, 10);
+  EXPECT_FALSE(decoder.Crop(&outside));
+}
+
+ImageProto MakeImage(const char* data, size_t size,
+                     ImageProto::ImageFormat format) {
+  ImageProto image;
+  image.set_data(data, size);
+  image.set_format(format);
+  image.set_color(true);
+  return image;
+}
+
+google::protobuf::RepeatedPtrField<RectProto> MakeWindows(
+    const std::vector<cv::Rect>& rects) {
+  google::protobuf::RepeatedPtrField<RectProto> windows;
+  for (const auto& rect : rects) {
+    auto* window = windows.Add();
+    window->set_left(rect.x);
+    window->set_top(rect.y);
+    window->set_right(rect.x + rect.width);
+    window->set_bottom(rect.y + rect.height);
+  }
+  return windows;
+}
+
+/*!
+ * \brief Largest difference between a crop and the same rect of an image
+ *   with pixels of the given row width.
+ */
+int MaxDiff(const cv::Mat& crop, const std::vector<uint8_t>& image,
+            int image_width, const cv::Rect& rect) {
+  EXPECT_EQ(crop.rows, rect.height);
+  EXPECT_EQ(crop.cols, rect.width);
+  int max_diff = 0;
+  for (int y = 0; y < std::min(crop.rows, rect.height); ++y) {
+    const auto* row = crop.ptr<uint8_t>(y);
+    for (int x = 0; x < std::min(crop.cols, rect.width) * 3; ++x) {
+      int a = row[x];
+      int b = image[((rect.y + y) * image_width + rect.x) * 3 + x];
+      max_diff = std::max(max_diff, std::abs(a - b));
+    }
+  }
+  return max_diff;
+}
+
+TEST(ImageTest, DecodeImageWindowsMatchesFullDecode) {
+  const std::vector<cv::Rect> rects = {cv::Rect(150, 100, 200, 120),
+                                       cv::Rect(333, 41, 97, 211),
+                                       cv::Rect(3, 5, 64, 48)};
+  struct Case {
+    size_t num_windows;
+    int height, width;
+    /*! \brief Scale the windows are decoded at. */
+    int denom;
+  };
+  // The smallest window limits the scale.
+  const Case cases[] = {{3, 0, 0, 1}, {3, 24, 24, 2}, {2, 24, 24, 4}};
+  for (bool subsampled : {false, true}) {
+    auto data = EncodeJpeg(480, 640, subsampled);
+    auto image = MakeImage(data.data(), data.size(), ImageProto::JPEG);
+    for (const auto& c : cases) {
+      std::vector<cv::Rect> windows(rects.begin(),
+                                    rects.begin() + c.num_windows);
+      cv::Size size;
+      auto crops = DecodeImageWindows(image, MakeWindows(windows), c.height,
+                                      c.width, CO_RGB, &size);
+      EXPECT_EQ(size.height, 480);
+      EXPECT_EQ(size.width, 640);
+      ASSERT_EQ(crops.size(), windows.size());
+
+      // Each crop is the window of the whole image decoded at its scale.
+      cv::Rect full;
+      auto full_pixels = DecodeRegion(data, c.denom, CO_RGB, &full);
+      for (size_t i = 0; i < windows.size(); ++i) {
+        const auto& w = windows[i];
+        int x0 = w.x / c.denom;
+        int y0 = w.y / c.denom;
+        int x1 = (w.x + w.width + c.denom - 1) / c.denom;
+        int y1 = (w.y + w.height + c.denom - 1) / c.denom;
+        cv::Rect scaled(x0, y0, x1 - x0, y1 - y0);
+        EXPECT_LE(MaxDiff(crops[i], full_pixels, full.width, scaled), 1)
+            << "subsampled=" << subsampled << " denom=" << c.denom
+            << " window=" << i;
+      }
+    }
+  }
+}
+
+TEST(ImageTest, DecodeImageWindowsWithoutWindows) {
+  auto data = EncodeJpeg(480, 640, true);
+  auto image = MakeImage(data.data(), data.size(), ImageProto::JPEG);
+  cv::Size size;
+  // 1/4 of the image is still larger than 100 x 100.
+  auto crops = DecodeImageWindows(image, MakeWindows({}), 100, 100, CO_RGB,
+                                  &size);
+  ASSERT_EQ(crops.size(), 1);
+  EXPECT_EQ(size.height, 480);
+  EXPECT_EQ(size.width, 640);
+  cv::Rect full;
+  auto full_pixels = DecodeRegion(data, 4, CO_RGB, &full);
+  EXPECT_EQ(MaxDiff(crops[0], full_pixels, full.width, full), 0);
+}
+
+TEST(ImageTest, DecodeImageWindowsWithoutRoiDecode) {
+  auto data = EncodeJpeg(480, 640, true);
+  auto image = MakeImage(data.data(), data.size(), ImageProto::JPEG);
+  std::vector<cv::Rect> windows = {cv::Rect(150, 100, 200, 120),
+                                   cv::Rect(333, 41, 97, 211)};
+  FLAGS_roi_decode = false;
+  cv::Size size;
+  auto crops = DecodeImageWindows(image, MakeWindows(windows), 24, 24, CO_RGB,
+                                  &size);
+  FLAGS_roi_decode = true;
+  EXPECT_EQ(size.height, 480);
+  EXPECT_EQ(size.width, 640);
+  ASSERT_EQ(crops.size(), windows.size());
+  // The image is fully decoded, so the windows are at full scale.
+  cv::Rect full;
+  auto full_pixels = DecodeRegion(data, 1, CO_RGB, &full);
+  for (size_t i = 0; i < windows.size(); ++i) {
+    EXPECT_LE(MaxDiff(crops[i], full_pixels, full.width, windows[i]), 1)
+        << "window=" << i;
+  }
+}
+
+TEST(ImageTest, DecodeImageWindowsOfPng) {
+  cv::Mat rgb(48, 64, CV_8UC3);
+  cv::randu(rgb, cv::Scalar::all(0), cv::Scalar::all(256));
+  cv::Mat bgr;
+  cv::cvtColor(rgb, bgr, cv::COLOR_RGB2BGR);
+  std::vector<uchar> png;
+  ASSERT_TRUE(cv::imencode(".png", bgr, png));
+  auto image = MakeImage(reinterpret_cast<const char*>(png.data()),
+                         png.size(), ImageProto::PNG);
+  std::vector<cv::Rect> windows = {cv::Rect(10, 5, 20, 30)};
+  cv::Size size;
+  auto crops = DecodeImageWindows(image, MakeWindows(windows), 8, 8, CO_RGB,
+                                  &size);
+  EXPECT_EQ(size.height, 48);
+  EXPECT_EQ(size.width, 64);
+  ASSERT_EQ(crops.size(), 1);
+  // PNG is lossless, so the crop has the original pixels.
+  std::vector<uint8_t> pixels(rgb.data, rgb.data + rgb.total() * 3);
+  EXPECT_EQ(MaxDiff(crops[0], pixels, 64, windows[0]), 0);
+}
+
+TEST(ImageTest, DecodeImageWindowsRejectsWindowOutside) {
+  auto data = EncodeJpeg(64, 64, true);
+  ImageProto image;
+  image.set_data(data.data(), data.size());
+  image.set_format(ImageProto::JPEG);
+  image.set_color(true);
+  google::protobuf::RepeatedPtrField<RectProto> windows;
+  auto* rect = windows.Add();
+  rect->set_left(10);
+  rect->set_top(10);
+  rect->set_right(70);
+  rect->set_bottom(20);
+  cv::Size size;
+  EXPECT_TRUE(DecodeImageWindows(image, windows, 32, 32, CO_RGB, &size)
+                  .empty());
+}
+
+}  // namespace
+}  // namespace nexus
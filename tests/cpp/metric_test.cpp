@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/metric.h"
+
+namespace nexus {
+namespace {
+
+TEST(ShardedCounterTest, ConcurrentIncrease) {
+  constexpr int kThreads = 8;
+  constexpr int kPerThread = 100000;
+  ShardedCounter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&counter] {
+      for (int i = 0; i < kPerThread; ++i) {
+        counter.Increase();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.value(), kThreads * kPerThread);
+  counter.Increase(5);
+  EXPECT_EQ(counter.value(), kThreads * kPerThread + 5);
+  counter.Reset();
+  EXPECT_EQ(counter.value(), 0);
+}
+
+TEST(PrometheusWriterTest, TextFormat) {
+  PrometheusWriter writer;
+  writer.AddCounter("nexus_requests_total", "Requests received.",
+                    {{"model", "resnet"}}, 10);
+  writer.AddCounter("nexus_requests_total", "Requests received.",
+                    {{"model", "a\"b\\c\nd"}}, 2);
+  writer.AddGauge("nexus_queue_length", "Queue length.", {}, 1.5);
+  Histogram h;
+  for (int v = 1; v <= 5; ++v) {
+    h.Record(v);
+  }
+  writer.AddHistogram("nexus_latency_us", "Latency.", {{"stage", "exec"}},
+                      h.Snapshot());
+  EXPECT_EQ(writer.str(),
+            "# HELP nexus_requests_total Requests received.\n"
+            "# TYPE nexus_requests_total counter\n"
+            "nexus_requests_total{model=\"resnet\"} 10\n"
+            "nexus_requests_total{model=\"a\\\"b\\\\c\\nd\"} 2\n"
+            "# HELP nexus_queue_length Queue length.\n"
+            "# TYPE nexus_queue_length gauge\n"
+            "nexus_queue_length 1.5\n"
+            "# HELP nexus_latency_us Latency.\n"
+            "# TYPE nexus_latency_us summary\n"
+            "nexus_latency_us{stage=\"exec\",quantile=\"0.5\"} 3\n"
+            "nexus_latency_us{stage=\"exec\",quantile=\"0.9\"} 5\n"
+            "nexus_latency_us{stage=\"exec\",quantile=\"0.99\"} 5\n"
+            "nexus_latency_us{stage=\"exec\",quantile=\"0.999\"} 5\n"
+            "nexus_latency_us_sum{stage=\"exec\"} 15\n"
+            "nexus_latency_us_count{stage=\"exec\"} 5\n");
+}
+
+TEST(MetricRegistryTest, ExportText) {
+  auto& registry = MetricRegistry::Singleton();
+  auto b = registry.CreateShardedCounter("test_export_b_total", "B.");
+  auto a = registry.CreateShardedHistogram("test_export_a_us", "A.");
+  auto b2 = registry.CreateShardedCounter("test_export_b_total", "B.",
+                                          {{"shard", "2"}});
+  b->Increase(3);
+  b2->Increase();
+  a->Record(7);
+  auto text = registry.ExportText();
+  auto pos_a = text.find("test_export_a_us_count 1\n");
+  auto pos_b = text.find("test_export_b_total 3\n");
+  auto pos_b2 = text.find("test_export_b_total{shard=\"2\"} 1\n");
+  ASSERT_NE(pos_a, std::string::npos) << text;
+  ASSERT_NE(pos_b, std::string::npos) << text;
+  ASSERT_NE(pos_b2, std::string::npos) << text;
+  EXPECT_LT(pos_a, pos_b);
+  EXPECT_LT(pos_b, pos_b2);
+
+  registry.RemoveMetric(a);
+  registry.RemoveMetric(b);
+  registry.RemoveMetric(b2);
+  EXPECT_EQ(registry.ExportText().find("test_export_"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace nexus
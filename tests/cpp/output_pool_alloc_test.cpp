@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/backend/batch_task.h"
+#include "nexus/backend/output_pool.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+
+// These tests replace the global operator new to count allocations, so they
+// run in their own executable instead of in runtest.
+
+namespace {
+
+// Counts heap allocations made by the current thread while enabled.
+thread_local bool count_allocations = false;
+thread_local size_t num_allocations = 0;
+
+void* CountedAlloc(size_t size, size_t alignment) {
+  if (count_allocations) {
+    ++num_allocations;
+  }
+  size = size ? size : 1;
+  if (alignment > alignof(std::max_align_t)) {
+    // aligned_alloc needs a size that is a multiple of the alignment.
+    return std::aligned_alloc(alignment,
+                              (size + alignment - 1) / alignment * alignment);
+  }
+  return std::malloc(size);
+}
+
+void* CountedNew(size_t size, size_t alignment) {
+  void* ptr = CountedAlloc(size, alignment);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+// All replacements allocate with malloc or aligned_alloc and release with
+// free, so every new and delete form pairs with every other.
+void* operator new(size_t size) {
+  return CountedNew(size, alignof(std::max_align_t));
+}
+void* operator new[](size_t size) {
+  return CountedNew(size, alignof(std::max_align_t));
+}
+void* operator new(size_t size, std::align_val_t al) {
+  return CountedNew(size, static_cast<size_t>(al));
+}
+void* operator new[](size_t size, std::align_val_t al) {
+  return CountedNew(size, static_cast<size_t>(al));
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAlloc(size, alignof(std::max_align_t));
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return CountedAlloc(size, alignof(std::max_align_t));
+}
+void* operator new(size_t size, std::align_val_t al,
+                   const std::nothrow_t&) noexcept {
+  return CountedAlloc(size, static_cast<size_t>(al));
+}
+void* operator new[](size_t size, std::align_val_t al,
+                     const std::nothrow_t&) noexcept {
+  return CountedAlloc(size, static_cast<size_t>(al));
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+
+namespace nexus {
+namespace backend {
+namespace {
+
+constexpr uint32_t kMaxBatch = 8;
+constexpr size_t kInputSize = 2;
+
+class AllocationCounter {
+ public:
+  AllocationCounter() {
+    num_allocations = 0;
+    count_allocations = true;
+  }
+  ~AllocationCounter() { count_allocations = false; }
+  size_t count() const { return num_allocations; }
+};
+
+class OutputArrayPoolAllocTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+    pool_ = std::make_unique<OutputArrayPool>(
+        std::unordered_map<std::string, size_t>{{"prob", 10}, {"feat", 3}},
+        kMaxBatch, cpu);
+    input_array_ =
+        std::make_shared<Array>(DT_FLOAT, kMaxBatch * kInputSize, cpu);
+    for (uint32_t i = 0; i < kMaxBatch; ++i) {
+      auto task = std::make_shared<Task>();
+      task->AppendInput(std::make_shared<Array>(DT_FLOAT, kInputSize, cpu));
+      tasks_.push_back(task);
+    }
+  }
+
+  std::shared_ptr<BatchTask> MakeBatchTask(uint32_t batch_size) {
+    auto batch_task = std::make_shared<BatchTask>(kMaxBatch);
+    batch_task->SetInputArray(input_array_);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      batch_task->AppendInput(tasks_[i]->inputs[0], tasks_[i]);
+    }
+    return batch_task;
+  }
+
+  std::unique_ptr<OutputArrayPool> pool_;
+  std::shared_ptr<Array> input_array_;
+  std::vector<std::shared_ptr<Task>> tasks_;
+};
+
+TEST_F(OutputArrayPoolAllocTest, SlicingDoesNotAllocateOnceWarm) {
+  // Warm up the pool and the per-query output slots.
+  {
+    auto batch_task = MakeBatchTask(kMaxBatch);
+    batch_task->SetBatchOutput(pool_->Acquire());
+    batch_task->SliceOutputBatch();
+  }
+  auto batch_task = MakeBatchTask(kMaxBatch);
+  size_t allocations;
+  {
+    AllocationCounter counter;
+    batch_task->SetBatchOutput(pool_->Acquire());
+    batch_task->SliceOutputBatch();
+    allocations = counter.count();
+  }
+  // Only the vector holding the outputs of the batch is allocated.
+  EXPECT_LE(allocations, 1);
+  EXPECT_EQ(pool_->num_allocated(), 1);
+}
+
+TEST_F(OutputArrayPoolAllocTest, UnpooledSlicingAllocatesPerQuery) {
+  auto batch_task = MakeBatchTask(kMaxBatch);
+  size_t allocations;
+  {
+    AllocationCounter counter;
+    batch_task->CreateOutputArrays({{"prob", 10}, {"feat", 3}},
+                                   DeviceManager::Singleton().GetCPUDevice());
+    batch_task->SliceOutputBatch(
+        {{"prob", Slice(kMaxBatch, 10)}, {"feat", Slice(kMaxBatch, 3)}});
+    allocations = counter.count();
+  }
+  EXPECT_GT(allocations, kMaxBatch * 2);
+}
+
+}  // namespace
+}  // namespace backend
+}  // namespace nexus
@@ -0,0 +1,119 @@
+#include "nexus/backend/output_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/backend/batch_task.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+
+namespace nexus {
+namespace backend {
+namespace {
+
+constexpr uint32_t kMaxBatch = 8;
+constexpr size_t kInputSize = 2;
+
+class OutputArrayPoolTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+    pool_ = std::make_unique<OutputArrayPool>(
+        std::unordered_map<std::string, size_t>{{"prob", 10}, {"feat", 3}},
+        kMaxBatch, cpu);
+    input_array_ =
+        std::make_shared<Array>(DT_FLOAT, kMaxBatch * kInputSize, cpu);
+    for (uint32_t i = 0; i < kMaxBatch; ++i) {
+      auto task = std::make_shared<Task>();
+      task->AppendInput(std::make_shared<Array>(DT_FLOAT, kInputSize, cpu));
+      tasks_.push_back(task);
+    }
+  }
+
+  std::shared_ptr<BatchTask> MakeBatchTask(uint32_t batch_size) {
+    auto batch_task = std::make_shared<BatchTask>(kMaxBatch);
+    batch_task->SetInputArray(input_array_);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      batch_task->AppendInput(tasks_[i]->inputs[0], tasks_[i]);
+    }
+    return batch_task;
+  }
+
+  std::unique_ptr<OutputArrayPool> pool_;
+  std::shared_ptr<Array> input_array_;
+  std::vector<std::shared_ptr<Task>> tasks_;
+};
+
+TEST_F(OutputArrayPoolTest, OutputsAreIndexedByName) {
+  ASSERT_EQ(pool_->num_outputs(), 2);
+  EXPECT_EQ(pool_->output_name(0), "feat");
+  EXPECT_EQ(pool_->output_name(1), "prob");
+  EXPECT_EQ(pool_->GetOutputIndex("prob"), 1);
+  EXPECT_EQ(pool_->output_size(1), 10);
+  EXPECT_EQ(pool_->GetOutputIndex("none"), -1);
+}
+
+TEST_F(OutputArrayPoolTest, BatchOutputIsRecycled) {
+  auto first = pool_->Acquire();
+  auto* first_ptr = first.get();
+  auto second = pool_->Acquire();
+  EXPECT_NE(first_ptr, second.get());
+  EXPECT_EQ(pool_->num_allocated(), 2);
+  first.reset();
+  EXPECT_EQ(pool_->Acquire().get(), first_ptr);
+  EXPECT_EQ(pool_->num_allocated(), 2);
+}
+
+TEST_F(OutputArrayPoolTest, OutputKeepsBatchOutputInUse) {
+  auto batch_task = MakeBatchTask(3);
+  batch_task->SetBatchOutput(pool_->Acquire());
+  batch_task->SliceOutputBatch();
+  auto output = batch_task->outputs()[1];
+  batch_task.reset();
+  // The sliced output still references the batch output.
+  auto other = pool_->Acquire();
+  EXPECT_EQ(pool_->num_allocated(), 2);
+  output.reset();
+  other.reset();
+  pool_->Acquire();
+  EXPECT_EQ(pool_->num_allocated(), 2);
+}
+
+TEST_F(OutputArrayPoolTest, SliceEvenly) {
+  auto batch_task = MakeBatchTask(3);
+  batch_task->SetBatchOutput(pool_->Acquire());
+  float* prob = batch_task->GetOutputArray("prob")->Data<float>();
+  for (size_t i = 0; i < 3 * 10; ++i) {
+    prob[i] = static_cast<float>(i);
+  }
+  batch_task->SliceOutputBatch();
+  const auto& outputs = batch_task->outputs();
+  ASSERT_EQ(outputs.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(outputs[i]->task_id, tasks_[i]->task_id);
+    EXPECT_EQ(outputs[i]->index, 0);
+    EXPECT_EQ(outputs[i]->NumElements(1), 10);
+    EXPECT_EQ(outputs[i]->Data(1)[0], static_cast<float>(i * 10));
+    EXPECT_EQ(outputs[i]->NumElements(0), 3);
+  }
+}
+
+TEST_F(OutputArrayPoolTest, SliceByNameFillsViewsAndArrays) {
+  auto batch_task = MakeBatchTask(2);
+  batch_task->SetBatchOutput(pool_->Acquire());
+  batch_task->GetOutputArray("feat")->Data<float>()[3] = 42.f;
+  batch_task->SliceOutputBatch({{"prob", Slice(2, 10)}, {"feat", Slice(2, 3)}});
+  const auto& output = batch_task->outputs()[1];
+  EXPECT_EQ(output->Data(0)[0], 42.f);
+  EXPECT_EQ(output->arrays.at("feat")->Data<float>()[0], 42.f);
+  EXPECT_EQ(output->arrays.at("prob")->num_elements(), 10);
+}
+
+}  // namespace
+}  // namespace backend
+}  // namespace nexus
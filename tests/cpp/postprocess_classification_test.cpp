@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "nexus/backend/utils.h"
+
+namespace nexus {
+namespace backend {
+namespace {
+
+std::vector<std::pair<float, uint32_t>> ReferenceTopK(
+    const std::vector<float>& prob, uint32_t k, float threshold) {
+  std::vector<std::pair<float, uint32_t>> all;
+  for (uint32_t i = 0; i < prob.size(); ++i) {
+    if (prob[i] > threshold) {
+      all.emplace_back(prob[i], i);
+    }
+  }
+  std::sort(all.begin(), all.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.first > rhs.first ||
+           (lhs.first == rhs.first && lhs.second < rhs.second);
+  });
+  if (all.size() > k) {
+    all.resize(k);
+  }
+  return all;
+}
+
+TEST(SelectTopKTest, MatchesReferenceSort) {
+  std::mt19937 gen(0xabcdabcd987LL);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+  // Few distinct values to exercise ties.
+  std::uniform_int_distribution<int> coarse(0, 7);
+  std::vector<std::pair<float, uint32_t>> top;
+  for (size_t n : {0, 1, 3, 15, 16, 17, 100, 1000, 1001, 20000}) {
+    for (uint32_t k : {1, 2, 5, 10, 50}) {
+      for (float threshold : {0.f, 0.5f, 0.99f}) {
+        for (bool ties : {false, true}) {
+          std::vector<float> prob(n);
+          for (auto& p : prob) {
+            p = ties ? coarse(gen) / 7.f : uniform(gen);
+          }
+          SelectTopK(prob.data(), n, k, threshold, &top);
+          EXPECT_EQ(top, ReferenceTopK(prob, k, threshold))
+              << "n=" << n << " k=" << k << " threshold=" << threshold
+              << " ties=" << ties;
+        }
+      }
+    }
+  }
+}
+
+TEST(SelectTopKTest, AscendingAndDescendingInputs) {
+  constexpr size_t kNumClasses = 1000;
+  std::vector<float> ascending(kNumClasses), descending(kNumClasses);
+  for (size_t i = 0; i < kNumClasses; ++i) {
+    ascending[i] = float(i) / kNumClasses;
+    descending[i] = float(kNumClasses - i) / kNumClasses;
+  }
+  std::vector<std::pair<float, uint32_t>> top;
+  SelectTopK(ascending.data(), kNumClasses, 3, 0.f, &top);
+  EXPECT_EQ(top, ReferenceTopK(ascending, 3, 0.f));
+  SelectTopK(descending.data(), kNumClasses, 3, 0.f, &top);
+  EXPECT_EQ(top, ReferenceTopK(descending, 3, 0.f));
+}
+
+TEST(SelectTopKTest, NothingAboveThreshold) {
+  std::vector<float> prob(100, 0.f);
+  std::vector<std::pair<float, uint32_t>> top;
+  SelectTopK(prob.data(), prob.size(), 5, 0.f, &top);
+  EXPECT_TRUE(top.empty());
+}
+
+TEST(SelectTopKTest, KAboveNumberOfClasses) {
+  std::vector<float> prob = {0.1f, 0.4f, 0.2f, 0.3f};
+  std::vector<std::pair<float, uint32_t>> top;
+  SelectTopK(prob.data(), prob.size(), UINT32_MAX, 0.f, &top);
+  EXPECT_EQ(top, ReferenceTopK(prob, UINT32_MAX, 0.f));
+  EXPECT_LE(top.capacity(), prob.size());
+}
+
+TEST(ParseClassificationOptionsTest, Defaults) {
+  QueryProto query;
+  auto options = ParseClassificationOptions(query);
+  EXPECT_EQ(options.fields, kAllClassificationFields);
+  EXPECT_EQ(options.topk, 1);
+  EXPECT_EQ(options.threshold, 0.f);
+}
+
+TEST(ParseClassificationOptionsTest, FieldsTopKAndThreshold) {
+  QueryProto query;
+  query.add_output_field("class_prob");
+  query.add_output_field("unknown");
+  query.set_topk(3);
+  auto* filter = query.add_filter();
+  filter->set_name("class_prob");
+  filter->set_data_type(DT_FLOAT);
+  filter->set_f(0.25f);
+  auto options = ParseClassificationOptions(query);
+  EXPECT_EQ(options.fields, kClassProb);
+  EXPECT_EQ(options.topk, 3);
+  EXPECT_EQ(options.threshold, 0.25f);
+}
+
+TEST(PostprocessClassificationTest, TopKRecords) {
+  QueryProto query;
+  query.add_output_field("class_id");
+  query.add_output_field("class_name");
+  query.set_topk(2);
+  std::unordered_map<int, std::string> classnames = {
+      {0, "cat"}, {1, "dog"}, {2, "bird"}, {3, "fish"}};
+  std::vector<float> prob = {0.1f, 0.5f, 0.05f, 0.35f};
+  QueryResultProto result;
+  PostprocessClassification(query, prob.data(), prob.size(), &result,
+                            &classnames);
+  ASSERT_EQ(result.output_size(), 2);
+  const auto& first = result.output(0);
+  ASSERT_EQ(first.named_value_size(), 2);
+  EXPECT_EQ(first.named_value(0).name(), "class_id");
+  EXPECT_EQ(first.named_value(0).i(), 1);
+  EXPECT_EQ(first.named_value(1).name(), "class_name");
+  EXPECT_EQ(first.named_value(1).s(), "dog");
+  EXPECT_EQ(result.output(1).named_value(0).i(), 3);
+}
+
+TEST(PostprocessClassificationTest, DefaultIsArgmaxWithAllFields) {
+  QueryProto query;
+  std::vector<float> prob = {0.2f, 0.7f, 0.7f, 0.1f};
+  QueryResultProto result;
+  PostprocessClassification(query, prob.data(), prob.size(), &result);
+  ASSERT_EQ(result.output_size(), 1);
+  const auto& record = result.output(0);
+  ASSERT_EQ(record.named_value_size(), 3);
+  EXPECT_EQ(record.named_value(0).i(), 1);
+  EXPECT_EQ(record.named_value(1).f(), 0.7f);
+}
+
+}  // namespace
+}  // namespace backend
+}  // namespace nexus
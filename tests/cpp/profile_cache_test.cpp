@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "nexus/common/model_db.h"
+#include "nexus/common/profile_cache.h"
+
+namespace nexus {
+namespace {
+
+namespace fs = boost::filesystem;
+
+std::string ProfileText(const std::string& profile_id,
+                        const std::string& gpu_uuid, double base_us,
+                        int max_batch) {
+  std::string text = profile_id + "\nTITAN_X\n" + gpu_uuid +
+                     "\nForward latency\n"
+                     "batch,latency(us),std(us),static memory(B),"
+                     "peak memory(B),repeat\n";
+  for (int batch = 1; batch <= max_batch; ++batch) {
+    text += std::to_string(batch) + "," + std::to_string(base_us * batch) +
+            ",1.5,1000," + std::to_string(2000 * batch) + ",20\n";
+  }
+  text +=
+      "Preprocess latency (mean,std,repeat)\n"
+      "100.25,2.5,20\n"
+      "Postprocess latency (mean,std,repeat)\n"
+      "50.5,1,20\n";
+  return text;
+}
+
+class ProfileCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/profile_cache_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    cache_path_ = dir_ + "/profiles.cache";
+    for (int i = 0; i < 3; ++i) {
+      WriteProfile(i, ProfileText("tensorflow:model_" + std::to_string(i),
+                                  "generic", 1000 * (i + 1), 4));
+    }
+  }
+
+  void TearDown() override { fs::remove_all(dir_); }
+
+  std::string ProfilePath(int i) const {
+    return dir_ + "/profile_" + std::to_string(i) + ".txt";
+  }
+
+  void WriteProfile(int i, const std::string& text) {
+    std::ofstream fout(ProfilePath(i), std::ios::trunc);
+    fout << text;
+  }
+
+  /*! \brief Set the mtime of a profile to a second since the epoch. */
+  void SetMtime(int i, time_t sec) {
+    struct timespec times[2] = {{sec, 0}, {sec, 0}};
+    ASSERT_EQ(utimensat(AT_FDCWD, ProfilePath(i).c_str(), times, 0), 0);
+  }
+
+  std::vector<ProfileSource> Sources(int n) const {
+    std::vector<ProfileSource> sources(n);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_TRUE(ProfileSource::Stat(ProfilePath(i), &sources[i]));
+    }
+    return sources;
+  }
+
+  void CorruptCache(size_t offset) {
+    std::fstream f(cache_path_, std::ios::in | std::ios::out);
+    f.seekg(offset);
+    char c = f.get();
+    f.seekp(offset);
+    f.put(c ^ 0x5a);
+  }
+
+  std::string dir_;
+  std::string cache_path_;
+};
+
+TEST_F(ProfileCacheTest, ParseProfileText) {
+  RawProfile profile;
+  ASSERT_TRUE(ParseProfileText(ProfileText("caffe:vgg16:1", "GPU-1", 10, 3),
+                               &profile));
+  EXPECT_EQ(profile.profile_id, "caffe:vgg16:1");
+  EXPECT_EQ(profile.gpu_device_name, "TITAN_X");
+  EXPECT_EQ(profile.gpu_uuid, "GPU-1");
+  ASSERT_EQ(profile.forward.size(), 3);
+  EXPECT_DOUBLE_EQ(profile.forward[2].latency_mean, 30);
+  EXPECT_DOUBLE_EQ(profile.forward[2].latency_std, 1.5);
+  EXPECT_EQ(profile.forward[2].static_memory, 1000);
+  EXPECT_EQ(profile.forward[2].memory_usage, 6000);
+  EXPECT_EQ(profile.forward[2].repeat, 20);
+  EXPECT_DOUBLE_EQ(profile.preprocess.latency_mean, 100.25);
+  EXPECT_DOUBLE_EQ(profile.postprocess.latency_std, 1);
+
+  auto text = ProfileText("caffe:vgg16:1", "GPU-1", 10, 3);
+  auto skipped = text;
+  skipped.replace(skipped.find("\n2,"), 3, "\n3,");
+  EXPECT_FALSE(ParseProfileText(skipped, &profile));
+  EXPECT_FALSE(ParseProfileText(text.substr(0, text.size() / 2), &profile));
+  auto bad_number = text;
+  bad_number.replace(bad_number.find("100.25"), 6, "100.x5");
+  EXPECT_FALSE(ParseProfileText(bad_number, &profile));
+}
+
+TEST_F(ProfileCacheTest, BuildThenMap) {
+  auto cache = ProfileCache::Load(Sources(3), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 3);
+  EXPECT_FALSE(cache->mapped());
+
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 0);
+  EXPECT_TRUE(cache->mapped());
+  ASSERT_EQ(cache->entries().size(), 3);
+  EXPECT_EQ(cache->entries()[1].profile_id, "tensorflow:model_1");
+  auto profile = cache->Read(1);
+  ASSERT_EQ(profile.forward.size(), 4);
+  EXPECT_DOUBLE_EQ(profile.forward[3].latency_mean, 8000);
+  EXPECT_DOUBLE_EQ(profile.preprocess.latency_mean, 100.25);
+  EXPECT_DOUBLE_EQ(profile.postprocess.latency_mean, 50.5);
+}
+
+TEST_F(ProfileCacheTest, WithoutFile) {
+  auto cache = ProfileCache::Load(Sources(3), "");
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 3);
+  EXPECT_EQ(cache->Read(2).forward[0].latency_mean, 3000);
+  EXPECT_FALSE(fs::exists(cache_path_));
+}
+
+TEST_F(ProfileCacheTest, ContentChanged) {
+  ASSERT_NE(ProfileCache::Load(Sources(3), cache_path_), nullptr);
+  WriteProfile(1, ProfileText("tensorflow:model_1", "generic", 1234, 5));
+  SetMtime(1, 1000);
+  auto cache = ProfileCache::Load(Sources(3), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 1);
+  EXPECT_EQ(cache->Read(1).forward.size(), 5);
+  EXPECT_DOUBLE_EQ(cache->Read(1).forward[0].latency_mean, 1234);
+
+  // Same size, so only the mtime tells that the content changed.
+  WriteProfile(1, ProfileText("tensorflow:model_1", "generic", 4321, 5));
+  SetMtime(1, 2000);
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  EXPECT_EQ(cache->num_parsed(), 1);
+  EXPECT_DOUBLE_EQ(cache->Read(1).forward[0].latency_mean, 4321);
+
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  EXPECT_TRUE(cache->mapped());
+}
+
+TEST_F(ProfileCacheTest, TouchedButUnchanged) {
+  ASSERT_NE(ProfileCache::Load(Sources(3), cache_path_), nullptr);
+  SetMtime(2, 1000);
+  auto cache = ProfileCache::Load(Sources(3), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 0);
+  EXPECT_FALSE(cache->mapped());
+  EXPECT_DOUBLE_EQ(cache->Read(2).forward[0].latency_mean, 3000);
+
+  // The new mtime is in the rewritten cache.
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  EXPECT_TRUE(cache->mapped());
+}
+
+TEST_F(ProfileCacheTest, SourcesAddedAndRemoved) {
+  ASSERT_NE(ProfileCache::Load(Sources(3), cache_path_), nullptr);
+  WriteProfile(3, ProfileText("tensorflow:model_3", "generic", 500, 2));
+  auto cache = ProfileCache::Load(Sources(4), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 1);
+  EXPECT_EQ(cache->entries().size(), 4);
+
+  cache = ProfileCache::Load(Sources(2), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 0);
+  EXPECT_FALSE(cache->mapped());
+  EXPECT_EQ(cache->entries().size(), 2);
+}
+
+TEST_F(ProfileCacheTest, InvalidCacheIsRebuilt) {
+  ASSERT_NE(ProfileCache::Load(Sources(3), cache_path_), nullptr);
+  // A byte of the payload.
+  CorruptCache(100);
+  auto cache = ProfileCache::Load(Sources(3), cache_path_);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->num_parsed(), 3);
+
+  // The format version follows the 8-byte magic.
+  CorruptCache(8);
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  EXPECT_EQ(cache->num_parsed(), 3);
+
+  fs::resize_file(cache_path_, 16);
+  cache = ProfileCache::Load(Sources(3), cache_path_);
+  EXPECT_EQ(cache->num_parsed(), 3);
+  EXPECT_TRUE(ProfileCache::Load(Sources(3), cache_path_)->mapped());
+}
+
+TEST_F(ProfileCacheTest, MalformedSource) {
+  WriteProfile(0, "not a profile\n");
+  EXPECT_EQ(ProfileCache::Load(Sources(3), cache_path_), nullptr);
+}
+
+TEST_F(ProfileCacheTest, ModelDatabaseLoadsLazily) {
+  fs::create_directories(dir_ + "/root/store");
+  fs::create_directories(dir_ + "/root/db");
+  fs::create_directories(dir_ + "/root/profiles/TITAN_X");
+  {
+    std::ofstream fout(dir_ + "/root/db/model_db.yml");
+    fout << "models: []\nshare_prefix: []\ntf_share: []\n";
+  }
+  auto profile_dir = dir_ + "/root/profiles/TITAN_X/";
+  for (auto uuid : {"GPU-0", "GPU-1"}) {
+    std::ofstream fout(profile_dir + uuid + ".txt");
+    fout << ProfileText("tensorflow:resnet_0:1", uuid,
+                        uuid[4] == '0' ? 1000 : 1100, 8);
+  }
+  ModelProfile expected_generic(profile_dir + "GPU-0.txt");
+  expected_generic.MergeProfile(ModelProfile(profile_dir + "GPU-1.txt"));
+  ModelProfile expected_gpu1(profile_dir + "GPU-1.txt");
+
+  for (int run = 0; run < 2; ++run) {
+    ModelDatabase db(dir_ + "/root");
+    EXPECT_TRUE(fs::exists(dir_ + "/root/profiles.cache"));
+    auto* generic =
+        db.GetModelProfile("TITAN_X", "generic", "tensorflow:resnet_0:1");
+    ASSERT_NE(generic, nullptr);
+    EXPECT_EQ(generic, db.GetModelProfile("TITAN_X", "generic",
+                                          "tensorflow:resnet_0:1"));
+    auto* gpu1 =
+        db.GetModelProfile("TITAN_X", "GPU-1", "tensorflow:resnet_0:1");
+    ASSERT_NE(gpu1, nullptr);
+    // The mirror of version 1 of a model is version 0.
+    EXPECT_EQ(gpu1, db.GetModelProfile("TITAN_X", "GPU-1",
+                                       "tensorflow:resnet_1:1"));
+    for (uint32_t batch = 1; batch <= 8; ++batch) {
+      EXPECT_DOUBLE_EQ(generic->GetForwardLatency(batch),
+                       expected_generic.GetForwardLatency(batch));
+      EXPECT_DOUBLE_EQ(gpu1->GetForwardLatency(batch),
+                       expected_gpu1.GetForwardLatency(batch));
+    }
+    EXPECT_EQ(db.GetModelProfile("TITAN_X", "GPU-1", "tensorflow:vgg:1"),
+              nullptr);
+  }
+}
+
+}  // namespace
+}  // namespace nexus
@@ -0,0 +1,373 @@
+#include "nexus/dispatcher/rankmt/scheduler.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ario/ario.h"
+#include "nexus/common/model_def.h"
+#include "nexus/common/time_util.h"
+#include "nexus/dispatcher/backend_delegate.h"
+#include "nexus/dispatcher/frontend_delegate.h"
+#include "test_model_db.h"
+
+DECLARE_bool(dispatcher_prefix_batch);
+DECLARE_double(hack_rpsmeter);
+
+namespace nexus {
+namespace dispatcher {
+namespace rankmt {
+namespace {
+
+constexpr uint32_t kFrontendId = 100;
+constexpr auto kWaitTimeout = std::chrono::seconds(2);
+/*! \brief Longer than the SLAs, so each round is planned or dropped by then. */
+constexpr auto kRoundTimeout = std::chrono::milliseconds(200);
+constexpr int kMaxRounds = 10;
+
+/*! \brief Forward of a batch of b takes 1000 * b + 2000 us. */
+constexpr const char* kSleepFramework = "sleep#1000,2000,0,0";
+/*! \brief Same cost, but the first half of the forward is the prefix. */
+constexpr const char* kPrefixFramework = "sleep#1000,2000,0,0,50";
+
+/*! \brief Records the batch plans that the dispatcher sends. */
+class FakeBackend : public BackendDelegate {
+ public:
+  explicit FakeBackend(uint32_t node_id)
+      : BackendDelegate(node_id, "FakeGPU", "FakeUUID", 0) {}
+
+  void Tick() override {}
+  void SendLoadModelCommand(const ModelSession& model_session,
+                            uint32_t max_batch,
+                            ModelIndex model_index) override {}
+  void EnqueueBatchPlan(BatchPlanProto&& plan) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      plans_.push_back(std::move(plan));
+    }
+    cv_.notify_all();
+  }
+
+  /*! \brief Wait until the backend got num_plans plans in total. */
+  bool WaitPlans(size_t num_plans,
+                 std::chrono::milliseconds timeout = kWaitTimeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout,
+                        [&] { return plans_.size() >= num_plans; });
+  }
+
+  std::vector<BatchPlanProto> plans() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return plans_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<BatchPlanProto> plans_;
+};
+
+/*! \brief Records the queries that the dispatcher drops. */
+class FakeFrontend : public FrontendDelegate {
+ public:
+  FakeFrontend() : FrontendDelegate(kFrontendId) {}
+
+  void Tick() override {}
+  void UpdateBackendList(BackendListUpdates&& request) override {}
+  void MarkQueriesDroppedByDispatcher(DispatchReply&& reply) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& query : reply.query_list()) {
+        dropped_.insert(query.query_id());
+      }
+    }
+    cv_.notify_all();
+  }
+
+  bool WaitDropped(uint64_t query_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, kWaitTimeout,
+                        [&] { return dropped_.count(query_id) > 0; });
+  }
+
+  bool IsDropped(uint64_t query_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_.count(query_id) > 0;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::unordered_set<uint64_t> dropped_;
+};
+
+/*!
+ * \brief Runs the scheduler, its RankThread and its ModelThreads on one
+ *   event loop, with fake backends and a fake frontend.
+ */
+class RankmtSchedulerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    UseTestModelDatabase();
+    // ModelThread sizes batches for this request rate.
+    hack_rpsmeter_ = FLAGS_hack_rpsmeter;
+    FLAGS_hack_rpsmeter = 100;
+    prefix_batch_ = FLAGS_dispatcher_prefix_batch;
+    executor_ =
+        std::make_unique<ario::EpollExecutor>(ario::PollerType::kSpinning);
+    scheduler_ = std::make_unique<MultiThreadRankScheduler>(executor_.get(),
+                                                            executor_.get());
+    frontend_ = std::make_shared<FakeFrontend>();
+    scheduler_->AddFrontend(NodeId(kFrontendId), frontend_);
+  }
+
+  void TearDown() override {
+    if (thread_.joinable()) {
+      scheduler_->Stop();
+      executor_->StopEventLoop();
+      thread_.join();
+    }
+    scheduler_.reset();
+    FLAGS_hack_rpsmeter = hack_rpsmeter_;
+    FLAGS_dispatcher_prefix_batch = prefix_batch_;
+  }
+
+  std::shared_ptr<FakeBackend> AddBackend(uint32_t node_id) {
+    auto backend = std::make_shared<FakeBackend>(node_id);
+    scheduler_->AddBackend(NodeId(node_id), backend);
+    return backend;
+  }
+
+  static ModelSession MakeModelSession(
+      const std::string& model_name, uint32_t latency_sla_ms,
+      const std::string& framework = kSleepFramework) {
+    ModelSession model_session;
+    model_session.set_framework(framework);
+    model_session.set_model_name(model_name);
+    model_session.set_version(1);
+    model_session.set_latency_sla(latency_sla_ms);
+    return model_session;
+  }
+
+  MultiThreadRankScheduler::RequestEntrance AddModelSession(
+      const std::string& model_name, uint32_t latency_sla_ms,
+      const std::string& framework = kSleepFramework) {
+    return scheduler_->AddModelSession(
+        executor_.get(),
+        MakeModelSession(model_name, latency_sla_ms, framework));
+  }
+
+  void Start() {
+    thread_ = std::thread([this] { executor_->RunEventLoop(); });
+  }
+
+  static DispatchRequest MakeDispatchRequest(ModelIndex model_index,
+                                             uint64_t query_id) {
+    DispatchRequest request;
+    request.set_model_index(model_index.t);
+    request.set_query_id(query_id);
+    auto* query = request.mutable_query_without_input();
+    query->set_query_id(query_id);
+    query->set_model_index(model_index.t);
+    query->set_global_id(query_id);
+    query->set_frontend_id(kFrontendId);
+    query->mutable_clock()->set_frontend_recv_ns(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch())
+            .count());
+    return request;
+  }
+
+  /*! \brief Dispatch a query to the entrance on the event loop. */
+  void EnqueueQuery(MultiThreadRankScheduler::RequestEntrance entrance,
+                    ModelIndex model_index, uint64_t query_id) {
+    EnqueueQueries({{entrance, MakeDispatchRequest(model_index, query_id)}});
+  }
+
+  /*!
+   * \brief Dispatch the requests in one event loop callback, so that no plan
+   *   is granted in between.
+   */
+  void EnqueueQueries(
+      std::vector<std::pair<MultiThreadRankScheduler::RequestEntrance,
+                            DispatchRequest>>
+          requests) {
+    executor_->PostBigCallback(
+        [requests = std::move(requests)](ario::ErrorCode) mutable {
+          for (auto& [entrance, request] : requests) {
+            EXPECT_EQ(entrance.EnqueueQuery(std::move(request)), CTRL_OK);
+          }
+        },
+        ario::ErrorCode::kOk);
+  }
+
+  /*!
+   * \brief Call enqueue_round(round) for rounds 0, 1, ... until the backend
+   *   gets a plan of all queries_per_round queries of the round, and return
+   *   the round, or -1. The plan of a batch is sent at the latest time that
+   *   meets its deadline, so a stalled event loop drops queries of the batch
+   *   instead, and the next round retries.
+   */
+  template <typename EnqueueRoundFn>
+  int EnqueueUntilPlanned(FakeBackend& backend, EnqueueRoundFn&& enqueue_round,
+                          int queries_per_round = 1) {
+    for (int round = 0; round < kMaxRounds; ++round) {
+      auto num_plans = backend.plans().size();
+      enqueue_round(round);
+      if (backend.WaitPlans(num_plans + 1, kRoundTimeout) &&
+          backend.plans().back().queries_size() == queries_per_round) {
+        return round;
+      }
+    }
+    return -1;
+  }
+
+  std::unique_ptr<ario::EpollExecutor> executor_;
+  std::unique_ptr<MultiThreadRankScheduler> scheduler_;
+  std::shared_ptr<FakeFrontend> frontend_;
+  std::thread thread_;
+  double hack_rpsmeter_;
+  bool prefix_batch_;
+};
+
+TEST_F(RankmtSchedulerTest, GrantPlanAfterModelReady) {
+  auto backend = AddBackend(1);
+  auto entrance = AddModelSession("sleep_test", 50);
+  auto model_index = entrance.model_index();
+  Start();
+
+  // The backend has not loaded the model, so the query is dropped.
+  EnqueueQuery(entrance, model_index, 1);
+  ASSERT_TRUE(frontend_->WaitDropped(1));
+  EXPECT_TRUE(backend->plans().empty());
+
+  scheduler_->MarkBackendModelReady(NodeId(1), model_index);
+  int round = EnqueueUntilPlanned(*backend, [&](int round) {
+    EnqueueQuery(entrance, model_index, 2 + round);
+  });
+  ASSERT_GE(round, 0);
+  auto plans = backend->plans();
+  ASSERT_EQ(plans.size(), 1);
+  EXPECT_EQ(plans[0].model_index(), model_index.t);
+  ASSERT_EQ(plans[0].queries_size(), 1);
+  EXPECT_EQ(plans[0].queries(0).query_without_input().global_id(), 2 + round);
+  EXPECT_FALSE(frontend_->IsDropped(2 + round));
+}
+
+TEST_F(RankmtSchedulerTest, GrantPlanToBackendWithModelReady) {
+  auto backend1 = AddBackend(1);
+  auto backend2 = AddBackend(2);
+  auto entrance = AddModelSession("sleep_test", 50);
+  auto model_index = entrance.model_index();
+  scheduler_->MarkBackendModelReady(NodeId(2), model_index);
+  Start();
+
+  int round = EnqueueUntilPlanned(*backend2, [&](int round) {
+    EnqueueQuery(entrance, model_index, 1 + round);
+  });
+  ASSERT_GE(round, 0);
+  EXPECT_TRUE(backend1->plans().empty());
+  EXPECT_FALSE(frontend_->IsDropped(1 + round));
+}
+
+TEST_F(RankmtSchedulerTest, GroupSessionsThatSharePrefix) {
+  FLAGS_dispatcher_prefix_batch = true;
+  auto backend = AddBackend(1);
+  auto leader = AddModelSession("prefix_a", 50, kPrefixFramework);
+  auto member = AddModelSession("prefix_b", 50, kPrefixFramework);
+  EXPECT_NE(member.model_index().t, leader.model_index().t);
+  EXPECT_EQ(member.model_session().model_name(), "prefix_a");
+  scheduler_->MarkBackendModelReady(NodeId(1), leader.model_index());
+  scheduler_->MarkBackendModelReady(NodeId(1), member.model_index());
+  Start();
+
+  // Member queries have odd ids.
+  int round = EnqueueUntilPlanned(
+      *backend,
+      [&](int round) {
+        EnqueueQueries(
+            {{leader, MakeDispatchRequest(leader.model_index(), 2 * round + 2)},
+             {member,
+              MakeDispatchRequest(member.model_index(), 2 * round + 3)}});
+      },
+      2);
+  ASSERT_GE(round, 0);
+  auto plan = backend->plans().back();
+  EXPECT_EQ(plan.model_index(), leader.model_index().t);
+  for (const auto& query : plan.queries()) {
+    const auto& query_without_input = query.query_without_input();
+    EXPECT_EQ(query_without_input.global_id() / 2, round + 1);
+    if (query_without_input.global_id() % 2) {
+      EXPECT_EQ(query_without_input.model_index(), member.model_index().t);
+    } else {
+      // Leader queries take the model_index of the plan.
+      EXPECT_EQ(query_without_input.model_index(), 0);
+    }
+  }
+}
+
+TEST_F(RankmtSchedulerTest, GrantGroupPlanAfterMembersReady) {
+  FLAGS_dispatcher_prefix_batch = true;
+  auto backend1 = AddBackend(1);
+  auto backend2 = AddBackend(2);
+  auto leader = AddModelSession("prefix_a", 50, kPrefixFramework);
+  auto member = AddModelSession("prefix_b", 50, kPrefixFramework);
+  scheduler_->MarkBackendModelReady(NodeId(1), leader.model_index());
+  scheduler_->MarkBackendModelReady(NodeId(2), leader.model_index());
+  Start();
+
+  // A plan may carry member queries, so it waits for the members too.
+  EnqueueQuery(leader, leader.model_index(), 1);
+  ASSERT_TRUE(frontend_->WaitDropped(1));
+  EXPECT_TRUE(backend1->plans().empty());
+  EXPECT_TRUE(backend2->plans().empty());
+
+  scheduler_->MarkBackendModelReady(NodeId(2), member.model_index());
+  int round = EnqueueUntilPlanned(*backend2, [&](int round) {
+    EnqueueQuery(leader, leader.model_index(), 2 + round);
+  });
+  ASSERT_GE(round, 0);
+  EXPECT_TRUE(backend1->plans().empty());
+  EXPECT_FALSE(frontend_->IsDropped(2 + round));
+}
+
+TEST_F(RankmtSchedulerTest, SeparateSessionsWithoutSharedPrefix) {
+  FLAGS_dispatcher_prefix_batch = true;
+  AddBackend(1);
+  auto leader = AddModelSession("prefix_a", 50, kPrefixFramework);
+
+  // The model DB does not list prefix_c as sharing a prefix with prefix_a.
+  EXPECT_EQ(scheduler_->FindPrefixGroupLeader(
+                MakeModelSession("prefix_c", 50, kPrefixFramework)),
+            nullptr);
+  // The sessions must agree on the SLA and on the cost of the prefix.
+  EXPECT_EQ(scheduler_->FindPrefixGroupLeader(
+                MakeModelSession("prefix_b", 100, kPrefixFramework)),
+            nullptr);
+  EXPECT_EQ(scheduler_->FindPrefixGroupLeader(
+                MakeModelSession("prefix_b", 50, "sleep#1000,2000,0,0,20")),
+            nullptr);
+  auto member = MakeModelSession("prefix_b", 50, kPrefixFramework);
+  const auto* group_leader = scheduler_->FindPrefixGroupLeader(member);
+  ASSERT_NE(group_leader, nullptr);
+  EXPECT_EQ(group_leader->model_name(), "prefix_a");
+
+  // Grouping is off by default.
+  FLAGS_dispatcher_prefix_batch = false;
+  EXPECT_EQ(scheduler_->FindPrefixGroupLeader(member), nullptr);
+  auto separate = AddModelSession("prefix_b", 50, kPrefixFramework);
+  EXPECT_EQ(separate.model_session().model_name(), "prefix_b");
+}
+
+}  // namespace
+}  // namespace rankmt
+}  // namespace dispatcher
+}  // namespace nexus
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "nexus/app/rate_limiter.h"
+#include "nexus/common/token_bucket.h"
+
+namespace nexus {
+namespace app {
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+TEST(TokenBucketTest, BurstThenRate) {
+  TokenBucket bucket(100, 10);
+  auto t0 = Clock::now();
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(bucket.TryAcquire(t0));
+  }
+  EXPECT_FALSE(bucket.TryAcquire(t0));
+  EXPECT_FALSE(bucket.TryAcquire(t0 + milliseconds(5)));
+  EXPECT_TRUE(bucket.TryAcquire(t0 + milliseconds(10)));
+  EXPECT_FALSE(bucket.TryAcquire(t0 + milliseconds(10)));
+
+  // Idle time refills the bucket only up to the burst.
+  int admitted = 0;
+  for (int i = 0; i < 20; ++i) {
+    admitted += bucket.TryAcquire(t0 + std::chrono::seconds(10));
+  }
+  EXPECT_EQ(admitted, 10);
+}
+
+TEST(TokenBucketTest, Unlimited) {
+  TokenBucket bucket(0, 1);
+  auto t0 = Clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(bucket.TryAcquire(t0));
+  }
+  bucket.SetRate(1);
+  EXPECT_DOUBLE_EQ(bucket.rate(), 1);
+  EXPECT_TRUE(bucket.TryAcquire(t0));
+  EXPECT_FALSE(bucket.TryAcquire(t0));
+}
+
+TEST(TokenBucketTest, ConcurrentSessions) {
+  // Each session sends 10000 req/s for one second of simulated time, against
+  // its own limit of 1000 req/s and a limit of 2000 req/s shared by all, as
+  // the user sessions and the model sessions of a frontend.
+  constexpr int kNumSessions = 8;
+  TokenBucket model(2000, 20);
+  std::vector<std::unique_ptr<TokenBucket> > sessions;
+  for (int i = 0; i < kNumSessions; ++i) {
+    sessions.emplace_back(new TokenBucket(1000, 10));
+  }
+  std::vector<int> admitted_by_session(kNumSessions);
+  std::atomic<int> admitted_by_model{0};
+  auto t0 = Clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumSessions; ++i) {
+    threads.emplace_back([&, i] {
+      for (int step = 0; step < 10000; ++step) {
+        auto now = t0 + microseconds(step * 100);
+        if (!sessions[i]->TryAcquire(now)) {
+          continue;
+        }
+        ++admitted_by_session[i];
+        if (model.TryAcquire(now)) {
+          ++admitted_by_model;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int admitted : admitted_by_session) {
+    EXPECT_GE(admitted, 1000);
+    EXPECT_LE(admitted, 1010);
+  }
+  // Threads run at different simulated times, so the shared bucket may be
+  // refilled later than the one that runs ahead.
+  EXPECT_GE(admitted_by_model.load(), 1000);
+  EXPECT_LE(admitted_by_model.load(), 2020);
+}
+
+TEST(ModelRateLimiterTest, FixedLimit) {
+  ModelRateLimiter limiter(100, 1, false, milliseconds(1000), 0.05);
+  auto t0 = Clock::now();
+  EXPECT_TRUE(limiter.TryAcquire(t0));
+  EXPECT_FALSE(limiter.TryAcquire(t0));
+  // Drops do not change a fixed limit.
+  for (int i = 0; i < 100; ++i) {
+    limiter.OnReply(true, t0 + std::chrono::seconds(2));
+  }
+  EXPECT_NEAR(limiter.rate(), 100, 1);
+}
+
+TEST(ModelRateLimiterTest, AdaptToDrops) {
+  ModelRateLimiter limiter(0, 1, true, milliseconds(1000), 0.05);
+  auto t0 = Clock::now();
+
+  // Half of the queries in the first window are dropped.
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(limiter.TryAcquire(t0 + milliseconds(i)));
+    limiter.OnReply(i % 2 == 0, t0 + milliseconds(i));
+  }
+  EXPECT_EQ(limiter.rate(), 0);
+  limiter.OnReply(false, t0 + milliseconds(1000));
+  EXPECT_NEAR(limiter.rate(), 80, 1);
+  EXPECT_TRUE(limiter.TryAcquire(t0 + milliseconds(1000)));
+  EXPECT_FALSE(limiter.TryAcquire(t0 + milliseconds(1001)));
+
+  // No drops in the second window.
+  int admitted = 1;
+  for (int i = 1; i < 60; ++i) {
+    admitted += limiter.TryAcquire(t0 + milliseconds(1000 + i * 13));
+  }
+  EXPECT_EQ(admitted, 60);
+  limiter.OnReply(false, t0 + milliseconds(2000));
+  EXPECT_NEAR(limiter.rate(), 88, 1);
+
+  // The limit is lifted once it is far above the admitted rate.
+  limiter.OnReply(false, t0 + milliseconds(3000));
+  EXPECT_EQ(limiter.rate(), 0);
+}
+
+}  // namespace
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "nexus/app/reply_router.h"
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace app {
+namespace {
+
+std::string SerializeResult(uint64_t query_id) {
+  ControlMessage msg;
+  auto* result = msg.mutable_query_result();
+  result->set_query_id(query_id);
+  result->set_model_index(3);
+  result->set_status(CTRL_OK);
+  auto* record = result->add_output();
+  auto* value = record->add_named_value();
+  value->set_name("class_id");
+  value->set_data_type(DT_INT32);
+  value->set_i(7);
+  result->set_latency_us(1234);
+  return msg.SerializeAsString();
+}
+
+TEST(ReplyRouterTest, PeekQueryResultId) {
+  for (uint64_t query_id : {1ULL, 127ULL, 128ULL, 1ULL << 40}) {
+    auto bytes = SerializeResult(query_id);
+    uint64_t peeked = 0;
+    ASSERT_TRUE(PeekQueryResultId(bytes.data(), bytes.size(), &peeked));
+    EXPECT_EQ(peeked, query_id);
+  }
+
+  // A zero query ID is not serialized.
+  auto bytes = SerializeResult(0);
+  uint64_t peeked = 42;
+  ASSERT_TRUE(PeekQueryResultId(bytes.data(), bytes.size(), &peeked));
+  EXPECT_EQ(peeked, 0);
+}
+
+TEST(ReplyRouterTest, PeekOtherMessages) {
+  ControlMessage msg;
+  auto* reply = msg.mutable_dispatch_reply();
+  reply->set_model_index(1);
+  reply->add_query_list()->set_query_id(5);
+  auto bytes = msg.SerializeAsString();
+  uint64_t peeked;
+  EXPECT_FALSE(PeekQueryResultId(bytes.data(), bytes.size(), &peeked));
+
+  msg.mutable_update_backend_list();
+  bytes = msg.SerializeAsString();
+  EXPECT_FALSE(PeekQueryResultId(bytes.data(), bytes.size(), &peeked));
+
+  EXPECT_FALSE(PeekQueryResultId(nullptr, 0, &peeked));
+  std::string garbage("\xff\xff\xff\xff\xff", 5);
+  EXPECT_FALSE(PeekQueryResultId(garbage.data(), garbage.size(), &peeked));
+}
+
+TEST(ReplyRouterTest, RouteByQuery) {
+  ReplyRouter router(4);
+  ASSERT_EQ(router.num_result_executors(), 4);
+  for (uint64_t query_id = 1; query_id <= 8; ++query_id) {
+    auto bytes = SerializeResult(query_id);
+    auto bytes_again = SerializeResult(query_id);
+    auto* executor = &router.Route(bytes.data(), bytes.size());
+    EXPECT_NE(executor, &router.control_executor());
+    EXPECT_EQ(executor, &router.Route(bytes_again.data(), bytes_again.size()));
+    auto next = SerializeResult(query_id + 1);
+    EXPECT_NE(executor, &router.Route(next.data(), next.size()));
+  }
+
+  ControlMessage msg;
+  msg.mutable_dispatch_reply()->set_model_index(1);
+  auto bytes = msg.SerializeAsString();
+  EXPECT_EQ(&router.Route(bytes.data(), bytes.size()),
+            &router.control_executor());
+}
+
+}  // namespace
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,159 @@
+#include "nexus/app/result_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace app {
+namespace {
+
+QueryResultProto Result(uint64_t qid, const std::string& label) {
+  QueryResultProto result;
+  result.set_query_id(qid);
+  result.set_status(CTRL_OK);
+  auto* value = result.add_output()->add_named_value();
+  value->set_name("name");
+  value->set_data_type(DT_STRING);
+  value->set_s(label);
+  return result;
+}
+
+ValueProto Image(const std::string& data) {
+  ValueProto input;
+  input.set_data_type(DT_IMAGE);
+  input.mutable_image()->set_data(data);
+  return input;
+}
+
+TEST(ResultCacheTest, KeyDependsOnInputAndOutputs) {
+  uint64_t a = HashInput(Image("frame a"));
+  EXPECT_EQ(a, HashInput(Image("frame a")));
+  EXPECT_NE(a, HashInput(Image("frame b")));
+  EXPECT_EQ(ResultCache::Key(a, {}, 1, {}), ResultCache::Key(a, {}, 1, {}));
+  EXPECT_NE(ResultCache::Key(a, {}, 1, {}), ResultCache::Key(a, {}, 5, {}));
+  EXPECT_NE(ResultCache::Key(a, {}, 1, {}),
+            ResultCache::Key(a, {"name"}, 1, {}));
+}
+
+TEST(ResultCacheTest, HitAndMiss) {
+  ResultCache cache(1 << 20, std::chrono::seconds(60));
+  QueryResultProto result;
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  EXPECT_TRUE(cache.Complete(7, Result(1, "cat")).empty());
+  EXPECT_GT(cache.size_bytes(), 0);
+
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kHit);
+  ASSERT_EQ(result.output_size(), 1);
+  EXPECT_EQ(result.output(0).named_value(0).s(), "cat");
+  EXPECT_EQ(cache.Lookup(8, 3, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.num_hits(), 1);
+  EXPECT_EQ(cache.num_misses(), 2);
+}
+
+TEST(ResultCacheTest, ErrorsAreNotCached) {
+  ResultCache cache(1 << 20, std::chrono::seconds(60));
+  QueryResultProto result;
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  auto error = Result(1, "");
+  error.set_status(CTRL_DISPATCHER_DROPPED_QUERY);
+  cache.Complete(7, error);
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kMiss);
+}
+
+TEST(ResultCacheTest, EntriesExpire) {
+  ResultCache cache(1 << 20, std::chrono::milliseconds(1));
+  QueryResultProto result;
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  cache.Complete(7, Result(1, "cat"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.size_bytes(), 0);
+}
+
+TEST(ResultCacheTest, EvictLeastRecentlyUsed) {
+  // Keys 0, 16 and 32 share a shard that holds two entries.
+  ResultCache probe(1 << 20, std::chrono::seconds(60));
+  QueryResultProto result;
+  probe.Lookup(0, 0, &result);
+  probe.Complete(0, Result(0, "cat"));
+  size_t entry_bytes = probe.size_bytes();
+  ResultCache cache(entry_bytes * 2 * ResultCache::kNumShards,
+                    std::chrono::seconds(60));
+
+  for (uint64_t key : {0, 16}) {
+    EXPECT_EQ(cache.Lookup(key, key, &result), ResultCache::kMiss);
+    cache.Complete(key, Result(key, "cat"));
+  }
+  EXPECT_EQ(cache.Lookup(0, 1, &result), ResultCache::kHit);
+  EXPECT_EQ(cache.Lookup(32, 2, &result), ResultCache::kMiss);
+  cache.Complete(32, Result(2, "cat"));
+  EXPECT_EQ(cache.size_bytes(), entry_bytes * 2);
+  EXPECT_EQ(cache.Lookup(0, 3, &result), ResultCache::kHit);
+  EXPECT_EQ(cache.Lookup(32, 4, &result), ResultCache::kHit);
+  EXPECT_EQ(cache.Lookup(16, 5, &result), ResultCache::kMiss);
+}
+
+TEST(ResultCacheTest, CoalesceInflightQueries) {
+  ResultCache cache(1 << 20, std::chrono::seconds(60));
+  QueryResultProto result;
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kCoalesced);
+  EXPECT_EQ(cache.Lookup(7, 3, &result), ResultCache::kCoalesced);
+  EXPECT_EQ(cache.Lookup(8, 4, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.Complete(7, Result(1, "cat")),
+            (std::vector<uint64_t>{2, 3}));
+  EXPECT_EQ(cache.Lookup(7, 5, &result), ResultCache::kHit);
+  EXPECT_EQ(cache.num_coalesced(), 2);
+
+  // Queries coalesced into a failed query fail too, and the next one is
+  // dispatched again.
+  EXPECT_EQ(cache.Lookup(8, 6, &result), ResultCache::kCoalesced);
+  auto error = Result(4, "");
+  error.set_status(CTRL_DISPATCHER_DROPPED_QUERY);
+  EXPECT_EQ(cache.Complete(8, error), (std::vector<uint64_t>{6}));
+  EXPECT_EQ(cache.Lookup(8, 7, &result), ResultCache::kMiss);
+}
+
+TEST(ResultCacheTest, RedispatchAfterLostLeader) {
+  ResultCache cache(1 << 20, std::chrono::milliseconds(20));
+  QueryResultProto result;
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kCoalesced);
+  // Query 1 never gets a reply.
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  EXPECT_EQ(cache.Lookup(7, 3, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.Lookup(7, 4, &result), ResultCache::kCoalesced);
+  // A late reply of the lost query does not take the waiters.
+  EXPECT_TRUE(cache.Complete(7, Result(1, "cat")).empty());
+  EXPECT_EQ(cache.Complete(7, Result(3, "cat")),
+            (std::vector<uint64_t>{2, 4}));
+}
+
+TEST(ResultCacheTest, ExpireLeaderThatNeverCompletes) {
+  ResultCache cache(1 << 20, std::chrono::milliseconds(20));
+  QueryResultProto result;
+  EXPECT_TRUE(cache.ExpireInflight().empty());
+  EXPECT_EQ(cache.Lookup(7, 1, &result), ResultCache::kMiss);
+  EXPECT_EQ(cache.Lookup(7, 2, &result), ResultCache::kCoalesced);
+  EXPECT_EQ(cache.Lookup(8, 3, &result), ResultCache::kMiss);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  EXPECT_EQ(cache.Lookup(8, 4, &result), ResultCache::kMiss);
+
+  // Only the query of key 7 is given up on. Key 8 was dispatched again.
+  EXPECT_EQ(cache.ExpireInflight(), (std::vector<uint64_t>{2}));
+  EXPECT_TRUE(cache.ExpireInflight().empty());
+  EXPECT_EQ(cache.Lookup(7, 5, &result), ResultCache::kMiss);
+  EXPECT_TRUE(cache.Complete(7, Result(1, "cat")).empty());
+  EXPECT_TRUE(cache.Complete(7, Result(5, "cat")).empty());
+  EXPECT_EQ(cache.Lookup(7, 6, &result), ResultCache::kHit);
+}
+
+}  // namespace
+}  // namespace app
+}  // namespace nexus
@@ -0,0 +1,83 @@
+#include "nexus/common/sharded_map.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/typedef.h"
+
+namespace nexus {
+namespace {
+
+TEST(ShardedMapTest, InsertTake) {
+  ShardedMap<QueryId, std::unique_ptr<int>, 4> map;
+  EXPECT_TRUE(map.Insert(QueryId(1), std::make_unique<int>(10)));
+  EXPECT_TRUE(map.Insert(QueryId(5), std::make_unique<int>(50)));
+  EXPECT_FALSE(map.Insert(QueryId(1), std::make_unique<int>(11)));
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_TRUE(map.Contains(QueryId(5)));
+
+  auto value = map.Take(QueryId(1));
+  ASSERT_TRUE(value.has_value());
+  EXPECT_EQ(**value, 10);
+  // A second reply of the same query is rejected.
+  EXPECT_FALSE(map.Take(QueryId(1)).has_value());
+  EXPECT_FALSE(map.Take(QueryId(2)).has_value());
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(ShardedMapTest, ConcurrentExecuteAndReply) {
+  constexpr int kProducers = 8;
+  constexpr int kConsumers = 4;
+  constexpr uint64_t kQueriesPerProducer = 20000;
+  constexpr uint64_t kTotal = kProducers * kQueriesPerProducer;
+  ShardedMap<QueryId, uint64_t> map;
+  std::atomic<uint64_t> next_qid{0};
+  std::atomic<uint64_t> num_taken{0};
+  std::atomic<uint64_t> sum_taken{0};
+  std::vector<std::atomic<uint64_t>> published(kTotal);
+  for (auto& p : published) {
+    p.store(0, std::memory_order_relaxed);
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kProducers; ++i) {
+    threads.emplace_back([&] {
+      for (uint64_t n = 0; n < kQueriesPerProducer; ++n) {
+        auto qid = next_qid.fetch_add(1);
+        ASSERT_TRUE(map.Insert(QueryId(qid), qid + 1));
+        published[qid].store(1, std::memory_order_release);
+      }
+    });
+  }
+  // Replies race with executions. Each consumer owns the query ids that are
+  // equal to its index modulo kConsumers, and takes each exactly once.
+  for (int i = 0; i < kConsumers; ++i) {
+    threads.emplace_back([&, i] {
+      for (uint64_t qid = i; qid < kTotal; qid += kConsumers) {
+        while (published[qid].load(std::memory_order_acquire) == 0) {
+          std::this_thread::yield();
+        }
+        auto value = map.Take(QueryId(qid));
+        ASSERT_TRUE(value.has_value()) << "qid=" << qid;
+        EXPECT_EQ(*value, qid + 1);
+        EXPECT_FALSE(map.Take(QueryId(qid)).has_value());
+        num_taken.fetch_add(1);
+        sum_taken.fetch_add(*value);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(num_taken.load(), kTotal);
+  EXPECT_EQ(sum_taken.load(), kTotal * (kTotal + 1) / 2);
+  EXPECT_EQ(map.size(), 0);
+}
+
+}  // namespace
+}  // namespace nexus
@@ -0,0 +1,308 @@
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nexus/backend/batch_plan_context.h"
+#include "nexus/backend/gpu_executor.h"
+#include "nexus/backend/model_exec.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/block_queue.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+#include "nexus/common/time_util.h"
+#include "test_model_db.h"
+
+DECLARE_bool(model_profile_cache);
+DECLARE_int32(sleep_model_load_ms);
+
+namespace nexus {
+namespace backend {
+
+DECLARE_int32(backend_max_inflight_plans);
+
+namespace {
+
+#ifdef USE_GPU
+constexpr int kGpuId = 0;
+#else
+constexpr int kGpuId = -1;
+#endif
+
+/*! \brief Forward of a batch of b takes 1000 * b + 2000 us. */
+constexpr const char* kSleepFramework = "sleep#1000,2000,0,0";
+/*! \brief Same cost, but the first half of the forward is the prefix. */
+constexpr const char* kPrefixFramework = "sleep#1000,2000,0,0,50";
+
+int64_t ToNs(TimePoint time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+int64_t ElapsedMs(TimePoint start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                               start)
+      .count();
+}
+
+/*! \brief Runs SleepModels from the test model database. */
+class SleepModelTest : public testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    UseTestModelDatabase();
+    FLAGS_model_profile_cache = false;
+  }
+
+  void SetUp() override { load_ms_ = FLAGS_sleep_model_load_ms; }
+
+  void TearDown() override { FLAGS_sleep_model_load_ms = load_ms_; }
+
+  std::shared_ptr<ModelExecutor> LoadModel(
+      uint32_t model_index, uint32_t max_batch,
+      const std::string& model_name = "sleep_test",
+      const std::string& framework = kSleepFramework) {
+    ModelInstanceConfig config;
+    auto* model_session = config.add_model_session();
+    model_session->set_framework(framework);
+    model_session->set_model_name(model_name);
+    model_session->set_version(1);
+    model_session->set_latency_sla(100);
+    config.set_batch(1);
+    config.set_max_batch(max_batch);
+    return std::make_shared<ModelExecutor>(kGpuId, config,
+                                           ModelIndex(model_index),
+                                           task_queue_);
+  }
+
+  /*!
+   * \brief A plan of one query of the model, with its input ready.
+   * \param deadline Deadline of the query. No deadline if zero.
+   */
+  std::shared_ptr<BatchPlanContext> MakePlan(
+      const std::shared_ptr<ModelExecutor>& model, uint64_t plan_id,
+      TimePoint exec_time, TimePoint deadline = {}) {
+    BatchPlanProto proto;
+    proto.set_plan_id(plan_id);
+    proto.set_model_index(model->model()->model_index().t);
+    proto.set_exec_time_ns(ToNs(exec_time));
+    auto* query = proto.add_queries();
+    query->mutable_query_without_input()->set_global_id(plan_id);
+    if (deadline != TimePoint()) {
+      query->set_deadline_ns(ToNs(deadline));
+    }
+    auto plan = std::make_shared<BatchPlanContext>(std::move(proto));
+    plan->SetInputArray(model->AcquireInputArray());
+
+    auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+    auto task = std::make_shared<Task>(nullptr, model);
+    task->query.set_global_id(plan_id);
+    task->AppendInput(std::make_shared<Array>(
+        DT_FLOAT, model->model()->InputShape().NumElements(1), cpu));
+    EXPECT_TRUE(plan->AddPreprocessedTask(task));
+    return plan;
+  }
+
+  /*!
+   * \brief A due plan of the leader of a prefix group, with one query per
+   *   entry of query_models. Query i has global id i + 1.
+   */
+  std::shared_ptr<BatchPlanContext> MakePrefixGroupPlan(
+      const std::shared_ptr<ModelExecutor>& leader, uint64_t plan_id,
+      const std::vector<std::shared_ptr<ModelExecutor>>& query_models) {
+    BatchPlanProto proto;
+    proto.set_plan_id(plan_id);
+    proto.set_model_index(leader->model()->model_index().t);
+    proto.set_exec_time_ns(ToNs(Clock::now()));
+    for (size_t i = 0; i < query_models.size(); ++i) {
+      auto* query = proto.add_queries()->mutable_query_without_input();
+      query->set_global_id(i + 1);
+      if (query_models[i] != leader) {
+        query->set_model_index(query_models[i]->model()->model_index().t);
+      }
+    }
+    auto plan = std::make_shared<BatchPlanContext>(std::move(proto));
+    plan->SetInputArray(leader->AcquireInputArray());
+
+    auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+    for (size_t i = 0; i < query_models.size(); ++i) {
+      const auto& model = query_models[i];
+      auto task = std::make_shared<Task>(nullptr, model);
+      task->query.set_global_id(i + 1);
+      task->query.set_model_index(model->model()->model_index().t);
+      task->AppendInput(std::make_shared<Array>(
+          DT_FLOAT, model->model()->InputShape().NumElements(1), cpu));
+      EXPECT_TRUE(plan->AddPreprocessedTask(task));
+    }
+    return plan;
+  }
+
+  int32_t load_ms_;
+  BlockPriorityQueue<Task> task_queue_;
+};
+
+TEST(WarmupBatchSizesTest, CoversSmallHalfAndFullBatch) {
+  EXPECT_EQ(WarmupBatchSizes(1), std::vector<uint32_t>({1}));
+  EXPECT_EQ(WarmupBatchSizes(2), std::vector<uint32_t>({1, 2}));
+  EXPECT_EQ(WarmupBatchSizes(3), std::vector<uint32_t>({1, 3}));
+  EXPECT_EQ(WarmupBatchSizes(8), std::vector<uint32_t>({1, 4, 8}));
+}
+
+TEST_F(SleepModelTest, LoadAndWarmup) {
+  FLAGS_sleep_model_load_ms = 50;
+  auto load_start = Clock::now();
+  auto model = LoadModel(1, 8);
+  EXPECT_GE(ElapsedMs(load_start), 50);
+
+  // Batches of 1, 4 and 8 take 3 + 6 + 10 ms.
+  auto warmup_start = Clock::now();
+  model->Warmup(WarmupBatchSizes(8));
+  EXPECT_GE(ElapsedMs(warmup_start), 19);
+
+  // Warmup returns its input array.
+  auto input_array = model->AcquireInputArray();
+  EXPECT_NE(input_array, nullptr);
+  model->ReleaseInputArray(input_array);
+}
+
+TEST_F(SleepModelTest, ConcurrentLoads) {
+  FLAGS_sleep_model_load_ms = 200;
+  std::vector<std::shared_ptr<ModelExecutor>> models(3);
+  std::vector<std::thread> loaders;
+  auto start = Clock::now();
+  for (uint32_t i = 0; i < models.size(); ++i) {
+    loaders.emplace_back([this, &models, i] { models[i] = LoadModel(i, 4); });
+  }
+  for (auto& loader : loaders) {
+    loader.join();
+  }
+  auto elapsed_ms = ElapsedMs(start);
+  EXPECT_GE(elapsed_ms, 200);
+  // Loads of different models do not wait for each other.
+  EXPECT_LT(elapsed_ms, 400);
+  for (const auto& model : models) {
+    ASSERT_NE(model, nullptr);
+    EXPECT_EQ(model->model()->max_batch(), 500);
+  }
+}
+
+TEST_F(SleepModelTest, TrimAfterInflightBatches) {
+  auto model = LoadModel(1, 8);
+  auto now = Clock::now();
+  // Forward of one query takes 3 ms.
+  auto deadline = now + std::chrono::milliseconds(8);
+
+  auto plan = MakePlan(model, 1, now, deadline);
+  auto inflight =
+      model->StartBatchPlan(plan, now + std::chrono::milliseconds(2));
+  ASSERT_NE(inflight, nullptr);
+  EXPECT_GE(inflight->expected_finish, now + std::chrono::milliseconds(5));
+  model->FinishBatchPlan(std::move(inflight));
+  auto task = task_queue_.pop();
+  EXPECT_EQ(task->result.status(), CTRL_OK);
+
+  // Queued behind batches that keep the device busy for 6 ms, the query
+  // cannot finish by its deadline.
+  now = Clock::now();
+  deadline = now + std::chrono::milliseconds(8);
+  plan = MakePlan(model, 2, now, deadline);
+  inflight = model->StartBatchPlan(plan, now + std::chrono::milliseconds(6));
+  EXPECT_EQ(inflight, nullptr);
+  task = task_queue_.pop();
+  EXPECT_EQ(task->result.status(), TIMEOUT);
+}
+
+TEST_F(SleepModelTest, PipelinedPlansOnSharedDevice) {
+  // Each model has FLAGS_backend_max_inflight_plans + 1 input arrays.
+  constexpr int kNumPlans = 6;
+  ASSERT_GE(FLAGS_backend_max_inflight_plans + 1, kNumPlans / 2);
+  auto model_a = LoadModel(1, 8);
+  auto model_b = LoadModel(2, 8);
+  GpuExecutorPlanFollower executor(kGpuId, ario::PollerType::kBlocking);
+  executor.AddModel(model_a);
+  executor.AddModel(model_b);
+  executor.Start();
+
+  // All plans are due. Plans of the two models alternate and the device runs
+  // one forward of 3 ms at a time.
+  auto start = Clock::now();
+  for (int i = 0; i < kNumPlans; ++i) {
+    const auto& model = i % 2 == 0 ? model_a : model_b;
+    executor.AddBatchPlan(
+        MakePlan(model, i + 1, start + std::chrono::microseconds(i)));
+  }
+
+  int max_inflight = 0;
+  std::vector<std::shared_ptr<Task>> tasks;
+  while (tasks.size() < kNumPlans && ElapsedMs(start) < 5000) {
+    max_inflight = std::max(max_inflight, executor.num_inflight());
+    auto task = task_queue_.pop(std::chrono::microseconds(100));
+    if (task != nullptr) {
+      tasks.push_back(std::move(task));
+    }
+  }
+  auto elapsed_ms = ElapsedMs(start);
+  executor.Stop();
+
+  ASSERT_EQ(tasks.size(), kNumPlans);
+  // The models share the device, so their forwards do not overlap.
+  EXPECT_GE(elapsed_ms, 3 * kNumPlans);
+  EXPECT_LE(max_inflight, FLAGS_backend_max_inflight_plans);
+  EXPECT_GE(max_inflight, 1);
+  // Plans finish in the order of their exec_time.
+  std::sort(tasks.begin(), tasks.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs->query.global_id() < rhs->query.global_id();
+  });
+  for (int i = 0; i < kNumPlans; ++i) {
+    EXPECT_EQ(tasks[i]->result.status(), CTRL_OK);
+    if (i > 0) {
+      EXPECT_GT(tasks[i]->query.clock().backend_finish_ns(),
+                tasks[i - 1]->query.clock().backend_finish_ns())
+          << "plan " << i + 1;
+    }
+  }
+}
+
+TEST_F(SleepModelTest, MixedPrefixGroupPlan) {
+  auto leader = LoadModel(1, 8, "prefix_a", kPrefixFramework);
+  auto member = LoadModel(2, 8, "prefix_b", kPrefixFramework);
+  std::vector<std::shared_ptr<ModelExecutor>> query_models = {leader, member,
+                                                              leader};
+  auto plan = MakePrefixGroupPlan(leader, 1, query_models);
+
+  // The prefix of the batch of 3 takes 2.5 ms, the suffix of the 2 leader
+  // queries 2 ms and the suffix of the member query 1.5 ms.
+  constexpr auto kForwardTime = std::chrono::microseconds(6000);
+  auto start = Clock::now();
+  auto inflight = leader->StartBatchPlan(plan);
+  ASSERT_NE(inflight, nullptr);
+  // The forward is issued without waiting for it.
+  EXPECT_LT(Clock::now() - start, kForwardTime);
+  leader->FinishBatchPlan(std::move(inflight));
+  EXPECT_GE(Clock::now() - start, kForwardTime);
+
+  for (size_t i = 0; i < query_models.size(); ++i) {
+    auto task = task_queue_.pop();
+    ASSERT_NE(task, nullptr);
+    auto global_id = task->query.global_id();
+    ASSERT_GE(global_id, 1);
+    ASSERT_LE(global_id, query_models.size());
+    EXPECT_EQ(task->model, query_models[global_id - 1]) << global_id;
+    EXPECT_EQ(task->stage, kPostprocess);
+    ASSERT_EQ(task->outputs.size(), 1);
+    ASSERT_NE(task->outputs[0], nullptr);
+    EXPECT_EQ(task->outputs[0]->task_id, task->task_id) << global_id;
+    EXPECT_NE(task->outputs[0]->Data(0), nullptr);
+    task->model->Postprocess(task);
+    EXPECT_EQ(task->result.status(), CTRL_OK);
+  }
+}
+
+}  // namespace
+}  // namespace backend
+}  // namespace nexus
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "nexus/common/model_db.h"
+#include "nexus/common/sleep_profile.h"
+
+namespace nexus {
+namespace {
+
+TEST(SleepProfileTest, ParseWithoutPrefix) {
+  auto profile = SleepProfile::Parse("sleep#100,1000,50,20");
+  ASSERT_TRUE(profile.has_value());
+  EXPECT_EQ(profile->forward_us(4), 1400);
+  EXPECT_EQ(profile->prefix_percent(), 0);
+  EXPECT_EQ(profile->prefix_forward_us(4), 0);
+  EXPECT_EQ(profile->suffix_forward_us(4), 1400);
+}
+
+TEST(SleepProfileTest, ParseWithPrefix) {
+  auto profile = SleepProfile::Parse("sleep#100,1000,50,20,80");
+  ASSERT_TRUE(profile.has_value());
+  EXPECT_EQ(profile->prefix_percent(), 80);
+  EXPECT_EQ(profile->prefix_forward_us(4), 1120);
+  EXPECT_EQ(profile->suffix_forward_us(4), 280);
+}
+
+TEST(SleepProfileTest, ParseBadParameters) {
+  EXPECT_FALSE(SleepProfile::Parse("sleep#100,1000").has_value());
+  EXPECT_FALSE(SleepProfile::Parse("sleep#100,1000,50,20,101").has_value());
+  EXPECT_FALSE(SleepProfile::Parse("tensorflow").has_value());
+}
+
+TEST(SleepProfileTest, SharesPrefix) {
+  SleepProfile a(100, 1000, 50, 20, 80);
+  SleepProfile same_prefix(160, 1600, 0, 0, 50);
+  SleepProfile other_prefix(100, 2000, 50, 20, 80);
+  SleepProfile no_prefix(100, 1000, 50, 20);
+  EXPECT_TRUE(a.SharesPrefixWith(a));
+  EXPECT_TRUE(a.SharesPrefixWith(same_prefix));
+  EXPECT_TRUE(same_prefix.SharesPrefixWith(a));
+  EXPECT_FALSE(a.SharesPrefixWith(other_prefix));
+  EXPECT_FALSE(a.SharesPrefixWith(no_prefix));
+  EXPECT_FALSE(no_prefix.SharesPrefixWith(no_prefix));
+}
+
+TEST(SleepProfileTest, ModelProfileLatencies) {
+  auto profile =
+      ModelProfile::FromSleepProfile(SleepProfile(100, 1000, 50, 20));
+  // Means plus a standard deviation of 1%.
+  EXPECT_DOUBLE_EQ(profile.GetForwardLatency(1), 1111);
+  EXPECT_DOUBLE_EQ(profile.GetForwardLatency(4), 1414);
+  EXPECT_DOUBLE_EQ(profile.GetPreprocessLatency(), 50.5);
+  EXPECT_DOUBLE_EQ(profile.GetPostprocessLatency(), 20.2);
+}
+
+}  // namespace
+}  // namespace nexus
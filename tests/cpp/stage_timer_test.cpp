@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "nexus/common/time_util.h"
+
+namespace nexus {
+namespace {
+
+enum TestTimePoint { kBegin = 0, kExec, kEnd, kNumTestTimePoints };
+
+using TestTimer = StageTimer<TestTimePoint, kNumTestTimePoints>;
+
+TEST(StageTimerTest, Elapsed) {
+  TestTimer timer;
+  auto t0 = Clock::now();
+  timer.Record(kBegin, t0);
+  timer.Record(kEnd, t0 + std::chrono::microseconds(2500));
+  EXPECT_TRUE(timer.Recorded(kBegin));
+  EXPECT_FALSE(timer.Recorded(kExec));
+  EXPECT_EQ(timer.Get(kBegin), t0);
+  EXPECT_EQ(timer.GetLatencyMicros(kBegin, kEnd), 2500);
+  EXPECT_EQ(timer.GetLatencyMillis(kBegin, kEnd), 2);
+  EXPECT_EQ(timer.Elapsed<std::chrono::nanoseconds>(kBegin, kEnd).count(),
+            2500000);
+}
+
+TEST(StageTimerTest, Unrecorded) {
+  TestTimer timer;
+  EXPECT_EQ(timer.GetLatencyMicros(kBegin, kEnd), 0);
+  timer.Record(kBegin);
+  EXPECT_EQ(timer.GetLatencyMicros(kBegin, kExec), 0);
+  EXPECT_EQ(timer.GetLatencyMicros(kExec, kBegin), 0);
+}
+
+TEST(StageTimerTest, RecordReplaces) {
+  TestTimer timer;
+  auto t0 = Clock::now();
+  timer.Record(kBegin, t0);
+  timer.Record(kExec, t0 + std::chrono::microseconds(10));
+  timer.Record(kExec, t0 + std::chrono::microseconds(30));
+  EXPECT_EQ(timer.GetLatencyMicros(kBegin, kExec), 30);
+}
+
+}  // namespace
+}  // namespace nexus
@@ -0,0 +1,280 @@
+#include "nexus/common/staged_input.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "ario/memory.h"
+#include "nexus/app/request_context.h"
+#include "nexus/backend/utils.h"
+#include "nexus/common/message.h"
+
+namespace nexus {
+namespace {
+
+constexpr size_t kPoolBits = 22;
+constexpr size_t kBlockBits = 20;
+
+/*!
+ * \brief Stands in for an RDMA read between a frontend and a backend. The
+ *   frontend stages inputs in exposed blocks and the backend reads them into
+ *   its own blocks by the offset and length advertised in the query.
+ */
+class LocalTransport {
+ public:
+  LocalTransport()
+      : frontend_buffers_(kPoolBits, kBlockBits),
+        backend_buffers_(kPoolBits, kBlockBits) {}
+
+  ario::OwnedMemoryBlock AllocateExposed() {
+    return frontend_buffers_.Allocate();
+  }
+
+  ario::OwnedMemoryBlock Read(const ario::OwnedMemoryBlock& exposed,
+                              size_t length) {
+    return Read(exposed.data() - frontend_buffers_.data(), length);
+  }
+
+  ario::OwnedMemoryBlock Read(size_t offset, size_t length) {
+    auto buf = backend_buffers_.Allocate();
+    auto view = buf.AsMessageView();
+    EXPECT_LE(length, view.max_bytes_length());
+    std::memcpy(view.bytes(), frontend_buffers_.data() + offset, length);
+    view.set_bytes_length(length);
+    return buf;
+  }
+
+ private:
+  ario::MemoryBlockAllocator frontend_buffers_;
+  ario::MemoryBlockAllocator backend_buffers_;
+};
+
+std::optional<StagedInput> ParseBlock(ario::OwnedMemoryBlock& buf) {
+  auto view = buf.AsMessageView();
+  return ParseStagedInput(reinterpret_cast<const char*>(view.bytes()),
+                          view.bytes_length());
+}
+
+/*! \brief A frontend request of a float tensor. */
+std::shared_ptr<app::RequestContext> MakeTensorRequest(
+    app::RequestPool& pool, const std::vector<uint32_t>& shape,
+    const std::vector<float>& data) {
+  RequestProto request;
+  auto* input = request.mutable_input();
+  input->set_data_type(DT_TENSOR);
+  auto* tensor = input->mutable_tensor();
+  tensor->set_data_type(DT_FLOAT);
+  for (auto dim : shape) {
+    tensor->add_shape(dim);
+  }
+  for (auto value : data) {
+    tensor->add_floats(value);
+  }
+  auto msg = std::make_shared<Message>(kUserRequest, request.ByteSizeLong());
+  msg->EncodeBody(request);
+  return std::make_shared<app::RequestContext>(nullptr, msg, pool);
+}
+
+cv::Mat RandomImage(int height, int width) {
+  cv::Mat img(height, width, CV_8UC3);
+  cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+  return img;
+}
+
+TEST(StagedInputTest, TensorDeliveredByteExact) {
+  LocalTransport transport;
+  auto exposed = transport.AllocateExposed();
+  auto* buf = reinterpret_cast<char*>(exposed.data());
+  std::vector<float> tensor(4 * 5 * 3);
+  for (size_t i = 0; i < tensor.size(); ++i) {
+    tensor[i] = 0.25f * i - 3.f;
+  }
+  auto* payload = StageTensorHeader(buf, exposed.size(), DT_FLOAT, {4, 5, 3});
+  ASSERT_NE(payload, nullptr);
+  std::memcpy(payload, tensor.data(), tensor.size() * sizeof(float));
+  size_t length = payload - buf + tensor.size() * sizeof(float);
+
+  auto fetched = transport.Read(exposed, length);
+  auto staged = ParseBlock(fetched);
+  ASSERT_TRUE(staged.has_value());
+  EXPECT_EQ(staged->header.kind, StagedInputHeader::kTensor);
+  EXPECT_EQ(staged->header.data_type, DT_FLOAT);
+  EXPECT_EQ(staged->num_elements(), tensor.size());
+  EXPECT_EQ(std::memcmp(staged->payload, tensor.data(),
+                        tensor.size() * sizeof(float)),
+            0);
+
+  std::vector<float> out(tensor.size());
+  ASSERT_TRUE(StagedInputToFloatImage(*staged, 4, 5, out.data()));
+  EXPECT_EQ(out, tensor);
+  EXPECT_FALSE(StagedInputToFloatImage(*staged, 5, 4, out.data()));
+}
+
+TEST(StagedInputTest, Uint8ImageConvertedToFloat) {
+  LocalTransport transport;
+  auto exposed = transport.AllocateExposed();
+  auto* buf = reinterpret_cast<char*>(exposed.data());
+  auto img = RandomImage(8, 6);
+  auto* payload = StageTensorHeader(buf, exposed.size(), DT_UINT8, {8, 6, 3});
+  ASSERT_NE(payload, nullptr);
+  std::memcpy(payload, img.data, img.total() * img.elemSize());
+
+  auto fetched =
+      transport.Read(exposed, payload - buf + img.total() * img.elemSize());
+  auto staged = ParseBlock(fetched);
+  ASSERT_TRUE(staged.has_value());
+  std::vector<float> out(8 * 6 * 3);
+  ASSERT_TRUE(StagedInputToFloatImage(*staged, 8, 6, out.data()));
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_EQ(out[i], static_cast<float>(img.data[i])) << "i=" << i;
+  }
+}
+
+TEST(StagedInputTest, EncodedImageDecodedOnBackend) {
+  LocalTransport transport;
+  auto exposed = transport.AllocateExposed();
+  auto* buf = reinterpret_cast<char*>(exposed.data());
+  auto rgb = RandomImage(16, 12);
+  cv::Mat bgr;
+  cv::cvtColor(rgb, bgr, cv::COLOR_RGB2BGR);
+  std::vector<uchar> png;
+  ASSERT_TRUE(cv::imencode(".png", bgr, png));
+  auto* payload =
+      StageEncodedImageHeader(buf, exposed.size(), ImageProto::PNG, png.size());
+  ASSERT_NE(payload, nullptr);
+  std::memcpy(payload, png.data(), png.size());
+
+  auto fetched = transport.Read(exposed, payload - buf + png.size());
+  auto staged = ParseBlock(fetched);
+  ASSERT_TRUE(staged.has_value());
+  EXPECT_EQ(staged->header.kind, StagedInputHeader::kEncodedImage);
+  EXPECT_EQ(std::memcmp(staged->payload, png.data(), png.size()), 0);
+
+  // PNG is lossless, so the decoded pixels match the original ones.
+  std::vector<float> out(16 * 12 * 3);
+  ASSERT_TRUE(StagedInputToFloatImage(*staged, 16, 12, out.data()));
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_EQ(out[i], static_cast<float>(rgb.data[i])) << "i=" << i;
+  }
+}
+
+TEST(StagedInputTest, RejectBadInput) {
+  std::vector<char> buf(1024);
+  EXPECT_EQ(StageTensorHeader(buf.data(), buf.size(), DT_FLOAT, {32, 32}),
+            nullptr);
+  EXPECT_EQ(StageTensorHeader(buf.data(), buf.size(), DT_STRING, {4}),
+            nullptr);
+  EXPECT_EQ(
+      StageTensorHeader(buf.data(), buf.size(), DT_UINT8, {1, 1, 1, 1, 1}),
+      nullptr);
+  EXPECT_EQ(StageEncodedImageHeader(buf.data(), buf.size(), ImageProto::JPEG,
+                                    buf.size()),
+            nullptr);
+
+  auto* payload =
+      StageTensorHeader(buf.data(), buf.size(), DT_UINT8, {4, 4, 3});
+  ASSERT_NE(payload, nullptr);
+  size_t length = payload - buf.data() + 4 * 4 * 3;
+  EXPECT_TRUE(ParseStagedInput(buf.data(), length).has_value());
+  EXPECT_FALSE(ParseStagedInput(buf.data(), length - 1).has_value());
+  EXPECT_FALSE(ParseStagedInput(buf.data(), 16).has_value());
+  buf[0] ^= 1;
+  EXPECT_FALSE(ParseStagedInput(buf.data(), length).has_value());
+}
+
+TEST(StagedInputTest, RejectOverflowingDims) {
+  std::vector<char> buf(1024);
+  uint32_t dims[] = {1u << 16, 1u << 16, 1u << 16, 1u << 16};
+  EXPECT_FALSE(TensorPayloadBytes(DT_FLOAT, dims, 4).has_value());
+  EXPECT_EQ(StageTensorHeader(buf.data(), buf.size(), DT_FLOAT,
+                              {1u << 16, 1u << 16, 1u << 16, 1u << 16}),
+            nullptr);
+
+  // The dims multiply to 2^64, which wraps around to the empty payload.
+  auto* payload = StageTensorHeader(buf.data(), buf.size(), DT_UINT8, {0});
+  ASSERT_NE(payload, nullptr);
+  StagedInputHeader header;
+  std::memcpy(&header, buf.data(), sizeof(header));
+  header.num_dims = 3;
+  header.dims[0] = 1u << 31;
+  header.dims[1] = 1u << 31;
+  header.dims[2] = 4;
+  std::memcpy(buf.data(), &header, sizeof(header));
+  EXPECT_FALSE(ParseStagedInput(buf.data(), buf.size()).has_value());
+
+  // The payload size overflows when added to the header size.
+  header.num_dims = 0;
+  header.payload_bytes = std::numeric_limits<uint64_t>::max();
+  std::memcpy(buf.data(), &header, sizeof(header));
+  EXPECT_FALSE(ParseStagedInput(buf.data(), buf.size()).has_value());
+
+  // An empty image of a huge width does not reach cv::Mat.
+  payload = StageTensorHeader(buf.data(), buf.size(), DT_UINT8,
+                              {0, 1u << 31, 3});
+  ASSERT_NE(payload, nullptr);
+  auto staged = ParseStagedInput(buf.data(), payload - buf.data());
+  ASSERT_TRUE(staged.has_value());
+  std::vector<float> out(4 * 4 * 3);
+  EXPECT_FALSE(StagedInputToFloatImage(*staged, 4, 4, out.data()));
+}
+
+TEST(StagedInputTest, RequestTensorToChannelsFirstModelInput) {
+  constexpr int kHeight = 4;
+  constexpr int kWidth = 5;
+  std::vector<float> hwc(kHeight * kWidth * 3);
+  for (size_t i = 0; i < hwc.size(); ++i) {
+    hwc[i] = 0.5f * i;
+  }
+  // The request returns its exposed block on destruction.
+  LocalTransport transport;
+  app::RequestPool pool;
+  auto req = MakeTensorRequest(pool, {kHeight, kWidth, 3}, hwc);
+  ASSERT_TRUE(req->StageInput(transport.AllocateExposed(), kHeight, kWidth));
+  auto fetched =
+      transport.Read(req->rdma_read_offset(), req->rdma_read_length());
+  auto view = fetched.AsMessageView();
+  auto* buf = reinterpret_cast<const char*>(view.bytes());
+  size_t len = view.bytes_length();
+
+  // As a Caffe model takes it.
+  auto input = backend::StagedInputToModelInput(
+      buf, len, Shape({8, 3, kHeight, kWidth}), true);
+  ASSERT_NE(input, nullptr);
+  ASSERT_EQ(input->num_elements(), hwc.size());
+  const float* chw = input->Data<float>();
+  constexpr int kPlane = kHeight * kWidth;
+  for (int c = 0; c < 3; ++c) {
+    for (int i = 0; i < kPlane; ++i) {
+      ASSERT_EQ(chw[c * kPlane + i], hwc[i * 3 + c]) << "c=" << c
+                                                     << " i=" << i;
+    }
+  }
+
+  // As a TensorFlow model takes it.
+  input = backend::StagedInputToModelInput(
+      buf, len, Shape({8, kHeight, kWidth, 3}), false);
+  ASSERT_NE(input, nullptr);
+  EXPECT_EQ(std::vector<float>(input->Data<float>(),
+                               input->Data<float>() + hwc.size()),
+            hwc);
+
+  // The NCHW shape read as NHWC has 5 channels.
+  EXPECT_EQ(backend::StagedInputToModelInput(
+                buf, len, Shape({8, 3, kHeight, kWidth}), false),
+            nullptr);
+}
+
+TEST(StagedInputTest, RequestTensorWithOverflowingShape) {
+  LocalTransport transport;
+  app::RequestPool pool;
+  // The shape has 2^64 floats, a count that wraps around to no data.
+  auto req = MakeTensorRequest(pool, {1u << 31, 1u << 31, 4}, {});
+  EXPECT_FALSE(req->StageInput(transport.AllocateExposed(), 4, 4));
+}
+
+}  // namespace
+}  // namespace nexus
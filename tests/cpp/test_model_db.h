@@ -0,0 +1,70 @@
+#ifndef NEXUS_TESTS_CPP_TEST_MODEL_DB_H_
+#define NEXUS_TESTS_CPP_TEST_MODEL_DB_H_
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <stdlib.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+
+DECLARE_string(model_root);
+
+namespace nexus {
+
+/*!
+ * \brief Point --model_root at a model database that has the model info of
+ *   the sleep models used by the tests. ModelDatabase::Singleton reads the
+ *   database once per process, so all tests share this one. It is removed
+ *   when the process exits. The models take 8x8 images. prefix_a and
+ *   prefix_b share a prefix, prefix_c shares none.
+ */
+inline void UseTestModelDatabase() {
+  struct TestModelDatabase {
+    TestModelDatabase() {
+      namespace fs = boost::filesystem;
+      char dir[] = "/tmp/nexus_test_model_db_XXXXXX";
+      CHECK(mkdtemp(dir) != nullptr);
+      root = dir;
+      fs::create_directories(root + "/store");
+      fs::create_directories(root + "/profiles");
+      fs::create_directories(root + "/db");
+      std::ofstream fout(root + "/db/model_db.yml");
+      // SleepModel takes the model info of the TensorFlow model of its name.
+      fout << "models:\n";
+      for (const char* name :
+           {"sleep_test", "prefix_a", "prefix_b", "prefix_c"}) {
+        fout << "  - framework: tensorflow\n"
+                "    model_name: "
+             << name
+             << "\n"
+                "    type: classification\n"
+                "    version: 1\n"
+                "    input_layer: input\n"
+                "    output_layer: output\n"
+                "    image_height: 8\n"
+                "    image_width: 8\n";
+      }
+      fout << "share_prefix:\n"
+              "  - prefix_length: 3\n"
+              "    models:\n";
+      for (const char* name : {"prefix_a", "prefix_b"}) {
+        fout << "      - framework: tensorflow\n"
+                "        model_name: "
+             << name
+             << "\n"
+                "        version: 1\n";
+      }
+    }
+    ~TestModelDatabase() { boost::filesystem::remove_all(root); }
+
+    std::string root;
+  };
+  static TestModelDatabase db;
+  FLAGS_model_root = db.root;
+}
+
+}  // namespace nexus
+
+#endif  // NEXUS_TESTS_CPP_TEST_MODEL_DB_H_
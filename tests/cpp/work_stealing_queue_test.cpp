@@ -0,0 +1,125 @@
+#include "nexus/common/work_stealing_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace nexus {
+namespace {
+
+class Item : public DeadlineItem {
+ public:
+  Item(int id, TimePoint deadline) : DeadlineItem(deadline), id(id) {}
+  const int id;
+};
+
+std::shared_ptr<Item> MakeItem(int id, int deadline_ms) {
+  static const auto base = Clock::now();
+  return std::make_shared<Item>(id,
+                                base + std::chrono::milliseconds(deadline_ms));
+}
+
+constexpr auto kNoWait = std::chrono::microseconds(0);
+
+TEST(WorkStealingQueueTest, EarliestDeadlineFirst) {
+  WorkStealingQueue<Item> queue(1);
+  queue.Push(MakeItem(1, 30), 0);
+  queue.Push(MakeItem(2, 10), 0);
+  queue.Push(MakeItem(3, 20), 0);
+  EXPECT_EQ(queue.size(), 3);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 2);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 3);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 1);
+  EXPECT_EQ(queue.Pop(0, kNoWait), nullptr);
+}
+
+TEST(WorkStealingQueueTest, PreferOwnQueueThenSteal) {
+  WorkStealingQueue<Item> queue(2);
+  queue.Push(MakeItem(1, 10), 1);
+  queue.Push(MakeItem(2, 20), 0);
+  // Worker 0 runs its own item even though worker 1 has an earlier one.
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 2);
+  // Worker 0 is idle, so it steals from worker 1.
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 1);
+  EXPECT_EQ(queue.Pop(1, kNoWait), nullptr);
+}
+
+TEST(WorkStealingQueueTest, StealEarliestHead) {
+  WorkStealingQueue<Item> queue(4);
+  queue.Push(MakeItem(1, 30), 1);
+  queue.Push(MakeItem(2, 40), 2);
+  queue.Push(MakeItem(3, 10), 2);
+  queue.Push(MakeItem(4, 20), 3);
+  // Worker 0 is idle. It steals the earliest head of the other queues, not
+  // the head of the next worker's queue.
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 3);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 4);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 1);
+  EXPECT_EQ(queue.Pop(0, kNoWait)->id, 2);
+  EXPECT_EQ(queue.Pop(0, kNoWait), nullptr);
+}
+
+TEST(WorkStealingQueueTest, PopWaitsForPush) {
+  WorkStealingQueue<Item> queue(2);
+  auto start = Clock::now();
+  EXPECT_EQ(queue.Pop(0, std::chrono::milliseconds(20)), nullptr);
+  EXPECT_GE(Clock::now() - start, std::chrono::milliseconds(20));
+
+  std::thread producer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    queue.Push(MakeItem(7, 0), 1);
+  });
+  auto item = queue.Pop(0, std::chrono::seconds(10));
+  producer.join();
+  ASSERT_NE(item, nullptr);
+  EXPECT_EQ(item->id, 7);
+}
+
+TEST(WorkStealingQueueTest, ConcurrentPushPop) {
+  constexpr int kWorkers = 8;
+  constexpr int kProducers = 4;
+  constexpr int kItemsPerProducer = 20000;
+  constexpr int kTotal = kProducers * kItemsPerProducer;
+  WorkStealingQueue<Item> queue(kWorkers);
+  std::vector<std::atomic<int>> seen(kTotal);
+  for (auto& s : seen) {
+    s.store(0);
+  }
+  std::atomic<int> num_popped{0};
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < kItemsPerProducer; ++i) {
+        int id = p * kItemsPerProducer + i;
+        // Skew pushes towards a few workers so that the others must steal.
+        queue.Push(MakeItem(id, id % 100), id % 3 == 0 ? -1 : 0);
+      }
+    });
+  }
+  for (int w = 0; w < kWorkers; ++w) {
+    threads.emplace_back([&, w] {
+      while (num_popped.load() < kTotal) {
+        auto item = queue.Pop(w, std::chrono::milliseconds(1));
+        if (item) {
+          seen[item->id].fetch_add(1);
+          num_popped.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(queue.size(), 0);
+  for (int id = 0; id < kTotal; ++id) {
+    ASSERT_EQ(seen[id].load(), 1) << "id=" << id;
+  }
+}
+
+}  // namespace
+}  // namespace nexus
@@ -0,0 +1,98 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "nexus/backend/batch_plan_context.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+#include "nexus/proto/control.pb.h"
+
+DEFINE_int32(repeats, 20000, "Number of plans to run for each plan size");
+DEFINE_int32(drop_percent, 5, "Percentage of queries dropped in each plan");
+
+using namespace nexus;
+using namespace nexus::backend;
+
+namespace {
+
+struct PreparedPlan {
+  BatchPlanProto proto;
+  std::vector<std::shared_ptr<Task>> tasks;
+  std::vector<GlobalId> dropped;
+};
+
+std::vector<PreparedPlan> PreparePlans(int plan_size, int repeats,
+                                       std::mt19937& gen) {
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::vector<PreparedPlan> plans(repeats);
+  uint64_t next_global_id = 1;
+  for (int r = 0; r < repeats; ++r) {
+    auto& plan = plans[r];
+    plan.proto.set_plan_id(r);
+    for (int i = 0; i < plan_size; ++i) {
+      auto global_id = next_global_id++;
+      plan.proto.add_queries()->mutable_query_without_input()->set_global_id(
+          global_id);
+      if (percent(gen) < FLAGS_drop_percent) {
+        plan.dropped.emplace_back(global_id);
+      } else {
+        auto task = std::make_shared<Task>();
+        task->query.set_global_id(global_id);
+        plan.tasks.push_back(task);
+      }
+    }
+    // Fetches complete in arbitrary order.
+    std::shuffle(plan.tasks.begin(), plan.tasks.end(), gen);
+  }
+  return plans;
+}
+
+void Bench(int plan_size) {
+  using namespace std::chrono;
+  std::mt19937 gen(0xabcdabcd987LL);
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  auto input_array = std::make_shared<Array>(DT_FLOAT, 1, cpu);
+  auto plans = PreparePlans(plan_size, FLAGS_repeats, gen);
+
+  auto st = steady_clock::now();
+  size_t total_tasks = 0;
+  for (auto& prepared : plans) {
+    BatchPlanContext plan(std::move(prepared.proto));
+    plan.SetInputArray(input_array);
+    for (auto global_id : prepared.dropped) {
+      plan.MarkQueryDropped(global_id);
+    }
+    for (auto& task : prepared.tasks) {
+      plan.AddPreprocessedTask(task);
+    }
+    CHECK(plan.IsReadyToRun());
+    total_tasks += plan.PopPreprocessedTasks().size();
+    plan.ReleaseInputArray();
+  }
+  auto ed = steady_clock::now();
+
+  double elapse_ns = duration_cast<nanoseconds>(ed - st).count();
+  printf("plan_size: %4d    per_plan: %10.1fns    per_query: %7.1fns\n",
+         plan_size, elapse_ns / FLAGS_repeats,
+         elapse_ns / FLAGS_repeats / plan_size);
+  CHECK_GT(total_tasks, 0u);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  for (int plan_size : {1, 4, 16, 32, 64, 128, 256}) {
+    Bench(plan_size);
+  }
+}
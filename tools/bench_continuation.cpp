@@ -0,0 +1,326 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "nexus/app/exec_block.h"
+#include "nexus/app/query_processor.h"
+#include "nexus/app/request_context.h"
+#include "nexus/app/user_session.h"
+#include "nexus/app/worker.h"
+#include "nexus/common/block_queue.h"
+#include "nexus/common/connection.h"
+#include "nexus/common/message.h"
+
+DEFINE_int32(duration_ms, 3000, "Duration of each run");
+DEFINE_int32(inflight, 256, "Number of requests in flight");
+DEFINE_int32(stages, 3, "Number of model queries of each request, in order");
+DEFINE_int32(model_latency_us, 2000, "Latency of each model query");
+DEFINE_int32(continuation_threads, 4,
+             "Number of frontend workers with continuations");
+DEFINE_int32(max_blocking_threads, 64,
+             "Thread counts of the blocking design double from 4 up to it");
+
+using namespace nexus;
+using namespace nexus::app;
+
+namespace {
+
+/*!
+ * \brief Stands in for model replies: runs each callback after
+ *   --model_latency_us on a thread of its own, like the reply path of a
+ *   frontend.
+ */
+class StubModel {
+ public:
+  StubModel() : thread_(&StubModel::Run, this) {}
+
+  ~StubModel() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  void Submit(std::function<void()> on_reply) {
+    auto done =
+        Clock::now() + std::chrono::microseconds(FLAGS_model_latency_us);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push({done, std::move(on_reply)});
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  struct Pending {
+    TimePoint done;
+    std::function<void()> on_reply;
+    bool operator<(const Pending& rhs) const { return done > rhs.done; }
+  };
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      if (pending_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto done = pending_.top().done;
+      if (Clock::now() < done) {
+        cv_.wait_until(lock, done);
+        continue;
+      }
+      auto on_reply = pending_.top().on_reply;
+      pending_.pop();
+      lock.unlock();
+      on_reply();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::priority_queue<Pending> pending_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+/*!
+ * \brief Counts the replies sent to a user session over loopback, and sends
+ *   a new request for each, so that --inflight requests are in flight.
+ */
+class UserStandIn : public MessageHandler {
+ public:
+  explicit UserStandIn(std::function<void()> send_request)
+      : send_request_(std::move(send_request)) {
+    boost::asio::ip::tcp::acceptor acceptor(
+        io_context_, boost::asio::ip::tcp::endpoint(
+                         boost::asio::ip::address_v4::loopback(), 0));
+    boost::asio::ip::tcp::socket user_socket(io_context_);
+    user_socket.connect(acceptor.local_endpoint());
+    boost::asio::ip::tcp::socket frontend_socket(io_context_);
+    acceptor.accept(frontend_socket);
+    user_ = std::make_shared<Connection>(std::move(user_socket), this);
+    session_ = std::make_shared<UserSession>(std::move(frontend_socket), this);
+    user_->Start();
+    thread_ = std::thread([this] { io_context_.run(); });
+  }
+
+  ~UserStandIn() {
+    io_context_.stop();
+    thread_.join();
+  }
+
+  std::shared_ptr<UserSession> session() const { return session_; }
+
+  uint64_t num_replies() const { return num_replies_.load(); }
+
+  void Stop() { stopped_ = true; }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    ReplyProto reply;
+    message->DecodeBody(&reply);
+    CHECK_EQ(reply.status(), CTRL_OK) << reply.error_message();
+    num_replies_.fetch_add(1, std::memory_order_relaxed);
+    if (!stopped_) {
+      send_request_();
+    }
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {}
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+ private:
+  std::function<void()> send_request_;
+  boost::asio::io_context io_context_;
+  std::shared_ptr<Connection> user_;
+  std::shared_ptr<UserSession> session_;
+  std::atomic<uint64_t> num_replies_{0};
+  std::atomic<bool> stopped_{false};
+  std::thread thread_;
+};
+
+std::shared_ptr<Message> MakeRequestMessage() {
+  RequestProto request;
+  request.set_user_id(1);
+  request.set_req_id(1);
+  auto msg = std::make_shared<Message>(kUserRequest, request.ByteSizeLong());
+  msg->EncodeBody(request);
+  return msg;
+}
+
+QueryResultProto MakeQueryResult(uint64_t qid) {
+  QueryResultProto result;
+  result.set_query_id(qid);
+  result.set_status(CTRL_OK);
+  return result;
+}
+
+/*!
+ * \brief Each worker runs a request from start to reply, and waits for each
+ *   model reply, as app code reading QueryResult right after Execute would.
+ */
+class BlockingFrontend {
+ public:
+  explicit BlockingFrontend(int num_threads) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&BlockingFrontend::Run, this);
+    }
+  }
+
+  ~BlockingFrontend() {
+    running_ = false;
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  RequestPool& request_pool() { return unused_pool_; }
+
+  void AddNewRequest(std::shared_ptr<RequestContext> ctx) {
+    queue_.push(std::move(ctx));
+  }
+
+ private:
+  void Run() {
+    while (running_) {
+      auto ctx = queue_.pop(std::chrono::milliseconds(50));
+      if (ctx == nullptr) {
+        continue;
+      }
+      for (int i = 0; i < FLAGS_stages; ++i) {
+        std::promise<void> reply;
+        model_.Submit([&reply] { reply.set_value(); });
+        reply.get_future().wait();
+      }
+      ctx->SendReply();
+    }
+  }
+
+  StubModel model_;
+  RequestPool unused_pool_;
+  BlockQueue<RequestContext> queue_;
+  std::atomic<bool> running_{true};
+  std::vector<std::thread> threads_;
+};
+
+/*!
+ * \brief The frontend workers and QueryProcessor of nexus. Each stage sends
+ *   a query and continues with RequestContext::Then.
+ */
+class ContinuationFrontend {
+ public:
+  explicit ContinuationFrontend(int num_threads)
+      : qp_({new ExecBlock(0,
+                           [this](std::shared_ptr<RequestContext> ctx) {
+                             RunStage(std::move(ctx), 0);
+                             return std::vector<VariablePtr>{};
+                           },
+                           {})}) {
+    pool_.Init(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      workers_.emplace_back(new Worker(&qp_, pool_, i));
+      workers_.back()->Start();
+    }
+  }
+
+  ~ContinuationFrontend() {
+    for (auto& worker : workers_) {
+      worker->Stop();
+    }
+    for (auto& worker : workers_) {
+      worker->Join();
+    }
+  }
+
+  RequestPool& request_pool() { return pool_; }
+
+  void AddNewRequest(std::shared_ptr<RequestContext> ctx) {
+    pool_.AddNewRequest(std::move(ctx));
+  }
+
+ private:
+  void RunStage(std::shared_ptr<RequestContext> ctx, int stage) {
+    if (stage == FLAGS_stages) {
+      return;
+    }
+    uint64_t qid = next_qid_.fetch_add(1);
+    model_.Submit([ctx, qid, this] {
+      ctx->HandleQueryResult(MakeQueryResult(qid), model_session_);
+    });
+    ctx->Then(std::make_shared<QueryResult>(qid),
+              [this, stage](std::shared_ptr<RequestContext> ctx) {
+                RunStage(std::move(ctx), stage + 1);
+              });
+  }
+
+  StubModel model_;
+  ModelSession model_session_;
+  std::atomic<uint64_t> next_qid_{0};
+  QueryProcessor qp_;
+  RequestPool pool_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+template <typename Frontend>
+double Bench(int num_threads) {
+  auto request_msg = MakeRequestMessage();
+  Frontend frontend(num_threads);
+  std::unique_ptr<UserStandIn> user;
+  auto send_request = [&] {
+    frontend.AddNewRequest(std::make_shared<RequestContext>(
+        user->session(), request_msg, frontend.request_pool()));
+  };
+  user.reset(new UserStandIn(send_request));
+  for (int i = 0; i < FLAGS_inflight; ++i) {
+    send_request();
+  }
+
+  // Skip the first requests, which all start at once.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto replies = user->num_replies();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_duration_ms));
+  auto elapse = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  double rps = (user->num_replies() - replies) / elapse;
+  user->Stop();
+  return rps;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  double ideal = FLAGS_inflight * 1e6 / FLAGS_stages / FLAGS_model_latency_us;
+  printf("inflight=%d stages=%d model_latency_us=%d, at most %.0f requests/s\n",
+         FLAGS_inflight, FLAGS_stages, FLAGS_model_latency_us, ideal);
+  for (int n = 4; n <= FLAGS_max_blocking_threads; n *= 2) {
+    printf("blocking      threads=%3d  %10.0f requests/s\n", n,
+           Bench<BlockingFrontend>(n));
+  }
+  printf("continuation  threads=%3d  %10.0f requests/s\n",
+         FLAGS_continuation_threads,
+         Bench<ContinuationFrontend>(FLAGS_continuation_threads));
+}
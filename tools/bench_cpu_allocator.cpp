@@ -0,0 +1,105 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/cpu_allocator.h"
+
+DEFINE_int32(rounds, 200, "Number of rounds of each thread");
+DEFINE_int32(batch, 16, "Blocks each thread holds before freeing them");
+DEFINE_int32(max_threads, 4, "Thread counts double from 1 up to it");
+DEFINE_bool(touch, true, "Write a byte on each page of a block");
+
+using namespace nexus;
+
+namespace {
+
+struct Malloc {
+  void* Allocate(size_t nbytes) { return malloc(nbytes); }
+  void Free(void* ptr) { free(ptr); }
+};
+
+struct Pooled {
+  void* Allocate(size_t nbytes) {
+    return CPUAllocator::Singleton().Allocate(nbytes);
+  }
+  void Free(void* ptr) { CPUAllocator::Singleton().Free(ptr); }
+};
+
+/*!
+ * \brief Each round allocates a batch of blocks, as the inputs of a batch
+ *   of tasks, then frees them.
+ * \return Wall-clock nanoseconds per block of all threads together.
+ */
+template <typename Allocator>
+double Bench(int nthreads, size_t nbytes) {
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&] {
+      Allocator allocator;
+      std::vector<char*> blocks(FLAGS_batch);
+      ++ready;
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      for (int round = 0; round < FLAGS_rounds; ++round) {
+        for (auto& block : blocks) {
+          block = static_cast<char*>(allocator.Allocate(nbytes));
+          if (FLAGS_touch) {
+            for (size_t i = 0; i < nbytes; i += 4096) {
+              block[i] = 1;
+            }
+          }
+        }
+        for (auto* block : blocks) {
+          allocator.Free(block);
+        }
+      }
+    });
+  }
+  while (ready.load() < nthreads) {
+    std::this_thread::yield();
+  }
+  auto st = std::chrono::steady_clock::now();
+  go = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - st;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         nthreads / FLAGS_rounds / FLAGS_batch;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  struct Size {
+    const char* name;
+    size_t nbytes;
+  };
+  const Size sizes[] = {{"224x224x3 float", 224 * 224 * 3 * sizeof(float)},
+                        {"224x224x3 uint8", 224 * 224 * 3},
+                        {"1000 float", 1000 * sizeof(float)}};
+  printf("rounds=%d batch=%d touch=%d, wall-clock ns per block\n",
+         FLAGS_rounds, FLAGS_batch, FLAGS_touch);
+  printf("%16s %8s %10s %10s\n", "size", "threads", "malloc", "pooled");
+  for (const auto& size : sizes) {
+    for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+      double malloc_ns = Bench<Malloc>(n, size.nbytes);
+      double pooled_ns = Bench<Pooled>(n, size.nbytes);
+      printf("%16s %8d %10.1f %10.1f\n", size.name, n, malloc_ns, pooled_ns);
+    }
+  }
+  printf("%s\n", CPUAllocator::Singleton().stats().ToString().c_str());
+}
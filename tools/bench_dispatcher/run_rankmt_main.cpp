@@ -336,6 +336,11 @@ class DispatcherRunner {
                                                   w.model_session);
       request_entrances_.push_back(entrance);
       model_index_table_.push_back(entrance.model_index());
+      // Fake backends have every model loaded from the start.
+      for (const auto& backend : backends_) {
+        scheduler_->MarkBackendModelReady(NodeId(backend->node_id()),
+                                          entrance.model_index());
+      }
     }
   }
 
@@ -0,0 +1,302 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "nexus/app/exec_block.h"
+#include "nexus/app/exec_plan.h"
+
+DEFINE_int32(requests, 200000, "Number of requests of each thread");
+DEFINE_int32(max_threads, 8, "Thread counts double from 1 up to it");
+DEFINE_int32(fanout, 2, "Number of queries sent by the second stage");
+
+using namespace nexus;
+using namespace nexus::app;
+
+namespace {
+
+thread_local uint64_t tls_num_allocs = 0;
+
+}  // namespace
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  ++tls_num_allocs;
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+namespace {
+
+/*!
+ * \brief Dependency tracking of RequestContext before ExecPlan: string-keyed
+ *   maps of variables and queries, and a rescan of all pending blocks for
+ *   each ready variable.
+ */
+class NamedExecState {
+ public:
+  explicit NamedExecState(const std::vector<ExecBlock*>& blocks) {
+    for (auto block : blocks) {
+      auto deps = block->dependency();
+      if (deps.empty()) {
+        ready_blocks_.push_back(block);
+      } else {
+        pending_blocks_.emplace(block->id(), block);
+        block_deps_.emplace(block->id(), block->dependency());
+      }
+    }
+  }
+
+  bool finished() const {
+    return pending_blocks_.empty() && ready_blocks_.empty();
+  }
+
+  ExecBlock* NextReadyBlock() {
+    if (ready_blocks_.empty()) {
+      return nullptr;
+    }
+    auto block = ready_blocks_.front();
+    ready_blocks_.pop_front();
+    return block;
+  }
+
+  VariablePtr GetVariable(const std::string& name) { return vars_.at(name); }
+
+  void AddBlockReturn(std::vector<VariablePtr> vars) {
+    for (auto var : vars) {
+      auto var_name = var->name();
+      for (auto qid : var->query_ids()) {
+        auto itr = dangling_results_.find(qid);
+        if (itr != dangling_results_.end()) {
+          var->AddQueryResult(itr->second);
+          dangling_results_.erase(itr);
+        } else {
+          qid_var_map_.emplace(qid, var_name);
+        }
+      }
+      if (var->ready()) {
+        AddReadyVariable(var);
+      } else {
+        waiting_vars_.emplace(var_name, var);
+      }
+    }
+  }
+
+  void AddQueryResult(const QueryResultProto& result) {
+    uint64_t qid = result.query_id();
+    auto qid_itr = qid_var_map_.find(qid);
+    if (qid_itr == qid_var_map_.end()) {
+      dangling_results_.emplace(qid, result);
+      return;
+    }
+    std::string var_name = qid_itr->second;
+    qid_var_map_.erase(qid_itr);
+    auto var = waiting_vars_.at(var_name);
+    if (var->AddQueryResult(result)) {
+      waiting_vars_.erase(var_name);
+      AddReadyVariable(var);
+    }
+  }
+
+ private:
+  void AddReadyVariable(VariablePtr var) {
+    vars_.emplace(var->name(), var);
+    std::vector<int> ready_blocks;
+    for (auto& block_itr : block_deps_) {
+      block_itr.second.erase(var->name());
+      if (block_itr.second.empty()) {
+        ready_blocks.push_back(block_itr.first);
+      }
+    }
+    for (auto block_id : ready_blocks) {
+      auto block = pending_blocks_.at(block_id);
+      pending_blocks_.erase(block_id);
+      block_deps_.erase(block_id);
+      ready_blocks_.push_back(block);
+    }
+  }
+
+  std::deque<ExecBlock*> ready_blocks_;
+  std::unordered_map<int, ExecBlock*> pending_blocks_;
+  std::unordered_map<int, std::unordered_set<std::string> > block_deps_;
+  std::unordered_map<std::string, VariablePtr> vars_;
+  std::unordered_map<std::string, VariablePtr> waiting_vars_;
+  std::unordered_map<uint64_t, std::string> qid_var_map_;
+  std::unordered_map<uint64_t, QueryResultProto> dangling_results_;
+};
+
+/*! \brief Same as RequestContext: ExecState with lookups by index. */
+class CompiledExecState {
+ public:
+  explicit CompiledExecState(const ExecPlan& plan) { state_.Init(&plan); }
+  bool finished() const { return state_.finished(); }
+  ExecBlock* NextReadyBlock() { return state_.NextReadyBlock(); }
+  VariablePtr GetVariable(int index) { return state_.GetVariable(index); }
+  void AddBlockReturn(std::vector<VariablePtr> vars) {
+    state_.AddBlockReturn(vars);
+  }
+  void AddQueryResult(const QueryResultProto& result) {
+    state_.AddQueryResult(result);
+  }
+
+ private:
+  ExecState state_;
+};
+
+/*!
+ * \brief The DAG of traffic_complex: detect, then recognize each detected
+ *   object, then fill the reply. Model handlers are stubs whose results
+ *   arrive right after the block returns, like replies on the reply path.
+ */
+class ThreeStageApp {
+ public:
+  ThreeStageApp() {
+    auto stub = [](std::shared_ptr<RequestContext>) {
+      return std::vector<VariablePtr>{};
+    };
+    blocks_ = {new ExecBlock(0, stub, {}),
+               new ExecBlock(1, stub, {"ssd_output"}),
+               new ExecBlock(2, stub, {"rec_output"})};
+    plan_.reset(new ExecPlan(blocks_));
+    ssd_output_var_ = plan_->VariableIndex("ssd_output");
+    rec_output_var_ = plan_->VariableIndex("rec_output");
+  }
+
+  const std::vector<ExecBlock*>& blocks() const { return blocks_; }
+  const ExecPlan& plan() const { return *plan_; }
+
+  template <typename State>
+  void RunRequest(State& state, uint64_t* next_qid) const {
+    std::vector<QueryResultProto> replies;
+    while (!state.finished()) {
+      auto block = state.NextReadyBlock();
+      CHECK(block != nullptr);
+      std::vector<VariablePtr> ret;
+      switch (block->id()) {
+        case 0:
+          ret.push_back(std::make_shared<Variable>(
+              "ssd_output", Execute(next_qid, &replies)));
+          break;
+        case 1: {
+          CHECK(GetVariable(state, ssd_output_var_, "ssd_output") != nullptr);
+          std::vector<std::shared_ptr<QueryResult> > results;
+          for (int i = 0; i < FLAGS_fanout; ++i) {
+            results.push_back(Execute(next_qid, &replies));
+          }
+          ret.push_back(std::make_shared<Variable>("rec_output", results));
+          break;
+        }
+        case 2:
+          CHECK(GetVariable(state, rec_output_var_, "rec_output") != nullptr);
+          break;
+      }
+      state.AddBlockReturn(std::move(ret));
+      for (const auto& reply : replies) {
+        state.AddQueryResult(reply);
+      }
+      replies.clear();
+    }
+  }
+
+ private:
+  static std::shared_ptr<QueryResult> Execute(
+      uint64_t* next_qid, std::vector<QueryResultProto>* replies) {
+    uint64_t qid = (*next_qid)++;
+    replies->emplace_back();
+    replies->back().set_query_id(qid);
+    return std::make_shared<QueryResult>(qid);
+  }
+
+  static VariablePtr GetVariable(NamedExecState& state, int index,
+                                 const std::string& name) {
+    return state.GetVariable(name);
+  }
+
+  static VariablePtr GetVariable(CompiledExecState& state, int index,
+                                 const std::string& name) {
+    return state.GetVariable(index);
+  }
+
+  std::vector<ExecBlock*> blocks_;
+  std::unique_ptr<ExecPlan> plan_;
+  int ssd_output_var_;
+  int rec_output_var_;
+};
+
+struct Result {
+  double requests_per_sec;
+  double allocs_per_request;
+};
+
+template <typename State>
+Result Bench(const ThreeStageApp& app, int num_threads) {
+  std::atomic<uint64_t> num_allocs{0};
+  auto worker = [&](uint64_t thread_index) {
+    uint64_t next_qid = thread_index << 40;
+    auto allocs = tls_num_allocs;
+    for (int i = 0; i < FLAGS_requests; ++i) {
+      if constexpr (std::is_same<State, NamedExecState>::value) {
+        State state(app.blocks());
+        app.RunRequest(state, &next_qid);
+      } else {
+        State state(app.plan());
+        app.RunRequest(state, &next_qid);
+      }
+    }
+    num_allocs += tls_num_allocs - allocs;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(worker, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto elapse = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  double total = static_cast<double>(num_threads) * FLAGS_requests;
+  return {total / elapse, num_allocs.load() / total};
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  ThreeStageApp app;
+  printf("%8s %14s %14s %8s %14s %14s\n", "threads", "named(req/s)",
+         "compiled(req/s)", "speedup", "named(allocs)", "compiled(allocs)");
+  for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+    auto named = Bench<NamedExecState>(app, n);
+    auto compiled = Bench<CompiledExecState>(app, n);
+    printf("%8d %14.0f %14.0f %7.2fx %14.1f %14.1f\n", n,
+           named.requests_per_sec, compiled.requests_per_sec,
+           compiled.requests_per_sec / named.requests_per_sec,
+           named.allocs_per_request, compiled.allocs_per_request);
+  }
+}
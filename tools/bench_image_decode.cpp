@@ -0,0 +1,164 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "nexus/common/image.h"
+
+DEFINE_string(image, "", "JPEG frame to decode. Synthesized if empty.");
+DEFINE_int32(frame_height, 1080, "Height of the synthesized frame");
+DEFINE_int32(frame_width, 1920, "Width of the synthesized frame");
+DEFINE_int32(input_size, 224, "Model input the windows are resized to");
+DEFINE_int32(repeats, 50, "Decodes of each case");
+
+using namespace nexus;
+
+namespace {
+
+/*! \brief Frame of smooth gradients and noise, about as dense as a photo. */
+std::vector<char> SynthesizeJpeg(int height, int width) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> noise(-8, 8);
+  std::vector<unsigned char> pixels(height * width * 3);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      auto* p = &pixels[(y * width + x) * 3];
+      int base[3] = {x * 255 / width, y * 255 / height,
+                     ((x / 64 + y / 64) % 2) * 128 + 64};
+      for (int c = 0; c < 3; ++c) {
+        p[c] = std::min(255, std::max(0, base[c] + noise(rng)));
+      }
+    }
+  }
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  unsigned char* out = nullptr;
+  unsigned long out_size = 0;
+  jpeg_mem_dest(&cinfo, &out, &out_size);
+  cinfo.image_height = height;
+  cinfo.image_width = width;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = &pixels[cinfo.next_scanline * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  std::vector<char> data(out, out + out_size);
+  free(out);
+  return data;
+}
+
+struct Case {
+  const char* name;
+  /*! \brief Windows in the full frame. Empty for the whole frame. */
+  std::vector<cv::Rect> windows;
+};
+
+/*!
+ * \brief Decode the frame the way DecodeImageWindows does.
+ * \param scaled Decode at the scale that keeps each window at least
+ *   input_size large.
+ * \param roi Decode only the region that spans the windows.
+ * \return Microseconds per decode.
+ */
+double Bench(const std::vector<char>& data, int src_height, int src_width,
+             std::vector<cv::Rect> windows, bool scaled, bool roi,
+             int* decoded_pixels) {
+  if (windows.empty()) {
+    windows.assign(1, cv::Rect(0, 0, src_width, src_height));
+  }
+  int denom = scaled ? 8 : 1;
+  for (const auto& w : windows) {
+    denom = std::min(denom, JpegScaleDenominator(w.height, w.width,
+                                                 FLAGS_input_size,
+                                                 FLAGS_input_size));
+  }
+  if (!roi) {
+    windows.assign(1, cv::Rect(0, 0, src_width, src_height));
+  }
+  int left = src_width, top = src_height, right = 0, bottom = 0;
+  for (const auto& w : windows) {
+    left = std::min(left, w.x / denom);
+    top = std::min(top, w.y / denom);
+    right = std::max(right, (w.x + w.width + denom - 1) / denom);
+    bottom = std::max(bottom, (w.y + w.height + denom - 1) / denom);
+  }
+  std::vector<uint8_t> buffer;
+  auto st = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_repeats; ++i) {
+    JpegRegionDecoder decoder;
+    CHECK(decoder.Start(data.data(), data.size(), denom, true, CO_RGB));
+    cv::Rect region(left, top, right - left, bottom - top);
+    CHECK(decoder.Crop(&region));
+    buffer.resize(region.height * region.width * 3);
+    CHECK(decoder.Read(buffer.data(), region.width * 3));
+    *decoded_pixels = region.height * region.width;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - st;
+  return std::chrono::duration<double, std::micro>(elapsed).count() /
+         FLAGS_repeats;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  std::vector<char> data;
+  if (FLAGS_image.empty()) {
+    data = SynthesizeJpeg(FLAGS_frame_height, FLAGS_frame_width);
+  } else {
+    std::ifstream fin(FLAGS_image, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(fin),
+                std::istreambuf_iterator<char>());
+  }
+  int height, width;
+  CHECK(GetJpegSize(data.data(), data.size(), &height, &width))
+      << "Not a JPEG image";
+  // Boxes as a detector finds them in a street frame, relative to 1080p.
+  auto box = [&](int x, int y, int w, int h) {
+    return cv::Rect(x * width / 1920, y * height / 1080, w * width / 1920,
+                    h * height / 1080);
+  };
+  std::vector<Case> cases = {
+      {"whole frame", {}},
+      {"1 car", {box(820, 560, 420, 300)}},
+      {"1 face", {box(1310, 300, 96, 96)}},
+      {"3 faces", {box(310, 280, 80, 80), box(1310, 300, 96, 96),
+                   box(1500, 330, 72, 72)}},
+      {"4 cars", {box(60, 600, 380, 260), box(520, 640, 300, 220),
+                  box(900, 560, 420, 300), box(1480, 620, 360, 240)}},
+  };
+  printf("%dx%d frame, %zu bytes, input %d, us per decode\n", width, height,
+         data.size(), FLAGS_input_size);
+  printf("%12s %10s %10s %10s %12s\n", "windows", "full", "scaled",
+         "scaled+roi", "roi pixels");
+  for (const auto& c : cases) {
+    int full_pixels, scaled_pixels, roi_pixels;
+    double full_us =
+        Bench(data, height, width, c.windows, false, false, &full_pixels);
+    double scaled_us =
+        Bench(data, height, width, c.windows, true, false, &scaled_pixels);
+    double roi_us =
+        Bench(data, height, width, c.windows, true, true, &roi_pixels);
+    printf("%12s %10.0f %10.0f %10.0f %12d\n", c.name, full_us, scaled_us,
+           roi_us, roi_pixels);
+  }
+}
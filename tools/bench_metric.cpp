@@ -0,0 +1,78 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/metric.h"
+
+DEFINE_int32(updates, 2000000, "Number of updates of each thread");
+DEFINE_int32(max_threads, 8, "Thread counts double from 1 up to it");
+
+using namespace nexus;
+
+namespace {
+
+/*!
+ * \return Wall-clock nanoseconds per update of all threads together, so
+ *   lower is better and contention shows as a growing cost.
+ */
+template <typename Update>
+double Bench(int nthreads, Update update) {
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&] {
+      ++ready;
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      for (int i = 0; i < FLAGS_updates; ++i) {
+        update(i & 4095);
+      }
+    });
+  }
+  while (ready.load() < nthreads) {
+    std::this_thread::yield();
+  }
+  auto st = std::chrono::steady_clock::now();
+  go = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - st;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         nthreads / FLAGS_updates;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  printf("updates=%d per thread, wall-clock ns per update\n", FLAGS_updates);
+  printf("%8s %10s %15s %10s %17s\n", "threads", "Counter", "ShardedCounter",
+         "Histogram", "ShardedHistogram");
+  for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+    Counter counter;
+    ShardedCounter sharded_counter;
+    Histogram histogram;
+    ShardedHistogram sharded_histogram;
+    double counter_ns = Bench(n, [&](int64_t) { counter.Increase(1); });
+    double sharded_counter_ns =
+        Bench(n, [&](int64_t) { sharded_counter.Increase(1); });
+    double histogram_ns = Bench(n, [&](int64_t v) { histogram.Record(v); });
+    double sharded_histogram_ns =
+        Bench(n, [&](int64_t v) { sharded_histogram.Record(v); });
+    CHECK_EQ(sharded_counter.value(),
+             static_cast<uint64_t>(n) * FLAGS_updates);
+    printf("%8d %10.1f %15.1f %10.1f %17.1f\n", n, counter_ns,
+           sharded_counter_ns, histogram_ns, sharded_histogram_ns);
+  }
+}
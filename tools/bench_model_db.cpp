@@ -0,0 +1,96 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "nexus/common/model_db.h"
+
+DECLARE_bool(model_profile_cache);
+DEFINE_string(db_dir, "/tmp/nexus_bench_model_db",
+              "Directory to generate the model database in");
+DEFINE_int32(num_profiles, 10000, "Number of profile files");
+DEFINE_int32(num_devices, 4, "Number of GPU device types");
+DEFINE_int32(max_batch, 64, "Number of batch sizes in each profile");
+
+using namespace nexus;
+namespace fs = boost::filesystem;
+
+namespace {
+
+void GenerateDatabase() {
+  fs::remove_all(FLAGS_db_dir);
+  fs::create_directories(FLAGS_db_dir + "/store");
+  fs::create_directories(FLAGS_db_dir + "/db");
+  std::ofstream(FLAGS_db_dir + "/db/model_db.yml")
+      << "models: []\nshare_prefix: []\ntf_share: []\n";
+  for (int i = 0; i < FLAGS_num_profiles; ++i) {
+    int device = i % FLAGS_num_devices;
+    auto dir = FLAGS_db_dir + "/profiles/GPU_" + std::to_string(device);
+    fs::create_directories(dir);
+    std::ofstream fout(dir + "/tensorflow:model_" + std::to_string(i) +
+                       ":1.txt");
+    fout << "tensorflow:model_" << i << ":1\nGPU_" << device << "\nGPU-"
+         << device << "-0\nForward latency\n"
+         << "batch,latency(us),std(us),static memory(B),peak memory(B),"
+         << "repeat\n";
+    for (int batch = 1; batch <= FLAGS_max_batch; ++batch) {
+      fout << batch << "," << 1000 + i % 100 + batch * 123.456 << ","
+           << 10.5 + batch * 0.01 << ",1048576," << 2097152 * batch
+           << ",20\n";
+    }
+    fout << "Preprocess latency (mean,std,repeat)\n"
+         << "300.5,12.25,20\n"
+         << "Postprocess latency (mean,std,repeat)\n"
+         << "50.125,3.5,20\n";
+  }
+}
+
+/*! \brief Seconds since st. */
+double Since(std::chrono::steady_clock::time_point st) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - st)
+      .count();
+}
+
+/*! \brief Construct the database, then get every profile. */
+void Bench(const char* name) {
+  auto st = std::chrono::steady_clock::now();
+  ModelDatabase db(FLAGS_db_dir);
+  double construct_sec = Since(st);
+
+  st = std::chrono::steady_clock::now();
+  CHECK(db.GetModelProfile("GPU_0", "generic", "tensorflow:model_0:1"));
+  double first_sec = Since(st);
+
+  st = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_num_profiles; ++i) {
+    int device = i % FLAGS_num_devices;
+    CHECK(db.GetModelProfile("GPU_" + std::to_string(device), "generic",
+                             "tensorflow:model_" + std::to_string(i) + ":1"));
+  }
+  double all_sec = Since(st);
+  printf("%-24s start %8.1f ms  first profile %6.1f us  "
+         "all profiles %7.1f ms\n",
+         name, construct_sec * 1e3, first_sec * 1e6, all_sec * 1e3);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  GenerateDatabase();
+  printf("num_profiles=%d num_devices=%d max_batch=%d\n", FLAGS_num_profiles,
+         FLAGS_num_devices, FLAGS_max_batch);
+  FLAGS_model_profile_cache = false;
+  Bench("text, no cache");
+  FLAGS_model_profile_cache = true;
+  Bench("text, writing the cache");
+  Bench("mapped cache");
+  fs::remove_all(FLAGS_db_dir);
+}
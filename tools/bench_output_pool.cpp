@@ -0,0 +1,92 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/backend/batch_task.h"
+#include "nexus/backend/output_pool.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+
+DEFINE_int32(repeats, 20000, "Number of batches to run for each batch size");
+DEFINE_int32(output_size, 1000, "Number of floats in each output");
+DEFINE_int32(num_outputs, 1, "Number of output layers of the model");
+
+using namespace nexus;
+using namespace nexus::backend;
+
+namespace {
+
+constexpr uint32_t kMaxBatch = 256;
+
+void Bench(uint32_t batch_size) {
+  using namespace std::chrono;
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  std::unordered_map<std::string, size_t> output_sizes;
+  for (int i = 0; i < FLAGS_num_outputs; ++i) {
+    output_sizes.emplace("output" + std::to_string(i), FLAGS_output_size);
+  }
+  OutputArrayPool pool(output_sizes, kMaxBatch, cpu);
+  auto input_array = std::make_shared<Array>(DT_FLOAT, kMaxBatch, cpu);
+  std::vector<std::shared_ptr<Task>> tasks;
+  for (uint32_t i = 0; i < batch_size; ++i) {
+    auto task = std::make_shared<Task>();
+    task->AppendInput(std::make_shared<Array>(DT_FLOAT, 1, cpu));
+    tasks.push_back(task);
+  }
+  auto make_batch_task = [&] {
+    auto batch_task = std::make_shared<BatchTask>(kMaxBatch);
+    batch_task->SetInputArray(input_array);
+    for (auto& task : tasks) {
+      batch_task->AppendInput(task->inputs[0], task);
+    }
+    return batch_task;
+  };
+
+  // Output arrays allocated and sliced into named arrays for every batch.
+  auto st = steady_clock::now();
+  for (int r = 0; r < FLAGS_repeats; ++r) {
+    auto batch_task = make_batch_task();
+    batch_task->CreateOutputArrays(output_sizes, cpu);
+    std::unordered_map<std::string, Slice> slices;
+    for (const auto& iter : output_sizes) {
+      slices.emplace(iter.first, Slice(batch_size, iter.second));
+    }
+    batch_task->SliceOutputBatch(slices);
+  }
+  auto ed = steady_clock::now();
+  double alloc_ns = duration_cast<nanoseconds>(ed - st).count();
+
+  // Output arrays from the pool and sliced into views.
+  st = steady_clock::now();
+  for (int r = 0; r < FLAGS_repeats; ++r) {
+    auto batch_task = make_batch_task();
+    batch_task->SetBatchOutput(pool.Acquire());
+    batch_task->SliceOutputBatch();
+  }
+  ed = steady_clock::now();
+  double pooled_ns = duration_cast<nanoseconds>(ed - st).count();
+
+  printf("batch_size: %4u    alloc_per_batch: %10.1fns    "
+         "pooled_per_batch: %10.1fns    pool_size: %zu\n",
+         batch_size, alloc_ns / FLAGS_repeats, pooled_ns / FLAGS_repeats,
+         pool.num_allocated());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  for (uint32_t batch_size : {1, 4, 16, 32, 64, 128, 256}) {
+    Bench(batch_size);
+  }
+}
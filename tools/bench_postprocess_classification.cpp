@@ -0,0 +1,126 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "nexus/backend/utils.h"
+#include "nexus/proto/nnquery.pb.h"
+
+DEFINE_int32(batch_size, 256, "Number of queries in a batch");
+DEFINE_int32(repeats, 200, "Number of batches to run for each setting");
+
+using namespace nexus;
+using namespace nexus::backend;
+
+namespace {
+
+// The argmax-only implementation that PostprocessClassification replaced.
+void LegacyPostprocessClassification(const QueryProto& query,
+                                     const float* prob, size_t nprobs,
+                                     QueryResultProto* result) {
+  std::unordered_set<std::string> output_fields(query.output_field().begin(),
+                                                query.output_field().end());
+  if (output_fields.empty()) {
+    output_fields.insert("class_id");
+    output_fields.insert("class_prob");
+    output_fields.insert("class_name");
+  }
+  float max_prob = 0.;
+  int max_idx = -1;
+  for (int i = 0; i < (int)nprobs; ++i) {
+    float p = prob[i];
+    if (p > max_prob) {
+      max_prob = p;
+      max_idx = i;
+    }
+  }
+  if (max_idx > -1) {
+    auto record = result->add_output();
+    for (const auto& field : output_fields) {
+      auto value = record->add_named_value();
+      value->set_name(field);
+      if (field == "class_id") {
+        value->set_i(max_idx);
+      } else if (field == "class_prob") {
+        value->set_f(max_prob);
+      }
+    }
+  }
+}
+
+std::vector<float> MakeSoftmaxLike(size_t nclasses, size_t batch_size,
+                                   std::mt19937& gen) {
+  std::exponential_distribution<float> dist(1.f);
+  std::vector<float> prob(nclasses * batch_size);
+  for (size_t b = 0; b < batch_size; ++b) {
+    float sum = 0;
+    for (size_t i = 0; i < nclasses; ++i) {
+      float p = dist(gen);
+      p = p * p * p;
+      prob[b * nclasses + i] = p;
+      sum += p;
+    }
+    for (size_t i = 0; i < nclasses; ++i) {
+      prob[b * nclasses + i] /= sum;
+    }
+  }
+  return prob;
+}
+
+template <typename Fn>
+double TimePerQueryNs(size_t batch_size, Fn&& fn) {
+  using namespace std::chrono;
+  QueryResultProto result;
+  auto st = steady_clock::now();
+  for (int r = 0; r < FLAGS_repeats; ++r) {
+    for (size_t b = 0; b < batch_size; ++b) {
+      result.Clear();
+      fn(b, &result);
+    }
+  }
+  auto ed = steady_clock::now();
+  return double(duration_cast<nanoseconds>(ed - st).count()) / FLAGS_repeats /
+         batch_size;
+}
+
+void Bench(size_t nclasses) {
+  std::mt19937 gen(0xabcdabcd987LL);
+  size_t batch_size = FLAGS_batch_size;
+  auto prob = MakeSoftmaxLike(nclasses, batch_size, gen);
+  QueryProto query;
+  query.add_output_field("class_id");
+  query.add_output_field("class_prob");
+
+  double legacy_ns = TimePerQueryNs(batch_size, [&](size_t b, auto* result) {
+    LegacyPostprocessClassification(query, &prob[b * nclasses], nclasses,
+                                    result);
+  });
+  printf("nclasses: %6zu    legacy_top1: %8.1fns", nclasses, legacy_ns);
+  for (uint32_t topk : {1, 5}) {
+    query.set_topk(topk);
+    auto options = ParseClassificationOptions(query);
+    double ns = TimePerQueryNs(batch_size, [&](size_t b, auto* result) {
+      PostprocessClassification(options, &prob[b * nclasses], nclasses,
+                                result);
+    });
+    printf("    top%u: %8.1fns", topk, ns);
+  }
+  printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  for (size_t nclasses : {1000, 5000, 20000}) {
+    Bench(nclasses);
+  }
+}
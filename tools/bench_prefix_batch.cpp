@@ -0,0 +1,144 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nexus/backend/batch_plan_context.h"
+#include "nexus/backend/model_exec.h"
+#include "nexus/backend/task.h"
+#include "nexus/common/block_queue.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+#include "nexus/common/sleep_profile.h"
+#include "nexus/common/time_util.h"
+
+DEFINE_string(profile, "sleep#500,3000,0,0,80",
+              "Sleep profile of every model in the prefix group. The last "
+              "parameter is the percentage of time spent in the prefix.");
+DEFINE_string(model, "resnet_0",
+              "TensorFlow model in --model_root whose model info the sleep "
+              "models take");
+DEFINE_int32(batch, 4, "Queries of each model in a round");
+DEFINE_int32(rounds, 50, "Rounds to run for each number of models");
+DEFINE_int32(max_models, 8, "Largest number of models in the group");
+
+using namespace nexus;
+using namespace nexus::backend;
+
+namespace {
+
+#ifdef USE_GPU
+constexpr int kGpuId = 0;
+#else
+constexpr int kGpuId = -1;
+#endif
+
+std::shared_ptr<ModelExecutor> LoadModel(uint32_t model_index,
+                                         BlockPriorityQueue<Task>& task_queue) {
+  ModelInstanceConfig config;
+  auto* model_session = config.add_model_session();
+  model_session->set_framework(FLAGS_profile);
+  model_session->set_model_name(FLAGS_model);
+  model_session->set_version(1);
+  config.set_batch(1);
+  config.set_max_batch(FLAGS_batch * FLAGS_max_models);
+  return std::make_shared<ModelExecutor>(kGpuId, config,
+                                         ModelIndex(model_index), task_queue);
+}
+
+/*!
+ * \brief Run a due plan of the leader with FLAGS_batch queries of each of
+ *   the models, and wait for its outputs.
+ */
+void RunPlan(const std::shared_ptr<ModelExecutor>& leader,
+             const std::vector<std::shared_ptr<ModelExecutor>>& models,
+             BlockPriorityQueue<Task>& task_queue, uint64_t& next_id) {
+  BatchPlanProto proto;
+  proto.set_plan_id(next_id);
+  proto.set_model_index(leader->model()->model_index().t);
+  proto.set_exec_time_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             Clock::now().time_since_epoch())
+                             .count());
+  std::vector<std::shared_ptr<Task>> tasks;
+  auto* cpu = DeviceManager::Singleton().GetCPUDevice();
+  for (const auto& model : models) {
+    for (int i = 0; i < FLAGS_batch; ++i) {
+      auto global_id = next_id++;
+      auto* query = proto.add_queries()->mutable_query_without_input();
+      query->set_global_id(global_id);
+      if (model != leader) {
+        query->set_model_index(model->model()->model_index().t);
+      }
+      auto task = std::make_shared<Task>(nullptr, model);
+      task->query.set_global_id(global_id);
+      task->AppendInput(std::make_shared<Array>(
+          DT_FLOAT, model->model()->InputShape().NumElements(1), cpu));
+      tasks.push_back(std::move(task));
+    }
+  }
+  auto plan = std::make_shared<BatchPlanContext>(std::move(proto));
+  plan->SetInputArray(leader->AcquireInputArray());
+  for (auto& task : tasks) {
+    CHECK(plan->AddPreprocessedTask(task));
+  }
+  leader->ExecuteBatchPlan(plan);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    task_queue.pop();
+  }
+}
+
+/*! \brief Average time of a round in milliseconds. */
+double Bench(const std::vector<std::shared_ptr<ModelExecutor>>& models,
+             bool prefix_batch, BlockPriorityQueue<Task>& task_queue) {
+  uint64_t next_id = 1;
+  auto start = Clock::now();
+  for (int r = 0; r < FLAGS_rounds; ++r) {
+    if (prefix_batch) {
+      RunPlan(models.front(), models, task_queue, next_id);
+    } else {
+      for (const auto& model : models) {
+        RunPlan(model, {model}, task_queue, next_id);
+      }
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  return elapsed.count() / FLAGS_rounds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  auto profile = SleepProfile::Parse(FLAGS_profile);
+  CHECK(profile.has_value()) << "Bad profile " << FLAGS_profile;
+  CHECK_GT(profile->prefix_percent(), 0)
+      << "The profile has no prefix: " << FLAGS_profile;
+
+  BlockPriorityQueue<Task> task_queue;
+  std::vector<std::shared_ptr<ModelExecutor>> models;
+  for (int i = 0; i < FLAGS_max_models; ++i) {
+    models.push_back(LoadModel(i + 1, task_queue));
+  }
+
+  printf("profile=%s batch=%d rounds=%d\n", FLAGS_profile.c_str(),
+         FLAGS_batch, FLAGS_rounds);
+  printf("%6s %12s %12s %12s %12s %8s\n", "models", "sep_ms", "sep_rps",
+         "group_ms", "group_rps", "speedup");
+  for (int n = 1; n <= FLAGS_max_models; ++n) {
+    std::vector<std::shared_ptr<ModelExecutor>> group(models.begin(),
+                                                      models.begin() + n);
+    double sep_ms = Bench(group, false, task_queue);
+    double group_ms = Bench(group, true, task_queue);
+    double queries = FLAGS_batch * n;
+    printf("%6d %12.2f %12.1f %12.2f %12.1f %8.2f\n", n, sep_ms,
+           1e3 * queries / sep_ms, group_ms, 1e3 * queries / group_ms,
+           sep_ms / group_ms);
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/common/sharded_map.h"
+#include "nexus/common/typedef.h"
+
+DEFINE_int32(pairs, 200000, "Number of execute/reply pairs of each thread");
+DEFINE_int32(inflight, 64,
+             "Number of queries of each thread waiting for replies");
+DEFINE_int32(max_threads, 32, "Thread counts double from 1 up to it");
+
+using namespace nexus;
+
+namespace {
+
+/*! \brief The query table of ModelHandler before sharding. */
+class MutexMap {
+ public:
+  bool Insert(QueryId key, std::shared_ptr<int> value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return map_.emplace(key, std::move(value)).second;
+  }
+
+  std::optional<std::shared_ptr<int>> Take(QueryId key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = map_.find(key);
+    if (iter == map_.end()) {
+      return std::nullopt;
+    }
+    auto value = std::move(iter->second);
+    map_.erase(iter);
+    return value;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<QueryId, std::shared_ptr<int>> map_;
+};
+
+/*!
+ * \brief Each thread executes queries and takes the replies of the ones it
+ *   executed `inflight` queries ago, like worker threads and the reply path
+ *   of a frontend sharing the table of one model.
+ */
+template <typename Map>
+double Bench(int num_threads) {
+  using namespace std::chrono;
+  Map map;
+  std::atomic<uint64_t> next_qid{0};
+  auto ctx = std::make_shared<int>(0);
+  auto worker = [&] {
+    std::deque<uint64_t> inflight;
+    for (int i = 0; i < FLAGS_pairs; ++i) {
+      auto qid = next_qid.fetch_add(1, std::memory_order_relaxed);
+      CHECK(map.Insert(QueryId(qid), ctx));
+      inflight.push_back(qid);
+      if (inflight.size() > static_cast<size_t>(FLAGS_inflight)) {
+        CHECK(map.Take(QueryId(inflight.front())).has_value());
+        inflight.pop_front();
+      }
+    }
+    for (auto qid : inflight) {
+      CHECK(map.Take(QueryId(qid)).has_value());
+    }
+  };
+
+  auto start = steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto elapse = duration<double>(steady_clock::now() - start).count();
+  return static_cast<double>(num_threads) * FLAGS_pairs / elapse;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  printf("%8s %16s %16s %8s\n", "threads", "mutex(pairs/s)", "sharded(pairs/s)",
+         "speedup");
+  for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+    double mutex_rate = Bench<MutexMap>(n);
+    double sharded_rate =
+        Bench<ShardedMap<QueryId, std::shared_ptr<int>>>(n);
+    printf("%8d %16.0f %16.0f %7.2fx\n", n, mutex_rate, sharded_rate,
+           sharded_rate / mutex_rate);
+  }
+}
@@ -0,0 +1,233 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ario/ario.h"
+#include "nexus/app/reply_router.h"
+#include "nexus/common/metric.h"
+#include "nexus/common/sharded_map.h"
+#include "nexus/common/time_util.h"
+#include "nexus/proto/control.pb.h"
+
+DEFINE_int32(num_queries, 200000, "Number of query results of each run");
+DEFINE_int32(queries_per_request, 3, "Number of queries of each request");
+DEFINE_int32(records, 10, "Number of output records of each result");
+DEFINE_int32(inflight, 4096, "Number of messages posted but not handled");
+DEFINE_int32(control_every, 1000,
+             "Number of query results between two dispatch replies");
+DEFINE_int32(max_threads, 4, "Thread counts double from 1 up to it");
+
+using namespace nexus;
+using namespace nexus::app;
+
+namespace {
+
+/*! \brief Stands in for the RequestContext that waits for the results. */
+struct PendingRequest {
+  std::mutex mutex;
+  std::vector<QueryResultProto> results;
+};
+
+/*!
+ * \brief Query results of a frontend, as a backend serializes them, and the
+ *   requests that wait for them.
+ */
+class Workload {
+ public:
+  Workload() {
+    ControlMessage msg;
+    auto* result = msg.mutable_query_result();
+    result->set_model_index(1);
+    result->set_status(CTRL_OK);
+    for (int i = 0; i < FLAGS_records; ++i) {
+      auto* record = result->add_output();
+      auto* class_id = record->add_named_value();
+      class_id->set_name("class_id");
+      class_id->set_data_type(DT_INT32);
+      class_id->set_i(i);
+      auto* prob = record->add_named_value();
+      prob->set_name("class_prob");
+      prob->set_data_type(DT_FLOAT);
+      prob->set_f(1.f / (i + 1));
+      auto* name = record->add_named_value();
+      name->set_name("class_name");
+      name->set_data_type(DT_STRING);
+      name->set_s("class_name_" + std::to_string(i));
+    }
+    result->set_latency_us(1000);
+    for (int i = 0; i < FLAGS_num_queries; ++i) {
+      result->set_query_id(i + 1);
+      messages_.push_back(msg.SerializeAsString());
+    }
+    ControlMessage reply;
+    reply.mutable_dispatch_reply()->set_model_index(1);
+    reply.mutable_dispatch_reply()->add_query_list()->set_query_id(1);
+    control_message_ = reply.SerializeAsString();
+  }
+
+  /*! \brief Create the requests that wait for the results. */
+  void Reset() {
+    std::shared_ptr<PendingRequest> request;
+    for (int i = 0; i < FLAGS_num_queries; ++i) {
+      if (i % FLAGS_queries_per_request == 0) {
+        request = std::make_shared<PendingRequest>();
+      }
+      pending_.Insert(i + 1, request);
+    }
+  }
+
+  /*! \brief What OnRecvInternal and ModelHandler do with a query result. */
+  void Handle(const std::string& bytes) {
+    ControlMessage msg;
+    CHECK(msg.ParseFromString(bytes));
+    auto* result = msg.mutable_query_result();
+    auto request = pending_.Take(result->query_id());
+    CHECK(request.has_value());
+    std::lock_guard<std::mutex> lock((*request)->mutex);
+    (*request)->results.push_back(std::move(*result));
+  }
+
+  const std::vector<std::string>& messages() const { return messages_; }
+  const std::string& control_message() const { return control_message_; }
+
+ private:
+  std::vector<std::string> messages_;
+  std::string control_message_;
+  ShardedMap<uint64_t, std::shared_ptr<PendingRequest>> pending_;
+};
+
+/*! \brief One shared executor, as the frontend had before ReplyRouter. */
+class SharedExecutor {
+ public:
+  explicit SharedExecutor(int nthreads)
+      : executor_(ario::PollerType::kBlocking) {
+    for (int i = 0; i < nthreads; ++i) {
+      threads_.emplace_back(&ario::EpollExecutor::RunEventLoop, &executor_);
+    }
+  }
+
+  ~SharedExecutor() {
+    executor_.StopEventLoop();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  ario::EpollExecutor& Route(const void*, size_t) { return executor_; }
+
+ private:
+  ario::EpollExecutor executor_;
+  std::vector<std::thread> threads_;
+};
+
+class RoutedExecutors {
+ public:
+  explicit RoutedExecutors(int nthreads) : router_(nthreads) {
+    router_.Start(&threads_);
+  }
+
+  ~RoutedExecutors() {
+    router_.Stop();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  ario::EpollExecutor& Route(const void* data, size_t size) {
+    return router_.Route(data, size);
+  }
+
+ private:
+  ReplyRouter router_;
+  std::vector<std::thread> threads_;
+};
+
+struct Result {
+  double results_per_sec;
+  HistogramSnapshot control_latency;
+};
+
+/*!
+ * \brief Post the query results to the executors from one thread, as the
+ *   RDMA event loop does, with a dispatch reply every --control_every
+ *   results.
+ */
+template <typename Executors>
+Result Bench(Workload& workload, int nthreads) {
+  workload.Reset();
+  Histogram control_latency;
+  std::atomic<int> inflight{0};
+  std::atomic<int> handled{0};
+  auto st = Clock::now();
+  {
+    Executors executors(nthreads);
+    const auto& messages = workload.messages();
+    for (size_t i = 0; i < messages.size(); ++i) {
+      while (inflight.load(std::memory_order_acquire) >= FLAGS_inflight) {
+        std::this_thread::yield();
+      }
+      // The RDMA buffer is copied, since messages are reused across runs.
+      auto buf = std::make_shared<std::string>(messages[i]);
+      auto& executor = executors.Route(buf->data(), buf->size());
+      inflight.fetch_add(1, std::memory_order_relaxed);
+      executor.PostBigCallback(
+          [&, buf](ario::ErrorCode) {
+            workload.Handle(*buf);
+            handled.fetch_add(1, std::memory_order_relaxed);
+            inflight.fetch_sub(1, std::memory_order_release);
+          },
+          ario::ErrorCode::kOk);
+      if (i % FLAGS_control_every == 0) {
+        const auto& control = workload.control_message();
+        auto sent = Clock::now();
+        executors.Route(control.data(), control.size())
+            .PostBigCallback(
+                [&, sent](ario::ErrorCode) {
+                  auto elapsed = Clock::now() - sent;
+                  control_latency.Record(
+                      std::chrono::duration_cast<std::chrono::microseconds>(
+                          elapsed)
+                          .count());
+                },
+                ario::ErrorCode::kOk);
+      }
+    }
+    while (handled.load() < FLAGS_num_queries) {
+      std::this_thread::yield();
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - st).count();
+  return {FLAGS_num_queries / elapsed, control_latency.Snapshot()};
+}
+
+void Print(const char* name, int nthreads, const Result& result) {
+  printf("%-7s threads=%d  %10.0f results/s  dispatch reply latency "
+         "p50=%5ldus p99=%6ldus\n",
+         name, nthreads, result.results_per_sec,
+         result.control_latency.Percentile(50),
+         result.control_latency.Percentile(99));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  Workload workload;
+  printf("num_queries=%d records=%d, %zu bytes per result\n",
+         FLAGS_num_queries, FLAGS_records, workload.messages()[0].size());
+  for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+    Print("shared", n, Bench<SharedExecutor>(workload, n));
+    Print("routed", n, Bench<RoutedExecutors>(workload, n));
+  }
+}
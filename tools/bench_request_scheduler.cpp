@@ -0,0 +1,248 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <immintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "nexus/common/block_queue.h"
+#include "nexus/common/time_util.h"
+#include "nexus/common/work_stealing_queue.h"
+
+DEFINE_int32(duration_ms, 2000, "Duration of each run");
+DEFINE_int32(min_workers, 4, "Min number of workers");
+DEFINE_int32(max_workers, 64, "Max number of workers. Doubles from min.");
+DEFINE_int32(requests_per_worker, 4, "Requests in flight of each worker");
+DEFINE_int32(stages, 3, "Number of model queries of each request");
+DEFINE_int32(work_us, 5, "CPU time of each stage of a request");
+DEFINE_int32(model_latency_us, 200, "Latency of each model query");
+DEFINE_int32(completer_threads, 2,
+             "Number of threads that complete model queries");
+
+using namespace nexus;
+
+namespace {
+
+struct StubRequest : public DeadlineItem {
+  explicit StubRequest(int stages) : stages_left(stages) {
+    SetDeadline(std::chrono::milliseconds(50));
+  }
+  int stages_left;
+  TimePoint ready_time = Clock::now();
+  int last_worker = -1;
+};
+
+using RequestPtr = std::shared_ptr<StubRequest>;
+
+/*!
+ * \brief The RequestPool of the frontend before work stealing: one global
+ *   priority queue, and a set of blocked requests under another mutex.
+ */
+class GlobalPool {
+ public:
+  explicit GlobalPool(size_t num_workers) {}
+  void AddNewRequest(RequestPtr req) { ready_.push(std::move(req)); }
+  void AddBlockRequest(RequestPtr req) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocked_.insert(std::move(req));
+  }
+  void MoveToReady(RequestPtr req) {
+    ready_.push(req);
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocked_.erase(req);
+  }
+  RequestPtr GetRequest(size_t worker, std::chrono::milliseconds timeout) {
+    return ready_.pop(timeout);
+  }
+
+ private:
+  BlockPriorityQueue<StubRequest> ready_;
+  std::mutex mutex_;
+  std::unordered_set<RequestPtr> blocked_;
+};
+
+/*! \brief Same as the RequestPool of the frontend. */
+class StealingPool {
+ public:
+  explicit StealingPool(size_t num_workers) : ready_(num_workers) {}
+  void AddNewRequest(RequestPtr req) { ready_.Push(std::move(req), -1); }
+  void AddBlockRequest(RequestPtr req) {}
+  void MoveToReady(RequestPtr req) {
+    int worker = req->last_worker;
+    ready_.Push(std::move(req), worker);
+  }
+  RequestPtr GetRequest(size_t worker, std::chrono::milliseconds timeout) {
+    auto req = ready_.Pop(worker, timeout);
+    if (req) {
+      req->last_worker = static_cast<int>(worker);
+    }
+    return req;
+  }
+
+ private:
+  WorkStealingQueue<StubRequest> ready_;
+};
+
+/*!
+ * \brief Stands in for a ModelHandler. Completes each query after
+ *   --model_latency_us on a completer thread, which resumes the request.
+ */
+template <typename Pool>
+class StubModelHandler {
+ public:
+  explicit StubModelHandler(Pool& pool) : pool_(pool) {
+    for (int i = 0; i < FLAGS_completer_threads; ++i) {
+      completers_.emplace_back(new Completer);
+    }
+    for (auto& c : completers_) {
+      c->thread = std::thread(&StubModelHandler::RunCompleter, this, c.get());
+    }
+  }
+
+  ~StubModelHandler() {
+    for (auto& c : completers_) {
+      {
+        std::lock_guard<std::mutex> lock(c->mutex);
+        c->stop = true;
+      }
+      c->cv.notify_one();
+      c->thread.join();
+    }
+  }
+
+  void Execute(RequestPtr req) {
+    auto& c = *completers_[next_.fetch_add(1) % completers_.size()];
+    auto done =
+        Clock::now() + std::chrono::microseconds(FLAGS_model_latency_us);
+    {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      c.pending.push({done, std::move(req)});
+    }
+    c.cv.notify_one();
+  }
+
+ private:
+  struct Pending {
+    TimePoint done;
+    RequestPtr req;
+    bool operator<(const Pending& rhs) const { return done > rhs.done; }
+  };
+
+  struct Completer {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::priority_queue<Pending> pending;
+    bool stop = false;
+    std::thread thread;
+  };
+
+  void RunCompleter(Completer* c) {
+    std::unique_lock<std::mutex> lock(c->mutex);
+    while (!c->stop) {
+      if (c->pending.empty()) {
+        c->cv.wait(lock);
+        continue;
+      }
+      auto done = c->pending.top().done;
+      if (Clock::now() < done) {
+        c->cv.wait_until(lock, done);
+        continue;
+      }
+      auto req = c->pending.top().req;
+      c->pending.pop();
+      lock.unlock();
+      req->ready_time = Clock::now();
+      pool_.MoveToReady(std::move(req));
+      lock.lock();
+    }
+  }
+
+  Pool& pool_;
+  std::atomic<size_t> next_{0};
+  std::vector<std::unique_ptr<Completer>> completers_;
+};
+
+void SpinFor(std::chrono::microseconds duration) {
+  auto until = Clock::now() + duration;
+  while (Clock::now() < until) {
+    _mm_pause();
+  }
+}
+
+template <typename Pool>
+void Bench(const char* name, int num_workers) {
+  Pool pool(num_workers);
+  StubModelHandler<Pool> model(pool);
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> completed{0};
+  std::vector<std::vector<long>> added_ns(num_workers);
+
+  for (int i = 0; i < num_workers * FLAGS_requests_per_worker; ++i) {
+    pool.AddNewRequest(std::make_shared<StubRequest>(FLAGS_stages));
+  }
+  std::vector<std::thread> workers;
+  for (int w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&, w] {
+      auto& samples = added_ns[w];
+      while (running.load(std::memory_order_relaxed)) {
+        auto req = pool.GetRequest(w, std::chrono::milliseconds(10));
+        if (!req) {
+          continue;
+        }
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              Clock::now() - req->ready_time)
+                              .count());
+        SpinFor(std::chrono::microseconds(FLAGS_work_us));
+        if (req->stages_left-- > 0) {
+          pool.AddBlockRequest(req);
+          model.Execute(std::move(req));
+        } else {
+          completed.fetch_add(1, std::memory_order_relaxed);
+          pool.AddNewRequest(std::make_shared<StubRequest>(FLAGS_stages));
+        }
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_duration_ms));
+  running = false;
+  for (auto& t : workers) {
+    t.join();
+  }
+
+  std::vector<long> all;
+  for (auto& s : added_ns) {
+    all.insert(all.end(), s.begin(), s.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) {
+    if (all.empty()) {
+      return 0.;
+    }
+    return all[static_cast<size_t>(p * (all.size() - 1))] / 1e3;
+  };
+  double rps = completed.load() * 1e3 / FLAGS_duration_ms;
+  printf("%-8s workers=%3d  rps=%10.0f  added_latency_us p50=%8.1f p99=%8.1f\n",
+         name, num_workers, rps, pct(0.5), pct(0.99));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  for (int n = FLAGS_min_workers; n <= FLAGS_max_workers; n *= 2) {
+    Bench<GlobalPool>("global", n);
+    Bench<StealingPool>("stealing", n);
+  }
+}
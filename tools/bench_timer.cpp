@@ -0,0 +1,65 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include "nexus/common/time_util.h"
+
+DEFINE_int32(tasks, 1000000, "Number of tasks to time");
+
+using namespace nexus;
+
+namespace {
+
+enum BenchTimePoint { kBegin = 0, kExec, kEnd, kNumBenchTimePoints };
+
+/*!
+ * \brief Times what a backend task does with its timer: record begin, exec
+ *   and end, then read the latency and the queuing time.
+ * \return Nanoseconds per task.
+ */
+template <typename NewTimer, typename RunTask>
+double Bench(NewTimer new_timer, RunTask run_task) {
+  uint64_t checksum = 0;
+  auto st = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_tasks; ++i) {
+    auto timer = new_timer();
+    checksum += run_task(*timer);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - st;
+  CHECK_GE(checksum, 0);
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         FLAGS_tasks;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  // Timers are heap allocated as a member of each std::make_shared<Task>.
+  double string_ns = Bench([] { return std::make_unique<Timer>(); },
+                           [](Timer& timer) {
+                             timer.Record("begin");
+                             timer.Record("exec");
+                             timer.Record("end");
+                             return timer.GetLatencyMicros("begin", "end") +
+                                    timer.GetLatencyMicros("begin", "exec");
+                           });
+  using EnumTimer = StageTimer<BenchTimePoint, kNumBenchTimePoints>;
+  double enum_ns = Bench([] { return std::make_unique<EnumTimer>(); },
+                         [](EnumTimer& timer) {
+                           timer.Record(kBegin);
+                           timer.Record(kExec);
+                           timer.Record(kEnd);
+                           return timer.GetLatencyMicros(kBegin, kEnd) +
+                                  timer.GetLatencyMicros(kBegin, kExec);
+                         });
+  printf("tasks=%d, ns per task with 3 records and 2 latencies\n",
+         FLAGS_tasks);
+  printf("Timer       %8.1f\n", string_ns);
+  printf("StageTimer  %8.1f\n", enum_ns);
+}
@@ -0,0 +1,290 @@
+#include <dlfcn.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/connection.h"
+#include "nexus/common/message.h"
+
+DEFINE_int32(connections, 2000, "Number of concurrent user connections");
+DEFINE_int32(pipeline, 4, "Requests in flight on each connection");
+DEFINE_int32(request_bytes, 64, "Body length of each request");
+DEFINE_int32(reply_bytes, 128, "Body length of each reply");
+DEFINE_int32(reply_threads, 4,
+             "Threads that send replies, like the workers of a frontend");
+DEFINE_int32(client_threads, 2, "Threads that run the client connections");
+DEFINE_int32(duration_ms, 3000, "Duration of the measurement");
+
+using namespace nexus;
+
+namespace {
+
+// Only the threads of the server are counted, so that the numbers describe
+// the frontend side of the connections.
+thread_local bool tls_count = false;
+std::atomic<uint64_t> num_allocs{0};
+std::atomic<uint64_t> num_read_calls{0};
+std::atomic<uint64_t> num_write_calls{0};
+
+template <typename Fn>
+Fn RealFunction(const char* name) {
+  auto fn = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+  CHECK(fn != nullptr) << "Cannot find " << name;
+  return fn;
+}
+
+}  // namespace
+
+// Count the socket syscalls issued by boost::asio by interposing libc.
+extern "C" {
+
+ssize_t read(int fd, void* buf, size_t count) {
+  static auto real = RealFunction<ssize_t (*)(int, void*, size_t)>("read");
+  if (tls_count) num_read_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, const struct iovec*, int)>("readv");
+  if (tls_count) num_read_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, iov, iovcnt);
+}
+
+ssize_t recv(int fd, void* buf, size_t len, int flags) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, void*, size_t, int)>("recv");
+  if (tls_count) num_read_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, buf, len, flags);
+}
+
+ssize_t recvmsg(int fd, struct msghdr* msg, int flags) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, struct msghdr*, int)>("recvmsg");
+  if (tls_count) num_read_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, msg, flags);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, const void*, size_t)>("write");
+  if (tls_count) num_write_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, const struct iovec*, int)>("writev");
+  if (tls_count) num_write_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, iov, iovcnt);
+}
+
+ssize_t send(int fd, const void* buf, size_t len, int flags) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, const void*, size_t, int)>("send");
+  if (tls_count) num_write_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, buf, len, flags);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr* msg, int flags) {
+  static auto real =
+      RealFunction<ssize_t (*)(int, const struct msghdr*, int)>("sendmsg");
+  if (tls_count) num_write_calls.fetch_add(1, std::memory_order_relaxed);
+  return real(fd, msg, flags);
+}
+
+}  // extern "C"
+
+// Count the allocations of the server threads. The replaced operators are not
+// inlined, so that callers do not see new paired with free.
+__attribute__((noinline)) void* operator new(size_t size) {
+  if (tls_count) num_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+namespace {
+
+/*!
+ * \brief Stands in for the frontend: replies to each request from a pool of
+ *   threads, like RequestContext::SendReply does from the workers.
+ */
+class EchoServer : public MessageHandler {
+ public:
+  EchoServer()
+      : acceptor_(io_context_,
+                  boost::asio::ip::tcp::endpoint(
+                      boost::asio::ip::address_v4::loopback(), 0)),
+        socket_(io_context_),
+        reply_pool_(FLAGS_reply_threads) {
+    acceptor_.listen(boost::asio::socket_base::max_listen_connections);
+    DoAccept();
+    thread_ = std::thread([this] {
+      tls_count = true;
+      io_context_.run();
+    });
+  }
+
+  ~EchoServer() {
+    io_context_.stop();
+    thread_.join();
+    reply_pool_.join();
+  }
+
+  boost::asio::ip::tcp::endpoint endpoint() const {
+    return acceptor_.local_endpoint();
+  }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    CHECK_EQ(message->type(), kUserRequest);
+    boost::asio::post(reply_pool_, [conn] {
+      tls_count = true;
+      auto reply = std::make_shared<Message>(kUserReply, FLAGS_reply_bytes);
+      std::memset(reply->body(), 0, reply->body_length());
+      conn->Write(std::move(reply));
+    });
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {}
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+ private:
+  void DoAccept() {
+    acceptor_.async_accept(socket_, [this](boost::system::error_code ec) {
+      if (ec) {
+        return;
+      }
+      auto conn = std::make_shared<Connection>(std::move(socket_), this);
+      conns_.push_back(conn);
+      conn->Start();
+      DoAccept();
+    });
+  }
+
+  boost::asio::io_context io_context_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::thread_pool reply_pool_;
+  std::vector<std::shared_ptr<Connection>> conns_;
+  std::thread thread_;
+};
+
+/*! \brief Keeps --pipeline requests in flight on each of its connections. */
+class Client : public MessageHandler {
+ public:
+  explicit Client(const boost::asio::ip::tcp::endpoint& server) {
+    for (int i = 0; i < FLAGS_connections; ++i) {
+      boost::asio::ip::tcp::socket socket(io_context_);
+      socket.connect(server);
+      conns_.push_back(std::make_shared<Connection>(std::move(socket), this));
+    }
+  }
+
+  ~Client() {
+    io_context_.stop();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  void Start() {
+    for (auto& conn : conns_) {
+      conn->Start();
+      for (int i = 0; i < FLAGS_pipeline; ++i) {
+        SendRequest(conn.get());
+      }
+    }
+    for (int i = 0; i < FLAGS_client_threads; ++i) {
+      threads_.emplace_back([this] { io_context_.run(); });
+    }
+  }
+
+  uint64_t num_replies() const { return num_replies_.load(); }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    CHECK_EQ(message->type(), kUserReply);
+    num_replies_.fetch_add(1, std::memory_order_relaxed);
+    SendRequest(conn.get());
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {
+    LOG(ERROR) << "Client connection error: " << ec.message();
+  }
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+ private:
+  void SendRequest(Connection* conn) {
+    auto msg = std::make_shared<Message>(kUserRequest, FLAGS_request_bytes);
+    std::memset(msg->body(), 0, msg->body_length());
+    conn->Write(std::move(msg));
+  }
+
+  boost::asio::io_context io_context_;
+  std::vector<std::shared_ptr<Connection>> conns_;
+  std::vector<std::thread> threads_;
+  std::atomic<uint64_t> num_replies_{0};
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  EchoServer server;
+  Client client(server.endpoint());
+  client.Start();
+
+  // Warm up the connections and the buffers before measuring.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  auto replies0 = client.num_replies();
+  auto allocs0 = num_allocs.load();
+  auto reads0 = num_read_calls.load();
+  auto writes0 = num_write_calls.load();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_duration_ms));
+  auto elapse = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  double replies = client.num_replies() - replies0;
+  double allocs = num_allocs.load() - allocs0;
+  double reads = num_read_calls.load() - reads0;
+  double writes = num_write_calls.load() - writes0;
+
+  printf("connections=%d pipeline=%d request_bytes=%d reply_bytes=%d\n",
+         FLAGS_connections, FLAGS_pipeline, FLAGS_request_bytes,
+         FLAGS_reply_bytes);
+  printf("throughput      %12.0f replies/s\n", replies / elapse);
+  printf("server reads    %12.3f syscalls/reply\n", reads / replies);
+  printf("server writes   %12.3f syscalls/reply\n", writes / replies);
+  printf("server allocs   %12.3f allocations/reply\n", allocs / replies);
+}
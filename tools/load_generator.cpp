@@ -0,0 +1,568 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "nexus/app/result_cache.h"
+#include "nexus/common/connection.h"
+#include "nexus/common/message.h"
+#include "nexus/common/metric.h"
+#include "nexus/proto/control.pb.h"
+#include "nexus/proto/nnquery.pb.h"
+
+DEFINE_string(server, "127.0.0.1:9001", "Frontend address");
+DEFINE_int32(connections, 16, "Number of user connections");
+DEFINE_string(arrival, "poisson", "Arrival schedule: poisson, constant, trace");
+DEFINE_double(rps, 1000, "Request rate of the poisson and constant schedules");
+DEFINE_string(trace, "",
+              "File of arrival times in seconds since the start, one per line, "
+              "for --arrival=trace");
+DEFINE_int32(duration_sec, 10, "Duration of sending requests");
+DEFINE_int32(warmup_sec, 1,
+             "Requests scheduled in the first seconds are not measured");
+DEFINE_int32(drain_sec, 5, "Time to wait for outstanding replies at the end");
+DEFINE_string(image, "", "JPEG file sent as the input of each request");
+DEFINE_string(hack_filename, "",
+              "Image filename sent instead of the image bytes");
+DEFINE_double(repeat_ratio, 1,
+              "Fraction of requests that resend one of the last "
+              "--repeat_window inputs. The others send a new input: the image "
+              "with a counter appended, which JPEG decoders ignore.");
+DEFINE_int32(repeat_window, 16, "Number of recent inputs that are resent");
+DEFINE_uint64(seed, 0, "Seed of the poisson schedule and of input repeats");
+DEFINE_bool(stub_server, false,
+            "Send requests to an in-process stub frontend instead of --server");
+DEFINE_int32(stub_latency_us, 5000, "Latency of the stub frontend");
+DEFINE_int32(stub_result_cache_mb, 0,
+             "Size of the result cache of the stub frontend. 0 disables it.");
+DEFINE_int32(stub_result_cache_ttl_ms, 1000,
+             "Time to live of results cached by the stub frontend");
+
+using namespace nexus;
+using namespace nexus::app;
+
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+int64_t ElapsedNs(SteadyClock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now() - since)
+      .count();
+}
+
+/*!
+ * \brief Intended send times of requests, in nanoseconds since the start.
+ *   They only depend on the schedule, never on when replies arrive, so the
+ *   load stays open-loop however slow the server is.
+ */
+class ArrivalSchedule {
+ public:
+  ArrivalSchedule() : rng_(FLAGS_seed), interval_(1e9 / FLAGS_rps) {
+    if (FLAGS_arrival == "trace") {
+      std::ifstream fin(FLAGS_trace);
+      CHECK(fin.good()) << "Cannot open trace " << FLAGS_trace;
+      double sec;
+      while (fin >> sec) {
+        trace_.push_back(static_cast<int64_t>(sec * 1e9));
+      }
+      CHECK(std::is_sorted(trace_.begin(), trace_.end()))
+          << "Arrival times in the trace are not sorted";
+    } else {
+      CHECK(FLAGS_arrival == "poisson" || FLAGS_arrival == "constant")
+          << "Unknown arrival schedule " << FLAGS_arrival;
+      CHECK_GT(FLAGS_rps, 0);
+    }
+  }
+
+  /*! \return Intended time of the next request, or -1 if there is none. */
+  int64_t Next() {
+    int64_t next;
+    if (FLAGS_arrival == "trace") {
+      if (index_ == trace_.size()) {
+        return -1;
+      }
+      next = trace_[index_];
+    } else if (FLAGS_arrival == "constant") {
+      next = static_cast<int64_t>(index_ * interval_);
+    } else {
+      last_ += std::exponential_distribution<double>(1.0 / interval_)(rng_);
+      next = static_cast<int64_t>(last_);
+    }
+    ++index_;
+    return next;
+  }
+
+ private:
+  std::mt19937_64 rng_;
+  double interval_;
+  std::vector<int64_t> trace_;
+  size_t index_ = 0;
+  double last_ = 0;
+};
+
+/*! \brief A stage of QueryPunchClock, between two of its timestamps. */
+struct Stage {
+  const char* name;
+  int64_t (QueryPunchClock::*begin)() const;
+  int64_t (QueryPunchClock::*end)() const;
+};
+
+const Stage kStages[] = {
+    {"frontend_queue", &QueryPunchClock::frontend_recv_ns,
+     &QueryPunchClock::frontend_dispatch_ns},
+    {"to_dispatcher", &QueryPunchClock::frontend_dispatch_ns,
+     &QueryPunchClock::dispatcher_recv_ns},
+    {"dispatcher_sched", &QueryPunchClock::dispatcher_recv_ns,
+     &QueryPunchClock::dispatcher_dispatch_ns},
+    {"to_backend", &QueryPunchClock::dispatcher_dispatch_ns,
+     &QueryPunchClock::backend_recv_ns},
+    {"backend_queue", &QueryPunchClock::backend_recv_ns,
+     &QueryPunchClock::backend_exec_ns},
+    {"backend_exec", &QueryPunchClock::backend_exec_ns,
+     &QueryPunchClock::backend_finish_ns},
+    {"to_frontend", &QueryPunchClock::backend_finish_ns,
+     &QueryPunchClock::frontend_got_reply_ns},
+};
+constexpr size_t kNumStages = sizeof(kStages) / sizeof(kStages[0]);
+
+/*!
+ * \brief Sends requests on schedule over many user connections, all driven
+ *   by one io_context.
+ *
+ *   Latency is measured from the intended send time rather than the actual
+ *   one. When the generator falls behind its schedule, the delay counts
+ *   against the server instead of being omitted.
+ */
+class LoadGenerator : public MessageHandler {
+ public:
+  LoadGenerator(boost::asio::io_context& io_context,
+                const boost::asio::ip::tcp::endpoint& server)
+      : io_context_(io_context), timer_(io_context), rng_(FLAGS_seed) {
+    request_.mutable_input()->set_data_type(DT_IMAGE);
+    auto* image = request_.mutable_input()->mutable_image();
+    image->set_format(ImageProto::JPEG);
+    image->set_color(true);
+    if (!FLAGS_image.empty()) {
+      std::ifstream fin(FLAGS_image, std::ios::binary);
+      CHECK(fin.good()) << "Cannot open image " << FLAGS_image;
+      image->set_data(std::string(std::istreambuf_iterator<char>(fin), {}));
+    }
+    image_data_ = image->data();
+    image->set_hack_filename(FLAGS_hack_filename);
+
+    for (int i = 0; i < FLAGS_connections; ++i) {
+      boost::asio::ip::tcp::socket socket(io_context_);
+      socket.connect(server);
+      conns_.push_back(std::make_shared<Connection>(std::move(socket), this));
+      conns_.back()->Start();
+      RequestProto reg;
+      reg.set_user_id(i + 1);
+      auto msg = std::make_shared<Message>(kUserRegister, reg.ByteSizeLong());
+      msg->EncodeBody(reg);
+      conns_.back()->Write(std::move(msg));
+    }
+  }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    ReplyProto reply;
+    message->DecodeBody(&reply);
+    if (num_registered_ < conns_.size()) {
+      CHECK_EQ(reply.status(), CTRL_OK) << "Failed to register user";
+      if (++num_registered_ == conns_.size()) {
+        Start();
+      }
+      return;
+    }
+    HandleReply(reply);
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {
+    if (!stopped_) {
+      LOG(ERROR) << "Connection error: " << ec.message();
+      conn->Stop();
+    }
+  }
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+  void Stop() {
+    stopped_ = true;
+    for (auto& conn : conns_) {
+      conn->Stop();
+    }
+  }
+
+  void PrintSummary() const {
+    double duration = FLAGS_duration_sec - FLAGS_warmup_sec;
+    printf("arrival=%s connections=%d\n", FLAGS_arrival.c_str(),
+           FLAGS_connections);
+    printf("sent %lu (%.0f req/s after warmup), replied %lu, errors %lu, "
+           "outstanding %lu\n",
+           num_sent_, num_measured_ / duration, num_replies_, num_errors_,
+           num_sent_ - num_replies_ - num_errors_);
+    printf("%-20s %8s %8s %8s %8s %8s %8s\n", "(us)", "count", "p50", "p90",
+           "p99", "p99.9", "max");
+    PrintRow("latency", latency_us_);
+    PrintRow("service_latency", service_latency_us_);
+    PrintRow("send_lag", send_lag_us_);
+    PrintRow("frontend_latency", frontend_latency_us_);
+    for (size_t i = 0; i < kNumStages; ++i) {
+      PrintRow(kStages[i].name, stage_us_[i]);
+    }
+  }
+
+ private:
+  struct Pending {
+    int64_t intended_ns;
+    int64_t sent_ns;
+  };
+
+  void Start() {
+    start_ = SteadyClock::now();
+    next_ns_ = schedule_.Next();
+    Schedule();
+  }
+
+  void Schedule() {
+    if (stopped_ || next_ns_ < 0 ||
+        next_ns_ >= FLAGS_duration_sec * int64_t(1e9)) {
+      finished_sending_ = true;
+      StopIfDrained();
+      return;
+    }
+    timer_.expires_at(start_ + std::chrono::nanoseconds(next_ns_));
+    timer_.async_wait([this](boost::system::error_code ec) {
+      if (ec) {
+        return;
+      }
+      // Catch up with every request whose time has come.
+      int64_t now = ElapsedNs(start_);
+      while (next_ns_ >= 0 && next_ns_ <= now &&
+             next_ns_ < FLAGS_duration_sec * int64_t(1e9)) {
+        Send(next_ns_);
+        next_ns_ = schedule_.Next();
+      }
+      Schedule();
+    });
+  }
+
+  /*! \brief Pick a new or recently sent input by --repeat_ratio. */
+  void SetInput() {
+    if (FLAGS_repeat_ratio >= 1) {
+      return;
+    }
+    uint64_t index;
+    if (num_inputs_ > 0 &&
+        std::uniform_real_distribution<double>()(rng_) < FLAGS_repeat_ratio) {
+      uint64_t window =
+          std::min<uint64_t>(FLAGS_repeat_window, num_inputs_);
+      index = num_inputs_ - 1 - rng_() % window;
+    } else {
+      index = num_inputs_++;
+    }
+    auto* data = request_.mutable_input()->mutable_image()->mutable_data();
+    data->assign(image_data_);
+    data->append(reinterpret_cast<const char*>(&index), sizeof(index));
+  }
+
+  void Send(int64_t intended_ns) {
+    uint32_t req_id = pending_.size();
+    SetInput();
+    request_.set_user_id(req_id % conns_.size() + 1);
+    request_.set_req_id(req_id);
+    auto msg = std::make_shared<Message>(kUserRequest, request_.ByteSizeLong());
+    msg->EncodeBody(request_);
+    int64_t sent_ns = ElapsedNs(start_);
+    pending_.push_back({intended_ns, sent_ns});
+    conns_[req_id % conns_.size()]->Write(std::move(msg));
+    ++num_sent_;
+    if (Measured(intended_ns)) {
+      ++num_measured_;
+      send_lag_us_.Record((sent_ns - intended_ns) / 1000);
+    }
+  }
+
+  void HandleReply(const ReplyProto& reply) {
+    int64_t now = ElapsedNs(start_);
+    CHECK_LT(reply.req_id(), pending_.size()) << "Unknown request";
+    const auto& pending = pending_[reply.req_id()];
+    if (reply.status() != CTRL_OK) {
+      ++num_errors_;
+      StopIfDrained();
+      return;
+    }
+    ++num_replies_;
+    StopIfDrained();
+    if (!Measured(pending.intended_ns)) {
+      return;
+    }
+    latency_us_.Record((now - pending.intended_ns) / 1000);
+    service_latency_us_.Record((now - pending.sent_ns) / 1000);
+    frontend_latency_us_.Record(reply.latency_us());
+    for (const auto& query : reply.query_latency()) {
+      const auto& clock = query.clock();
+      for (size_t i = 0; i < kNumStages; ++i) {
+        int64_t begin = (clock.*kStages[i].begin)();
+        int64_t end = (clock.*kStages[i].end)();
+        if (begin != 0 && end != 0) {
+          stage_us_[i].Record((end - begin) / 1000);
+        }
+      }
+    }
+  }
+
+  /*! \brief Stop the event loop once all requests are sent and replied. */
+  void StopIfDrained() {
+    if (finished_sending_ && num_replies_ + num_errors_ == num_sent_) {
+      io_context_.stop();
+    }
+  }
+
+  static bool Measured(int64_t intended_ns) {
+    return intended_ns >= FLAGS_warmup_sec * int64_t(1e9);
+  }
+
+  static void PrintRow(const char* name, const Histogram& histogram) {
+    auto s = histogram.Snapshot();
+    if (s.count == 0) {
+      return;
+    }
+    printf("%-20s %8lu %8ld %8ld %8ld %8ld %8ld\n", name, s.count,
+           s.Percentile(50), s.Percentile(90), s.Percentile(99),
+           s.Percentile(99.9), s.max);
+  }
+
+  boost::asio::io_context& io_context_;
+  boost::asio::steady_timer timer_;
+  std::vector<std::shared_ptr<Connection>> conns_;
+  size_t num_registered_ = 0;
+  bool stopped_ = false;
+  bool finished_sending_ = false;
+  RequestProto request_;
+  std::string image_data_;
+  std::mt19937_64 rng_;
+  uint64_t num_inputs_ = 0;
+  ArrivalSchedule schedule_;
+  SteadyClock::time_point start_;
+  int64_t next_ns_ = -1;
+  /*! \brief Indexed by request id. */
+  std::vector<Pending> pending_;
+  uint64_t num_sent_ = 0;
+  uint64_t num_measured_ = 0;
+  uint64_t num_replies_ = 0;
+  uint64_t num_errors_ = 0;
+  /*! \brief From the intended send time to the reply. */
+  Histogram latency_us_;
+  /*! \brief From the actual send time to the reply. */
+  Histogram service_latency_us_;
+  /*! \brief How late the generator sends requests. */
+  Histogram send_lag_us_;
+  /*! \brief Latency reported by the frontend in ReplyProto. */
+  Histogram frontend_latency_us_;
+  Histogram stage_us_[kNumStages];
+};
+
+/*!
+ * \brief Frontend stand-in that replies to each request after
+ *   --stub_latency_us, with a punch clock whose stages split the latency
+ *   evenly. With --stub_result_cache_mb, requests go through a ResultCache
+ *   as the queries of a frontend would, and only misses are "dispatched".
+ */
+class StubFrontend : public MessageHandler {
+ public:
+  StubFrontend()
+      : acceptor_(io_context_,
+                  boost::asio::ip::tcp::endpoint(
+                      boost::asio::ip::address_v4::loopback(), 0)),
+        socket_(io_context_) {
+    if (FLAGS_stub_result_cache_mb > 0) {
+      cache_ = std::make_unique<ResultCache>(
+          size_t(FLAGS_stub_result_cache_mb) << 20,
+          std::chrono::milliseconds(FLAGS_stub_result_cache_ttl_ms));
+    }
+    DoAccept();
+    thread_ = std::thread([this] { io_context_.run(); });
+  }
+
+  ~StubFrontend() {
+    io_context_.stop();
+    thread_.join();
+  }
+
+  boost::asio::ip::tcp::endpoint endpoint() const {
+    return acceptor_.local_endpoint();
+  }
+
+  uint64_t num_requests() const { return num_requests_.load(); }
+
+  uint64_t num_dispatches() const { return num_dispatches_.load(); }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    RequestProto request;
+    message->DecodeBody(&request);
+    auto reply = std::make_shared<ReplyProto>();
+    reply->set_user_id(request.user_id());
+    reply->set_req_id(request.req_id());
+    reply->set_status(CTRL_OK);
+    if (message->type() == kUserRegister) {
+      Reply(conn, *reply);
+      return;
+    }
+    uint64_t qid = num_requests_.fetch_add(1);
+    uint64_t key = 0;
+    if (cache_ != nullptr) {
+      key = ResultCache::Key(HashInput(request.input()), {}, 1, {});
+      QueryResultProto cached;
+      switch (cache_->Lookup(key, qid, &cached)) {
+        case ResultCache::kHit:
+          Reply(conn, *reply);
+          return;
+        case ResultCache::kCoalesced:
+          coalesced_.emplace(qid, std::make_pair(conn, reply));
+          return;
+        case ResultCache::kMiss:
+          break;
+      }
+    }
+    num_dispatches_.fetch_add(1);
+    auto recv_time = Clock::now();
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        io_context_, std::chrono::microseconds(FLAGS_stub_latency_us));
+    timer->async_wait([this, conn, reply, recv_time, qid, key,
+                       timer](boost::system::error_code) {
+      auto now = Clock::now();
+      reply->set_latency_us(
+          std::chrono::duration_cast<std::chrono::microseconds>(now -
+                                                                recv_time)
+              .count());
+      int64_t begin = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          recv_time.time_since_epoch())
+                          .count();
+      int64_t step = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         now - recv_time)
+                         .count() /
+                     kNumStages;
+      auto* clock = reply->add_query_latency()->mutable_clock();
+      clock->set_frontend_recv_ns(begin);
+      clock->set_frontend_dispatch_ns(begin + step);
+      clock->set_dispatcher_recv_ns(begin + 2 * step);
+      clock->set_dispatcher_dispatch_ns(begin + 3 * step);
+      clock->set_backend_recv_ns(begin + 4 * step);
+      clock->set_backend_exec_ns(begin + 5 * step);
+      clock->set_backend_finish_ns(begin + 6 * step);
+      clock->set_frontend_got_reply_ns(begin + 7 * step);
+      Reply(conn, *reply);
+      if (cache_ != nullptr) {
+        QueryResultProto result;
+        result.set_query_id(qid);
+        result.set_status(CTRL_OK);
+        for (uint64_t waiter : cache_->Complete(key, result)) {
+          auto iter = coalesced_.find(waiter);
+          auto& waiter_reply = *iter->second.second;
+          waiter_reply.set_latency_us(reply->latency_us());
+          *waiter_reply.mutable_query_latency() = reply->query_latency();
+          Reply(iter->second.first, waiter_reply);
+          coalesced_.erase(iter);
+        }
+      }
+    });
+  }
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final {
+    conn->Stop();
+    conns_.erase(conn);
+  }
+
+  void HandleConnected(std::shared_ptr<Connection> conn) final {}
+
+ private:
+  void DoAccept() {
+    acceptor_.async_accept(socket_, [this](boost::system::error_code ec) {
+      if (ec) {
+        return;
+      }
+      auto conn = std::make_shared<Connection>(std::move(socket_), this);
+      conns_.insert(conn);
+      conn->Start();
+      DoAccept();
+    });
+  }
+
+  static void Reply(const std::shared_ptr<Connection>& conn,
+                    const ReplyProto& reply) {
+    auto msg = std::make_shared<Message>(kUserReply, reply.ByteSizeLong());
+    msg->EncodeBody(reply);
+    conn->Write(std::move(msg));
+  }
+
+  boost::asio::io_context io_context_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::ip::tcp::socket socket_;
+  std::unordered_set<std::shared_ptr<Connection>> conns_;
+  std::unique_ptr<ResultCache> cache_;
+  /*! \brief Requests waiting for an identical request in flight. */
+  std::unordered_map<uint64_t, std::pair<std::shared_ptr<Connection>,
+                                         std::shared_ptr<ReplyProto>>>
+      coalesced_;
+  std::atomic<uint64_t> num_requests_{0};
+  std::atomic<uint64_t> num_dispatches_{0};
+  std::thread thread_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+  CHECK_LT(FLAGS_warmup_sec, FLAGS_duration_sec);
+
+  std::unique_ptr<StubFrontend> stub;
+  boost::asio::io_context io_context;
+  boost::asio::ip::tcp::endpoint server;
+  if (FLAGS_stub_server) {
+    stub.reset(new StubFrontend);
+    server = stub->endpoint();
+  } else {
+    auto pos = FLAGS_server.rfind(':');
+    CHECK_NE(pos, std::string::npos) << "Wrong server address " << FLAGS_server;
+    boost::asio::ip::tcp::resolver resolver(io_context);
+    server = *resolver
+                  .resolve(FLAGS_server.substr(0, pos),
+                           FLAGS_server.substr(pos + 1))
+                  .begin();
+  }
+
+  LoadGenerator generator(io_context, server);
+  io_context.run_for(
+      std::chrono::seconds(FLAGS_duration_sec + FLAGS_drain_sec));
+  generator.Stop();
+  io_context.run_for(std::chrono::milliseconds(100));
+  generator.PrintSummary();
+  if (stub != nullptr) {
+    uint64_t requests = stub->num_requests();
+    uint64_t dispatches = stub->num_dispatches();
+    printf("stub frontend dispatched %lu of %lu requests (%.1f%% saved)\n",
+           dispatches, requests,
+           requests ? 100.0 * (requests - dispatches) / requests : 0.0);
+  }
+}
@@ -8,6 +8,8 @@
 #include <numeric>
 #include <opencv2/opencv.hpp>
 #include <random>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <tuple>
 #include <utility>
@@ -43,11 +45,12 @@ std::pair<double, double> CalcAvgStd(std::vector<double> xs) {
 class Benchmark {
  public:
   Benchmark(std::vector<unsigned char> encoded, int num_workers, int resize,
-            int repeats)
+            int repeats, bool scaled_decode)
       : encoded_(std::move(encoded)),
         num_workers_(num_workers),
         resize_(resize),
-        repeats_(repeats) {}
+        repeats_(repeats),
+        scaled_decode_(scaled_decode) {}
 
   void Run() {
     warmup_repeats_ = static_cast<int>(repeats_ * 0.2);
@@ -63,27 +66,35 @@ class Benchmark {
     for (auto& t : workers) {
       t.join();
     }
+    end_time_ = std::chrono::system_clock::now();
 
     std::vector<double> decode_micros, convert_micros, resize_micros;
     for (const auto& [d1, d2, d3] : nano_elapses_) {
       decode_micros.push_back(d1 / 1e3);
-      convert_micros.push_back(d2 / 1e3);
-      resize_micros.push_back(d3 / 1e3);
+      resize_micros.push_back(d2 / 1e3);
+      convert_micros.push_back(d3 / 1e3);
     }
     auto [decode_avg, decode_std] = CalcAvgStd(decode_micros);
     auto [convert_avg, convert_std] = CalcAvgStd(convert_micros);
     auto [resize_avg, resize_std] = CalcAvgStd(resize_micros);
     auto total_avg = decode_avg + convert_avg + resize_avg;
     auto total_std = decode_std + convert_std + resize_std;
+    double elapse_sec = std::chrono::duration<double>(end_time_ - start_time_)
+                            .count();
+    int total_repeats = warmup_repeats_ + bench_repeats_ + cooldown_repeats_;
+    double throughput = total_repeats * num_workers_ / elapse_sec;
     printf(
+        "decode: %-6s      "
         "num_workers: %3d      "
         "decode: %9.3f+/-%7.3fus      "
-        "convert: %9.3f+/-%7.3fus      "
         "resize: %9.3f+/-%7.3fus      "
+        "convert: %9.3f+/-%7.3fus      "
         "total: %9.3f+/-%7.3fus      "
+        "throughput: %9.1f/s"
         "\n",
-        num_workers_, decode_avg, decode_std, convert_avg, convert_std,
-        resize_avg, resize_std, total_avg, total_std);
+        scaled_decode_ ? "scaled" : "full", num_workers_, decode_avg,
+        decode_std, resize_avg, resize_std, convert_avg, convert_std,
+        total_avg, total_std, throughput);
 
     return;
   }
@@ -98,6 +109,9 @@ class Benchmark {
     image_proto->set_format(nexus::ImageProto_ImageFormat_JPEG);
     image_proto->set_color(true);
 
+    // Same stages as the data plane: the frontend decodes and resizes the
+    // image to uint8 pixels, and the backend converts them to float.
+    std::vector<unsigned char> staged(resize_ * resize_ * 3);
     std::vector<float> preprocessed(resize_ * resize_ * 3);
     std::vector<std::tuple<long, long, long>> es;
     es.reserve(bench_repeats_);
@@ -106,13 +120,17 @@ class Benchmark {
     for (int i = -warmup_repeats_, end = bench_repeats_ + cooldown_repeats_;
          i < end; ++i) {
       auto t0 = high_resolution_clock::now();
-      cv::Mat image = nexus::DecodeImage(value_proto.image(), nexus::CO_RGB);
+      cv::Mat image =
+          scaled_decode_
+              ? nexus::DecodeImageScaled(value_proto.image(), resize_, resize_,
+                                         nexus::CO_RGB)
+              : nexus::DecodeImage(value_proto.image(), nexus::CO_RGB);
       auto t1 = high_resolution_clock::now();
-      cv::Mat fimg;
-      image.convertTo(fimg, CV_32FC3);
+      cv::Mat resized(resize_, resize_, CV_8UC3, staged.data());
+      cv::resize(image, resized, cv::Size(resize_, resize_));
       auto t2 = high_resolution_clock::now();
-      cv::Mat resized(resize_, resize_, CV_32FC3, preprocessed.data());
-      cv::resize(fimg, resized, cv::Size(resize_, resize_));
+      cv::Mat fimg(resize_, resize_, CV_32FC3, preprocessed.data());
+      resized.convertTo(fimg, CV_32FC3);
       auto t3 = high_resolution_clock::now();
 
       if (0 <= i && i < bench_repeats_) {
@@ -133,27 +151,55 @@ class Benchmark {
   int num_workers_;
   int resize_;
   int repeats_;
+  bool scaled_decode_;
   int warmup_repeats_;
   int bench_repeats_;
   int cooldown_repeats_;
   std::chrono::system_clock::time_point start_time_;
+  std::chrono::system_clock::time_point end_time_;
   std::mutex nano_elapses_mu_;
   std::vector<std::tuple<long, long, long>> nano_elapses_;
 };
 
-DEFINE_int32(original_size, 224, "Client-side input image size");
+DEFINE_string(original_sizes, "224,640,1280,2560",
+              "Comma-separated client-side input image sizes");
 DEFINE_int32(target_size, 224, "Neural-network input image size");
-DEFINE_int32(repeats, 10000, "Repeat trials of each thread");
+DEFINE_int32(repeats, 1000, "Repeat trials of each thread");
+DEFINE_int32(max_workers, 0,
+             "Max number of worker threads. Number of cores if 0. Thread "
+             "counts double from 1 up to it.");
+
+std::vector<int> ParseSizes(const std::string& s) {
+  std::vector<int> sizes;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    sizes.push_back(std::stoi(item));
+  }
+  return sizes;
+}
 
 int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InstallFailureSignalHandler();
 
-  auto jpg = GenerateRandomJPG(FLAGS_original_size, FLAGS_original_size);
-  int ncores = std::thread::hardware_concurrency();
-  for (int num_workers = 1; num_workers <= ncores; ++num_workers) {
-    Benchmark b(jpg, num_workers, FLAGS_target_size, FLAGS_repeats);
-    b.Run();
+  int max_workers = FLAGS_max_workers > 0
+                        ? FLAGS_max_workers
+                        : static_cast<int>(std::thread::hardware_concurrency());
+  for (int original_size : ParseSizes(FLAGS_original_sizes)) {
+    auto jpg = GenerateRandomJPG(original_size, original_size);
+    int denom = nexus::JpegScaleDenominator(original_size, original_size,
+                                            FLAGS_target_size,
+                                            FLAGS_target_size);
+    printf("original_size: %d  jpeg_bytes: %zu  scale: 1/%d\n", original_size,
+           jpg.size(), denom);
+    for (int num_workers = 1; num_workers <= max_workers; num_workers *= 2) {
+      for (bool scaled_decode : {false, true}) {
+        Benchmark b(jpg, num_workers, FLAGS_target_size, FLAGS_repeats,
+                    scaled_decode);
+        b.Run();
+      }
+    }
   }
 }